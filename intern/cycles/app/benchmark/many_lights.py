@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+#
+# Copyright 2011-2019 Blender Foundation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Generates a many lights scene for cycles_standalone, to compare sampling
+# lights from the flat light distribution against the light tree:
+#
+#   ./many_lights.py output_dir
+#   cycles --samples 64 --output flat.png output_dir/many_lights_flat.xml
+#   cycles --samples 64 --output tree.png output_dir/many_lights_tree.xml
+
+import argparse
+import os
+import random
+
+
+def write_scene(f, args):
+    rng = random.Random(args.seed)
+
+    f.write('<cycles>\n')
+
+    # Camera looking at the wall, from above the floor.
+    f.write('<transform translate="0 2 -14">\n')
+    f.write('\t<camera width="%d" height="%d" />\n' % (args.width, args.height))
+    f.write('</transform>\n\n')
+
+    f.write('<shader name="floor">\n')
+    f.write('\t<diffuse_bsdf name="floor_closure" color="0.5 0.5 0.5" />\n')
+    f.write('\t<connect from="floor_closure bsdf" to="output surface" />\n')
+    f.write('</shader>\n\n')
+
+    f.write('<shader name="led">\n')
+    f.write('\t<emission name="led_closure" color="1 1 1" strength="%g" />\n' % args.led_strength)
+    f.write('\t<connect from="led_closure emission" to="output surface" />\n')
+    f.write('</shader>\n\n')
+
+    f.write('<shader name="lamp">\n')
+    f.write('\t<emission name="lamp_closure" color="1 1 1" strength="1" />\n')
+    f.write('\t<connect from="lamp_closure emission" to="output surface" />\n')
+    f.write('</shader>\n\n')
+
+    # Floor plane.
+    f.write('<state shader="floor">\n')
+    f.write('\t<mesh P="-20 0 -20  20 0 -20  20 0 20  -20 0 20" nverts="4" verts="0 1 2 3" />\n')
+    f.write('</state>\n\n')
+
+    # LED wall: a grid of small emissive quads facing the camera.
+    P = []
+    verts = []
+    led_size = 0.05
+    for y in range(args.led_rows):
+        for x in range(args.led_columns):
+            cx = (x - 0.5 * args.led_columns) * 0.2
+            cy = 0.5 + y * 0.2
+            first = len(P)
+            P += [(cx, cy, 10.0),
+                  (cx + led_size, cy, 10.0),
+                  (cx + led_size, cy + led_size, 10.0),
+                  (cx, cy + led_size, 10.0)]
+            verts += [first + 3, first + 2, first + 1, first]
+
+    f.write('<state shader="led">\n')
+    f.write('\t<mesh P="%s" nverts="%s" verts="%s" />\n' % (
+        '  '.join('%g %g %g' % p for p in P),
+        ' '.join(['4'] * (len(verts) // 4)),
+        ' '.join(str(v) for v in verts)))
+    f.write('</state>\n\n')
+
+    # Small colored point lights scattered just above the floor.
+    f.write('<state shader="lamp">\n')
+    for i in range(args.lights):
+        co = (rng.uniform(-15.0, 15.0), rng.uniform(0.05, 1.0), rng.uniform(-8.0, 20.0))
+        color = [rng.uniform(0.2, 1.0) * args.light_strength for _ in range(3)]
+        f.write('\t<light type="point" co="%g %g %g" strength="%g %g %g" size="0.02" />\n' % (
+            co + tuple(color)))
+    f.write('</state>\n\n')
+
+    f.write('</cycles>\n')
+
+
+def write_variant(path, scene_name, use_light_tree):
+    with open(path, 'w') as f:
+        f.write('<cycles>\n')
+        f.write('<integrator use_light_tree="%s" />\n' % ('true' if use_light_tree else 'false'))
+        f.write('<include src="%s" />\n' % scene_name)
+        f.write('</cycles>\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a many lights benchmark scene")
+    parser.add_argument('output_dir')
+    parser.add_argument('--lights', type=int, default=2000)
+    parser.add_argument('--light-strength', type=float, default=5.0)
+    parser.add_argument('--led-rows', type=int, default=40)
+    parser.add_argument('--led-columns', type=int, default=100)
+    parser.add_argument('--led-strength', type=float, default=20.0)
+    parser.add_argument('--width', type=int, default=960)
+    parser.add_argument('--height', type=int, default=540)
+    parser.add_argument('--seed', type=int, default=0)
+    args = parser.parse_args()
+
+    os.makedirs(args.output_dir, exist_ok=True)
+
+    scene_name = 'many_lights_scene.xml'
+    with open(os.path.join(args.output_dir, scene_name), 'w') as f:
+        write_scene(f, args)
+
+    write_variant(os.path.join(args.output_dir, 'many_lights_flat.xml'), scene_name, False)
+    write_variant(os.path.join(args.output_dir, 'many_lights_tree.xml'), scene_name, True)
+
+
+if __name__ == '__main__':
+    main()
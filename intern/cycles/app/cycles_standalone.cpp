@@ -391,6 +391,7 @@ static void options_parse(int argc, const char **argv)
   ArgParse ap;
   bool help = false, debug = false, version = false;
   int verbosity = 1;
+  int texture_cache_size = 0;
 
   ap.options("Usage: cycles [options] file.xml",
              "%*",
@@ -431,6 +432,9 @@ static void options_parse(int argc, const char **argv)
              "--tile-height %d",
              &options.session_params.tile_size.y,
              "Tile height in pixels",
+             "--texture-cache-size %d",
+             &texture_cache_size,
+             "Read images on demand through a texture cache of this size in megabytes (CPU only)",
              "--list-devices",
              &list,
              "List information about all available devices",
@@ -488,6 +492,11 @@ static void options_parse(int argc, const char **argv)
   else if (ssname == "svm")
     options.scene_params.shadingsystem = SHADINGSYSTEM_SVM;
 
+  if (texture_cache_size > 0) {
+    options.scene_params.use_texture_cache = true;
+    options.scene_params.texture_cache_size = texture_cache_size;
+  }
+
 #ifndef WITH_CYCLES_STANDALONE_GUI
   options.session_params.background = true;
 #endif
@@ -247,6 +247,27 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         min=0, max=(1 << 24),
         default=32,
     )
+    use_adaptive_sampling: BoolProperty(
+        name="Use Adaptive Sampling",
+        description="Automatically stop sampling pixels once their noise is below the threshold, "
+        "only supported for final renders on the CPU",
+        default=False,
+    )
+    adaptive_threshold: FloatProperty(
+        name="Adaptive Sampling Threshold",
+        description="Noise level at which pixels stop being sampled, "
+        "lower values take more samples (automatic if 0)",
+        min=0.0, max=1.0,
+        default=0.0,
+        precision=4,
+    )
+    adaptive_min_samples: IntProperty(
+        name="Adaptive Min Samples",
+        description="Minimum number of samples taken before a pixel can stop sampling "
+        "(automatic if 0)",
+        min=0, max=4096,
+        default=0,
+    )
     preview_pause: BoolProperty(
         name="Pause Preview",
         description="Pause all viewport preview renders",
@@ -341,6 +362,12 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         min=0.0, max=1.0,
         default=0.01,
     )
+    use_light_tree: BoolProperty(
+        name="Light Tree",
+        description="Sample lights by their distance and orientation to the shading point rather than their area only, "
+        "reduces noise in scenes with many lights. Only used on the CPU, and not when sampling all lights",
+        default=False,
+    )
 
     min_light_bounces: IntProperty(
             name="Min Light Bounces",
@@ -609,6 +636,35 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         default=0,
         min=0, max=16,
     )
+    use_bvh_refit: BoolProperty(
+        name="Refit BVH",
+        description="Keep the BVH of each object between frames of an animation render with persistent data, "
+        "and refit it to deformed geometry instead of building the BVH of the entire scene for every frame "
+        "(faster to update, slower to render)",
+        default=False,
+    )
+    bvh_refit_threshold: FloatProperty(
+        name="Refit Threshold",
+        description="Rebuild the BVH of a refitted object once its estimated ray tracing cost grew by more "
+        "than this factor since it was built",
+        default=1.5,
+        min=1.0, max=10.0,
+    )
+    use_texture_cache: BoolProperty(
+        name="Use Texture Cache",
+        description="Read image textures from disk on demand, per tile and mipmap level, instead of "
+        "loading them fully into memory (only supported on the CPU with SVM, works best with tiled "
+        "and mipmapped .tx files)",
+        default=False,
+    )
+    texture_cache_size: IntProperty(
+        name="Texture Cache Size",
+        description="Memory limit of the texture cache in megabytes, least recently used tiles are "
+        "freed once exceeded",
+        default=1024,
+        min=16, max=65536,
+        subtype='UNSIGNED',
+    )
     tile_order: EnumProperty(
         name="Tile Order",
         description="Tile order for rendering",
@@ -1285,6 +1341,13 @@ class CyclesRenderLayerSettings(bpy.types.PropertyGroup):
         default=False,
         update=update_render_passes,
     )
+    pass_debug_sample_count: BoolProperty(
+        name="Debug Sample Count",
+        description="Number of samples taken by each pixel, "
+        "lower than the sample count where adaptive sampling stopped early",
+        default=False,
+        update=update_render_passes,
+    )
 
     use_pass_volume_direct: BoolProperty(
         name="Volume Direct",
@@ -65,6 +65,7 @@ BlenderSession::BlenderSession(BL::RenderEngine &b_engine,
       b_data(b_data),
       b_render(b_engine.render()),
       b_depsgraph(PointerRNA_NULL),
+      depsgraph_generation(0),
       b_scene(PointerRNA_NULL),
       b_v3d(PointerRNA_NULL),
       b_rv3d(PointerRNA_NULL),
@@ -94,6 +95,7 @@ BlenderSession::BlenderSession(BL::RenderEngine &b_engine,
       b_data(b_data),
       b_render(b_engine.render()),
       b_depsgraph(PointerRNA_NULL),
+      depsgraph_generation(0),
       b_scene(PointerRNA_NULL),
       b_v3d(b_v3d),
       b_rv3d(b_rv3d),
@@ -176,6 +178,13 @@ void BlenderSession::create_session()
 
 void BlenderSession::reset_session(BL::BlendData &b_data, BL::Depsgraph &b_depsgraph)
 {
+  /* With persistent data Blender keeps the depsgraph between frames. Compare its generation,
+   * a new depsgraph may be allocated at the address of the previous one. */
+  const int depsgraph_generation = b_engine.depsgraph_generation();
+  const bool is_same_depsgraph = (sync != NULL &&
+                                  depsgraph_generation == this->depsgraph_generation);
+  this->depsgraph_generation = depsgraph_generation;
+
   this->b_data = b_data;
   this->b_depsgraph = b_depsgraph;
   this->b_scene = b_depsgraph.scene_eval();
@@ -226,7 +235,6 @@ void BlenderSession::reset_session(BL::BlendData &b_data, BL::Depsgraph &b_depsg
   }
 
   session->progress.reset();
-  scene->reset();
 
   session->tile_manager.set_tile_order(session_params.tile_order);
 
@@ -235,11 +243,22 @@ void BlenderSession::reset_session(BL::BlendData &b_data, BL::Depsgraph &b_depsg
    */
   session->stats.mem_peak = session->stats.mem_used;
 
-  /* There is no single depsgraph to use for the entire render.
-   * See note on create_session().
-   */
-  /* sync object should be re-created */
-  sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress);
+  if (is_same_depsgraph) {
+    /* Keep the synced data of the previous frame and only sync what changed, like for viewport
+     * updates. Meshes of which only the vertices changed get their BVH refitted. */
+    sync->reset(b_data, b_scene);
+    sync->sync_recalc(b_depsgraph, b_v3d);
+  }
+  else {
+    scene->reset();
+
+    /* There is no single depsgraph to use for the entire render.
+     * See note on create_session().
+     */
+    /* sync object should be re-created, it's keyed by pointers to depsgraph data */
+    delete sync;
+    sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress);
+  }
 
   BL::SpaceView3D b_null_space_view3d(PointerRNA_NULL);
   BL::RegionView3D b_null_region_view3d(PointerRNA_NULL);
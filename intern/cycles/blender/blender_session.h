@@ -101,6 +101,7 @@ class BlenderSession {
   BL::BlendData b_data;
   BL::RenderSettings b_render;
   BL::Depsgraph b_depsgraph;
+  int depsgraph_generation;
   /* NOTE: Blender's scene might become invalid after call
    * free_blender_memory_if_possible().
    */
@@ -100,7 +100,13 @@ int BVHStackEntry::encodeIdx() const
 /* BVH */
 
 BVH::BVH(const BVHParams &params_, const vector<Mesh *> &meshes_, const vector<Object *> &objects_)
-    : params(params_), meshes(meshes_), objects(objects_)
+    : params(params_),
+      meshes(meshes_),
+      objects(objects_),
+      build_sah_cost(0.0f),
+      sah_cost(0.0f),
+      refit_cost(0.0f),
+      refit_root_area(0.0f)
 {
 }
 
@@ -165,6 +171,10 @@ void BVH::build(Progress &progress, Stats *)
     bvh2_root->deleteSubtree();
   }
 
+  if (root != NULL && !params.top_level) {
+    build_sah_cost = sah_cost = root->computeSubtreeSAHCost(params);
+  }
+
   if (progress.get_cancel()) {
     if (root != NULL) {
       root->deleteSubtree();
@@ -200,7 +210,25 @@ void BVH::refit(Progress &progress)
     return;
 
   progress.set_substatus("Refitting BVH nodes");
+  refit_cost = 0.0f;
+  refit_root_area = 0.0f;
   refit_nodes();
+
+  /* Same as BVHNode::computeSubtreeSAHCost(), the probability of visiting a node is its area
+   * relative to the root, which is the largest node. */
+  sah_cost = (refit_root_area > 0.0f) ? refit_cost / refit_root_area : 0.0f;
+}
+
+bool BVH::need_rebuild(float refit_threshold) const
+{
+  return build_sah_cost > 0.0f && sah_cost > build_sah_cost * refit_threshold;
+}
+
+void BVH::refit_node_cost(const BoundBox &bbox, int num_children, int num_primitives)
+{
+  const float area = bbox.safe_area();
+  refit_cost += area * params.cost(num_children, num_primitives);
+  refit_root_area = max(refit_root_area, area);
 }
 
 void BVH::refit_primitives(int start, int end, BoundBox &bbox, uint &visibility)
@@ -87,6 +87,12 @@ class BVH {
   vector<Mesh *> meshes;
   vector<Object *> objects;
 
+  /* Surface area heuristic cost of the tree when it was built, and after the last refit.
+   * Refitting keeps the topology of the tree, so the cost grows as primitives move apart.
+   * Zero if not known for the layout. */
+  float build_sah_cost;
+  float sah_cost;
+
   static BVH *create(const BVHParams &params,
                      const vector<Mesh *> &meshes,
                      const vector<Object *> &objects);
@@ -101,12 +107,21 @@ class BVH {
 
   void refit(Progress &progress);
 
+  /* Whether the refitted cost exceeds the built cost by the threshold, so that rebuilding is
+   * faster to render than keeping the refitted tree. */
+  bool need_rebuild(float refit_threshold) const;
+
  protected:
   BVH(const BVHParams &params, const vector<Mesh *> &meshes, const vector<Object *> &objects);
 
   /* Refit range of primitives. */
   void refit_primitives(int start, int end, BoundBox &bbox, uint &visibility);
 
+  /* Accumulate the cost of a refitted node, for sah_cost. */
+  void refit_node_cost(const BoundBox &bbox, int num_children, int num_primitives);
+  float refit_cost;
+  float refit_root_area;
+
   /* triangles and strands */
   void pack_primitives();
   void pack_triangle(int idx, float4 storage[3]);
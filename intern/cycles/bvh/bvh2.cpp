@@ -262,6 +262,8 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     leaf_data[0].z = __uint_as_float(visibility);
     leaf_data[0].w = __uint_as_float(data[0].w);
     memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4) * BVH_NODE_LEAF_SIZE);
+
+    refit_node_cost(bbox, 0, c1 - c0);
   }
   else {
     assert(idx + BVH_NODE_SIZE <= pack.nodes.size());
@@ -289,6 +291,8 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     bbox.grow(bbox0);
     bbox.grow(bbox1);
     visibility = visibility0 | visibility1;
+
+    refit_node_cost(bbox, 2, 0);
   }
 }
 
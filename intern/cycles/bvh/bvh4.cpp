@@ -407,6 +407,8 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     leaf_data[0].z = __uint_as_float(visibility);
     leaf_data[0].w = __uint_as_float(c.w);
     memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4) * BVH_QNODE_LEAF_SIZE);
+
+    refit_node_cost(bbox, 0, c.y - c.x);
   }
   else {
     int4 *data = &pack.nodes[idx];
@@ -441,6 +443,8 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     else {
       pack_aligned_node(idx, child_bbox, &c[0], visibility, 0.0f, 1.0f, num_nodes);
     }
+
+    refit_node_cost(bbox, num_nodes, 0);
   }
 }
 
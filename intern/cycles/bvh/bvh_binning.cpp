@@ -23,10 +23,18 @@
 
 #include "util/util_algorithm.h"
 #include "util/util_boundbox.h"
+#include "util/util_foreach.h"
+#include "util/util_task.h"
 #include "util/util_types.h"
+#include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Ranges with at least this many primitives are binned and partitioned by
+ * multiple threads, in chunks of the given size. */
+static const int BVH_BINNING_THREAD_THRESHOLD = 32768;
+static const int BVH_BINNING_CHUNK_SIZE = 8192;
+
 /* SSE replacements */
 
 __forceinline void prefetch_L1(const void * /*ptr*/)
@@ -97,71 +105,39 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   scale = rcp(cent_bounds_.size()) * make_float3((float)num_bins);
 
   /* initialize binning counter and bounds */
-  BoundBox bin_bounds[MAX_BINS][4]; /* bounds for every bin in every dimension */
-  int4 bin_count[MAX_BINS];         /* number of primitives mapped to bin */
+  Bins bins;
+  init_bins(&bins);
 
-  for (size_t i = 0; i < num_bins; i++) {
-    bin_count[i] = make_int4(0);
-    bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
+  /* map geometry to bins */
+  if (size() < BVH_BINNING_THREAD_THRESHOLD) {
+    bin_primitives(prims, start(), end(), &bins);
   }
-
-  /* map geometry to bins, unrolled once */
-  {
-    ssize_t i;
-
-    for (i = 0; i < ssize_t(size()) - 1; i += 2) {
-      prefetch_L2(&prims[start() + i + 8]);
-
-      /* map even and odd primitive to bin */
-      const BVHReference &prim0 = prims[start() + i + 0];
-      const BVHReference &prim1 = prims[start() + i + 1];
-
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      BoundBox bounds1 = get_prim_bounds(prim1);
-
-      int4 bin0 = get_bin(bounds0);
-      int4 bin1 = get_bin(bounds1);
-
-      /* increase bounds for bins for even primitive */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
-
-      /* increase bounds of bins for odd primitive */
-      int b10 = (int)extract<0>(bin1);
-      bin_count[b10][0]++;
-      bin_bounds[b10][0].grow(bounds1);
-      int b11 = (int)extract<1>(bin1);
-      bin_count[b11][1]++;
-      bin_bounds[b11][1].grow(bounds1);
-      int b12 = (int)extract<2>(bin1);
-      bin_count[b12][2]++;
-      bin_bounds[b12][2].grow(bounds1);
+  else {
+    /* Bin chunks of primitives in parallel, and merge the bins in order. */
+    const size_t num_chunks = divide_up(size(), BVH_BINNING_CHUNK_SIZE);
+    vector<Bins> chunk_bins(num_chunks);
+    TaskPool task_pool;
+
+    for (size_t c = 0; c < num_chunks; c++) {
+      const size_t chunk_start = start() + c * BVH_BINNING_CHUNK_SIZE;
+      const size_t chunk_end = min(chunk_start + BVH_BINNING_CHUNK_SIZE, (size_t)end());
+      init_bins(&chunk_bins[c]);
+      task_pool.push(function_bind(&BVHObjectBinning::bin_primitives,
+                                   this,
+                                   prims,
+                                   chunk_start,
+                                   chunk_end,
+                                   &chunk_bins[c]));
     }
-
-    /* for uneven number of primitives */
-    if (i < ssize_t(size())) {
-      /* map primitive to bin */
-      const BVHReference &prim0 = prims[start() + i];
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      int4 bin0 = get_bin(bounds0);
-
-      /* increase bounds of bins */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
+    task_pool.wait_work();
+
+    foreach (const Bins &chunk, chunk_bins) {
+      for (size_t i = 0; i < num_bins; i++) {
+        bins.count[i] = bins.count[i] + chunk.count[i];
+        bins.bounds[i][0].grow(chunk.bounds[i][0]);
+        bins.bounds[i][1].grow(chunk.bounds[i][1]);
+        bins.bounds[i][2].grow(chunk.bounds[i][2]);
+      }
     }
   }
 
@@ -175,14 +151,14 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   BoundBox bz = BoundBox::empty;
 
   for (size_t i = num_bins - 1; i > 0; i--) {
-    count = count + bin_count[i];
+    count = count + bins.count[i];
     r_count[i] = blocks(count);
 
-    bx = merge(bx, bin_bounds[i][0]);
+    bx = merge(bx, bins.bounds[i][0]);
     r_area[i][0] = bx.half_area();
-    by = merge(by, bin_bounds[i][1]);
+    by = merge(by, bins.bounds[i][1]);
     r_area[i][1] = by.half_area();
-    bz = merge(bz, bin_bounds[i][2]);
+    bz = merge(bz, bins.bounds[i][2]);
     r_area[i][2] = bz.half_area();
     r_area[i][3] = r_area[i][2];
   }
@@ -199,13 +175,13 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   bz = BoundBox::empty;
 
   for (size_t i = 1; i < num_bins; i++, ii += make_int4(1)) {
-    count = count + bin_count[i - 1];
+    count = count + bins.count[i - 1];
 
-    bx = merge(bx, bin_bounds[i - 1][0]);
+    bx = merge(bx, bins.bounds[i - 1][0]);
     float Ax = bx.half_area();
-    by = merge(by, bin_bounds[i - 1][1]);
+    by = merge(by, bins.bounds[i - 1][1]);
     float Ay = by.half_area();
-    bz = merge(bz, bin_bounds[i - 1][2]);
+    bz = merge(bz, bins.bounds[i - 1][2]);
     float Az = bz.half_area();
 
     float4 lCount = blocks(count);
@@ -226,46 +202,264 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   leafSAH = bounds_.half_area() * blocks(size());
 }
 
-void BVHObjectBinning::split(BVHReference *prims,
-                             BVHObjectBinning &left_o,
-                             BVHObjectBinning &right_o) const
+void BVHObjectBinning::init_bins(Bins *bins) const
 {
-  size_t N = size();
-
-  BoundBox lgeom_bounds = BoundBox::empty;
-  BoundBox rgeom_bounds = BoundBox::empty;
-  BoundBox lcent_bounds = BoundBox::empty;
-  BoundBox rcent_bounds = BoundBox::empty;
+  for (size_t i = 0; i < num_bins; i++) {
+    bins->count[i] = make_int4(0);
+    bins->bounds[i][0] = bins->bounds[i][1] = bins->bounds[i][2] = BoundBox::empty;
+  }
+}
 
-  ssize_t l = 0, r = N - 1;
+void BVHObjectBinning::bin_primitives(const BVHReference *prims,
+                                      size_t start,
+                                      size_t end,
+                                      Bins *bins) const
+{
+  /* map geometry to bins, unrolled once */
+  ssize_t i;
+
+  for (i = start; i < ssize_t(end) - 1; i += 2) {
+    prefetch_L2(&prims[i + 8]);
+
+    /* map even and odd primitive to bin */
+    const BVHReference &prim0 = prims[i + 0];
+    const BVHReference &prim1 = prims[i + 1];
+
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    BoundBox bounds1 = get_prim_bounds(prim1);
+
+    int4 bin0 = get_bin(bounds0);
+    int4 bin1 = get_bin(bounds1);
+
+    /* increase bounds for bins for even primitive */
+    int b00 = (int)extract<0>(bin0);
+    bins->count[b00][0]++;
+    bins->bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bins->count[b01][1]++;
+    bins->bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bins->count[b02][2]++;
+    bins->bounds[b02][2].grow(bounds0);
+
+    /* increase bounds of bins for odd primitive */
+    int b10 = (int)extract<0>(bin1);
+    bins->count[b10][0]++;
+    bins->bounds[b10][0].grow(bounds1);
+    int b11 = (int)extract<1>(bin1);
+    bins->count[b11][1]++;
+    bins->bounds[b11][1].grow(bounds1);
+    int b12 = (int)extract<2>(bin1);
+    bins->count[b12][2]++;
+    bins->bounds[b12][2].grow(bounds1);
+  }
 
-  while (l <= r) {
-    prefetch_L2(&prims[start() + l + 8]);
-    prefetch_L2(&prims[start() + r - 8]);
+  /* for uneven number of primitives */
+  if (i < ssize_t(end)) {
+    /* map primitive to bin */
+    const BVHReference &prim0 = prims[i];
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    int4 bin0 = get_bin(bounds0);
+
+    /* increase bounds of bins */
+    int b00 = (int)extract<0>(bin0);
+    bins->count[b00][0]++;
+    bins->bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bins->count[b01][1]++;
+    bins->bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bins->count[b02][2]++;
+    bins->bounds[b02][2].grow(bounds0);
+  }
+}
 
-    BVHReference prim = prims[start() + l];
+void BVHObjectBinning::split_classify(const BVHReference *prims,
+                                      SplitChunk *chunk,
+                                      uint8_t *is_left) const
+{
+  chunk->num_left = 0;
+  chunk->lgeom_bounds = BoundBox::empty;
+  chunk->rgeom_bounds = BoundBox::empty;
+  chunk->lcent_bounds = BoundBox::empty;
+  chunk->rcent_bounds = BoundBox::empty;
+
+  for (size_t i = chunk->start; i < chunk->end; i++) {
+    const BVHReference &prim = prims[i];
     BoundBox unaligned_bounds = get_prim_bounds(prim);
     float3 unaligned_center = unaligned_bounds.center2();
     float3 center = prim.bounds().center2();
 
     if (get_bin(unaligned_center)[dim] < pos) {
-      lgeom_bounds.grow(prim.bounds());
-      lcent_bounds.grow(center);
-      l++;
+      chunk->lgeom_bounds.grow(prim.bounds());
+      chunk->lcent_bounds.grow(center);
+      chunk->num_left++;
+      is_left[i - start()] = 1;
     }
     else {
-      rgeom_bounds.grow(prim.bounds());
-      rcent_bounds.grow(center);
-      swap(prims[start() + l], prims[start() + r]);
-      r--;
+      chunk->rgeom_bounds.grow(prim.bounds());
+      chunk->rcent_bounds.grow(center);
+      is_left[i - start()] = 0;
     }
   }
-  /* finish */
-  if (l != 0 && N - 1 - r != 0) {
-    right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + l, N - 1 - r),
-                               prims);
-    left_o = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), l), prims);
-    return;
+}
+
+void BVHObjectBinning::split_scatter(const BVHReference *prims,
+                                     const SplitChunk *chunk,
+                                     const uint8_t *is_left,
+                                     size_t left_offset,
+                                     size_t right_offset,
+                                     BVHReference *sorted_prims) const
+{
+  for (size_t i = chunk->start; i < chunk->end; i++) {
+    if (is_left[i - start()]) {
+      sorted_prims[left_offset++] = prims[i];
+    }
+    else {
+      sorted_prims[right_offset++] = prims[i];
+    }
+  }
+}
+
+static void copy_references(const BVHReference *src, BVHReference *dst, size_t start, size_t end)
+{
+  std::copy(src + start, src + end, dst + start);
+}
+
+void BVHObjectBinning::SplitScratch::alloc(size_t num_references)
+{
+  if (num_references >= (size_t)BVH_BINNING_THREAD_THRESHOLD) {
+    prims.resize(num_references);
+    is_left.resize(num_references);
+  }
+}
+
+void BVHObjectBinning::SplitScratch::free()
+{
+  prims.free_memory();
+  is_left.free_memory();
+}
+
+/* Partition large ranges in parallel. Chunks of primitives are classified
+ * first, and then moved to their side keeping their order, which makes the
+ * result independent of the number of threads. Returns false if all
+ * primitives are on one side. */
+bool BVHObjectBinning::split_threaded(BVHReference *prims,
+                                      SplitScratch *scratch,
+                                      BVHObjectBinning &left_o,
+                                      BVHObjectBinning &right_o) const
+{
+  const size_t N = size();
+  const size_t num_chunks = divide_up(N, BVH_BINNING_CHUNK_SIZE);
+  vector<SplitChunk> chunks(num_chunks);
+  uint8_t *is_left = &scratch->is_left[start()];
+
+  TaskPool task_pool;
+  for (size_t c = 0; c < num_chunks; c++) {
+    SplitChunk &chunk = chunks[c];
+    chunk.start = start() + c * BVH_BINNING_CHUNK_SIZE;
+    chunk.end = min(chunk.start + BVH_BINNING_CHUNK_SIZE, (size_t)end());
+    task_pool.push(
+        function_bind(&BVHObjectBinning::split_classify, this, prims, &chunk, is_left));
+  }
+  task_pool.wait_work();
+
+  size_t num_left = 0;
+  BoundBox lgeom_bounds = BoundBox::empty;
+  BoundBox rgeom_bounds = BoundBox::empty;
+  BoundBox lcent_bounds = BoundBox::empty;
+  BoundBox rcent_bounds = BoundBox::empty;
+
+  foreach (const SplitChunk &chunk, chunks) {
+    num_left += chunk.num_left;
+    lgeom_bounds.grow(chunk.lgeom_bounds);
+    rgeom_bounds.grow(chunk.rgeom_bounds);
+    lcent_bounds.grow(chunk.lcent_bounds);
+    rcent_bounds.grow(chunk.rcent_bounds);
+  }
+
+  if (num_left == 0 || num_left == N) {
+    return false;
+  }
+
+  /* Move primitives to their side in the scratch memory of the range, and copy them back. */
+  BVHReference *sorted_prims = &scratch->prims[start()];
+  size_t left_offset = 0, right_offset = num_left;
+
+  foreach (const SplitChunk &chunk, chunks) {
+    task_pool.push(function_bind(&BVHObjectBinning::split_scatter,
+                                 this,
+                                 prims,
+                                 &chunk,
+                                 is_left,
+                                 left_offset,
+                                 right_offset,
+                                 sorted_prims));
+    left_offset += chunk.num_left;
+    right_offset += chunk.end - chunk.start - chunk.num_left;
+  }
+  task_pool.wait_work();
+
+  foreach (const SplitChunk &chunk, chunks) {
+    task_pool.push(
+        function_bind(copy_references, &scratch->prims[0], prims, chunk.start, chunk.end));
+  }
+  task_pool.wait_work();
+
+  right_o = BVHObjectBinning(
+      BVHRange(rgeom_bounds, rcent_bounds, start() + num_left, N - num_left), prims);
+  left_o = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), num_left), prims);
+  return true;
+}
+
+void BVHObjectBinning::split(BVHReference *prims,
+                             BVHObjectBinning &left_o,
+                             BVHObjectBinning &right_o,
+                             SplitScratch *scratch) const
+{
+  size_t N = size();
+
+  BoundBox lgeom_bounds = BoundBox::empty;
+  BoundBox rgeom_bounds = BoundBox::empty;
+  BoundBox lcent_bounds = BoundBox::empty;
+  BoundBox rcent_bounds = BoundBox::empty;
+
+  if (size() >= BVH_BINNING_THREAD_THRESHOLD && scratch && scratch->prims.size() >= end()) {
+    if (split_threaded(prims, scratch, left_o, right_o)) {
+      return;
+    }
+  }
+  else {
+    ssize_t l = 0, r = N - 1;
+
+    while (l <= r) {
+      prefetch_L2(&prims[start() + l + 8]);
+      prefetch_L2(&prims[start() + r - 8]);
+
+      BVHReference prim = prims[start() + l];
+      BoundBox unaligned_bounds = get_prim_bounds(prim);
+      float3 unaligned_center = unaligned_bounds.center2();
+      float3 center = prim.bounds().center2();
+
+      if (get_bin(unaligned_center)[dim] < pos) {
+        lgeom_bounds.grow(prim.bounds());
+        lcent_bounds.grow(center);
+        l++;
+      }
+      else {
+        rgeom_bounds.grow(prim.bounds());
+        rcent_bounds.grow(center);
+        swap(prims[start() + l], prims[start() + r]);
+        r--;
+      }
+    }
+    /* finish */
+    if (l != 0 && N - 1 - r != 0) {
+      right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + l, N - 1 - r),
+                                 prims);
+      left_o = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), l), prims);
+      return;
+    }
   }
 
   /* object medium split if we did not make progress, can happen when all
@@ -22,17 +22,22 @@
 #include "bvh/bvh_unaligned.h"
 
 #include "util/util_types.h"
+#include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
 
-/* Single threaded object binner. Finds the split with the best SAH heuristic
+/* Object binner. Finds the split with the best SAH heuristic
  * by testing for each dimension multiple partitionings for regular spaced
  * partition locations. A partitioning for a partition location is computed,
  * by putting primitives whose centroid is on the left and right of the split
  * location to different sets. The SAH is evaluated by computing the number of
- * blocks occupied by the primitives in the partitions. */
+ * blocks occupied by the primitives in the partitions.
+ *
+ * Binning and partitioning of large ranges is multi-threaded, by chunks of
+ * primitives whose results are merged in order. The result is the same for
+ * any number of threads. */
 
 class BVHObjectBinning : public BVHRange {
  public:
@@ -45,7 +50,21 @@ class BVHObjectBinning : public BVHRange {
                    const BVHUnaligned *unaligned_heuristic = NULL,
                    const Transform *aligned_space = NULL);
 
-  void split(BVHReference *prims, BVHObjectBinning &left_o, BVHObjectBinning &right_o) const;
+  /* Memory to partition large ranges in parallel, indexed like the references. It's shared by
+   * all nodes of a build, their ranges don't overlap. */
+  struct SplitScratch {
+    vector<BVHReference> prims;
+    vector<uint8_t> is_left;
+
+    /* Only allocates for builds with ranges large enough to be partitioned in parallel. */
+    void alloc(size_t num_references);
+    void free();
+  };
+
+  void split(BVHReference *prims,
+             BVHObjectBinning &left_o,
+             BVHObjectBinning &right_o,
+             SplitScratch *scratch = NULL) const;
 
   __forceinline const BoundBox &unaligned_bounds()
   {
@@ -71,6 +90,39 @@ class BVHObjectBinning : public BVHRange {
   enum { MAX_BINS = 32 };
   enum { LOG_BLOCK_SIZE = 2 };
 
+  /* Bounds and number of primitives for every bin in every dimension. */
+  struct Bins {
+    BoundBox bounds[MAX_BINS][4];
+    int4 count[MAX_BINS];
+  };
+
+  /* Chunk of primitives partitioned by a thread, with the number of them on
+   * the left side and the geometry and centroid bounds of both sides. */
+  struct SplitChunk {
+    size_t start;
+    size_t end;
+    size_t num_left;
+    BoundBox lgeom_bounds;
+    BoundBox rgeom_bounds;
+    BoundBox lcent_bounds;
+    BoundBox rcent_bounds;
+  };
+
+  void init_bins(Bins *bins) const;
+  void bin_primitives(const BVHReference *prims, size_t start, size_t end, Bins *bins) const;
+
+  void split_classify(const BVHReference *prims, SplitChunk *chunk, uint8_t *is_left) const;
+  void split_scatter(const BVHReference *prims,
+                     const SplitChunk *chunk,
+                     const uint8_t *is_left,
+                     size_t left_offset,
+                     size_t right_offset,
+                     BVHReference *sorted_prims) const;
+  bool split_threaded(BVHReference *prims,
+                      SplitScratch *scratch,
+                      BVHObjectBinning &left_o,
+                      BVHObjectBinning &right_o) const;
+
   /* computes the bin numbers for each dimension for a box. */
   __forceinline int4 get_bin(const BoundBox &box) const
   {
@@ -108,21 +108,50 @@ BVHBuild::~BVHBuild()
 
 /* Adding References */
 
-void BVHBuild::add_reference_triangles(BoundBox &root, BoundBox &center, Mesh *mesh, int i)
+/* Range of primitives for which references are added by one task. Large meshes are split into
+ * multiple chunks, and consecutive instanced objects are grouped into one chunk. */
+struct BVHReferenceChunk {
+  enum Type { TRIANGLES, CURVES, OBJECTS };
+
+  BVHReferenceChunk(Type type, int object, size_t start, size_t end)
+      : type(type),
+        object(object),
+        start(start),
+        end(end),
+        bounds(BoundBox::empty),
+        center(BoundBox::empty)
+  {
+  }
+
+  Type type;
+  /* Object index, and range of its triangles or curves. Range of object indices for objects. */
+  int object;
+  size_t start;
+  size_t end;
+
+  /* References of the chunk, and bounds of them and their centers. */
+  vector<BVHReference> references;
+  BoundBox bounds;
+  BoundBox center;
+};
+
+void BVHBuild::add_reference_triangles(BVHReferenceChunk *chunk, Mesh *mesh)
 {
+  const int i = chunk->object;
+  BoundBox &root = chunk->bounds;
+  BoundBox &center = chunk->center;
   const Attribute *attr_mP = NULL;
   if (mesh->has_motion_blur()) {
     attr_mP = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
   }
-  const size_t num_triangles = mesh->num_triangles();
-  for (uint j = 0; j < num_triangles; j++) {
+  for (uint j = chunk->start; j < chunk->end; j++) {
     Mesh::Triangle t = mesh->get_triangle(j);
     const float3 *verts = &mesh->verts[0];
     if (attr_mP == NULL) {
       BoundBox bounds = BoundBox::empty;
       t.bounds_grow(verts, bounds);
       if (bounds.valid() && t.valid(verts)) {
-        references.push_back(BVHReference(bounds, j, i, PRIMITIVE_TRIANGLE));
+        chunk->references.push_back(BVHReference(bounds, j, i, PRIMITIVE_TRIANGLE));
         root.grow(bounds);
         center.grow(bounds.center2());
       }
@@ -142,7 +171,7 @@ void BVHBuild::add_reference_triangles(BoundBox &root, BoundBox &center, Mesh *m
         t.bounds_grow(vert_steps + step * num_verts, bounds);
       }
       if (bounds.valid()) {
-        references.push_back(BVHReference(bounds, j, i, PRIMITIVE_MOTION_TRIANGLE));
+        chunk->references.push_back(BVHReference(bounds, j, i, PRIMITIVE_MOTION_TRIANGLE));
         root.grow(bounds);
         center.grow(bounds.center2());
       }
@@ -180,7 +209,7 @@ void BVHBuild::add_reference_triangles(BoundBox &root, BoundBox &center, Mesh *m
         bounds.grow(curr_bounds);
         if (bounds.valid()) {
           const float prev_time = (float)(bvh_step - 1) * num_bvh_steps_inv_1;
-          references.push_back(
+          chunk->references.push_back(
               BVHReference(bounds, j, i, PRIMITIVE_MOTION_TRIANGLE, prev_time, curr_time));
           root.grow(bounds);
           center.grow(bounds.center2());
@@ -194,14 +223,16 @@ void BVHBuild::add_reference_triangles(BoundBox &root, BoundBox &center, Mesh *m
   }
 }
 
-void BVHBuild::add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh, int i)
+void BVHBuild::add_reference_curves(BVHReferenceChunk *chunk, Mesh *mesh)
 {
+  const int i = chunk->object;
+  BoundBox &root = chunk->bounds;
+  BoundBox &center = chunk->center;
   const Attribute *curve_attr_mP = NULL;
   if (mesh->has_motion_blur()) {
     curve_attr_mP = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
   }
-  const size_t num_curves = mesh->num_curves();
-  for (uint j = 0; j < num_curves; j++) {
+  for (uint j = chunk->start; j < chunk->end; j++) {
     const Mesh::Curve curve = mesh->get_curve(j);
     const float *curve_radius = &mesh->curve_radius[0];
     for (int k = 0; k < curve.num_keys - 1; k++) {
@@ -211,7 +242,7 @@ void BVHBuild::add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh
         curve.bounds_grow(k, &mesh->curve_keys[0], curve_radius, bounds);
         if (bounds.valid()) {
           int packed_type = PRIMITIVE_PACK_SEGMENT(PRIMITIVE_CURVE, k);
-          references.push_back(BVHReference(bounds, j, i, packed_type));
+          chunk->references.push_back(BVHReference(bounds, j, i, packed_type));
           root.grow(bounds);
           center.grow(bounds.center2());
         }
@@ -232,7 +263,7 @@ void BVHBuild::add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh
         }
         if (bounds.valid()) {
           int packed_type = PRIMITIVE_PACK_SEGMENT(PRIMITIVE_MOTION_CURVE, k);
-          references.push_back(BVHReference(bounds, j, i, packed_type));
+          chunk->references.push_back(BVHReference(bounds, j, i, packed_type));
           root.grow(bounds);
           center.grow(bounds.center2());
         }
@@ -288,7 +319,8 @@ void BVHBuild::add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh
           if (bounds.valid()) {
             const float prev_time = (float)(bvh_step - 1) * num_bvh_steps_inv_1;
             int packed_type = PRIMITIVE_PACK_SEGMENT(PRIMITIVE_MOTION_CURVE, k);
-            references.push_back(BVHReference(bounds, j, i, packed_type, prev_time, curr_time));
+            chunk->references.push_back(
+                BVHReference(bounds, j, i, packed_type, prev_time, curr_time));
             root.grow(bounds);
             center.grow(bounds.center2());
           }
@@ -302,88 +334,121 @@ void BVHBuild::add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh
   }
 }
 
-void BVHBuild::add_reference_mesh(BoundBox &root, BoundBox &center, Mesh *mesh, int i)
+void BVHBuild::add_reference_objects(BVHReferenceChunk *chunk)
 {
-  if (params.primitive_mask & PRIMITIVE_ALL_TRIANGLE) {
-    add_reference_triangles(root, center, mesh, i);
-  }
-  if (params.primitive_mask & PRIMITIVE_ALL_CURVE) {
-    add_reference_curves(root, center, mesh, i);
+  for (size_t i = chunk->start; i < chunk->end; i++) {
+    Object *ob = objects[i];
+    if (!ob->is_traceable()) {
+      continue;
+    }
+    chunk->references.push_back(BVHReference(ob->bounds, -1, i, 0));
+    chunk->bounds.grow(ob->bounds);
+    chunk->center.grow(ob->bounds.center2());
   }
 }
 
-void BVHBuild::add_reference_object(BoundBox &root, BoundBox &center, Object *ob, int i)
-{
-  references.push_back(BVHReference(ob->bounds, -1, i, 0));
-  root.grow(ob->bounds);
-  center.grow(ob->bounds.center2());
-}
-
-static size_t count_curve_segments(Mesh *mesh)
+static size_t count_curve_segments(Mesh *mesh, size_t start, size_t end)
 {
-  size_t num = 0, num_curves = mesh->num_curves();
+  size_t num = 0;
 
-  for (size_t i = 0; i < num_curves; i++)
+  for (size_t i = start; i < end; i++)
     num += mesh->get_curve(i).num_keys - 1;
 
   return num;
 }
 
+void BVHBuild::add_reference_chunk(BVHReferenceChunk *chunk)
+{
+  if (progress.get_cancel())
+    return;
+
+  switch (chunk->type) {
+    case BVHReferenceChunk::TRIANGLES:
+      chunk->references.reserve(chunk->end - chunk->start);
+      add_reference_triangles(chunk, objects[chunk->object]->mesh);
+      break;
+    case BVHReferenceChunk::CURVES: {
+      Mesh *mesh = objects[chunk->object]->mesh;
+      chunk->references.reserve(count_curve_segments(mesh, chunk->start, chunk->end));
+      add_reference_curves(chunk, mesh);
+      break;
+    }
+    case BVHReferenceChunk::OBJECTS:
+      chunk->references.reserve(chunk->end - chunk->start);
+      add_reference_objects(chunk);
+      break;
+  }
+}
+
 void BVHBuild::add_references(BVHRange &root)
 {
-  /* reserve space for references */
-  size_t num_alloc_references = 0;
+  /* Split primitives into chunks, in the same order as they are added to the references. */
+  vector<BVHReferenceChunk> chunks;
+  int i = 0;
 
   foreach (Object *ob, objects) {
-    if (params.top_level) {
-      if (!ob->is_traceable()) {
-        continue;
-      }
-      if (!ob->mesh->is_instanced()) {
-        if (params.primitive_mask & PRIMITIVE_ALL_TRIANGLE) {
-          num_alloc_references += ob->mesh->num_triangles();
-        }
-        if (params.primitive_mask & PRIMITIVE_ALL_CURVE) {
-          num_alloc_references += count_curve_segments(ob->mesh);
-        }
+    if (params.top_level && !ob->is_traceable()) {
+      /* Skipped by the object chunks. */
+    }
+    else if (params.top_level && ob->mesh->is_instanced()) {
+      if (chunks.empty() || chunks.back().type != BVHReferenceChunk::OBJECTS ||
+          chunks.back().end - chunks.back().start >= THREAD_TASK_SIZE) {
+        chunks.push_back(BVHReferenceChunk(BVHReferenceChunk::OBJECTS, i, i, i));
       }
-      else
-        num_alloc_references++;
+      chunks.back().end = i + 1;
     }
     else {
+      Mesh *mesh = ob->mesh;
       if (params.primitive_mask & PRIMITIVE_ALL_TRIANGLE) {
-        num_alloc_references += ob->mesh->num_triangles();
+        const size_t num_triangles = mesh->num_triangles();
+        for (size_t start = 0; start < num_triangles; start += THREAD_TASK_SIZE) {
+          chunks.push_back(BVHReferenceChunk(BVHReferenceChunk::TRIANGLES,
+                                             i,
+                                             start,
+                                             min(start + THREAD_TASK_SIZE, num_triangles)));
+        }
       }
       if (params.primitive_mask & PRIMITIVE_ALL_CURVE) {
-        num_alloc_references += count_curve_segments(ob->mesh);
+        const size_t num_curves = mesh->num_curves();
+        for (size_t start = 0; start < num_curves; start += THREAD_TASK_SIZE) {
+          chunks.push_back(BVHReferenceChunk(
+              BVHReferenceChunk::CURVES, i, start, min(start + THREAD_TASK_SIZE, num_curves)));
+        }
       }
     }
+
+    i++;
   }
 
-  references.reserve(num_alloc_references);
+  /* Add references of chunks in parallel. */
+  if (chunks.size() == 1) {
+    add_reference_chunk(&chunks[0]);
+  }
+  else {
+    foreach (BVHReferenceChunk &chunk, chunks) {
+      task_pool.push(function_bind(&BVHBuild::add_reference_chunk, this, &chunk));
+    }
+    task_pool.wait_work();
+  }
 
-  /* add references from objects */
-  BoundBox bounds = BoundBox::empty, center = BoundBox::empty;
-  int i = 0;
+  if (progress.get_cancel())
+    return;
 
-  foreach (Object *ob, objects) {
-    if (params.top_level) {
-      if (!ob->is_traceable()) {
-        ++i;
-        continue;
-      }
-      if (!ob->mesh->is_instanced())
-        add_reference_mesh(bounds, center, ob->mesh, i);
-      else
-        add_reference_object(bounds, center, ob, i);
-    }
-    else
-      add_reference_mesh(bounds, center, ob->mesh, i);
+  /* Concatenate references of chunks. */
+  size_t num_references = 0;
+  foreach (BVHReferenceChunk &chunk, chunks) {
+    num_references += chunk.references.size();
+  }
 
-    i++;
+  references.reserve(num_references);
 
-    if (progress.get_cancel())
-      return;
+  BoundBox bounds = BoundBox::empty, center = BoundBox::empty;
+
+  foreach (BVHReferenceChunk &chunk, chunks) {
+    references.insert(references.end(), chunk.references.begin(), chunk.references.end());
+    bounds.grow(chunk.bounds);
+    center.grow(chunk.center);
+    chunk.references.free_memory();
   }
 
   /* happens mostly on empty meshes */
@@ -463,9 +528,11 @@ BVHNode *BVHBuild::run()
   }
   else {
     /* Perform multithreaded binning build. */
+    split_scratch.alloc(references.size());
     BVHObjectBinning rootbin(root, (references.size()) ? &references[0] : NULL);
     rootnode = build_node(rootbin, 0);
     task_pool.wait_work();
+    split_scratch.free();
   }
 
   /* delete if we canceled */
@@ -641,10 +708,10 @@ BVHNode *BVHBuild::build_node(const BVHObjectBinning &range, int level)
   /* Perform split. */
   BVHObjectBinning left, right;
   if (do_unalinged_split) {
-    unaligned_range.split(&references[0], left, right);
+    unaligned_range.split(&references[0], left, right, &split_scratch);
   }
   else {
-    range.split(&references[0], left, right);
+    range.split(&references[0], left, right, &split_scratch);
   }
 
   BoundBox bounds;
@@ -665,11 +732,12 @@ BVHNode *BVHBuild::build_node(const BVHObjectBinning &range, int level)
     inner = new InnerNode(bounds, leftnode, rightnode);
   }
   else {
-    /* Threaded build */
+    /* Threaded build, the right child is built by another thread while this
+     * thread continues with the left child. */
     inner = new InnerNode(bounds);
 
-    task_pool.push(new BVHBuildTask(this, inner, 0, left, level + 1), true);
     task_pool.push(new BVHBuildTask(this, inner, 1, right, level + 1), true);
+    thread_build_node(inner, 0, &left, level + 1);
   }
 
   if (do_unalinged_split) {
@@ -775,12 +843,13 @@ BVHNode *BVHBuild::build_node(const BVHRange &range,
     inner = new InnerNode(bounds, leftnode, rightnode);
   }
   else {
-    /* Threaded build. */
+    /* Threaded build, the right child is built by another thread while this
+     * thread continues with the left child. The task copies its references,
+     * so the left child can modify them while splitting. */
     inner = new InnerNode(bounds);
-    task_pool.push(new BVHSpatialSplitBuildTask(this, inner, 0, left, *references, level + 1),
-                   true);
     task_pool.push(new BVHSpatialSplitBuildTask(this, inner, 1, right, *references, level + 1),
                    true);
+    thread_build_spatial_split_node(inner, 0, &left, references, level + 1, thread_id);
   }
 
   if (do_unalinged_split) {
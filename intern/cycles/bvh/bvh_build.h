@@ -20,6 +20,7 @@
 
 #include <float.h>
 
+#include "bvh/bvh_binning.h"
 #include "bvh/bvh_params.h"
 #include "bvh/bvh_unaligned.h"
 
@@ -32,6 +33,7 @@ CCL_NAMESPACE_BEGIN
 class Boundbox;
 class BVHBuildTask;
 class BVHNode;
+struct BVHReferenceChunk;
 class BVHSpatialSplitBuildTask;
 class BVHParams;
 class InnerNode;
@@ -63,11 +65,11 @@ class BVHBuild {
   friend class BVHSpatialSplitBuildTask;
   friend class BVHObjectBinning;
 
-  /* Adding references. */
-  void add_reference_triangles(BoundBox &root, BoundBox &center, Mesh *mesh, int i);
-  void add_reference_curves(BoundBox &root, BoundBox &center, Mesh *mesh, int i);
-  void add_reference_mesh(BoundBox &root, BoundBox &center, Mesh *mesh, int i);
-  void add_reference_object(BoundBox &root, BoundBox &center, Object *ob, int i);
+  /* Adding references, in parallel for chunks of primitives. */
+  void add_reference_triangles(BVHReferenceChunk *chunk, Mesh *mesh);
+  void add_reference_curves(BVHReferenceChunk *chunk, Mesh *mesh);
+  void add_reference_objects(BVHReferenceChunk *chunk);
+  void add_reference_chunk(BVHReferenceChunk *chunk);
   void add_references(BVHRange &root);
 
   /* Building. */
@@ -105,6 +107,9 @@ class BVHBuild {
   vector<BVHReference> references;
   int num_original_references;
 
+  /* Scratch memory for parallel partitioning of large ranges. */
+  BVHObjectBinning::SplitScratch split_scratch;
+
   /* Output primitive indexes and objects. */
   array<int> &prim_type;
   array<int> &prim_index;
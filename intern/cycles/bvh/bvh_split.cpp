@@ -24,9 +24,34 @@
 #include "render/object.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_foreach.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Ranges with at least this many references are chopped into spatial bins by
+ * multiple threads, in chunks of the given size. */
+static const int BVH_SPATIAL_BINNING_THREAD_THRESHOLD = 32768;
+static const int BVH_SPATIAL_BINNING_CHUNK_SIZE = 8192;
+
+/* Bins of one chunk of references. */
+struct BVHSpatialChunkBins {
+  BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+};
+
+static void bvh_spatial_bins_init(BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS])
+{
+  for (int dim = 0; dim < 3; dim++) {
+    for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+      BVHSpatialBin &bin = bins[dim][i];
+
+      bin.bounds = BoundBox::empty;
+      bin.enter = 0;
+      bin.exit = 0;
+    }
+  }
+}
+
 /* Object Split */
 
 BVHObjectSplit::BVHObjectSplit(BVHBuild *builder,
@@ -158,44 +183,45 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   float3 binSize = (range_bounds.max - origin) * (1.0f / (float)BVHParams::NUM_SPATIAL_BINS);
   float3 invBinSize = 1.0f / binSize;
 
-  for (int dim = 0; dim < 3; dim++) {
-    for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
-      BVHSpatialBin &bin = storage_->bins[dim][i];
-
-      bin.bounds = BoundBox::empty;
-      bin.enter = 0;
-      bin.exit = 0;
-    }
-  }
+  bvh_spatial_bins_init(storage_->bins);
 
   /* chop references into bins. */
-  for (unsigned int refIdx = range.start(); refIdx < range.end(); refIdx++) {
-    const BVHReference &ref = references_->at(refIdx);
-    BoundBox prim_bounds = get_prim_bounds(ref);
-    float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
-    float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
-    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
-    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
-
-    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
-    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
-
-    for (int dim = 0; dim < 3; dim++) {
-      BVHReference currRef(
-          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
+  if (range.size() < BVH_SPATIAL_BINNING_THREAD_THRESHOLD) {
+    bin_references(
+        &builder, range.start(), range.end(), origin, binSize, invBinSize, storage_->bins);
+  }
+  else {
+    /* Chop chunks of references in parallel, and merge the bins in order. */
+    const int num_chunks = divide_up(range.size(), BVH_SPATIAL_BINNING_CHUNK_SIZE);
+    vector<BVHSpatialChunkBins> chunk_bins(num_chunks);
+    TaskPool task_pool;
+
+    for (int c = 0; c < num_chunks; c++) {
+      const int chunk_start = range.start() + c * BVH_SPATIAL_BINNING_CHUNK_SIZE;
+      const int chunk_end = min(chunk_start + BVH_SPATIAL_BINNING_CHUNK_SIZE, range.end());
+      bvh_spatial_bins_init(chunk_bins[c].bins);
+      task_pool.push(function_bind(&BVHSpatialSplit::bin_references,
+                                   this,
+                                   &builder,
+                                   chunk_start,
+                                   chunk_end,
+                                   origin,
+                                   binSize,
+                                   invBinSize,
+                                   chunk_bins[c].bins));
+    }
+    task_pool.wait_work();
 
-      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
-        BVHReference leftRef, rightRef;
+    foreach (const BVHSpatialChunkBins &chunk, chunk_bins) {
+      for (int dim = 0; dim < 3; dim++) {
+        for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+          BVHSpatialBin &bin = storage_->bins[dim][i];
 
-        split_reference(
-            builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
-        storage_->bins[dim][i].bounds.grow(leftRef.bounds());
-        currRef = rightRef;
+          bin.bounds.grow(chunk.bins[dim][i].bounds);
+          bin.enter += chunk.bins[dim][i].enter;
+          bin.exit += chunk.bins[dim][i].exit;
+        }
       }
-
-      storage_->bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
-      storage_->bins[dim][firstBin[dim]].enter++;
-      storage_->bins[dim][lastBin[dim]].exit++;
     }
   }
 
@@ -232,6 +258,49 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   }
 }
 
+void BVHSpatialSplit::bin_references(const BVHBuild *builder,
+                                     int start,
+                                     int end,
+                                     const float3 &origin,
+                                     const float3 &bin_size,
+                                     const float3 &inv_bin_size,
+                                     BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS])
+{
+  for (int refIdx = start; refIdx < end; refIdx++) {
+    const BVHReference &ref = references_->at(refIdx);
+    BoundBox prim_bounds = get_prim_bounds(ref);
+    float3 firstBinf = (prim_bounds.min - origin) * inv_bin_size;
+    float3 lastBinf = (prim_bounds.max - origin) * inv_bin_size;
+    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
+    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+
+    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
+    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+
+    for (int dim = 0; dim < 3; dim++) {
+      BVHReference currRef(
+          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
+
+      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
+        BVHReference leftRef, rightRef;
+
+        split_reference(*builder,
+                        leftRef,
+                        rightRef,
+                        currRef,
+                        dim,
+                        origin[dim] + bin_size[dim] * (float)(i + 1));
+        bins[dim][i].bounds.grow(leftRef.bounds());
+        currRef = rightRef;
+      }
+
+      bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
+      bins[dim][firstBin[dim]].enter++;
+      bins[dim][lastBin[dim]].exit++;
+    }
+  }
+}
+
 void BVHSpatialSplit::split(BVHBuild *builder,
                             BVHRange &left,
                             BVHRange &right,
@@ -595,6 +595,7 @@ DeviceInfo Device::get_multi_device(const vector<DeviceInfo> &subdevices,
   info.has_volume_decoupled = true;
   info.has_osl = true;
   info.has_profiling = true;
+  info.has_adaptive_sampling = true;
 
   foreach (const DeviceInfo &device, subdevices) {
     /* Ensure CPU device does not slow down GPU. */
@@ -629,6 +630,7 @@ DeviceInfo Device::get_multi_device(const vector<DeviceInfo> &subdevices,
     info.has_volume_decoupled &= device.has_volume_decoupled;
     info.has_osl &= device.has_osl;
     info.has_profiling &= device.has_profiling;
+    info.has_adaptive_sampling &= device.has_adaptive_sampling;
   }
 
   return info;
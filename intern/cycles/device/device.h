@@ -37,6 +37,7 @@ CCL_NAMESPACE_BEGIN
 class BVH;
 class Progress;
 class RenderTile;
+class TextureCache;
 
 /* Device Types */
 
@@ -75,12 +76,13 @@ class DeviceInfo {
   string description;
   string id; /* used for user preferences, should stay fixed with changing hardware config */
   int num;
-  bool display_device;       /* GPU is used as a display device. */
-  bool has_half_images;      /* Support half-float textures. */
-  bool has_volume_decoupled; /* Decoupled volume shading. */
-  bool has_osl;              /* Support Open Shading Language. */
-  bool use_split_kernel;     /* Use split or mega kernel. */
-  bool has_profiling;        /* Supports runtime collection of profiling info. */
+  bool display_device;        /* GPU is used as a display device. */
+  bool has_half_images;       /* Support half-float textures. */
+  bool has_volume_decoupled;  /* Decoupled volume shading. */
+  bool has_osl;               /* Support Open Shading Language. */
+  bool use_split_kernel;      /* Use split or mega kernel. */
+  bool has_profiling;         /* Supports runtime collection of profiling info. */
+  bool has_adaptive_sampling; /* Stops sampling converged pixels early. */
   int cpu_threads;
   vector<DeviceInfo> multi_devices;
 
@@ -96,6 +98,7 @@ class DeviceInfo {
     has_osl = false;
     use_split_kernel = false;
     has_profiling = false;
+    has_adaptive_sampling = false;
   }
 
   bool operator==(const DeviceInfo &info)
@@ -359,6 +362,11 @@ class Device {
     return NULL;
   }
 
+  /* texture cache for images read on demand, only for CPU device */
+  virtual void texture_cache_set(TextureCache * /*texture_cache*/)
+  {
+  }
+
   /* load/compile kernels, must be called before adding tasks */
   virtual bool load_kernels(const DeviceRequestedFeatures & /*requested_features*/)
   {
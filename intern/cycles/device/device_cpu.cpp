@@ -34,6 +34,7 @@
 #include "kernel/kernel_types.h"
 #include "kernel/split/kernel_split_data.h"
 #include "kernel/kernel_globals.h"
+#include "kernel/kernel_adaptive_sampling.h"
 
 #include "kernel/filter/filter.h"
 
@@ -290,6 +291,7 @@ class CPUDevice : public Device {
 #ifdef WITH_OSL
     kernel_globals.osl = &osl_globals;
 #endif
+    kernel_globals.texture_cache = NULL;
     use_split_kernel = DebugFlags().cpu.split_kernel;
     if (use_split_kernel) {
       VLOG(1) << "Will be using split kernel.";
@@ -506,6 +508,11 @@ class CPUDevice : public Device {
 #endif
   }
 
+  void texture_cache_set(TextureCache *texture_cache)
+  {
+    kernel_globals.texture_cache = texture_cache;
+  }
+
   void thread_run(DeviceTask *task)
   {
     if (task->type == DeviceTask::RENDER) {
@@ -854,11 +861,87 @@ class CPUDevice : public Device {
 
       tile.sample = sample + 1;
 
+      if (task.adaptive_sampling.use && task.adaptive_sampling.need_filter(tile.sample)) {
+        const bool stop = adaptive_sampling_filter(kg, tile);
+        if (stop) {
+          /* All pixels converged, skip the remaining samples of the tile. */
+          const int num_progress_samples = end_sample - tile.sample + 1;
+          tile.sample = end_sample;
+          task.update_progress(&tile, tile.w * tile.h * num_progress_samples);
+          break;
+        }
+      }
+
       task.update_progress(&tile, tile.w * tile.h);
     }
     if (use_coverage) {
       coverage.finalize();
     }
+
+    if (task.adaptive_sampling.use) {
+      adaptive_sampling_post(kg, tile);
+    }
+    else {
+      tile.pixel_samples = (int64_t)tile.w * tile.h * (tile.sample - start_sample);
+    }
+  }
+
+  /* Estimate the error of all pixels of the tile and mark the converged ones, returns true when
+   * no pixel needs more samples. */
+  bool adaptive_sampling_filter(KernelGlobals *kg, RenderTile &tile)
+  {
+    WorkTile wtile;
+    wtile.x = tile.x;
+    wtile.y = tile.y;
+    wtile.w = tile.w;
+    wtile.h = tile.h;
+    wtile.offset = tile.offset;
+    wtile.stride = tile.stride;
+    wtile.buffer = (float *)tile.buffer;
+
+    for (int y = tile.y; y < tile.y + tile.h; ++y) {
+      for (int x = tile.x; x < tile.x + tile.w; ++x) {
+        const int index = tile.offset + x + y * tile.stride;
+        kernel_do_adaptive_stopping(kg, wtile.buffer + index * kernel_data.film.pass_stride);
+      }
+    }
+
+    bool any = false;
+    for (int y = tile.y; y < tile.y + tile.h; ++y) {
+      any |= kernel_do_adaptive_filter_x(kg, y, &wtile);
+    }
+    for (int x = tile.x; x < tile.x + tile.w; ++x) {
+      any |= kernel_do_adaptive_filter_y(kg, x, &wtile);
+    }
+    return (!any);
+  }
+
+  /* Scale pixels which stopped early to the number of samples of the tile.
+   *
+   * The sample count pass holds the samples of all passes over the tile. Pixels which stopped in
+   * a previous pass have less than the start sample, but were already scaled to it then. */
+  void adaptive_sampling_post(KernelGlobals *kg, RenderTile &tile)
+  {
+    float *render_buffer = (float *)tile.buffer;
+    const float start_sample = (float)tile.start_sample;
+    const float num_samples = (float)tile.sample;
+
+    tile.pixel_samples = 0;
+
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+      for (int x = tile.x; x < tile.x + tile.w; x++) {
+        const int index = tile.offset + x + y * tile.stride;
+        float *buffer = render_buffer + index * kernel_data.film.pass_stride;
+        const float pixel_samples = max(buffer[kernel_data.film.pass_sample_count], start_sample);
+
+        if (pixel_samples > 0.0f && pixel_samples < num_samples) {
+          kernel_adaptive_post_adjust(kg, buffer, num_samples / pixel_samples);
+        }
+
+        /* Only count the samples taken in this pass. */
+        tile.pixel_samples += (int64_t)(pixel_samples - start_sample);
+      }
+    }
   }
 
   void denoise(DenoisingTask &denoising, RenderTile &tile)
@@ -1059,6 +1142,7 @@ class CPUDevice : public Device {
 #ifdef WITH_OSL
     OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
+    kg.texture_cache_tdata = (kg.texture_cache) ? kg.texture_cache->thread_init() : NULL;
     return kg;
   }
 
@@ -1081,6 +1165,9 @@ class CPUDevice : public Device {
 #ifdef WITH_OSL
     OSLShader::thread_free(kg);
 #endif
+    if (kg->texture_cache_tdata != NULL) {
+      kg->texture_cache->thread_free(kg->texture_cache_tdata);
+    }
   }
 
   virtual bool load_kernels(const DeviceRequestedFeatures &requested_features_)
@@ -1227,6 +1314,7 @@ void device_cpu_info(vector<DeviceInfo> &devices)
   info.has_osl = true;
   info.has_half_images = true;
   info.has_profiling = true;
+  info.has_adaptive_sampling = true;
 
   devices.insert(devices.begin(), info);
 }
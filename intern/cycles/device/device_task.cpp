@@ -136,4 +136,20 @@ void DeviceTask::update_progress(RenderTile *rtile, int pixel_samples)
   }
 }
 
+/* Adaptive Sampling */
+
+AdaptiveSampling::AdaptiveSampling() : use(false), adaptive_step(0), min_samples(0)
+{
+}
+
+/* Whether the error of the pixels should be estimated after rendering this many samples, the
+ * auxiliary pass only has an equal share of the samples after an even number of them. */
+bool AdaptiveSampling::need_filter(int sample) const
+{
+  if (sample >= min_samples) {
+    return (sample & (adaptive_step - 1)) == 0;
+  }
+  return false;
+}
+
 CCL_NAMESPACE_END
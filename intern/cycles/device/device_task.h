@@ -62,6 +62,19 @@ class DenoiseParams {
   }
 };
 
+class AdaptiveSampling {
+ public:
+  AdaptiveSampling();
+
+  bool need_filter(int sample) const;
+
+  bool use;
+  /* Number of samples between error estimates, a power of two. */
+  int adaptive_step;
+  /* No pixel stops before taking this many samples. */
+  int min_samples;
+};
+
 class DeviceTask : public Task {
  public:
   typedef enum { RENDER, FILM_CONVERT, SHADER } Type;
@@ -114,6 +127,7 @@ class DeviceTask : public Task {
 
   bool need_finish_queue;
   bool integrator_branched;
+  AdaptiveSampling adaptive_sampling;
   int2 requested_tile_size;
 
  protected:
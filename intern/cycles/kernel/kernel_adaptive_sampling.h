@@ -0,0 +1,154 @@
+/*
+ * Copyright 2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_ADAPTIVE_SAMPLING_H__
+#define __KERNEL_ADAPTIVE_SAMPLING_H__
+
+CCL_NAMESPACE_BEGIN
+
+/* Adaptive Sampling
+ *
+ * The auxiliary pass accumulates every second sample of the combined pass, twice. Comparing it
+ * with the combined pass gives an estimate of the per pixel error. Pixels below the threshold are
+ * marked as converged in the fourth component of the auxiliary pass and skipped by the path
+ * tracing kernels, until the tile is finished and their passes are scaled up to the number of
+ * samples the tile was rendered with. */
+
+ccl_device_inline ccl_global float4 *kernel_adaptive_aux_buffer(KernelGlobals *kg,
+                                                                ccl_global float *buffer)
+{
+  return (ccl_global float4 *)(buffer + kernel_data.film.pass_adaptive_aux_buffer);
+}
+
+ccl_device_inline bool kernel_adaptive_pixel_converged(KernelGlobals *kg,
+                                                       ccl_global float *buffer)
+{
+  return kernel_data.film.pass_adaptive_aux_buffer &&
+         kernel_adaptive_aux_buffer(kg, buffer)->w != 0.0f;
+}
+
+/* Determines whether to continue sampling a given pixel or if it has sufficiently converged. */
+ccl_device void kernel_do_adaptive_stopping(KernelGlobals *kg, ccl_global float *buffer)
+{
+  const float4 I = *((ccl_global float4 *)buffer);
+  ccl_global float4 *aux = kernel_adaptive_aux_buffer(kg, buffer);
+  const float num_samples = buffer[kernel_data.film.pass_sample_count];
+
+  /* The per pixel error as seen in section 2.1 of
+   * "A hierarchical automatic stopping condition for Monte Carlo global illumination".
+   * A small epsilon is added to the divisor to prevent division by zero. */
+  const float error = (fabsf(I.x - aux->x) + fabsf(I.y - aux->y) + fabsf(I.z - aux->z)) /
+                      (num_samples * 0.0001f + sqrtf(I.x + I.y + I.z));
+
+  aux->w = (error < kernel_data.integrator.adaptive_threshold * num_samples) ? 1.0f : 0.0f;
+}
+
+/* A simple box filter in two passes: when a pixel needs more samples, its neighbors in the tile
+ * keep sampling too. Returns whether any pixel of the row still needs samples. */
+ccl_device bool kernel_do_adaptive_filter_x(KernelGlobals *kg, int y, ccl_global WorkTile *tile)
+{
+  bool any = false;
+  bool prev = false;
+  for (int x = tile->x; x < tile->x + tile->w; ++x) {
+    int index = tile->offset + x + y * tile->stride;
+    ccl_global float *buffer = tile->buffer + index * kernel_data.film.pass_stride;
+    ccl_global float4 *aux = kernel_adaptive_aux_buffer(kg, buffer);
+    if (aux->w == 0.0f) {
+      any = true;
+      if (x > tile->x && !prev) {
+        ccl_global float *prev_buffer = buffer - kernel_data.film.pass_stride;
+        kernel_adaptive_aux_buffer(kg, prev_buffer)->w = 0.0f;
+      }
+      prev = true;
+    }
+    else {
+      if (prev) {
+        aux->w = 0.0f;
+      }
+      prev = false;
+    }
+  }
+  return any;
+}
+
+ccl_device bool kernel_do_adaptive_filter_y(KernelGlobals *kg, int x, ccl_global WorkTile *tile)
+{
+  bool prev = false;
+  bool any = false;
+  for (int y = tile->y; y < tile->y + tile->h; ++y) {
+    int index = tile->offset + x + y * tile->stride;
+    ccl_global float *buffer = tile->buffer + index * kernel_data.film.pass_stride;
+    ccl_global float4 *aux = kernel_adaptive_aux_buffer(kg, buffer);
+    if (aux->w == 0.0f) {
+      any = true;
+      if (y > tile->y && !prev) {
+        ccl_global float *prev_buffer = buffer - tile->stride * kernel_data.film.pass_stride;
+        kernel_adaptive_aux_buffer(kg, prev_buffer)->w = 0.0f;
+      }
+      prev = true;
+    }
+    else {
+      if (prev) {
+        aux->w = 0.0f;
+      }
+      prev = false;
+    }
+  }
+  return any;
+}
+
+/* Passes which are written once or store IDs rather than accumulating every sample. */
+ccl_device_inline bool kernel_adaptive_pass_is_accumulated(KernelGlobals *kg, int offset)
+{
+  const int flag = kernel_data.film.pass_flag;
+
+  if (offset == kernel_data.film.pass_sample_count) {
+    return false;
+  }
+  if (((flag & PASSMASK(DEPTH)) && offset == kernel_data.film.pass_depth) ||
+      ((flag & PASSMASK(OBJECT_ID)) && offset == kernel_data.film.pass_object_id) ||
+      ((flag & PASSMASK(MATERIAL_ID)) && offset == kernel_data.film.pass_material_id)) {
+    return false;
+  }
+  if (kernel_data.film.cryptomatte_passes) {
+    const int num_layers = ((kernel_data.film.cryptomatte_passes & CRYPT_OBJECT) ? 1 : 0) +
+                           ((kernel_data.film.cryptomatte_passes & CRYPT_MATERIAL) ? 1 : 0) +
+                           ((kernel_data.film.cryptomatte_passes & CRYPT_ASSET) ? 1 : 0);
+    const int cryptomatte_offset = offset - kernel_data.film.pass_cryptomatte;
+    /* Slots are pairs of ID and weight, only the weights accumulate. */
+    if (cryptomatte_offset >= 0 &&
+        cryptomatte_offset < num_layers * kernel_data.film.cryptomatte_depth * 4) {
+      return (cryptomatte_offset & 1) != 0;
+    }
+  }
+  return true;
+}
+
+/* Scale the passes of a pixel which stopped early, as if it took all samples of the tile. */
+ccl_device void kernel_adaptive_post_adjust(KernelGlobals *kg,
+                                            ccl_global float *buffer,
+                                            float sample_multiplier)
+{
+  for (int i = 0; i < kernel_data.film.pass_stride; i++) {
+    if (kernel_adaptive_pass_is_accumulated(kg, i)) {
+      buffer[i] *= sample_multiplier;
+    }
+  }
+}
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_ADAPTIVE_SAMPLING_H__ */
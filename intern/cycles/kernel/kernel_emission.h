@@ -224,6 +224,11 @@ ccl_device_noinline_cpu float3 indirect_primitive_emission(
     /* multiple importance sampling, get triangle light pdf,
      * and compute weight with respect to BSDF pdf */
     float pdf = triangle_light_pdf(kg, sd, t);
+#ifdef __LIGHT_TREE__
+    if (kernel_data.integrator.use_light_tree) {
+      pdf *= light_tree_triangle_pdf_factor(kg, sd->object, sd->prim, sd->P + sd->I * t);
+    }
+#endif
     float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
     return L * mis_weight;
@@ -277,6 +282,11 @@ ccl_device_noinline_cpu void indirect_lamp_emission(KernelGlobals *kg,
     if (!(state->flag & PATH_RAY_MIS_SKIP)) {
       /* multiple importance sampling, get regular light pdf,
        * and compute weight with respect to BSDF pdf */
+#ifdef __LIGHT_TREE__
+      if (kernel_data.integrator.use_light_tree) {
+        ls.pdf *= light_tree_lamp_pdf_factor(kg, lamp, ray->P);
+      }
+#endif
       float mis_weight = power_heuristic(state->ray_pdf, ls.pdf);
       lamp_L *= mis_weight;
     }
@@ -24,6 +24,7 @@
 #ifdef __KERNEL_CPU__
 #  include "util/util_vector.h"
 #  include "util/util_map.h"
+#  include "util/util_texture_cache.h"
 #endif
 
 #ifdef __KERNEL_OPENCL__
@@ -64,6 +65,12 @@ typedef struct KernelGlobals {
   OSLThreadData *osl_tdata;
 #  endif
 
+#  ifdef __TEXTURE_CACHE__
+  /* Images read on demand instead of being loaded into memory, with data per render thread. */
+  TextureCache *texture_cache;
+  TextureCacheThreadData *texture_cache_tdata;
+#  endif
+
   /* **** Run-time data ****  */
 
   /* Heap-allocated storage for transparent shadows intersections. */
@@ -1102,6 +1102,162 @@ ccl_device int light_distribution_sample(KernelGlobals *kg, float *randu)
   return index;
 }
 
+/* Light Tree
+ *
+ * Emitters with a position are picked from the light tree instead of the light distribution. The
+ * tree is traversed from the root, choosing between children by the importance of their emitters
+ * for the shading point as in "Importance Sampling of Many Lights With Adaptive Tree Splitting".
+ * The sample pdfs are computed as for the light distribution, and then multiplied by the returned
+ * factor to use the probability of the tree instead. */
+
+#ifdef __LIGHT_TREE__
+
+ccl_device float light_tree_node_importance(KernelGlobals *kg, int index, float3 P)
+{
+  const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes, index);
+
+  if (knode->energy == 0.0f) {
+    return 0.0f;
+  }
+
+  const float3 bbox_min = make_float3(knode->bbox_min[0], knode->bbox_min[1], knode->bbox_min[2]);
+  const float3 bbox_max = make_float3(knode->bbox_max[0], knode->bbox_max[1], knode->bbox_max[2]);
+  const float3 centroid = 0.5f * (bbox_min + bbox_max);
+  const float radius_squared = len_squared(bbox_max - centroid);
+
+  float distance;
+  const float3 D = safe_normalize_len(P - centroid, &distance);
+  const float distance_squared = distance * distance;
+
+  /* Angle between the emitter normals and the shading point, reduced by the spread of the normals
+   * and the angle the bounding sphere covers. Points inside the sphere see all emitters. */
+  float cos_theta_prime = 1.0f;
+  if (knode->theta_o < M_PI_F && distance_squared > radius_squared) {
+    const float3 axis = make_float3(knode->axis[0], knode->axis[1], knode->axis[2]);
+    const float theta = safe_acosf(dot(axis, D));
+    const float theta_u = safe_asinf(sqrtf(radius_squared / distance_squared));
+    const float theta_prime = max(theta - knode->theta_o - theta_u, 0.0f);
+    if (theta_prime >= knode->theta_e) {
+      return 0.0f;
+    }
+    cos_theta_prime = cosf(theta_prime);
+  }
+
+  /* Clamp the distance to avoid a singularity at the emitters. */
+  return knode->energy * cos_theta_prime /
+         max(max(distance_squared, 0.25f * radius_squared), 1e-12f);
+}
+
+ccl_device float light_tree_left_probability(KernelGlobals *kg, int index, float3 P)
+{
+  const int right = kernel_tex_fetch(__light_tree_nodes, index).child;
+  const float importance_left = light_tree_node_importance(kg, index + 1, P);
+  const float importance_right = light_tree_node_importance(kg, right, P);
+  const float importance = importance_left + importance_right;
+
+  return (importance > 0.0f) ? importance_left / importance : 0.5f;
+}
+
+/* Replace an emitter picked from the light distribution by one from the light tree, if it is in
+ * the tree. The random number is rescaled for reuse. */
+ccl_device int light_tree_sample(
+    KernelGlobals *kg, int index, float3 P, float *randu, float *pdf_factor)
+{
+  if (kernel_tex_fetch(__light_tree_emitters, index).leaf == -1) {
+    return index;
+  }
+
+  float r = *randu;
+  float pdf = 1.0f;
+  int node = 0;
+
+  while (!kernel_tex_fetch(__light_tree_nodes, node).is_leaf) {
+    const float probability_left = light_tree_left_probability(kg, node, P);
+
+    if (r < probability_left) {
+      r = r / probability_left;
+      pdf *= probability_left;
+      node = node + 1;
+    }
+    else {
+      r = (r - probability_left) / (1.0f - probability_left);
+      pdf *= 1.0f - probability_left;
+      node = kernel_tex_fetch(__light_tree_nodes, node).child;
+    }
+  }
+
+  index = kernel_tex_fetch(__light_tree_nodes, node).child;
+  *randu = min(r, 1.0f - 1e-7f);
+  *pdf_factor = kernel_data.integrator.light_tree_pdf * pdf /
+                kernel_tex_fetch(__light_tree_emitters, index).distribution_pdf;
+
+  return index;
+}
+
+/* Factor to replace the probability of an emitter in the light distribution with the probability
+ * of reaching it in the light tree from the shading point. */
+ccl_device float light_tree_pdf_factor(KernelGlobals *kg, int index, float3 P)
+{
+  const ccl_global KernelLightTreeEmitter *kemitter = &kernel_tex_fetch(__light_tree_emitters,
+                                                                        index);
+  if (kemitter->leaf == -1) {
+    return 1.0f;
+  }
+
+  float pdf = 1.0f;
+  int node = kemitter->leaf;
+
+  while (node != 0) {
+    const int parent = kernel_tex_fetch(__light_tree_nodes, node).parent;
+    const float probability_left = light_tree_left_probability(kg, parent, P);
+
+    pdf *= (node == parent + 1) ? probability_left : 1.0f - probability_left;
+    node = parent;
+  }
+
+  return kernel_data.integrator.light_tree_pdf * pdf / kemitter->distribution_pdf;
+}
+
+ccl_device float light_tree_lamp_pdf_factor(KernelGlobals *kg, int lamp, float3 P)
+{
+  /* Lamps follow the triangles in the light distribution. */
+  const int index = kernel_data.integrator.num_distribution -
+                    kernel_data.integrator.num_all_lights + lamp;
+  return light_tree_pdf_factor(kg, index, P);
+}
+
+ccl_device float light_tree_triangle_pdf_factor(KernelGlobals *kg,
+                                                int object,
+                                                int prim,
+                                                float3 P)
+{
+  /* The emissive triangles of an object are stored consecutively and sorted by primitive. */
+  const uint2 range = kernel_tex_fetch(__light_tree_objects, object);
+  int first = range.x;
+  int len = range.y;
+
+  while (len > 0) {
+    const int half_len = len >> 1;
+    const int middle = first + half_len;
+
+    if (kernel_tex_fetch(__light_distribution, middle).prim < prim) {
+      first = middle + 1;
+      len = len - half_len - 1;
+    }
+    else {
+      len = half_len;
+    }
+  }
+
+  if (first == range.x + range.y || kernel_tex_fetch(__light_distribution, first).prim != prim) {
+    return 1.0f;
+  }
+
+  return light_tree_pdf_factor(kg, first, P);
+}
+
+#endif /* __LIGHT_TREE__ */
+
 /* Generic Light */
 
 ccl_device_inline bool light_select_reached_max_bounces(KernelGlobals *kg, int index, int bounce)
@@ -1118,10 +1274,18 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
                                       int bounce,
                                       LightSample *ls)
 {
+  float pdf_factor = 1.0f;
+
   if (lamp < 0) {
     /* sample index */
     int index = light_distribution_sample(kg, &randu);
 
+#ifdef __LIGHT_TREE__
+    if (kernel_data.integrator.use_light_tree) {
+      index = light_tree_sample(kg, index, P, &randu, &pdf_factor);
+    }
+#endif
+
     /* fetch light data */
     const ccl_global KernelLightDistribution *kdistribution = &kernel_tex_fetch(
         __light_distribution, index);
@@ -1133,6 +1297,7 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 
       triangle_light_sample(kg, prim, object, randu, randv, time, ls, P);
       ls->shader |= shader_flag;
+      ls->pdf *= pdf_factor;
       return (ls->pdf > 0.0f);
     }
 
@@ -1143,7 +1308,12 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
     return false;
   }
 
-  return lamp_light_sample(kg, lamp, randu, randv, P, ls);
+  if (!lamp_light_sample(kg, lamp, randu, randv, P, ls)) {
+    return false;
+  }
+
+  ls->pdf *= pdf_factor;
+  return true;
 }
 
 ccl_device_inline int light_select_num_samples(KernelGlobals *kg, int index)
@@ -32,6 +32,7 @@
 #include "kernel/kernel_shader.h"
 #include "kernel/kernel_light.h"
 #include "kernel/kernel_passes.h"
+#include "kernel/kernel_adaptive_sampling.h"
 
 #if defined(__VOLUME__) || defined(__SUBSURFACE__)
 #  include "kernel/kernel_volume.h"
@@ -656,6 +657,10 @@ ccl_device void kernel_path_trace(
 
   buffer += index * pass_stride;
 
+  if (kernel_adaptive_pixel_converged(kg, buffer)) {
+    return;
+  }
+
   /* Initialize random numbers and sample ray. */
   uint rng_hash;
   Ray ray;
@@ -135,6 +135,8 @@ CCL_NAMESPACE_BEGIN
 #  endif
 #  define __VOLUME_DECOUPLED__
 #  define __VOLUME_RECORD_ALL__
+#  define __LIGHT_TREE__
+#  define __TEXTURE_CACHE__
 #endif /* __KERNEL_CPU__ */
 
 #ifdef __KERNEL_CUDA__
@@ -375,6 +377,8 @@ typedef enum PassType {
   PASS_CRYPTOMATTE,
   PASS_AOV_COLOR,
   PASS_AOV_VALUE,
+  PASS_ADAPTIVE_AUX_BUFFER,
+  PASS_SAMPLE_COUNT,
   PASS_CATEGORY_MAIN_END = 31,
 
   PASS_MIST = 32,
@@ -1250,8 +1254,8 @@ typedef struct KernelFilm {
 
   int pass_aov_color;
   int pass_aov_value;
-  int pad1;
-  int pad2;
+  int pass_adaptive_aux_buffer;
+  int pass_sample_count;
 
   /* XYZ to rendering color space transform. float4 instead of float3 to
    * ensure consistent padding/alignment across devices. */
@@ -1365,7 +1369,14 @@ typedef struct KernelIntegrator {
 
   int max_closures;
 
-  int pad1;
+  /* adaptive sampling */
+  int adaptive_min_samples;
+  int adaptive_step;
+  float adaptive_threshold;
+
+  /* light tree, sampled with the probability of the emitters it contains */
+  int use_light_tree;
+  float light_tree_pdf;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
 
@@ -1534,6 +1545,35 @@ typedef struct KernelLightDistribution {
 } KernelLightDistribution;
 static_assert_align(KernelLightDistribution, 16);
 
+/* Node of the light tree, a bounding volume hierarchy over the emitters of the light distribution
+ * which have a position. Nodes are stored depth first, so the left child of an inner node directly
+ * follows it. */
+typedef struct KernelLightTreeNode {
+  float bbox_min[3];
+  float energy;
+  float bbox_max[3];
+  /* Bounding cone of the emitter normals, and the angle around them in which they emit. */
+  float theta_o;
+  float axis[3];
+  float theta_e;
+  /* Right child of an inner node, index in the light distribution for a leaf. */
+  int child;
+  int parent;
+  int is_leaf;
+  int pad;
+} KernelLightTreeNode;
+static_assert_align(KernelLightTreeNode, 16);
+
+typedef struct KernelLightTreeEmitter {
+  /* Leaf node of the emitter, -1 for emitters which are only sampled from the distribution. */
+  int leaf;
+  /* Probability of the emitter in the light distribution, which the light tree replaces. */
+  float distribution_pdf;
+  int pad1;
+  int pad2;
+} KernelLightTreeEmitter;
+static_assert_align(KernelLightTreeEmitter, 16);
+
 typedef struct KernelParticle {
   int index;
   float age;
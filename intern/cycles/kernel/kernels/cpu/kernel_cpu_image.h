@@ -498,6 +498,21 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
   }
 }
 
+#ifdef __TEXTURE_CACHE__
+/* Images in the texture cache are read on demand, with the texture coordinate differentials
+ * picking the mip level. Other images are in memory. */
+ccl_device float4 kernel_tex_image_interp_cache(
+    KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy)
+{
+  float4 r;
+  if (kg->texture_cache &&
+      kg->texture_cache->lookup(kg->texture_cache_tdata, id, x, y, dx, dy, &r)) {
+    return r;
+  }
+  return kernel_tex_image_interp(kg, id, x, y);
+}
+#endif
+
 ccl_device float4 kernel_tex_image_interp_3d(
     KernelGlobals *kg, int id, float x, float y, float z, InterpolationType interp)
 {
@@ -122,6 +122,8 @@ RenderTile::RenderTile()
 
   buffer = 0;
 
+  pixel_samples = 0;
+
   buffers = NULL;
 }
 
@@ -145,6 +145,10 @@ class RenderTile {
   device_ptr buffer;
   int device_size;
 
+  /* Samples taken by all pixels of the tile together, lower than the pixel count times the
+   * number of samples when pixels stopped early with adaptive sampling. */
+  int64_t pixel_samples;
+
   RenderBuffers *buffers;
 
   RenderTile();
@@ -16,6 +16,7 @@
 
 #include "render/attribute.h"
 #include "render/graph.h"
+#include "render/image.h"
 #include "render/nodes.h"
 #include "render/scene.h"
 #include "render/shader.h"
@@ -365,6 +366,9 @@ void ShaderGraph::simplify(Scene *scene)
     default_inputs(scene->shader_manager->use_osl());
     clean(scene);
     refine_bump_nodes();
+    if (scene->image_manager->has_texture_cache()) {
+      refine_image_texture_nodes();
+    }
 
     simplified = true;
   }
@@ -953,6 +957,50 @@ void ShaderGraph::refine_bump_nodes()
   }
 }
 
+void ShaderGraph::refine_image_texture_nodes()
+{
+  /* The texture cache picks the mip level of image textures from the differentials of their
+   * texture coordinate. Like for bump nodes, we copy the sub-graph defined from the "Vector"
+   * input to the "VectorDX" and "VectorDY" inputs, evaluated at positions shifted by dx/dy. */
+
+  foreach (ShaderNode *node, nodes) {
+    if (node->type != ImageTextureNode::node_type || node->bump == SHADER_BUMP_DX ||
+        node->bump == SHADER_BUMP_DY) {
+      continue;
+    }
+
+    ImageTextureNode *image_node = static_cast<ImageTextureNode *>(node);
+    ShaderInput *vector_input = node->input("Vector");
+    if (image_node->builtin_data != NULL || image_node->projection == NODE_IMAGE_PROJ_BOX ||
+        !vector_input->link) {
+      continue;
+    }
+
+    ShaderNodeSet nodes_vector;
+    ShaderNodeMap nodes_dx;
+    ShaderNodeMap nodes_dy;
+
+    find_dependencies(nodes_vector, vector_input);
+
+    copy_nodes(nodes_vector, nodes_dx);
+    copy_nodes(nodes_vector, nodes_dy);
+
+    foreach (NodePair &pair, nodes_dx)
+      pair.second->bump = SHADER_BUMP_DX;
+    foreach (NodePair &pair, nodes_dy)
+      pair.second->bump = SHADER_BUMP_DY;
+
+    ShaderOutput *out = vector_input->link;
+    connect(nodes_dx[out->parent]->output(out->name()), node->input("VectorDX"));
+    connect(nodes_dy[out->parent]->output(out->name()), node->input("VectorDY"));
+
+    foreach (NodePair &pair, nodes_dx)
+      add(pair.second);
+    foreach (NodePair &pair, nodes_dy)
+      add(pair.second);
+  }
+}
+
 void ShaderGraph::bump_from_displacement(bool use_object_space)
 {
   /* generate bump mapping automatically from displacement. bump mapping is
@@ -26,6 +26,7 @@
 #include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_texture.h"
+#include "util/util_texture_cache.h"
 #include "util/util_unique_ptr.h"
 
 #ifdef WITH_OSL
@@ -104,6 +105,10 @@ ImageManager::ImageManager(const DeviceInfo &info)
   max_num_images = TEX_NUM_MAX;
   has_half_images = info.has_half_images;
 
+  /* The kernel only reads from the texture cache on the CPU. */
+  texture_cache_supported = (info.type == DEVICE_CPU);
+  texture_cache = NULL;
+
   for (size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     tex_num_images[type] = 0;
   }
@@ -115,6 +120,8 @@ ImageManager::~ImageManager()
     for (size_t slot = 0; slot < images[type].size(); slot++)
       assert(!images[type][slot]);
   }
+
+  delete texture_cache;
 }
 
 void ImageManager::set_osl_texture_system(void *texture_system)
@@ -122,6 +129,21 @@ void ImageManager::set_osl_texture_system(void *texture_system)
   osl_texture_system = texture_system;
 }
 
+void ImageManager::set_texture_cache(bool use_texture_cache, size_t memory_limit)
+{
+  delete texture_cache;
+  texture_cache = NULL;
+
+  if (use_texture_cache && texture_cache_supported) {
+    texture_cache = new TextureCache(memory_limit);
+  }
+}
+
+bool ImageManager::has_texture_cache() const
+{
+  return texture_cache != NULL;
+}
+
 bool ImageManager::set_animation_frame_update(int frame)
 {
   if (frame != animation_frame) {
@@ -399,6 +421,7 @@ int ImageManager::add_image(const string &filename,
   img->frame = frame;
   img->interpolation = interpolation;
   img->extension = extension;
+  img->without_differentials = false;
   img->users = 1;
   img->alpha_type = alpha_type;
   img->colorspace = colorspace;
@@ -424,6 +447,28 @@ void ImageManager::add_image_user(int flat_slot)
   image->users++;
 }
 
+void ImageManager::tag_image_without_differentials(int flat_slot)
+{
+  if (flat_slot == -1) {
+    return;
+  }
+
+  ImageDataType type;
+  int slot = flattened_slot_to_type_index(flat_slot, &type);
+
+  Image *image = images[type][slot];
+  assert(image && image->users >= 1);
+
+  if (!image->without_differentials) {
+    image->without_differentials = true;
+    /* Move the image out of the texture cache. */
+    if (texture_cache) {
+      image->need_load = true;
+      need_update = true;
+    }
+  }
+}
+
 void ImageManager::remove_image(int flat_slot)
 {
   ImageDataType type;
@@ -502,6 +547,25 @@ static bool image_associate_alpha(ImageManager::Image *img)
            img->alpha_type == IMAGE_ALPHA_IGNORE || img->alpha_type == IMAGE_ALPHA_CHANNEL_PACKED);
 }
 
+static bool image_use_texture_cache(ImageManager::Image *img)
+{
+  /* Only files that need no conversion on load can be read on demand. The cache associates
+   * alpha, so images with alpha that must be left untouched are loaded fully as well. */
+  if (img->builtin_data || img->without_differentials || img->metadata.depth > 1) {
+    return false;
+  }
+  if (!(img->metadata.channels >= 1 && img->metadata.channels <= 4)) {
+    return false;
+  }
+  if (!(img->metadata.colorspace == u_colorspace_raw ||
+        img->metadata.colorspace == u_colorspace_srgb)) {
+    return false;
+  }
+
+  const bool has_alpha = (img->metadata.channels == 2 || img->metadata.channels == 4);
+  return !has_alpha || image_associate_alpha(img);
+}
+
 bool ImageManager::file_load_image_generic(Image *img, unique_ptr<ImageInput> *in)
 {
   if (img->filename == "")
@@ -801,6 +865,19 @@ void ImageManager::device_load_image(
     img->mem = NULL;
   }
 
+  /* Read on demand while rendering. */
+  if (texture_cache) {
+    if (image_use_texture_cache(img) && texture_cache->add_image(flat_slot,
+                                                                 img->filename,
+                                                                 img->metadata.channels,
+                                                                 img->interpolation,
+                                                                 img->extension)) {
+      img->need_load = false;
+      return;
+    }
+    texture_cache->remove_image(flat_slot);
+  }
+
   /* Create new texture. */
   if (type == IMAGE_DATA_TYPE_FLOAT4) {
     device_vector<float4> *tex_img = new device_vector<float4>(
@@ -981,6 +1058,10 @@ void ImageManager::device_free_image(Device *, ImageDataType type, int slot)
 #endif
     }
 
+    if (texture_cache) {
+      texture_cache->remove_image(type_index_to_flattened_slot(slot, type));
+    }
+
     if (img->mem) {
       thread_scoped_lock device_lock(device_mutex);
       delete img->mem;
@@ -998,6 +1079,8 @@ void ImageManager::device_update(Device *device, Scene *scene, Progress &progres
     return;
   }
 
+  device_update_texture_cache(device);
+
   TaskPool pool;
   for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     for (size_t slot = 0; slot < images[type].size(); slot++) {
@@ -1045,6 +1128,13 @@ void ImageManager::device_update_slot(Device *device,
   }
 }
 
+void ImageManager::device_update_texture_cache(Device *device)
+{
+  /* Images added to the texture cache have no device memory, kernels evaluated before the
+   * image manager update (true displacement) must read them from the cache as well. */
+  device->texture_cache_set(texture_cache);
+}
+
 void ImageManager::device_load_builtin(Device *device, Scene *scene, Progress &progress)
 {
   /* Load only builtin images, Blender needs this to load evaluated
@@ -1094,16 +1184,26 @@ void ImageManager::device_free(Device *device)
     }
     images[type].clear();
   }
+
+  device->texture_cache_set(NULL);
 }
 
 void ImageManager::collect_statistics(RenderStats *stats)
 {
   for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     foreach (const Image *image, images[type]) {
-      stats->image.textures.add_entry(
-          NamedSizeEntry(path_filename(image->filename), image->mem->memory_size()));
+      /* Images in the texture cache have no device memory. */
+      if (image && image->mem) {
+        stats->image.textures.add_entry(
+            NamedSizeEntry(path_filename(image->filename), image->mem->memory_size()));
+      }
     }
   }
+
+  if (texture_cache) {
+    stats->has_texture_cache = true;
+    texture_cache->collect_statistics(&stats->texture_cache);
+  }
 }
 
 CCL_NAMESPACE_END
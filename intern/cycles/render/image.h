@@ -35,6 +35,7 @@ class Progress;
 class RenderStats;
 class Scene;
 class ColorSpaceProcessor;
+class TextureCache;
 
 class ImageMetaData {
  public:
@@ -87,6 +88,9 @@ class ImageManager {
                 ustring colorspace,
                 ImageMetaData &metadata);
   void add_image_user(int flat_slot);
+  /* Images read without ray differentials can't pick a mip level from the texture cache, they
+   * are loaded into device memory instead. */
+  void tag_image_without_differentials(int flat_slot);
   void remove_image(int flat_slot);
   void remove_image(const string &filename,
                     void *builtin_data,
@@ -108,6 +112,7 @@ class ImageManager {
 
   void device_update(Device *device, Scene *scene, Progress &progress);
   void device_update_slot(Device *device, Scene *scene, int flat_slot, Progress *progress);
+  void device_update_texture_cache(Device *device);
   void device_free(Device *device);
 
   void device_load_builtin(Device *device, Scene *scene, Progress &progress);
@@ -116,6 +121,11 @@ class ImageManager {
   void set_osl_texture_system(void *texture_system);
   bool set_animation_frame_update(int frame);
 
+  /* Read images from files on demand through the texture cache, instead of loading them fully
+   * into device memory. Only supported on the CPU with SVM. */
+  void set_texture_cache(bool use_texture_cache, size_t memory_limit);
+  bool has_texture_cache() const;
+
   device_memory *image_memory(int flat_slot);
 
   void collect_statistics(RenderStats *stats);
@@ -157,6 +167,7 @@ class ImageManager {
     float frame;
     InterpolationType interpolation;
     ExtensionType extension;
+    bool without_differentials;
 
     string mem_name;
     device_memory *mem;
@@ -175,6 +186,9 @@ class ImageManager {
   vector<Image *> images[IMAGE_DATA_NUM_TYPES];
   void *osl_texture_system;
 
+  bool texture_cache_supported;
+  TextureCache *texture_cache;
+
   bool file_load_image_generic(Image *img, unique_ptr<ImageInput> *in);
 
   template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
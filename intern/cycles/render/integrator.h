@@ -74,6 +74,14 @@ class Integrator : public Node {
   bool sample_all_lights_direct;
   bool sample_all_lights_indirect;
   float light_sampling_threshold;
+  /* Sample lights with a tree by their distance and orientation instead of their area only. Not
+   * supported when the branched path integrator samples all lights. */
+  bool use_light_tree;
+
+  /* Adaptive sampling is used when the film has the auxiliary pass, zero picks automatic values
+   * based on the number of samples. */
+  int adaptive_min_samples;
+  float adaptive_threshold;
 
   enum Method {
     BRANCHED_PATH = 0,
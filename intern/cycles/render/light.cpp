@@ -20,6 +20,7 @@
 #include "render/film.h"
 #include "render/graph.h"
 #include "render/light.h"
+#include "render/light_tree.h"
 #include "render/mesh.h"
 #include "render/nodes.h"
 #include "render/object.h"
@@ -254,6 +255,59 @@ bool LightManager::object_usable_as_light(Object *object)
   return false;
 }
 
+/* Estimate of the emission of a shader for the light tree, without evaluating it. */
+static float light_tree_shader_emission(Shader *shader)
+{
+  float3 emission;
+  if (shader->is_constant_emission(&emission)) {
+    return max(average(emission), 0.0f);
+  }
+  return 1.0f;
+}
+
+/* Add lamps with a position to the light tree, returns false for distant and background lights
+ * which are only sampled from the distribution. */
+static bool light_tree_add_lamp(Light *light, int index, vector<LightTreeEmitter> &emitters)
+{
+  float energy = max(average(light->strength), 0.0f);
+  if (light->shader) {
+    energy *= light_tree_shader_emission(light->shader);
+  }
+  if (energy == 0.0f) {
+    return false;
+  }
+
+  BoundBox bbox = BoundBox::empty;
+  LightTreeCone cone;
+
+  if (light->type == LIGHT_POINT) {
+    bbox.grow(light->co, light->size);
+  }
+  else if (light->type == LIGHT_SPOT) {
+    bbox.grow(light->co, light->size);
+    cone = LightTreeCone(safe_normalize(light->dir), light->spot_angle * 0.5f, M_PI_2_F);
+  }
+  else if (light->type == LIGHT_AREA) {
+    const float3 axisu = light->axisu * (light->sizeu * light->size);
+    const float3 axisv = light->axisv * (light->sizev * light->size);
+    const float3 dir = safe_normalize(light->dir);
+
+    bbox.grow(light->co + 0.5f * (axisu + axisv));
+    bbox.grow(light->co + 0.5f * (axisu - axisv));
+    bbox.grow(light->co - 0.5f * (axisu + axisv));
+    bbox.grow(light->co - 0.5f * (axisu - axisv));
+    if (!is_zero(dir)) {
+      cone = LightTreeCone(dir, 0.0f, M_PI_2_F);
+    }
+  }
+  else {
+    return false;
+  }
+
+  emitters.push_back(LightTreeEmitter(bbox, cone, energy, index));
+  return true;
+}
+
 void LightManager::device_update_distribution(Device *,
                                               DeviceScene *dscene,
                                               Scene *scene,
@@ -307,6 +361,23 @@ void LightManager::device_update_distribution(Device *,
   KernelLightDistribution *distribution = dscene->light_distribution.alloc(num_distribution + 1);
   float totarea = 0.0f;
 
+  /* The branched path integrator sampling all lights splits the samples between lamps and mesh
+   * lights itself, the light tree is not used then. */
+  Integrator *integrator = scene->integrator;
+  const bool use_light_tree = integrator->use_light_tree &&
+                              !(integrator->method == Integrator::BRANCHED_PATH &&
+                                (integrator->sample_all_lights_direct ||
+                                 integrator->sample_all_lights_indirect));
+
+  /* Emitters with a position for the light tree with their area in the distribution, and the
+   * range of emissive triangles of every object in the distribution. */
+  vector<LightTreeEmitter> tree_emitters;
+  vector<float> tree_emitter_area;
+  vector<uint2> tree_objects;
+  if (use_light_tree) {
+    tree_objects.resize(scene->objects.size(), make_uint2(0, 0));
+  }
+
   /* triangles */
   size_t offset = 0;
   int j = 0;
@@ -343,6 +414,15 @@ void LightManager::device_update_distribution(Device *,
       use_light_visibility = true;
     }
 
+    /* Emission of the mesh shaders for the light tree. */
+    vector<float> shader_emission;
+    if (use_light_tree) {
+      tree_objects[object_id].x = offset;
+      foreach (Shader *shader, mesh->used_shaders) {
+        shader_emission.push_back(light_tree_shader_emission(shader));
+      }
+    }
+
     size_t mesh_num_triangles = mesh->num_triangles();
     for (size_t i = 0; i < mesh_num_triangles; i++) {
       int shader_index = mesh->shader[i];
@@ -371,10 +451,31 @@ void LightManager::device_update_distribution(Device *,
           p3 = transform_point(&tfm, p3);
         }
 
-        totarea += triangle_area(p1, p2, p3);
+        const float area = triangle_area(p1, p2, p3);
+        totarea += area;
+
+        if (use_light_tree && area > 0.0f) {
+          /* Mesh lights emit from both sides, so their normals don't bound the emission. */
+          BoundBox bbox = BoundBox::empty;
+          bbox.grow(p1);
+          bbox.grow(p2);
+          bbox.grow(p3);
+          const float emission = (shader_index < shader_emission.size()) ?
+                                     shader_emission[shader_index] :
+                                     light_tree_shader_emission(shader);
+          if (emission > 0.0f) {
+            tree_emitters.push_back(LightTreeEmitter(
+                bbox, LightTreeCone(), M_PI_F * area * emission, offset - 1));
+            tree_emitter_area.push_back(area);
+          }
+        }
       }
     }
 
+    if (use_light_tree) {
+      tree_objects[object_id].y = offset - tree_objects[object_id].x;
+    }
+
     j++;
   }
 
@@ -395,6 +496,10 @@ void LightManager::device_update_distribution(Device *,
     distribution[offset].lamp.size = light->size;
     totarea += lightarea;
 
+    if (use_light_tree && light_tree_add_lamp(light, offset, tree_emitters)) {
+      tree_emitter_area.push_back(lightarea);
+    }
+
     if (light->type == LIGHT_DISTANT) {
       use_lamp_mis |= (light->angle > 0.0f && light->use_mis);
     }
@@ -471,6 +576,55 @@ void LightManager::device_update_distribution(Device *,
     /* CDF */
     dscene->light_distribution.copy_to_device();
 
+    /* Light tree */
+    kintegrator->use_light_tree = use_light_tree;
+    kintegrator->light_tree_pdf = 0.0f;
+
+    if (use_light_tree) {
+      KernelLightTreeEmitter *kemitters = dscene->light_tree_emitters.alloc(num_distribution);
+      for (size_t i = 0; i < num_distribution; i++) {
+        kemitters[i].leaf = -1;
+        kemitters[i].distribution_pdf = 0.0f;
+        kemitters[i].pad1 = 0;
+        kemitters[i].pad2 = 0;
+      }
+
+      /* The tree is sampled with the probability of its emitters in the distribution. */
+      for (size_t i = 0; i < tree_emitters.size(); i++) {
+        const float distribution_pdf = tree_emitter_area[i] / totarea;
+        kemitters[tree_emitters[i].index].distribution_pdf = distribution_pdf;
+        kintegrator->light_tree_pdf += distribution_pdf;
+      }
+
+      double time_start = time_dt();
+      LightTree tree(tree_emitters);
+
+      /* Device vectors can't be empty, without emitters the root is never visited. */
+      KernelLightTreeNode *knodes = dscene->light_tree_nodes.alloc(
+          max(tree.nodes.size(), (size_t)1));
+      memset((void *)knodes, 0, sizeof(KernelLightTreeNode));
+      for (size_t i = 0; i < tree.nodes.size(); i++) {
+        knodes[i] = tree.nodes[i];
+        if (knodes[i].is_leaf) {
+          kemitters[knodes[i].child].leaf = i;
+        }
+      }
+
+      uint2 *kobjects = dscene->light_tree_objects.alloc(max(tree_objects.size(), (size_t)1));
+      kobjects[0] = make_uint2(0, 0);
+      for (size_t i = 0; i < tree_objects.size(); i++) {
+        kobjects[i] = tree_objects[i];
+      }
+
+      VLOG(1) << "Light tree with " << tree.nodes.size() << " nodes for " << tree_emitters.size()
+              << " of " << num_distribution << " emitters, built in " << time_dt() - time_start
+              << " seconds.";
+
+      dscene->light_tree_nodes.copy_to_device();
+      dscene->light_tree_emitters.copy_to_device();
+      dscene->light_tree_objects.copy_to_device();
+    }
+
     /* Portals */
     if (num_portals > 0) {
       kintegrator->portal_offset = light_index;
@@ -485,8 +639,13 @@ void LightManager::device_update_distribution(Device *,
   }
   else {
     dscene->light_distribution.free();
+    dscene->light_tree_nodes.free();
+    dscene->light_tree_emitters.free();
+    dscene->light_tree_objects.free();
 
     kintegrator->num_distribution = 0;
+    kintegrator->use_light_tree = false;
+    kintegrator->light_tree_pdf = 0.0f;
     kintegrator->num_all_lights = 0;
     kintegrator->pdf_triangles = 0.0f;
     kintegrator->pdf_lights = 0.0f;
@@ -930,6 +1089,9 @@ void LightManager::device_update(Device *device,
 void LightManager::device_free(Device *, DeviceScene *dscene)
 {
   dscene->light_distribution.free();
+  dscene->light_tree_nodes.free();
+  dscene->light_tree_emitters.free();
+  dscene->light_tree_objects.free();
   dscene->lights.free();
   dscene->light_background_marginal_cdf.free();
   dscene->light_background_conditional_cdf.free();
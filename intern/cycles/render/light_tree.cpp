@@ -0,0 +1,275 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/light_tree.h"
+
+#include "util/util_algorithm.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Number of bins per axis when searching for the best split. */
+static const int LIGHT_TREE_NUM_BINS = 12;
+
+/* Cone */
+
+LightTreeCone LightTreeCone::merge(const LightTreeCone &cone_a, const LightTreeCone &cone_b)
+{
+  /* Cone a is the wider one. */
+  const LightTreeCone &a = (cone_a.theta_o >= cone_b.theta_o) ? cone_a : cone_b;
+  const LightTreeCone &b = (cone_a.theta_o >= cone_b.theta_o) ? cone_b : cone_a;
+  const float theta_e = max(a.theta_e, b.theta_e);
+  const float theta_d = safe_acosf(dot(a.axis, b.axis));
+
+  if (min(theta_d + b.theta_o, M_PI_F) <= a.theta_o) {
+    return LightTreeCone(a.axis, a.theta_o, theta_e);
+  }
+
+  const float theta_o = 0.5f * (a.theta_o + theta_d + b.theta_o);
+  const float3 rotation_axis = cross(a.axis, b.axis);
+
+  if (theta_o >= M_PI_F || len_squared(rotation_axis) == 0.0f) {
+    return LightTreeCone(a.axis, M_PI_F, theta_e);
+  }
+
+  /* Rotate the axis of a towards b, to the middle of the merged cone. */
+  const float theta_r = theta_o - a.theta_o;
+  const float3 towards_b = cross(normalize(rotation_axis), a.axis);
+  const float3 axis = normalize(a.axis * cosf(theta_r) + towards_b * sinf(theta_r));
+
+  return LightTreeCone(axis, theta_o, theta_e);
+}
+
+float LightTreeCone::measure() const
+{
+  const float theta_w = min(theta_o + theta_e, M_PI_F);
+  const float cos_theta_o = cosf(theta_o);
+  const float sin_theta_o = sinf(theta_o);
+
+  return M_2PI_F * (1.0f - cos_theta_o) +
+         M_PI_2_F * (2.0f * theta_w * sin_theta_o - cosf(theta_o - 2.0f * theta_w) -
+                     2.0f * theta_o * sin_theta_o + cos_theta_o);
+}
+
+/* Split */
+
+namespace {
+
+struct LightTreeBin {
+  BoundBox bbox;
+  LightTreeCone cone;
+  float energy;
+  int count;
+
+  LightTreeBin() : bbox(BoundBox::empty), energy(0.0f), count(0)
+  {
+  }
+
+  void add(const BoundBox &other_bbox, const LightTreeCone &other_cone, float other_energy)
+  {
+    bbox.grow(other_bbox);
+    cone = (count == 0) ? other_cone : LightTreeCone::merge(cone, other_cone);
+    energy += other_energy;
+    count++;
+  }
+
+  void add(const LightTreeBin &other)
+  {
+    if (other.count == 0) {
+      return;
+    }
+    bbox.grow(other.bbox);
+    cone = (count == 0) ? other.cone : LightTreeCone::merge(cone, other.cone);
+    energy += other.energy;
+    count += other.count;
+  }
+
+  /* Surface area orientation heuristic, with a minimum size of the bounds so that splitting off
+   * point lights is not free. */
+  float cost(float min_size) const
+  {
+    const float3 size = max(bbox.size(), make_float3(min_size, min_size, min_size));
+    const float area = size.x * size.y + size.y * size.z + size.z * size.x;
+    return energy * cone.measure() * area;
+  }
+};
+
+struct LightTreeBinning {
+  int dim;
+  float min;
+  float inv_extent;
+
+  LightTreeBinning(int dim, float min, float extent)
+      : dim(dim), min(min), inv_extent(LIGHT_TREE_NUM_BINS / extent)
+  {
+  }
+
+  int bin(const LightTreeEmitter &emitter) const
+  {
+    const int bin = (int)((emitter.bbox.center()[dim] - min) * inv_extent);
+    return clamp(bin, 0, LIGHT_TREE_NUM_BINS - 1);
+  }
+};
+
+struct LightTreeSplitPredicate {
+  LightTreeBinning binning;
+  int split_bin;
+
+  LightTreeSplitPredicate(const LightTreeBinning &binning, int split_bin)
+      : binning(binning), split_bin(split_bin)
+  {
+  }
+
+  bool operator()(const LightTreeEmitter &emitter) const
+  {
+    return binning.bin(emitter) <= split_bin;
+  }
+};
+
+} /* namespace */
+
+/* Tree */
+
+LightTree::LightTree(vector<LightTreeEmitter> &emitters)
+{
+  if (emitters.empty()) {
+    return;
+  }
+
+  nodes.reserve(2 * emitters.size() - 1);
+  recursive_build(emitters, 0, emitters.size(), -1);
+}
+
+int LightTree::recursive_build(vector<LightTreeEmitter> &emitters,
+                               int start,
+                               int end,
+                               int parent)
+{
+  LightTreeBin bounds;
+  for (int i = start; i < end; i++) {
+    bounds.add(emitters[i].bbox, emitters[i].cone, emitters[i].energy);
+  }
+
+  const int index = nodes.size();
+  nodes.push_back(KernelLightTreeNode());
+
+  KernelLightTreeNode &knode = nodes[index];
+  knode.bbox_min[0] = bounds.bbox.min.x;
+  knode.bbox_min[1] = bounds.bbox.min.y;
+  knode.bbox_min[2] = bounds.bbox.min.z;
+  knode.energy = bounds.energy;
+  knode.bbox_max[0] = bounds.bbox.max.x;
+  knode.bbox_max[1] = bounds.bbox.max.y;
+  knode.bbox_max[2] = bounds.bbox.max.z;
+  knode.theta_o = bounds.cone.theta_o;
+  knode.axis[0] = bounds.cone.axis.x;
+  knode.axis[1] = bounds.cone.axis.y;
+  knode.axis[2] = bounds.cone.axis.z;
+  knode.theta_e = bounds.cone.theta_e;
+  knode.parent = parent;
+  knode.pad = 0;
+
+  if (end - start == 1) {
+    knode.child = emitters[start].index;
+    knode.is_leaf = 1;
+    return index;
+  }
+
+  knode.is_leaf = 0;
+
+  const int middle = find_split(emitters, start, end, bounds.bbox);
+  recursive_build(emitters, start, middle, index);
+  const int right = recursive_build(emitters, middle, end, index);
+
+  /* Nodes may have been reallocated by the children. */
+  nodes[index].child = right;
+
+  return index;
+}
+
+int LightTree::find_split(vector<LightTreeEmitter> &emitters,
+                          int start,
+                          int end,
+                          const BoundBox &bbox)
+{
+  BoundBox centroid_bbox = BoundBox::empty;
+  for (int i = start; i < end; i++) {
+    centroid_bbox.grow(emitters[i].bbox.center());
+  }
+
+  const float3 extent = centroid_bbox.size();
+  const float3 size = bbox.size();
+  const float max_size = max3(size);
+  const float min_size = 1e-3f * max_size;
+
+  float best_cost = FLT_MAX;
+  int best_dim = -1;
+  int best_bin = 0;
+
+  for (int dim = 0; dim < 3; dim++) {
+    if (!(extent[dim] > 0.0f)) {
+      continue;
+    }
+
+    const LightTreeBinning binning(dim, centroid_bbox.min[dim], extent[dim]);
+
+    LightTreeBin bins[LIGHT_TREE_NUM_BINS];
+    for (int i = start; i < end; i++) {
+      const LightTreeEmitter &emitter = emitters[i];
+      bins[binning.bin(emitter)].add(emitter.bbox, emitter.cone, emitter.energy);
+    }
+
+    /* Cost of everything right of each split, sweeping from the right. */
+    float right_cost[LIGHT_TREE_NUM_BINS];
+    LightTreeBin right;
+    for (int bin = LIGHT_TREE_NUM_BINS - 1; bin > 0; bin--) {
+      right.add(bins[bin]);
+      right_cost[bin - 1] = (right.count > 0) ? right.cost(min_size) : FLT_MAX;
+    }
+
+    /* Favor splitting along the longest axis of the node. */
+    const float regularization = max_size / size[dim];
+
+    LightTreeBin left;
+    for (int bin = 0; bin < LIGHT_TREE_NUM_BINS - 1; bin++) {
+      left.add(bins[bin]);
+      if (left.count == 0 || right_cost[bin] == FLT_MAX) {
+        continue;
+      }
+
+      const float cost = regularization * (left.cost(min_size) + right_cost[bin]);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_dim = dim;
+        best_bin = bin;
+      }
+    }
+  }
+
+  if (best_dim == -1) {
+    /* All emitters have the same centroid. */
+    return (start + end) / 2;
+  }
+
+  const LightTreeBinning binning(best_dim, centroid_bbox.min[best_dim], extent[best_dim]);
+  vector<LightTreeEmitter>::iterator middle = std::partition(emitters.begin() + start,
+                                                             emitters.begin() + end,
+                                                             LightTreeSplitPredicate(binning,
+                                                                                     best_bin));
+
+  return middle - emitters.begin();
+}
+
+CCL_NAMESPACE_END
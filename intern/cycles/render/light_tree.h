@@ -0,0 +1,82 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "kernel/kernel_types.h"
+
+#include "util/util_boundbox.h"
+#include "util/util_math.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Bounds of the orientation of emitters: their normals are within theta_o around the axis, and
+ * they emit light within theta_e around their normal. */
+struct LightTreeCone {
+  float3 axis;
+  float theta_o;
+  float theta_e;
+
+  LightTreeCone() : axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(M_PI_F), theta_e(M_PI_2_F)
+  {
+  }
+
+  LightTreeCone(const float3 &axis, float theta_o, float theta_e)
+      : axis(axis), theta_o(theta_o), theta_e(theta_e)
+  {
+  }
+
+  /* Smallest cone containing both cones. */
+  static LightTreeCone merge(const LightTreeCone &a, const LightTreeCone &b);
+
+  /* Solid angle measure of the directions in which light is emitted. */
+  float measure() const;
+};
+
+/* Emitter of the light distribution with a position. */
+struct LightTreeEmitter {
+  BoundBox bbox;
+  LightTreeCone cone;
+  float energy;
+  /* Index in the light distribution. */
+  int index;
+
+  LightTreeEmitter(const BoundBox &bbox, const LightTreeCone &cone, float energy, int index)
+      : bbox(bbox), cone(cone), energy(energy), index(index)
+  {
+  }
+};
+
+/* Bounding volume hierarchy over emitters with one emitter per leaf, split using the surface
+ * area orientation heuristic. */
+class LightTree {
+ public:
+  explicit LightTree(vector<LightTreeEmitter> &emitters);
+
+  /* Nodes in depth first order, ready to be copied to the device. */
+  vector<KernelLightTreeNode> nodes;
+
+ protected:
+  int recursive_build(vector<LightTreeEmitter> &emitters, int start, int end, int parent);
+  int find_split(vector<LightTreeEmitter> &emitters, int start, int end, const BoundBox &bbox);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
@@ -34,10 +34,12 @@
 #include "subd/subd_split.h"
 #include "subd/subd_patch_table.h"
 
+#include "util/util_atomic.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
 #include "util/util_set.h"
+#include "util/util_time.h"
 
 #ifdef WITH_EMBREE
 #  include "bvh/bvh_embree.h"
@@ -1054,8 +1056,13 @@ void Mesh::pack_patches(uint *patch_data, uint vert_offset, uint face_offset, ui
   }
 }
 
-void Mesh::compute_bvh(
-    Device *device, DeviceScene *dscene, SceneParams *params, Progress *progress, int n, int total)
+void Mesh::compute_bvh(Device *device,
+                       DeviceScene *dscene,
+                       SceneParams *params,
+                       Progress *progress,
+                       int n,
+                       int total,
+                       BVHStats *stats)
 {
   if (progress->get_cancel())
     return;
@@ -1079,15 +1086,33 @@ void Mesh::compute_bvh(
     vector<Object *> objects;
     objects.push_back(&object);
 
-    if (bvh && !need_update_rebuild) {
+    bool rebuild = (bvh == NULL || need_update_rebuild);
+
+    if (!rebuild) {
       progress->set_status(msg, "Refitting BVH");
 
       bvh->meshes = meshes;
       bvh->objects = objects;
 
       bvh->refit(*progress);
+
+      /* Refitting keeps the topology of the tree, which gets slow to traverse once the mesh
+       * deformed too much since it was built. */
+      if (bvh->need_rebuild(params->bvh_refit_threshold)) {
+        VLOG(1) << "Rebuilding BVH of mesh " << name << ", refitted cost " << bvh->sah_cost
+                << " exceeds built cost " << bvh->build_sah_cost;
+        atomic_fetch_and_add_z(&stats->meshes_rebuilt, 1);
+        rebuild = true;
+      }
+      else {
+        atomic_fetch_and_add_z(&stats->meshes_refitted, 1);
+      }
     }
     else {
+      atomic_fetch_and_add_z(&stats->meshes_built, 1);
+    }
+
+    if (rebuild) {
       progress->set_status(msg, "Building BVH");
 
       BVHParams bparams;
@@ -1976,6 +2001,8 @@ void MeshManager::device_update_bvh(Device *device,
   /* bvh build */
   progress.set_status("Updating Scene BVH", "Building");
 
+  scoped_timer timer(&bvh_stats.scene_time);
+
   BVHParams bparams;
   bparams.top_level = true;
   bparams.bvh_layout = BVHParams::best_bvh_layout(scene->params.bvh_layout,
@@ -2138,6 +2165,7 @@ void MeshManager::device_update_displacement_images(Device *device,
       }
     }
   }
+  image_manager->device_update_texture_cache(device);
   foreach (int slot, bump_images) {
     pool.push(function_bind(
         &ImageManager::device_update_slot, image_manager, device, scene, slot, &progress));
@@ -2182,6 +2210,9 @@ void MeshManager::device_update(Device *device,
                                 Scene *scene,
                                 Progress &progress)
 {
+  /* Statistics are of the last update, nothing was built when there is none. */
+  bvh_stats = BVHStats();
+
   if (!need_update)
     return;
 
@@ -2304,13 +2335,22 @@ void MeshManager::device_update(Device *device,
       return;
   }
 
+  scoped_timer bvh_timer;
+
   TaskPool pool;
 
   size_t i = 0;
   foreach (Mesh *mesh, scene->meshes) {
     if (mesh->need_update) {
-      pool.push(function_bind(
-          &Mesh::compute_bvh, mesh, device, dscene, &scene->params, &progress, i, num_bvh));
+      pool.push(function_bind(&Mesh::compute_bvh,
+                              mesh,
+                              device,
+                              dscene,
+                              &scene->params,
+                              &progress,
+                              i,
+                              num_bvh,
+                              &bvh_stats));
       if (mesh->need_build_bvh(bvh_layout)) {
         i++;
       }
@@ -2321,6 +2361,8 @@ void MeshManager::device_update(Device *device,
   pool.wait_work(&summary);
   VLOG(2) << "Objects BVH build pool statistics:\n" << summary.full_report();
 
+  bvh_stats.mesh_time = bvh_timer.get_time();
+
   foreach (Shader *shader, scene->shaders) {
     shader->need_update_mesh = false;
   }
@@ -2341,6 +2383,8 @@ void MeshManager::device_update(Device *device,
   if (progress.get_cancel())
     return;
 
+  VLOG(1) << "BVH update statistics:\n" << bvh_stats.full_report();
+
   device_update_mesh(device, dscene, scene, false, progress);
   if (progress.get_cancel())
     return;
@@ -2412,6 +2456,7 @@ void MeshManager::collect_statistics(const Scene *scene, RenderStats *stats)
     stats->mesh.geometry.add_entry(
         NamedSizeEntry(string(mesh->name.c_str()), mesh->get_total_size_in_bytes()));
   }
+  stats->mesh.bvh = bvh_stats;
 }
 
 bool Mesh::need_attribute(Scene *scene, AttributeStandard std)
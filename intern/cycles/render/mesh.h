@@ -22,6 +22,7 @@
 #include "bvh/bvh_params.h"
 #include "render/attribute.h"
 #include "render/shader.h"
+#include "render/stats.h"
 
 #include "util/util_array.h"
 #include "util/util_boundbox.h"
@@ -333,7 +334,8 @@ class Mesh : public Node {
                    SceneParams *params,
                    Progress *progress,
                    int n,
-                   int total);
+                   int total,
+                   BVHStats *stats);
 
   bool need_attribute(Scene *scene, AttributeStandard std);
   bool need_attribute(Scene *scene, ustring name);
@@ -399,6 +401,9 @@ class MeshManager {
   void collect_statistics(const Scene *scene, RenderStats *stats);
 
  protected:
+  /* Statistics of the last BVH update. */
+  BVHStats bvh_stats;
+
   /* Calculate verts/triangles/curves offsets in global arrays. */
   void mesh_calc_offset(Scene *scene);
 
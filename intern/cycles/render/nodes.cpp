@@ -266,6 +266,9 @@ NODE_DEFINE(ImageTextureNode)
   SOCKET_FLOAT(projection_blend, "Projection Blend", 0.0f);
 
   SOCKET_IN_POINT(vector, "Vector", make_float3(0.0f, 0.0f, 0.0f), SocketType::LINK_TEXTURE_UV);
+  /* Vector shifted by ray differentials, see ShaderGraph::refine_image_texture_nodes(). */
+  SOCKET_IN_POINT(vector_dx, "VectorDX", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
+  SOCKET_IN_POINT(vector_dy, "VectorDY", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
 
   SOCKET_OUT_COLOR(color, "Color");
   SOCKET_OUT_FLOAT(alpha, "Alpha");
@@ -413,8 +416,25 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
 
   if (has_image) {
     int vector_offset = tex_mapping.compile_begin(compiler, vector_in);
-    uint flags = 0;
 
+    /* Differentials for the texture cache to pick mip levels. */
+    ShaderInput *vector_dx_in = input("VectorDX");
+    ShaderInput *vector_dy_in = input("VectorDY");
+    const bool use_differentials = (vector_dx_in->link && vector_dy_in->link);
+    int vector_dx_offset = SVM_STACK_INVALID;
+    int vector_dy_offset = SVM_STACK_INVALID;
+    if (use_differentials) {
+      vector_dx_offset = tex_mapping.compile_begin(compiler, vector_dx_in);
+      vector_dy_offset = tex_mapping.compile_begin(compiler, vector_dy_in);
+    }
+    else {
+      /* Box projection and texture coordinates without differentials. */
+      foreach (int slot, slots) {
+        image_manager->tag_image_without_differentials(slot);
+      }
+    }
+
+    uint flags = 0;
     if (compress_as_srgb) {
       flags |= NODE_IMAGE_COMPRESS_AS_SRGB;
     }
@@ -444,7 +464,7 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
                                                compiler.stack_assign_if_linked(color_out),
                                                compiler.stack_assign_if_linked(alpha_out),
                                                flags),
-                        projection);
+                        compiler.encode_uchar4(projection, vector_dx_offset, vector_dy_offset));
 
       if (num_nodes > 0) {
         for (int i = 0; i < num_nodes; i++) {
@@ -474,6 +494,10 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
                         __float_as_int(projection_blend));
     }
 
+    if (use_differentials) {
+      tex_mapping.compile_end(compiler, vector_dx_in, vector_dx_offset);
+      tex_mapping.compile_end(compiler, vector_dy_in, vector_dy_offset);
+    }
     tex_mapping.compile_end(compiler, vector_in, vector_offset);
   }
   else {
@@ -647,6 +671,8 @@ void EnvironmentTextureNode::compile(SVMCompiler &compiler)
       flags |= NODE_IMAGE_COMPRESS_AS_SRGB;
     }
 
+    image_manager->tag_image_without_differentials(slots[0]);
+
     compiler.add_node(NODE_TEX_ENVIRONMENT,
                       slots[0],
                       compiler.encode_uchar4(vector_offset,
@@ -73,6 +73,9 @@ DeviceScene::DeviceScene(Device *device)
       lights(device, "__lights", MEM_TEXTURE),
       light_background_marginal_cdf(device, "__light_background_marginal_cdf", MEM_TEXTURE),
       light_background_conditional_cdf(device, "__light_background_conditional_cdf", MEM_TEXTURE),
+      light_tree_nodes(device, "__light_tree_nodes", MEM_TEXTURE),
+      light_tree_emitters(device, "__light_tree_emitters", MEM_TEXTURE),
+      light_tree_objects(device, "__light_tree_objects", MEM_TEXTURE),
       particles(device, "__particles", MEM_TEXTURE),
       svm_nodes(device, "__svm_nodes", MEM_TEXTURE),
       shaders(device, "__shaders", MEM_TEXTURE),
@@ -107,6 +110,10 @@ Scene::Scene(const SceneParams &params_, Device *device)
     shader_manager = ShaderManager::create(this, params.shadingsystem);
   else
     shader_manager = ShaderManager::create(this, SHADINGSYSTEM_SVM);
+
+  /* OSL has its own texture system. */
+  image_manager->set_texture_cache(params.use_texture_cache && !shader_manager->use_osl(),
+                                   (size_t)params.texture_cache_size * 1024 * 1024);
 }
 
 Scene::~Scene()
@@ -20,6 +20,7 @@
 #include "render/buffers.h"
 #include "render/camera.h"
 #include "device/device.h"
+#include "render/film.h"
 #include "render/graph.h"
 #include "render/integrator.h"
 #include "render/light.h"
@@ -465,6 +466,12 @@ void Session::release_tile(RenderTile &rtile)
 
   progress.add_finished_tile(rtile.task == RenderTile::DENOISE);
 
+  if (rtile.task == RenderTile::PATH_TRACE) {
+    const int64_t tile_pixels = (int64_t)rtile.w * rtile.h;
+    adaptive_sampling_stats.add_tile(
+        tile_pixels, rtile.pixel_samples, tile_pixels * rtile.num_samples);
+  }
+
   bool delete_tile;
 
   if (tile_manager.finish_tile(rtile.tile_index, delete_tile)) {
@@ -1025,6 +1032,11 @@ void Session::render()
   task.requested_tile_size = params.tile_size;
   task.passes_size = tile_manager.params.get_passes_size();
 
+  task.adaptive_sampling.use = Pass::contains(scene->film->passes, PASS_ADAPTIVE_AUX_BUFFER) &&
+                               device->info.has_adaptive_sampling && !params.progressive;
+  task.adaptive_sampling.min_samples = scene->dscene.data.integrator.adaptive_min_samples;
+  task.adaptive_sampling.adaptive_step = scene->dscene.data.integrator.adaptive_step;
+
   if (params.run_denoising) {
     task.denoising = params.denoising;
 
@@ -1129,6 +1141,12 @@ void Session::collect_statistics(RenderStats *render_stats)
   if (params.use_profiling && (params.device.type == DEVICE_CPU)) {
     render_stats->collect_profiling(scene, profiler);
   }
+  if (Pass::contains(scene->film->passes, PASS_ADAPTIVE_AUX_BUFFER) &&
+      device->info.has_adaptive_sampling) {
+    thread_scoped_lock tile_lock(tile_mutex);
+    render_stats->has_adaptive_sampling = true;
+    render_stats->adaptive_sampling = adaptive_sampling_stats;
+  }
 }
 
 int Session::get_max_closure_count()
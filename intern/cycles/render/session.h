@@ -219,6 +219,9 @@ class Session {
 
   double reset_time;
 
+  /* Samples taken by finished tiles, protected by tile_mutex. */
+  AdaptiveSamplingStats adaptive_sampling_stats;
+
   /* progressive refine */
   double last_update_time;
   bool update_progressive_refine(bool cancel);
@@ -196,6 +196,26 @@ string NamedSampleCountStats::full_report(int indent_level)
   return result;
 }
 
+/* BVH statistics. */
+
+BVHStats::BVHStats()
+    : meshes_built(0), meshes_refitted(0), meshes_rebuilt(0), mesh_time(0.0), scene_time(0.0)
+{
+}
+
+string BVHStats::full_report(int indent_level)
+{
+  const string indent(indent_level * kIndentNumSpaces, ' ');
+  string result = "";
+  result += indent + string_printf("Meshes: %d built, %d refitted, %d rebuilt after refit\n",
+                                   (int)meshes_built,
+                                   (int)meshes_refitted,
+                                   (int)meshes_rebuilt);
+  result += indent + string_printf("Mesh BVH time: %.2f seconds\n", mesh_time);
+  result += indent + string_printf("Scene BVH time: %.2f seconds\n", scene_time);
+  return result;
+}
+
 /* Mesh statistics. */
 
 MeshStats::MeshStats()
@@ -207,6 +227,7 @@ string MeshStats::full_report(int indent_level)
   const string indent(indent_level * kIndentNumSpaces, ' ');
   string result = "";
   result += indent + "Geometry:\n" + geometry.full_report(indent_level + 1);
+  result += indent + "BVH:\n" + bvh.full_report(indent_level + 1);
   return result;
 }
 
@@ -224,11 +245,44 @@ string ImageStats::full_report(int indent_level)
   return result;
 }
 
+/* Adaptive sampling statistics. */
+
+AdaptiveSamplingStats::AdaptiveSamplingStats()
+    : pixels(0), pixel_samples(0), max_pixel_samples(0)
+{
+}
+
+void AdaptiveSamplingStats::add_tile(int64_t tile_pixels,
+                                     int64_t tile_pixel_samples,
+                                     int64_t tile_max_pixel_samples)
+{
+  pixels += tile_pixels;
+  pixel_samples += tile_pixel_samples;
+  max_pixel_samples += tile_max_pixel_samples;
+}
+
+string AdaptiveSamplingStats::full_report(int indent_level)
+{
+  const string indent(indent_level * kIndentNumSpaces, ' ');
+  string result = "";
+  if (pixels == 0 || max_pixel_samples == 0) {
+    return result;
+  }
+  result += indent + string_printf("Effective samples per pixel: %.2f\n",
+                                   (double)pixel_samples / pixels);
+  result += indent + string_printf("Samples taken: %.2f%% of %.2f per pixel\n",
+                                   100.0 * pixel_samples / max_pixel_samples,
+                                   (double)max_pixel_samples / pixels);
+  return result;
+}
+
 /* Overall statistics. */
 
 RenderStats::RenderStats()
 {
   has_profiling = false;
+  has_adaptive_sampling = false;
+  has_texture_cache = false;
 }
 
 void RenderStats::collect_profiling(Scene *scene, Profiler &prof)
@@ -306,6 +360,12 @@ string RenderStats::full_report()
   string result = "";
   result += "Mesh statistics:\n" + mesh.full_report(1);
   result += "Image statistics:\n" + image.full_report(1);
+  if (has_texture_cache) {
+    result += "Texture cache statistics:\n" + texture_cache.full_report(1);
+  }
+  if (has_adaptive_sampling) {
+    result += "Adaptive sampling statistics:\n" + adaptive_sampling.full_report(1);
+  }
   if (has_profiling) {
     result += "Kernel statistics:\n" + kernel.full_report(1);
     result += "Shader statistics:\n" + shaders.full_report(1);
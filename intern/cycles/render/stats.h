@@ -21,6 +21,7 @@
 
 #include "util/util_stats.h"
 #include "util/util_string.h"
+#include "util/util_texture_cache.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
@@ -110,6 +111,24 @@ class NamedSampleCountStats {
 };
 
 /* Statistics about mesh in the render database. */
+class BVHStats {
+ public:
+  BVHStats();
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  /* Meshes of which the BVH was built, refitted, or rebuilt because refitting degraded it
+   * too much. */
+  size_t meshes_built;
+  size_t meshes_refitted;
+  size_t meshes_rebuilt;
+
+  /* Time spent on the BVH of meshes and on the BVH of the scene, in seconds. */
+  double mesh_time;
+  double scene_time;
+};
+
 class MeshStats {
  public:
   MeshStats();
@@ -122,6 +141,10 @@ class MeshStats {
    * memory like BVH.
    */
   NamedSizeStats geometry;
+
+  /* Statistics of the last BVH update, which for animation renders with persistent data is the
+   * update for the current frame. */
+  BVHStats bvh;
 };
 
 /* Statistics about images held in memory. */
@@ -135,6 +158,23 @@ class ImageStats {
   NamedSizeStats textures;
 };
 
+/* Statistics about the samples taken with adaptive sampling. */
+class AdaptiveSamplingStats {
+ public:
+  AdaptiveSamplingStats();
+
+  void add_tile(int64_t tile_pixels, int64_t tile_pixel_samples, int64_t tile_max_pixel_samples);
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  int64_t pixels;
+  /* Samples taken by all pixels together, and the samples they would have taken without
+   * adaptive sampling. */
+  int64_t pixel_samples;
+  int64_t max_pixel_samples;
+};
+
 /* Render process statistics. */
 class RenderStats {
  public:
@@ -147,9 +187,13 @@ class RenderStats {
   void collect_profiling(Scene *scene, Profiler &prof);
 
   bool has_profiling;
+  bool has_adaptive_sampling;
+  bool has_texture_cache;
 
   MeshStats mesh;
   ImageStats image;
+  TextureCacheStats texture_cache;
+  AdaptiveSamplingStats adaptive_sampling;
   NamedNestedSampleStats kernel;
   NamedSampleCountStats shaders;
   NamedSampleCountStats objects;
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+
+#include "util/util_progress.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Large enough for the top nodes to be binned and split by multiple threads. */
+const int TEST_MESH_RESOLUTION = 256;
+
+/* Displaced grid, so that triangles have varying sizes and orientations. */
+Mesh *create_test_mesh(int resolution)
+{
+  Mesh *mesh = new Mesh();
+  mesh->reserve_mesh((resolution + 1) * (resolution + 1), 2 * resolution * resolution);
+
+  for (int y = 0; y <= resolution; y++) {
+    for (int x = 0; x <= resolution; x++) {
+      const float z = 8.0f * sinf(0.37f * x) * cosf(0.23f * y);
+      mesh->add_vertex(make_float3((float)x, (float)y, z));
+    }
+  }
+
+  for (int y = 0; y < resolution; y++) {
+    for (int x = 0; x < resolution; x++) {
+      const int v0 = y * (resolution + 1) + x;
+      const int v1 = v0 + 1;
+      const int v2 = v1 + resolution + 1;
+      const int v3 = v0 + resolution + 1;
+      mesh->add_triangle(v0, v1, v2, 0, false);
+      mesh->add_triangle(v0, v2, v3, 0, false);
+    }
+  }
+
+  return mesh;
+}
+
+/* Build the BVH of the mesh and return the build time in seconds. */
+double build_bvh(Mesh *mesh, BVHLayout layout, bool use_spatial_split, PackedBVH *pack)
+{
+  Object object;
+  object.mesh = mesh;
+
+  vector<Mesh *> meshes;
+  meshes.push_back(mesh);
+  vector<Object *> objects;
+  objects.push_back(&object);
+
+  BVHParams params;
+  params.bvh_layout = layout;
+  params.use_spatial_split = use_spatial_split;
+
+  BVH *bvh = BVH::create(params, meshes, objects);
+  Progress progress;
+
+  const double start_time = time_dt();
+  bvh->build(progress);
+  const double build_time = time_dt() - start_time;
+
+  *pack = bvh->pack;
+  delete bvh;
+
+  return build_time;
+}
+
+/* Every triangle is referenced once, or more often when split spatially. */
+void expect_all_triangles(const PackedBVH &pack, size_t num_triangles, bool use_spatial_split)
+{
+  vector<int> num_references(num_triangles, 0);
+  for (size_t i = 0; i < pack.prim_index.size(); i++) {
+    ASSERT_GE(pack.prim_index[i], 0);
+    ASSERT_LT(pack.prim_index[i], (int)num_triangles);
+    num_references[pack.prim_index[i]]++;
+  }
+
+  for (size_t i = 0; i < num_triangles; i++) {
+    if (use_spatial_split) {
+      EXPECT_GE(num_references[i], 1);
+    }
+    else {
+      EXPECT_EQ(num_references[i], 1);
+    }
+  }
+}
+
+void test_build(bool use_spatial_split)
+{
+  TaskScheduler::init(0);
+  Mesh *mesh = create_test_mesh(TEST_MESH_RESOLUTION);
+
+  const BVHLayout layouts[] = {BVH_LAYOUT_BVH2, BVH_LAYOUT_BVH4, BVH_LAYOUT_BVH8};
+  for (int i = 0; i < 3; i++) {
+    PackedBVH pack;
+    const double build_time = build_bvh(mesh, layouts[i], use_spatial_split, &pack);
+    printf("%s %s build of %d triangles on %d threads: %.3f seconds\n",
+           bvh_layout_name(layouts[i]),
+           use_spatial_split ? "spatial split" : "binned",
+           (int)mesh->num_triangles(),
+           TaskScheduler::num_threads(),
+           build_time);
+
+    EXPECT_GT(pack.nodes.size(), (size_t)0);
+    expect_all_triangles(pack, mesh->num_triangles(), use_spatial_split);
+  }
+
+  delete mesh;
+  TaskScheduler::exit();
+}
+
+}  // namespace
+
+TEST(bvh_build, binned)
+{
+  test_build(false);
+}
+
+TEST(bvh_build, spatial_split)
+{
+  test_build(true);
+}
+
+/* The binned build gives the same tree for any number of threads. */
+TEST(bvh_build, binned_deterministic)
+{
+  Mesh *mesh = create_test_mesh(TEST_MESH_RESOLUTION);
+
+  TaskScheduler::init(1);
+  PackedBVH single_pack;
+  const double single_time = build_bvh(mesh, BVH_LAYOUT_BVH2, false, &single_pack);
+  TaskScheduler::exit();
+
+  TaskScheduler::init(0);
+  PackedBVH multi_pack;
+  const double multi_time = build_bvh(mesh, BVH_LAYOUT_BVH2, false, &multi_pack);
+  const int num_threads = TaskScheduler::num_threads();
+  TaskScheduler::exit();
+
+  printf("BVH2 binned build: %.3f seconds on 1 thread, %.3f seconds on %d threads\n",
+         single_time,
+         multi_time,
+         num_threads);
+
+  EXPECT_TRUE(single_pack.prim_index == multi_pack.prim_index);
+  EXPECT_TRUE(single_pack.nodes == multi_pack.nodes);
+  EXPECT_TRUE(single_pack.leaf_nodes == multi_pack.leaf_nodes);
+
+  delete mesh;
+}
+
+CCL_NAMESPACE_END
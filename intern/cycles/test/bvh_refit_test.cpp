@@ -0,0 +1,145 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+#include "render/scene.h"
+
+#include "util/util_progress.h"
+#include "util/util_task.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+const int TEST_MESH_RESOLUTION = 64;
+
+/* Grid of separate quads, so that vertices can be moved without stretching other quads. */
+Mesh *create_test_mesh(int resolution)
+{
+  Mesh *mesh = new Mesh();
+  mesh->reserve_mesh(4 * resolution * resolution, 2 * resolution * resolution);
+
+  for (int y = 0; y < resolution; y++) {
+    for (int x = 0; x < resolution; x++) {
+      const int v0 = mesh->verts.size();
+      mesh->add_vertex(make_float3(x, y, 0.0f));
+      mesh->add_vertex(make_float3(x + 0.9f, y, 0.0f));
+      mesh->add_vertex(make_float3(x + 0.9f, y + 0.9f, 0.0f));
+      mesh->add_vertex(make_float3(x, y + 0.9f, 0.0f));
+      mesh->add_triangle(v0, v0 + 1, v0 + 2, 0, false);
+      mesh->add_triangle(v0, v0 + 2, v0 + 3, 0, false);
+    }
+  }
+
+  return mesh;
+}
+
+/* Move every quad by the same offset, or swap the positions of quads far apart. The first keeps
+ * the tree as good as when built, the second makes its nodes span large parts of the grid. */
+void deform_test_mesh(Mesh *mesh, bool shuffle)
+{
+  const int num_quads = mesh->verts.size() / 4;
+  const float3 *verts = mesh->verts.data();
+  array<float3> new_verts(mesh->verts.size());
+
+  for (int i = 0; i < num_quads; i++) {
+    const int j = shuffle ? (i * 7919) % num_quads : i;
+    const float3 offset = shuffle ? verts[4 * j] - verts[4 * i] : make_float3(0.0f, 0.0f, 1.0f);
+    for (int k = 0; k < 4; k++) {
+      new_verts[4 * i + k] = verts[4 * i + k] + offset;
+    }
+  }
+
+  mesh->verts.steal_data(new_verts);
+}
+
+void test_refit(BVHLayout layout)
+{
+  TaskScheduler::init(0);
+  Mesh *mesh = create_test_mesh(TEST_MESH_RESOLUTION);
+
+  Object object;
+  object.mesh = mesh;
+  vector<Mesh *> meshes;
+  meshes.push_back(mesh);
+  vector<Object *> objects;
+  objects.push_back(&object);
+
+  BVHParams params;
+  params.bvh_layout = layout;
+  const float threshold = SceneParams().bvh_refit_threshold;
+
+  BVH *bvh = BVH::create(params, meshes, objects);
+  Progress progress;
+  bvh->build(progress);
+
+  const float build_cost = bvh->build_sah_cost;
+  EXPECT_GT(build_cost, 0.0f);
+  EXPECT_EQ(bvh->sah_cost, build_cost);
+  EXPECT_FALSE(bvh->need_rebuild(threshold));
+
+  /* Refitting the same positions gives the cost of the built tree. */
+  bvh->refit(progress);
+  EXPECT_NEAR(bvh->sah_cost, build_cost, build_cost * 0.1f);
+  EXPECT_FALSE(bvh->need_rebuild(threshold));
+
+  /* Moving everything together keeps the tree as good. */
+  deform_test_mesh(mesh, false);
+  bvh->refit(progress);
+  EXPECT_NEAR(bvh->sah_cost, build_cost, build_cost * 0.1f);
+  EXPECT_FALSE(bvh->need_rebuild(threshold));
+
+  /* Quads moved far from their neighbors in the tree make it slow to traverse. */
+  deform_test_mesh(mesh, true);
+  bvh->refit(progress);
+  printf("%s refitted cost %.2f of built cost %.2f\n",
+         bvh_layout_name(layout),
+         bvh->sah_cost,
+         build_cost);
+  EXPECT_GT(bvh->sah_cost, build_cost * threshold);
+  EXPECT_TRUE(bvh->need_rebuild(threshold));
+  EXPECT_FALSE(bvh->need_rebuild(bvh->sah_cost / build_cost + 0.1f));
+
+  delete bvh;
+  delete mesh;
+  TaskScheduler::exit();
+}
+
+}  // namespace
+
+TEST(bvh_refit, bvh2)
+{
+  test_refit(BVH_LAYOUT_BVH2);
+}
+
+TEST(bvh_refit, bvh4)
+{
+  test_refit(BVH_LAYOUT_BVH4);
+}
+
+TEST(bvh_refit, bvh8)
+{
+  test_refit(BVH_LAYOUT_BVH8);
+}
+
+CCL_NAMESPACE_END
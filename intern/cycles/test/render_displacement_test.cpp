@@ -0,0 +1,170 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "device/device.h"
+
+#include "render/colorspace.h"
+#include "render/graph.h"
+#include "render/mesh.h"
+#include "render/nodes.h"
+#include "render/object.h"
+#include "render/scene.h"
+#include "render/shader.h"
+#include "render/stats.h"
+
+#include "util/util_image.h"
+#include "util/util_path.h"
+#include "util/util_progress.h"
+#include "util/util_task.h"
+#include "util/util_unique_ptr.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+const int TEST_IMAGE_SIZE = 64;
+const int TEST_MESH_RESOLUTION = 8;
+const float TEST_HEIGHT = 1.0f;
+
+/* Single channel float image with the same height everywhere. */
+bool write_test_image(const string &filepath)
+{
+  unique_ptr<ImageOutput> out = unique_ptr<ImageOutput>(ImageOutput::create(filepath));
+  if (!out) {
+    return false;
+  }
+
+  vector<float> pixels(TEST_IMAGE_SIZE * TEST_IMAGE_SIZE, TEST_HEIGHT);
+  ImageSpec spec(TEST_IMAGE_SIZE, TEST_IMAGE_SIZE, 1, TypeDesc::FLOAT);
+  if (!(out->open(filepath, spec) && out->write_image(TypeDesc::FLOAT, &pixels[0]))) {
+    return false;
+  }
+  out->close();
+  return true;
+}
+
+}  // namespace
+
+/* Images used by true displacement are read before the image manager updates the device, with
+ * and without the texture cache. */
+class RenderDisplacement : public testing::TestWithParam<bool> {
+ protected:
+  Stats stats;
+  Profiler profiler;
+  DeviceInfo device_info;
+  Device *device_cpu;
+  SceneParams scene_params;
+  Scene *scene;
+  string filepath;
+
+  virtual void SetUp()
+  {
+    TaskScheduler::init(0);
+
+    filepath = "cycles_displacement_height.exr";
+    ASSERT_TRUE(write_test_image(filepath));
+
+    scene_params.use_texture_cache = GetParam();
+    device_cpu = Device::create(device_info, stats, profiler, true);
+    scene = new Scene(scene_params, device_cpu);
+    EXPECT_EQ(scene->image_manager->has_texture_cache(), GetParam());
+  }
+
+  virtual void TearDown()
+  {
+    delete scene;
+    delete device_cpu;
+    path_remove(filepath);
+    TaskScheduler::exit();
+  }
+
+  /* Image texture connected to the height of a displacement node. */
+  Shader *add_displacement_shader()
+  {
+    ShaderGraph *graph = new ShaderGraph();
+
+    ImageTextureNode *image = new ImageTextureNode();
+    image->filename = ustring(filepath);
+    image->colorspace = u_colorspace_raw;
+    graph->add(image);
+
+    DisplacementNode *displacement = new DisplacementNode();
+    graph->add(displacement);
+
+    graph->connect(image->output("Color"), displacement->input("Height"));
+    graph->connect(displacement->output("Displacement"), graph->output()->input("Displacement"));
+
+    Shader *shader = new Shader();
+    shader->name = "displacement";
+    shader->displacement_method = DISPLACE_TRUE;
+    shader->set_graph(graph);
+    shader->tag_update(scene);
+    scene->shaders.push_back(shader);
+    return shader;
+  }
+
+  /* Flat grid facing up. */
+  Mesh *add_mesh(Shader *shader)
+  {
+    Mesh *mesh = new Mesh();
+    mesh->used_shaders.push_back(shader);
+
+    const int resolution = TEST_MESH_RESOLUTION;
+    for (int y = 0; y <= resolution; y++) {
+      for (int x = 0; x <= resolution; x++) {
+        mesh->add_vertex(make_float3((float)x, (float)y, 0.0f));
+      }
+    }
+    for (int y = 0; y < resolution; y++) {
+      for (int x = 0; x < resolution; x++) {
+        const int v0 = y * (resolution + 1) + x;
+        const int v1 = v0 + 1;
+        const int v2 = v1 + resolution + 1;
+        const int v3 = v0 + resolution + 1;
+        mesh->add_triangle(v0, v1, v2, 0, false);
+        mesh->add_triangle(v0, v2, v3, 0, false);
+      }
+    }
+    scene->meshes.push_back(mesh);
+
+    Object *object = new Object();
+    object->mesh = mesh;
+    object->tfm = transform_identity();
+    scene->objects.push_back(object);
+    return mesh;
+  }
+};
+
+TEST_P(RenderDisplacement, image_height)
+{
+  Mesh *mesh = add_mesh(add_displacement_shader());
+
+  Progress progress;
+  scene->device_update(device_cpu, progress);
+
+  /* Height of 1 with the default midlevel of 0.5 and scale of 1, along the normal. */
+  ASSERT_EQ(mesh->verts.size(), (TEST_MESH_RESOLUTION + 1) * (TEST_MESH_RESOLUTION + 1));
+  for (size_t i = 0; i < mesh->verts.size(); i++) {
+    EXPECT_NEAR(mesh->verts[i].z, 0.5f, 1e-5f);
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(TextureCache, RenderDisplacement, testing::Bool());
+
+CCL_NAMESPACE_END
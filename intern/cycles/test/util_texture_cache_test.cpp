@@ -0,0 +1,162 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_foreach.h"
+#include "util/util_image.h"
+#include "util/util_math.h"
+#include "util/util_path.h"
+#include "util/util_texture_cache.h"
+#include "util/util_unique_ptr.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+const int TEST_IMAGE_SIZE = 64;
+const size_t TEST_CACHE_SIZE = 16 * 1024 * 1024;
+
+/* Float image filled with the same pixel, or a checkerboard of it and zero pixels. */
+string write_test_image(const string &name, const float *pixel, int channels, bool checker)
+{
+  const string filepath = "cycles_texture_cache_" + name;
+
+  vector<float> pixels(TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * channels);
+  for (int y = 0; y < TEST_IMAGE_SIZE; y++) {
+    for (int x = 0; x < TEST_IMAGE_SIZE; x++) {
+      const bool zero = checker && ((x + y) % 2);
+      for (int c = 0; c < channels; c++) {
+        pixels[(y * TEST_IMAGE_SIZE + x) * channels + c] = zero ? 0.0f : pixel[c];
+      }
+    }
+  }
+
+  unique_ptr<ImageOutput> out = unique_ptr<ImageOutput>(ImageOutput::create(filepath));
+  EXPECT_TRUE(out);
+  if (!out) {
+    return filepath;
+  }
+
+  ImageSpec spec(TEST_IMAGE_SIZE, TEST_IMAGE_SIZE, channels, TypeDesc::FLOAT);
+  EXPECT_TRUE(out->open(filepath, spec));
+  EXPECT_TRUE(out->write_image(TypeDesc::FLOAT, &pixels[0]));
+  out->close();
+
+  return filepath;
+}
+
+class TextureCacheTest : public testing::Test {
+ protected:
+  TextureCache *cache;
+  TextureCacheThreadData *tdata;
+  vector<string> filepaths;
+
+  void SetUp() override
+  {
+    cache = new TextureCache(TEST_CACHE_SIZE);
+    tdata = cache->thread_init();
+  }
+
+  void TearDown() override
+  {
+    cache->thread_free(tdata);
+    delete cache;
+    foreach (const string &filepath, filepaths) {
+      path_remove(filepath);
+    }
+  }
+
+  void add_image(int slot, const string &name, const float *pixel, int channels, bool checker)
+  {
+    const string filepath = write_test_image(name, pixel, channels, checker);
+    filepaths.push_back(filepath);
+    EXPECT_TRUE(
+        cache->add_image(slot, filepath, channels, INTERPOLATION_CLOSEST, EXTENSION_REPEAT));
+  }
+
+  float4 lookup(int slot, float2 d = make_float2(0.0f, 0.0f))
+  {
+    /* Center of a pixel, so the closest pixel is not ambiguous. */
+    const float co = (0.5f + TEST_IMAGE_SIZE / 2) / TEST_IMAGE_SIZE;
+    float4 result = make_float4(-1.0f, -1.0f, -1.0f, -1.0f);
+    EXPECT_TRUE(cache->lookup(
+        tdata, slot, co, co, make_float2(d.x, 0.0f), make_float2(0.0f, d.y), &result));
+    return result;
+  }
+};
+
+}  // namespace
+
+/* Images are expanded to RGBA the same way as images loaded into device memory. */
+TEST_F(TextureCacheTest, channels)
+{
+  const float pixel[4] = {0.25f, 0.5f, 0.75f, 0.125f};
+  add_image(0, "channels1.exr", pixel, 1, false);
+  add_image(1, "channels2.exr", pixel, 2, false);
+  add_image(2, "channels3.exr", pixel, 3, false);
+  add_image(3, "channels4.exr", pixel, 4, false);
+
+  EXPECT_TRUE(lookup(0) == make_float4(0.25f, 0.25f, 0.25f, 1.0f));
+  EXPECT_TRUE(lookup(1) == make_float4(0.25f, 0.25f, 0.25f, 0.5f));
+  EXPECT_TRUE(lookup(2) == make_float4(0.25f, 0.5f, 0.75f, 1.0f));
+  EXPECT_TRUE(lookup(3) == make_float4(0.25f, 0.5f, 0.75f, 0.125f));
+}
+
+/* Slots which are not in the cache are looked up in device memory instead. */
+TEST_F(TextureCacheTest, missing)
+{
+  const float pixel[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  add_image(1, "missing.exr", pixel, 4, false);
+
+  float4 result;
+  const float2 zero = make_float2(0.0f, 0.0f);
+  EXPECT_FALSE(cache->lookup(tdata, 0, 0.5f, 0.5f, zero, zero, &result));
+  EXPECT_FALSE(cache->lookup(tdata, 2, 0.5f, 0.5f, zero, zero, &result));
+  EXPECT_TRUE(cache->lookup(tdata, 1, 0.5f, 0.5f, zero, zero, &result));
+
+  cache->remove_image(1);
+  EXPECT_FALSE(cache->lookup(tdata, 1, 0.5f, 0.5f, zero, zero, &result));
+}
+
+/* Pixels with NaN or infinite values are zeroed, as for float images in device memory. */
+TEST_F(TextureCacheTest, non_finite)
+{
+  const float pixel_nan[4] = {NAN, 1.0f, 1.0f, 1.0f};
+  const float pixel_inf[1] = {INFINITY};
+  add_image(0, "nan.exr", pixel_nan, 4, false);
+  add_image(1, "inf.exr", pixel_inf, 1, false);
+
+  EXPECT_TRUE(lookup(0) == make_float4(0.0f, 0.0f, 0.0f, 0.0f));
+  EXPECT_TRUE(lookup(1) == make_float4(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+/* Differentials pick the mip level, a footprint covering the checkerboard averages it. */
+TEST_F(TextureCacheTest, mip_level)
+{
+  const float pixel[1] = {1.0f};
+  add_image(0, "checker.exr", pixel, 1, true);
+
+  const float4 texel = lookup(0);
+  EXPECT_TRUE(texel.x == 0.0f || texel.x == 1.0f);
+
+  const float4 average = lookup(0, make_float2(0.5f, 0.5f));
+  EXPECT_NEAR(average.x, 0.5f, 0.05f);
+  EXPECT_EQ(average.w, 1.0f);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_texture_cache.h"
+
+#include "util/util_atomic.h"
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_math.h"
+
+#include <OpenImageIO/texture.h>
+
+CCL_NAMESPACE_BEGIN
+
+struct TextureCacheImage {
+  OIIO::ustring filename;
+  OIIO::TextureSystem::TextureHandle *handle;
+  int channels;
+  OIIO::TextureOpt::InterpMode interpolation;
+  OIIO::TextureOpt::Wrap wrap;
+};
+
+struct TextureCacheThreadData {
+  OIIO::TextureSystem::Perthread *perthread;
+  OIIO::TextureOpt options;
+};
+
+namespace {
+
+OIIO::TextureOpt::InterpMode texture_cache_interpolation(InterpolationType interpolation)
+{
+  switch (interpolation) {
+    case INTERPOLATION_CLOSEST:
+      return OIIO::TextureOpt::InterpClosest;
+    case INTERPOLATION_CUBIC:
+      return OIIO::TextureOpt::InterpBicubic;
+    case INTERPOLATION_SMART:
+      return OIIO::TextureOpt::InterpSmartBicubic;
+    case INTERPOLATION_LINEAR:
+    default:
+      return OIIO::TextureOpt::InterpBilinear;
+  }
+}
+
+OIIO::TextureOpt::Wrap texture_cache_wrap(ExtensionType extension)
+{
+  switch (extension) {
+    case EXTENSION_EXTEND:
+      return OIIO::TextureOpt::WrapClamp;
+    case EXTENSION_CLIP:
+      return OIIO::TextureOpt::WrapBlack;
+    case EXTENSION_REPEAT:
+    default:
+      return OIIO::TextureOpt::WrapPeriodic;
+  }
+}
+
+/* Counters are 64 bit or 32 bit depending on the OpenImageIO version. */
+int64_t texture_cache_stat(const OIIO::TextureSystem *ts, const char *name)
+{
+  long long value64 = 0;
+  if (ts->getattribute(name, OIIO::TypeDesc::INT64, &value64)) {
+    return value64;
+  }
+  int value = 0;
+  if (ts->getattribute(name, OIIO::TypeDesc::INT, &value)) {
+    return value;
+  }
+  return 0;
+}
+
+float texture_cache_stat_time(const OIIO::TextureSystem *ts, const char *name)
+{
+  float value = 0.0f;
+  ts->getattribute(name, OIIO::TypeDesc::FLOAT, &value);
+  return value;
+}
+
+}  // namespace
+
+/* Statistics. */
+
+TextureCacheStats::TextureCacheStats()
+    : memory_used(0),
+      peak_memory_used(0),
+      memory_limit(0),
+      tile_lookups(0),
+      tile_misses(0),
+      files(0),
+      bytes_read(0),
+      load_time(0.0)
+{
+}
+
+string TextureCacheStats::full_report(int indent_level)
+{
+  const string indent(indent_level * 2, ' ');
+  string result = "";
+  result += indent + "Memory: " + string_human_readable_size(memory_used) + ", peak " +
+            string_human_readable_size(peak_memory_used) + " of " +
+            string_human_readable_size(memory_limit) + "\n";
+  if (tile_lookups > 0) {
+    result += indent + string_printf("Tile hit rate: %.2f%% of %llu lookups\n",
+                                     100.0 * (tile_lookups - tile_misses) / tile_lookups,
+                                     (unsigned long long)tile_lookups);
+  }
+  result += indent + string_printf("Files: %d, ", files) +
+            string_human_readable_size(bytes_read) +
+            string_printf(" read in %.2f seconds\n", load_time);
+  return result;
+}
+
+/* Texture cache. */
+
+TextureCache::TextureCache(size_t memory_limit)
+    : memory_limit(memory_limit), peak_memory_used(0)
+{
+  /* Private texture system, so the memory limit does not affect OSL. */
+  OIIO::TextureSystem *ts = OIIO::TextureSystem::create(false);
+  ts->attribute("max_memory_MB", (float)((double)memory_limit / (1024.0 * 1024.0)));
+  /* Read untiled and unmipped files as if they were .tx files. */
+  ts->attribute("autotile", 64);
+  ts->attribute("automip", 1);
+  texture_system = ts;
+}
+
+TextureCache::~TextureCache()
+{
+  foreach (TextureCacheImage *image, images) {
+    delete image;
+  }
+  OIIO::TextureSystem::destroy((OIIO::TextureSystem *)texture_system);
+}
+
+bool TextureCache::add_image(int slot,
+                             const string &filename,
+                             int channels,
+                             InterpolationType interpolation,
+                             ExtensionType extension)
+{
+  /* Drop tiles of a previous version of the image when reloading. */
+  remove_image(slot);
+
+  OIIO::TextureSystem *ts = (OIIO::TextureSystem *)texture_system;
+  const OIIO::ustring ufilename(filename);
+  OIIO::TextureSystem::TextureHandle *handle = ts->get_texture_handle(ufilename);
+
+  if (!handle || !ts->good(handle)) {
+    VLOG(1) << "Texture cache can't read image " << filename << ": " << ts->geterror();
+    return false;
+  }
+
+  TextureCacheImage *image = new TextureCacheImage();
+  image->filename = ufilename;
+  image->handle = handle;
+  image->channels = channels;
+  image->interpolation = texture_cache_interpolation(interpolation);
+  image->wrap = texture_cache_wrap(extension);
+
+  thread_scoped_lock images_lock(images_mutex);
+  if (slot >= (int)images.size()) {
+    images.resize(slot + 1, NULL);
+  }
+  images[slot] = image;
+
+  return true;
+}
+
+void TextureCache::remove_image(int slot)
+{
+  thread_scoped_lock images_lock(images_mutex);
+  if (slot < (int)images.size() && images[slot] != NULL) {
+    OIIO::TextureSystem *ts = (OIIO::TextureSystem *)texture_system;
+    ts->invalidate(images[slot]->filename);
+    delete images[slot];
+    images[slot] = NULL;
+  }
+}
+
+TextureCacheThreadData *TextureCache::thread_init()
+{
+  OIIO::TextureSystem *ts = (OIIO::TextureSystem *)texture_system;
+  TextureCacheThreadData *tdata = new TextureCacheThreadData();
+  tdata->perthread = ts->create_thread_info();
+  return tdata;
+}
+
+void TextureCache::thread_free(TextureCacheThreadData *tdata)
+{
+  OIIO::TextureSystem *ts = (OIIO::TextureSystem *)texture_system;
+  ts->destroy_thread_info(tdata->perthread);
+  delete tdata;
+
+  /* Render threads are freed after each task, often enough to track the peak usage without
+   * querying the texture system on every lookup. */
+  update_peak_memory();
+}
+
+bool TextureCache::lookup(TextureCacheThreadData *tdata,
+                          int slot,
+                          float x,
+                          float y,
+                          float2 dx,
+                          float2 dy,
+                          float4 *result)
+{
+  if (slot < 0 || slot >= (int)images.size() || images[slot] == NULL) {
+    return false;
+  }
+
+  const TextureCacheImage *image = images[slot];
+  OIIO::TextureSystem *ts = (OIIO::TextureSystem *)texture_system;
+  OIIO::TextureOpt &options = tdata->options;
+  options.interpmode = image->interpolation;
+  options.swrap = image->wrap;
+  options.twrap = image->wrap;
+  /* Alpha of images without alpha channel. */
+  options.fill = 1.0f;
+
+  /* Images are stored bottom to top, while the texture system looks them up top to bottom. */
+  const int channels = min(image->channels, 4);
+  float rgba[4];
+  if (!ts->texture(image->handle,
+                   tdata->perthread,
+                   options,
+                   x,
+                   1.0f - y,
+                   dx.x,
+                   -dx.y,
+                   dy.x,
+                   -dy.y,
+                   (channels == 3) ? 4 : channels,
+                   rgba)) {
+    *result = make_float4(
+        TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
+    return true;
+  }
+
+  /* Expand to RGBA the same way as images loaded into device memory. */
+  if (channels == 1) {
+    *result = make_float4(rgba[0], rgba[0], rgba[0], 1.0f);
+  }
+  else if (channels == 2) {
+    *result = make_float4(rgba[0], rgba[0], rgba[0], rgba[1]);
+  }
+  else {
+    *result = make_float4(rgba[0], rgba[1], rgba[2], rgba[3]);
+  }
+
+  /* Float images loaded into device memory have pixels with NaN or infinite values zeroed, do the
+   * same here since they would spread through filtering. */
+  if (!(isfinite_safe(result->x) && isfinite_safe(result->y) && isfinite_safe(result->z) &&
+        isfinite_safe(result->w))) {
+    *result = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+
+  return true;
+}
+
+void TextureCache::update_peak_memory()
+{
+  const OIIO::TextureSystem *ts = (const OIIO::TextureSystem *)texture_system;
+  const size_t memory_used = texture_cache_stat(ts, "stat:cache_memory_used");
+  atomic_fetch_and_update_max_z(&peak_memory_used, memory_used);
+}
+
+void TextureCache::collect_statistics(TextureCacheStats *stats)
+{
+  update_peak_memory();
+
+  const OIIO::TextureSystem *ts = (const OIIO::TextureSystem *)texture_system;
+  stats->memory_used = texture_cache_stat(ts, "stat:cache_memory_used");
+  stats->peak_memory_used = peak_memory_used;
+  stats->memory_limit = memory_limit;
+  stats->tile_lookups = texture_cache_stat(ts, "stat:find_tile_calls");
+  stats->tile_misses = texture_cache_stat(ts, "stat:find_tile_cache_misses");
+  stats->files = texture_cache_stat(ts, "stat:unique_files");
+  stats->bytes_read = texture_cache_stat(ts, "stat:bytes_read");
+  stats->load_time = texture_cache_stat_time(ts, "stat:fileio_time") +
+                     texture_cache_stat_time(ts, "stat:fileopen_time");
+}
+
+CCL_NAMESPACE_END
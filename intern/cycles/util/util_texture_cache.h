@@ -0,0 +1,104 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_TEXTURE_CACHE_H__
+#define __UTIL_TEXTURE_CACHE_H__
+
+#include "util/util_string.h"
+#include "util/util_texture.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct TextureCacheImage;
+struct TextureCacheThreadData;
+
+/* Statistics of the texture cache since it was created. */
+class TextureCacheStats {
+ public:
+  TextureCacheStats();
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  /* Memory used by tiles in the cache, at the end and at most while rendering. */
+  size_t memory_used;
+  size_t peak_memory_used;
+  size_t memory_limit;
+
+  /* Tile lookups, and how many of them had to read the tile from file. */
+  uint64_t tile_lookups;
+  uint64_t tile_misses;
+
+  /* Files opened, bytes read from them and time spent opening and reading them. */
+  int files;
+  size_t bytes_read;
+  double load_time;
+};
+
+/* Cache for images that are read on demand per tile and mip level, instead of being loaded fully
+ * into memory before rendering. The mip level is picked from texture coordinate differentials,
+ * and tiles are evicted least recently used first when exceeding the memory limit.
+ *
+ * Tiled and mipmapped files (.tx) are read most efficiently, other files are tiled and mipmapped
+ * by the cache when first used. Built on the OpenImageIO texture system, CPU only. */
+class TextureCache {
+ public:
+  explicit TextureCache(size_t memory_limit);
+  ~TextureCache();
+
+  /* Images are identified by their flat texture slot, the same as for device textures. Returns
+   * false if the file can not be read by the cache. */
+  bool add_image(int slot,
+                 const string &filename,
+                 int channels,
+                 InterpolationType interpolation,
+                 ExtensionType extension);
+  void remove_image(int slot);
+
+  /* Data for each render thread, also updates the peak memory usage when freed. */
+  TextureCacheThreadData *thread_init();
+  void thread_free(TextureCacheThreadData *tdata);
+
+  /* Filtered lookup of the image at (x, y), with the differentials of the coordinates in the
+   * screen x and y directions. Returns false if the image is not in the cache. */
+  bool lookup(TextureCacheThreadData *tdata,
+              int slot,
+              float x,
+              float y,
+              float2 dx,
+              float2 dy,
+              float4 *result);
+
+  void collect_statistics(TextureCacheStats *stats);
+
+ protected:
+  void update_peak_memory();
+
+  /* OpenImageIO texture system, opaque to keep it out of the kernel. */
+  void *texture_system;
+  size_t memory_limit;
+  size_t peak_memory_used;
+
+  thread_mutex images_mutex;
+  vector<TextureCacheImage *> images;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_TEXTURE_CACHE_H__ */
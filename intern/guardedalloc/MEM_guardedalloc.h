@@ -230,6 +230,11 @@ extern const char *(*MEM_name_ptr)(void *vmemh);
 /* Switch allocator to slower but fully guarded mode. */
 void MEM_use_guarded_allocator(void);
 
+/* Switch allocator to the mode with per-thread caches of small blocks, which scales better
+ * when many threads allocate at once. Same as the guarded mode, the switch is to happen before
+ * any allocation. */
+void MEM_use_cached_allocator(void);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
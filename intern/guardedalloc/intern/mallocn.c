@@ -130,3 +130,37 @@ void MEM_use_guarded_allocator(void)
   MEM_name_ptr = MEM_guarded_name_ptr;
 #endif
 }
+
+void MEM_use_cached_allocator(void)
+{
+  MEM_cached_init();
+
+  MEM_allocN_len = MEM_cached_allocN_len;
+  MEM_freeN = MEM_cached_freeN;
+  MEM_dupallocN = MEM_cached_dupallocN;
+  MEM_reallocN_id = MEM_cached_reallocN_id;
+  MEM_recallocN_id = MEM_cached_recallocN_id;
+  MEM_callocN = MEM_cached_callocN;
+  MEM_calloc_arrayN = MEM_cached_calloc_arrayN;
+  MEM_mallocN = MEM_cached_mallocN;
+  MEM_malloc_arrayN = MEM_cached_malloc_arrayN;
+  MEM_mallocN_aligned = MEM_cached_mallocN_aligned;
+  MEM_mapallocN = MEM_cached_mapallocN;
+  MEM_printmemlist_pydict = MEM_cached_printmemlist_pydict;
+  MEM_printmemlist = MEM_cached_printmemlist;
+  MEM_callbackmemlist = MEM_cached_callbackmemlist;
+  MEM_printmemlist_stats = MEM_cached_printmemlist_stats;
+  MEM_set_error_callback = MEM_cached_set_error_callback;
+  MEM_consistency_check = MEM_cached_consistency_check;
+  MEM_set_lock_callback = MEM_cached_set_lock_callback;
+  MEM_set_memory_debug = MEM_cached_set_memory_debug;
+  MEM_get_memory_in_use = MEM_cached_get_memory_in_use;
+  MEM_get_mapped_memory_in_use = MEM_cached_get_mapped_memory_in_use;
+  MEM_get_memory_blocks_in_use = MEM_cached_get_memory_blocks_in_use;
+  MEM_reset_peak_memory = MEM_cached_reset_peak_memory;
+  MEM_get_peak_memory = MEM_cached_get_peak_memory;
+
+#ifndef NDEBUG
+  MEM_name_ptr = MEM_cached_name_ptr;
+#endif
+}
@@ -0,0 +1,1006 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/** \file
+ * \ingroup MEM
+ *
+ * Memory allocation with per-thread caches of size-class slabs.
+ *
+ * Small blocks are carved from slabs which are shared by all threads, but allocating and freeing
+ * them only touches a cache which is local to the calling thread. Caches exchange free slots
+ * with the shared pool of the size class in batches, so the pool is only locked once per batch.
+ * Big blocks go directly to the system allocator, same as in the lock-free allocator.
+ *
+ * Statistics are counted per thread without atomics and aggregated when they are queried.
+ * Peak memory is only updated when a thread publishes its local changes, which happens once
+ * they exceed STATS_PUBLISH_THRESHOLD, so spikes shorter than that might be missed.
+ *
+ * Slabs are never returned to the system, freed slots are reused by allocations of the same size
+ * class only.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy */
+#include <stdarg.h>
+#include <sys/types.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#endif
+
+#include "MEM_guardedalloc.h"
+
+/* to ensure strict conversions */
+#include "../../source/blender/blenlib/BLI_strict_flags.h"
+
+#include "atomic_ops.h"
+#include "mallocn_intern.h"
+
+/* Header is 16 bytes, so blocks in slabs keep the alignment of the slots. */
+typedef struct MemHead {
+  /* Size class the block was allocated from, SIZE_CLASS_NONE for blocks which were allocated
+   * by the system allocator. */
+  unsigned short size_class;
+  unsigned short flag;
+  /* Alignment requested for MEMHEAD_ALIGN_FLAG blocks. */
+  unsigned int alignment;
+#if !defined(__LP64__) && !defined(_WIN64)
+  unsigned int _pad;
+#endif
+  /* Length of allocated memory block. */
+  size_t len;
+} MemHead;
+
+/* Aligned blocks use the same header, this is what MEMHEAD_ALIGN_PADDING expects. */
+typedef MemHead MemHeadAligned;
+
+enum {
+  MEMHEAD_MMAP_FLAG = 1,
+  MEMHEAD_ALIGN_FLAG = 2,
+};
+
+#define MEMHEAD_FROM_PTR(ptr) (((MemHead *)ptr) - 1)
+#define PTR_FROM_MEMHEAD(memhead) (memhead + 1)
+
+/* -------------------------------------------------------------------- */
+/** \name Size classes
+ * \{ */
+
+/* Sizes of the slots, including the header. Spacing grows with the size, so the space wasted
+ * by rounding up to the slot size stays below 25%. */
+static const unsigned short size_class_slot_size[] = {
+    32,   48,   64,   80,   96,   112,  128,  160,  192,  224,  256,
+    320,  384,  448,  512,  640,  768,  896,  1024, 1280, 1536, 1792,
+    2048, 2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192,
+};
+
+#define SIZE_CLASS_NUM (sizeof(size_class_slot_size) / sizeof(*size_class_slot_size))
+#define SIZE_CLASS_NONE 0xffff
+#define SIZE_CLASS_MAX_SLOT_SIZE 8192
+
+/* Alignment of the slots, and so of the blocks in slabs. */
+#define SLAB_ALIGNMENT ((size_t)16)
+/* Size of memory chunks which are split into slots of a single size class. */
+#define SLAB_CHUNK_SIZE ((size_t)64 * 1024)
+/* Amount of memory in free slots a thread keeps for every size class. */
+#define THREAD_CACHE_BIN_SIZE ((size_t)32 * 1024)
+
+/* Smallest size class for every slot size, in multiples of SLAB_ALIGNMENT. */
+static unsigned char size_class_lookup[SIZE_CLASS_MAX_SLOT_SIZE / SLAB_ALIGNMENT + 1];
+/* Maximum number of free slots a thread cache keeps for every size class. */
+static unsigned int size_class_cache_limit[SIZE_CLASS_NUM];
+
+MEM_INLINE unsigned int size_class_from_len(size_t len)
+{
+  const size_t index = (len + sizeof(MemHead) + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT;
+  if (UNLIKELY(index >= sizeof(size_class_lookup))) {
+    return SIZE_CLASS_NONE;
+  }
+  return size_class_lookup[index];
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Locking
+ * \{ */
+
+#ifdef WIN32
+typedef SRWLOCK MemLock;
+
+static void mem_lock_init(MemLock *lock)
+{
+  InitializeSRWLock(lock);
+}
+
+static void mem_lock(MemLock *lock)
+{
+  AcquireSRWLockExclusive(lock);
+}
+
+static void mem_unlock(MemLock *lock)
+{
+  ReleaseSRWLockExclusive(lock);
+}
+#else
+typedef pthread_mutex_t MemLock;
+
+static void mem_lock_init(MemLock *lock)
+{
+  pthread_mutex_init(lock, NULL);
+}
+
+static void mem_lock(MemLock *lock)
+{
+  pthread_mutex_lock(lock);
+}
+
+static void mem_unlock(MemLock *lock)
+{
+  pthread_mutex_unlock(lock);
+}
+#endif
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Global state
+ * \{ */
+
+/* Free slot, the link is stored where the MemHead of an allocated block is. */
+typedef struct FreeSlot {
+  struct FreeSlot *next;
+} FreeSlot;
+
+/* Chunks are linked together so they stay reachable for leak checkers. */
+typedef struct SlabChunk {
+  struct SlabChunk *next;
+  char _pad[SLAB_ALIGNMENT - sizeof(struct SlabChunk *)];
+} SlabChunk;
+
+/* Free slots shared by all threads. */
+typedef struct SizeClassPool {
+  MemLock lock;
+  FreeSlot *free_slots;
+  SlabChunk *chunks;
+} SizeClassPool;
+
+typedef struct ThreadCacheBin {
+  FreeSlot *free_slots;
+  unsigned int num_free_slots;
+} ThreadCacheBin;
+
+typedef struct ThreadCache {
+  struct ThreadCache *next, *prev;
+  ThreadCacheBin bins[SIZE_CLASS_NUM];
+  /* Blocks and memory allocated minus freed by this thread. Blocks might be freed by another
+   * thread than the one they were allocated by, so these wrap around and only make sense when
+   * summed over all caches. */
+  unsigned int totblock;
+  size_t mem_in_use;
+  /* Part of mem_in_use which is not yet added to mem_in_use_published. */
+  size_t mem_unpublished;
+} ThreadCache;
+
+/* Local changes of the memory usage are published once they exceed this. */
+#define STATS_PUBLISH_THRESHOLD ((ptrdiff_t)1024 * 1024)
+
+static SizeClassPool size_class_pools[SIZE_CLASS_NUM];
+
+static MemLock thread_caches_lock;
+static ThreadCache *thread_caches = NULL;
+/* Statistics of the caches of threads which exited already. */
+static unsigned int retired_totblock = 0;
+static size_t retired_mem_in_use = 0;
+
+static size_t mem_in_use_published = 0, mmap_in_use = 0, peak_mem = 0, slab_mem_reserved = 0;
+static bool malloc_debug_memset = false;
+static bool cached_initialized = false;
+
+static void (*error_callback)(const char *) = NULL;
+static void (*thread_lock_callback)(void) = NULL;
+static void (*thread_unlock_callback)(void) = NULL;
+
+#ifdef _MSC_VER
+#  define MEM_THREAD_LOCAL __declspec(thread)
+#else
+#  define MEM_THREAD_LOCAL __thread
+#endif
+
+static MEM_THREAD_LOCAL ThreadCache *thread_cache = NULL;
+
+/* Used to get notified when a thread exits, so its cache is given back. */
+#ifdef WIN32
+static DWORD thread_cache_key;
+#else
+static pthread_key_t thread_cache_key;
+#endif
+
+MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
+{
+  atomic_fetch_and_update_max_z(maximum_value, value);
+}
+
+#ifdef __GNUC__
+__attribute__((format(printf, 1, 2)))
+#endif
+static void
+print_error(const char *str, ...)
+{
+  char buf[512];
+  va_list ap;
+
+  va_start(ap, str);
+  vsnprintf(buf, sizeof(buf), str, ap);
+  va_end(ap);
+  buf[sizeof(buf) - 1] = '\0';
+
+  if (error_callback) {
+    error_callback(buf);
+  }
+}
+
+#if defined(WIN32)
+static void mem_lock_thread(void)
+{
+  if (thread_lock_callback)
+    thread_lock_callback();
+}
+
+static void mem_unlock_thread(void)
+{
+  if (thread_unlock_callback)
+    thread_unlock_callback();
+}
+#endif
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Size class pools
+ * \{ */
+
+/* Split a new chunk into slots, the pool is to be locked. */
+static bool size_class_pool_grow(SizeClassPool *pool, const unsigned int size_class)
+{
+  SlabChunk *chunk = malloc(SLAB_CHUNK_SIZE);
+  if (UNLIKELY(chunk == NULL)) {
+    return false;
+  }
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+
+  const size_t slot_size = size_class_slot_size[size_class];
+  const size_t num_slots = (SLAB_CHUNK_SIZE - sizeof(SlabChunk)) / slot_size;
+  char *slots = (char *)(chunk + 1);
+  for (size_t i = num_slots; i-- > 0;) {
+    FreeSlot *slot = (FreeSlot *)(slots + i * slot_size);
+    slot->next = pool->free_slots;
+    pool->free_slots = slot;
+  }
+  atomic_add_and_fetch_z(&slab_mem_reserved, SLAB_CHUNK_SIZE);
+  return true;
+}
+
+/* Take up to num_slots free slots from the pool, returns the number of taken slots. */
+static unsigned int size_class_pool_take(const unsigned int size_class,
+                                         const unsigned int num_slots,
+                                         FreeSlot **r_free_slots)
+{
+  SizeClassPool *pool = &size_class_pools[size_class];
+  unsigned int num_taken = 0;
+  mem_lock(&pool->lock);
+  if (pool->free_slots == NULL && !size_class_pool_grow(pool, size_class)) {
+    mem_unlock(&pool->lock);
+    *r_free_slots = NULL;
+    return 0;
+  }
+  FreeSlot *first = pool->free_slots, *last = first;
+  for (num_taken = 1; num_taken < num_slots && last->next != NULL; num_taken++) {
+    last = last->next;
+  }
+  pool->free_slots = last->next;
+  mem_unlock(&pool->lock);
+  last->next = NULL;
+  *r_free_slots = first;
+  return num_taken;
+}
+
+/* Give a linked list of free slots back to the pool. */
+static void size_class_pool_give(const unsigned int size_class, FreeSlot *first, FreeSlot *last)
+{
+  SizeClassPool *pool = &size_class_pools[size_class];
+  mem_lock(&pool->lock);
+  last->next = pool->free_slots;
+  pool->free_slots = first;
+  mem_unlock(&pool->lock);
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Thread caches
+ * \{ */
+
+static void thread_cache_stats_publish(ThreadCache *cache)
+{
+  const size_t mem_in_use = atomic_add_and_fetch_z(&mem_in_use_published,
+                                                   cache->mem_unpublished);
+  /* Frees might be published before the allocations they match, ignore such dips below zero. */
+  if ((ptrdiff_t)mem_in_use > 0) {
+    update_maximum(&peak_mem, mem_in_use);
+  }
+  cache->mem_unpublished = 0;
+}
+
+MEM_INLINE void thread_cache_stats_add(ThreadCache *cache, const size_t len)
+{
+  cache->totblock++;
+  cache->mem_in_use += len;
+  cache->mem_unpublished += len;
+  if (UNLIKELY((ptrdiff_t)cache->mem_unpublished > STATS_PUBLISH_THRESHOLD)) {
+    thread_cache_stats_publish(cache);
+  }
+}
+
+MEM_INLINE void thread_cache_stats_sub(ThreadCache *cache, const size_t len)
+{
+  cache->totblock--;
+  cache->mem_in_use -= len;
+  cache->mem_unpublished -= len;
+  if (UNLIKELY((ptrdiff_t)cache->mem_unpublished < -STATS_PUBLISH_THRESHOLD)) {
+    thread_cache_stats_publish(cache);
+  }
+}
+
+/* Give the first num_slots free slots of the bin back to the pool. */
+static void thread_cache_release(ThreadCache *cache,
+                                 const unsigned int size_class,
+                                 const unsigned int num_slots)
+{
+  ThreadCacheBin *bin = &cache->bins[size_class];
+  FreeSlot *first = bin->free_slots, *last = first;
+  for (unsigned int i = 1; i < num_slots; i++) {
+    last = last->next;
+  }
+  bin->free_slots = last->next;
+  bin->num_free_slots -= num_slots;
+  size_class_pool_give(size_class, first, last);
+}
+
+static void thread_cache_exit(ThreadCache *cache)
+{
+  for (unsigned int size_class = 0; size_class < SIZE_CLASS_NUM; size_class++) {
+    const unsigned int num_free_slots = cache->bins[size_class].num_free_slots;
+    if (num_free_slots != 0) {
+      thread_cache_release(cache, size_class, num_free_slots);
+    }
+  }
+
+  mem_lock(&thread_caches_lock);
+  if (cache->prev) {
+    cache->prev->next = cache->next;
+  }
+  else {
+    thread_caches = cache->next;
+  }
+  if (cache->next) {
+    cache->next->prev = cache->prev;
+  }
+  retired_totblock += cache->totblock;
+  retired_mem_in_use += cache->mem_in_use;
+  mem_unlock(&thread_caches_lock);
+
+  thread_cache_stats_publish(cache);
+  if (thread_cache == cache) {
+    thread_cache = NULL;
+  }
+  free(cache);
+}
+
+#ifdef WIN32
+static void WINAPI thread_cache_exit_cb(void *cache)
+{
+  if (cache != NULL) {
+    thread_cache_exit(cache);
+  }
+}
+#else
+static void thread_cache_exit_cb(void *cache)
+{
+  thread_cache_exit(cache);
+}
+#endif
+
+static ThreadCache *thread_cache_create(void)
+{
+  ThreadCache *cache = calloc(1, sizeof(ThreadCache));
+  if (UNLIKELY(cache == NULL)) {
+    print_error("Thread cache allocation failed\n");
+    abort();
+  }
+
+  mem_lock(&thread_caches_lock);
+  cache->next = thread_caches;
+  if (thread_caches) {
+    thread_caches->prev = cache;
+  }
+  thread_caches = cache;
+  mem_unlock(&thread_caches_lock);
+
+#ifdef WIN32
+  FlsSetValue(thread_cache_key, cache);
+#else
+  pthread_setspecific(thread_cache_key, cache);
+#endif
+  thread_cache = cache;
+  return cache;
+}
+
+MEM_INLINE ThreadCache *thread_cache_get(void)
+{
+  ThreadCache *cache = thread_cache;
+  if (UNLIKELY(cache == NULL)) {
+    cache = thread_cache_create();
+  }
+  return cache;
+}
+
+static FreeSlot *thread_cache_refill(ThreadCache *cache, const unsigned int size_class)
+{
+  ThreadCacheBin *bin = &cache->bins[size_class];
+  bin->num_free_slots = size_class_pool_take(
+      size_class, size_class_cache_limit[size_class] / 2, &bin->free_slots);
+  return bin->free_slots;
+}
+
+MEM_INLINE MemHead *thread_cache_alloc(ThreadCache *cache, const unsigned int size_class)
+{
+  ThreadCacheBin *bin = &cache->bins[size_class];
+  FreeSlot *slot = bin->free_slots;
+  if (UNLIKELY(slot == NULL)) {
+    slot = thread_cache_refill(cache, size_class);
+    if (UNLIKELY(slot == NULL)) {
+      return NULL;
+    }
+  }
+  bin->free_slots = slot->next;
+  bin->num_free_slots--;
+  return (MemHead *)slot;
+}
+
+MEM_INLINE void thread_cache_free(ThreadCache *cache, const unsigned int size_class, MemHead *memh)
+{
+  ThreadCacheBin *bin = &cache->bins[size_class];
+  FreeSlot *slot = (FreeSlot *)memh;
+  slot->next = bin->free_slots;
+  bin->free_slots = slot;
+  bin->num_free_slots++;
+  if (UNLIKELY(bin->num_free_slots > size_class_cache_limit[size_class])) {
+    thread_cache_release(cache, size_class, bin->num_free_slots / 2);
+  }
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Allocation
+ * \{ */
+
+/* Allocate block with the header filled in, zero alignment means the default one. */
+static MemHead *mem_alloc(ThreadCache *cache, size_t len, size_t alignment, const bool clear)
+{
+  MemHead *memh;
+  unsigned int size_class = SIZE_CLASS_NONE;
+  unsigned short flag = 0;
+
+  if (alignment <= SLAB_ALIGNMENT) {
+    size_class = size_class_from_len(len);
+  }
+
+  if (size_class != SIZE_CLASS_NONE) {
+    memh = thread_cache_alloc(cache, size_class);
+    if (LIKELY(memh) && clear) {
+      memset(memh + 1, 0, len);
+    }
+  }
+  else if (alignment == 0) {
+    memh = clear ? calloc(1, len + sizeof(MemHead)) : malloc(len + sizeof(MemHead));
+  }
+  else {
+    /* Some OS specific aligned allocators require a certain minimal alignment. */
+    if (alignment < ALIGNED_MALLOC_MINIMUM_ALIGNMENT) {
+      alignment = ALIGNED_MALLOC_MINIMUM_ALIGNMENT;
+    }
+    /* Padding in the beginning keeps the header right before the aligned data. */
+    const size_t extra_padding = MEMHEAD_ALIGN_PADDING(alignment);
+    memh = aligned_malloc(len + extra_padding + sizeof(MemHead), alignment);
+    if (LIKELY(memh)) {
+      memh = (MemHead *)((char *)memh + extra_padding);
+      if (clear) {
+        memset(memh + 1, 0, len);
+      }
+    }
+  }
+
+  if (UNLIKELY(memh == NULL)) {
+    return NULL;
+  }
+
+  if (UNLIKELY(malloc_debug_memset && len && !clear)) {
+    memset(memh + 1, 255, len);
+  }
+
+  if (alignment != 0) {
+    flag |= MEMHEAD_ALIGN_FLAG;
+  }
+  memh->size_class = (unsigned short)size_class;
+  memh->flag = flag;
+  memh->alignment = (unsigned int)alignment;
+  memh->len = len;
+  thread_cache_stats_add(cache, len);
+  return memh;
+}
+
+/* Change length of the block without moving it, when it stays in the same size class. */
+static bool mem_resize_in_place(MemHead *memh, const size_t len, const bool clear)
+{
+  if (memh->size_class == SIZE_CLASS_NONE || size_class_from_len(len) != memh->size_class) {
+    return false;
+  }
+  const size_t old_len = memh->len;
+  if (len > old_len) {
+    if (clear) {
+      memset((char *)(memh + 1) + old_len, 0, len - old_len);
+    }
+    else if (UNLIKELY(malloc_debug_memset)) {
+      memset((char *)(memh + 1) + old_len, 255, len - old_len);
+    }
+  }
+  ThreadCache *cache = thread_cache_get();
+  thread_cache_stats_sub(cache, old_len);
+  thread_cache_stats_add(cache, len);
+  memh->len = len;
+  return true;
+}
+
+size_t MEM_cached_allocN_len(const void *vmemh)
+{
+  if (vmemh) {
+    return MEMHEAD_FROM_PTR(vmemh)->len;
+  }
+  else {
+    return 0;
+  }
+}
+
+void MEM_cached_freeN(void *vmemh)
+{
+  if (vmemh == NULL) {
+    print_error("Attempt to free NULL pointer\n");
+#ifdef WITH_ASSERT_ABORT
+    abort();
+#endif
+    return;
+  }
+
+  MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+  const size_t len = memh->len;
+  ThreadCache *cache = thread_cache_get();
+
+  thread_cache_stats_sub(cache, len);
+
+  if (UNLIKELY(memh->flag & MEMHEAD_MMAP_FLAG)) {
+    atomic_sub_and_fetch_z(&mmap_in_use, len);
+#if defined(WIN32)
+    /* our windows mmap implementation is not thread safe */
+    mem_lock_thread();
+#endif
+    if (munmap(memh, len + sizeof(MemHead)))
+      printf("Couldn't unmap memory\n");
+#if defined(WIN32)
+    mem_unlock_thread();
+#endif
+    return;
+  }
+
+  if (UNLIKELY(malloc_debug_memset && len)) {
+    memset(memh + 1, 255, len);
+  }
+  if (LIKELY(memh->size_class != SIZE_CLASS_NONE)) {
+    thread_cache_free(cache, memh->size_class, memh);
+  }
+  else if (UNLIKELY(memh->flag & MEMHEAD_ALIGN_FLAG)) {
+    aligned_free(MEMHEAD_REAL_PTR(memh));
+  }
+  else {
+    free(memh);
+  }
+}
+
+void *MEM_cached_dupallocN(const void *vmemh)
+{
+  void *newp = NULL;
+  if (vmemh) {
+    const MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+    const size_t prev_size = MEM_cached_allocN_len(vmemh);
+    if (UNLIKELY(memh->flag & MEMHEAD_MMAP_FLAG)) {
+      newp = MEM_cached_mapallocN(prev_size, "dupli_mapalloc");
+    }
+    else if (UNLIKELY(memh->flag & MEMHEAD_ALIGN_FLAG)) {
+      newp = MEM_cached_mallocN_aligned(prev_size, (size_t)memh->alignment, "dupli_malloc");
+    }
+    else {
+      newp = MEM_cached_mallocN(prev_size, "dupli_malloc");
+    }
+    memcpy(newp, vmemh, prev_size);
+  }
+  return newp;
+}
+
+void *MEM_cached_reallocN_id(void *vmemh, size_t len, const char *str)
+{
+  void *newp = NULL;
+
+  if (vmemh) {
+    MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+    size_t old_len = MEM_cached_allocN_len(vmemh);
+
+    if (mem_resize_in_place(memh, SIZET_ALIGN_4(len), false)) {
+      return vmemh;
+    }
+
+    if (LIKELY(!(memh->flag & MEMHEAD_ALIGN_FLAG))) {
+      newp = MEM_cached_mallocN(len, "realloc");
+    }
+    else {
+      newp = MEM_cached_mallocN_aligned(len, (size_t)memh->alignment, "realloc");
+    }
+
+    if (newp) {
+      if (len < old_len) {
+        /* shrink */
+        memcpy(newp, vmemh, len);
+      }
+      else {
+        /* grow (or remain same size) */
+        memcpy(newp, vmemh, old_len);
+      }
+    }
+
+    MEM_cached_freeN(vmemh);
+  }
+  else {
+    newp = MEM_cached_mallocN(len, str);
+  }
+
+  return newp;
+}
+
+void *MEM_cached_recallocN_id(void *vmemh, size_t len, const char *str)
+{
+  void *newp = NULL;
+
+  if (vmemh) {
+    MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+    size_t old_len = MEM_cached_allocN_len(vmemh);
+
+    if (mem_resize_in_place(memh, SIZET_ALIGN_4(len), true)) {
+      return vmemh;
+    }
+
+    if (LIKELY(!(memh->flag & MEMHEAD_ALIGN_FLAG))) {
+      newp = MEM_cached_mallocN(len, "recalloc");
+    }
+    else {
+      newp = MEM_cached_mallocN_aligned(len, (size_t)memh->alignment, "recalloc");
+    }
+
+    if (newp) {
+      if (len < old_len) {
+        /* shrink */
+        memcpy(newp, vmemh, len);
+      }
+      else {
+        memcpy(newp, vmemh, old_len);
+
+        if (len > old_len) {
+          /* grow */
+          /* zero new bytes */
+          memset(((char *)newp) + old_len, 0, len - old_len);
+        }
+      }
+    }
+
+    MEM_cached_freeN(vmemh);
+  }
+  else {
+    newp = MEM_cached_callocN(len, str);
+  }
+
+  return newp;
+}
+
+void *MEM_cached_callocN(size_t len, const char *str)
+{
+  len = SIZET_ALIGN_4(len);
+
+  MemHead *memh = mem_alloc(thread_cache_get(), len, 0, true);
+
+  if (LIKELY(memh)) {
+    return PTR_FROM_MEMHEAD(memh);
+  }
+  print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+              SIZET_ARG(len),
+              str,
+              (unsigned int)MEM_cached_get_memory_in_use());
+  return NULL;
+}
+
+void *MEM_cached_calloc_arrayN(size_t len, size_t size, const char *str)
+{
+  size_t total_size;
+  if (UNLIKELY(!MEM_size_safe_multiply(len, size, &total_size))) {
+    print_error(
+        "Calloc array aborted due to integer overflow: "
+        "len=" SIZET_FORMAT "x" SIZET_FORMAT " in %s, total %u\n",
+        SIZET_ARG(len),
+        SIZET_ARG(size),
+        str,
+        (unsigned int)MEM_cached_get_memory_in_use());
+    abort();
+    return NULL;
+  }
+
+  return MEM_cached_callocN(total_size, str);
+}
+
+void *MEM_cached_mallocN(size_t len, const char *str)
+{
+  len = SIZET_ALIGN_4(len);
+
+  MemHead *memh = mem_alloc(thread_cache_get(), len, 0, false);
+
+  if (LIKELY(memh)) {
+    return PTR_FROM_MEMHEAD(memh);
+  }
+  print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+              SIZET_ARG(len),
+              str,
+              (unsigned int)MEM_cached_get_memory_in_use());
+  return NULL;
+}
+
+void *MEM_cached_malloc_arrayN(size_t len, size_t size, const char *str)
+{
+  size_t total_size;
+  if (UNLIKELY(!MEM_size_safe_multiply(len, size, &total_size))) {
+    print_error(
+        "Malloc array aborted due to integer overflow: "
+        "len=" SIZET_FORMAT "x" SIZET_FORMAT " in %s, total %u\n",
+        SIZET_ARG(len),
+        SIZET_ARG(size),
+        str,
+        (unsigned int)MEM_cached_get_memory_in_use());
+    abort();
+    return NULL;
+  }
+
+  return MEM_cached_mallocN(total_size, str);
+}
+
+void *MEM_cached_mallocN_aligned(size_t len, size_t alignment, const char *str)
+{
+  /* Huge alignment values doesn't make sense. */
+  assert(alignment < 1024);
+
+  /* We only support alignments that are a power of two. */
+  assert(IS_POW2(alignment));
+
+  len = SIZET_ALIGN_4(len);
+
+  MemHead *memh = mem_alloc(thread_cache_get(), len, alignment, false);
+
+  if (LIKELY(memh)) {
+    return PTR_FROM_MEMHEAD(memh);
+  }
+  print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+              SIZET_ARG(len),
+              str,
+              (unsigned int)MEM_cached_get_memory_in_use());
+  return NULL;
+}
+
+void *MEM_cached_mapallocN(size_t len, const char *str)
+{
+  MemHead *memh;
+
+  /* on 64 bit, simply use calloc instead, as mmap does not support
+   * allocating > 4 GB on Windows. the only reason mapalloc exists
+   * is to get around address space limitations in 32 bit OSes. */
+  if (sizeof(void *) >= 8)
+    return MEM_cached_callocN(len, str);
+
+  len = SIZET_ALIGN_4(len);
+
+#if defined(WIN32)
+  /* our windows mmap implementation is not thread safe */
+  mem_lock_thread();
+#endif
+  memh = mmap(NULL, len + sizeof(MemHead), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+#if defined(WIN32)
+  mem_unlock_thread();
+#endif
+
+  if (memh != (MemHead *)-1) {
+    memh->size_class = SIZE_CLASS_NONE;
+    memh->flag = MEMHEAD_MMAP_FLAG;
+    memh->alignment = 0;
+    memh->len = len;
+    thread_cache_stats_add(thread_cache_get(), len);
+    update_maximum(&peak_mem, atomic_add_and_fetch_z(&mmap_in_use, len));
+
+    return PTR_FROM_MEMHEAD(memh);
+  }
+  print_error(
+      "Mapalloc returns null, fallback to regular malloc: "
+      "len=" SIZET_FORMAT " in %s, total %u\n",
+      SIZET_ARG(len),
+      str,
+      (unsigned int)mmap_in_use);
+  return MEM_cached_callocN(len, str);
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Statistics and settings
+ * \{ */
+
+void MEM_cached_printmemlist_pydict(void)
+{
+}
+
+void MEM_cached_printmemlist(void)
+{
+}
+
+/* unused */
+void MEM_cached_callbackmemlist(void (*func)(void *))
+{
+  (void)func; /* Ignored. */
+}
+
+void MEM_cached_printmemlist_stats(void)
+{
+  printf("\ntotal memory len: %.3f MB\n",
+         (double)MEM_cached_get_memory_in_use() / (double)(1024 * 1024));
+  printf("peak memory len: %.3f MB\n", (double)peak_mem / (double)(1024 * 1024));
+  printf("slab memory reserved: %.3f MB\n", (double)slab_mem_reserved / (double)(1024 * 1024));
+  printf(
+      "\nFor more detailed per-block statistics run Blender with memory debugging command line "
+      "argument.\n");
+
+#ifdef HAVE_MALLOC_STATS
+  printf("System Statistics:\n");
+  malloc_stats();
+#endif
+}
+
+void MEM_cached_set_error_callback(void (*func)(const char *))
+{
+  error_callback = func;
+}
+
+bool MEM_cached_consistency_check(void)
+{
+  return true;
+}
+
+void MEM_cached_set_lock_callback(void (*lock)(void), void (*unlock)(void))
+{
+  thread_lock_callback = lock;
+  thread_unlock_callback = unlock;
+}
+
+void MEM_cached_set_memory_debug(void)
+{
+  malloc_debug_memset = true;
+}
+
+size_t MEM_cached_get_memory_in_use(void)
+{
+  mem_lock(&thread_caches_lock);
+  size_t mem_in_use = retired_mem_in_use;
+  for (const ThreadCache *cache = thread_caches; cache; cache = cache->next) {
+    mem_in_use += cache->mem_in_use;
+  }
+  mem_unlock(&thread_caches_lock);
+  return mem_in_use;
+}
+
+size_t MEM_cached_get_mapped_memory_in_use(void)
+{
+  return mmap_in_use;
+}
+
+unsigned int MEM_cached_get_memory_blocks_in_use(void)
+{
+  mem_lock(&thread_caches_lock);
+  unsigned int totblock = retired_totblock;
+  for (const ThreadCache *cache = thread_caches; cache; cache = cache->next) {
+    totblock += cache->totblock;
+  }
+  mem_unlock(&thread_caches_lock);
+  return totblock;
+}
+
+void MEM_cached_reset_peak_memory(void)
+{
+  peak_mem = MEM_cached_get_memory_in_use();
+}
+
+size_t MEM_cached_get_peak_memory(void)
+{
+  return peak_mem;
+}
+
+#ifndef NDEBUG
+const char *MEM_cached_name_ptr(void *vmemh)
+{
+  if (vmemh) {
+    return "unknown block name ptr";
+  }
+  else {
+    return "MEM_cached_name_ptr(NULL)";
+  }
+}
+#endif /* NDEBUG */
+
+void MEM_cached_init(void)
+{
+  if (cached_initialized) {
+    return;
+  }
+  cached_initialized = true;
+
+  unsigned int size_class = 0;
+  for (size_t index = 0; index < sizeof(size_class_lookup); index++) {
+    while (size_class_slot_size[size_class] < index * SLAB_ALIGNMENT) {
+      size_class++;
+    }
+    size_class_lookup[index] = (unsigned char)size_class;
+  }
+
+  for (size_class = 0; size_class < SIZE_CLASS_NUM; size_class++) {
+    const size_t limit = THREAD_CACHE_BIN_SIZE / size_class_slot_size[size_class];
+    size_class_cache_limit[size_class] = (unsigned int)(limit < 8 ? 8 : limit);
+    mem_lock_init(&size_class_pools[size_class].lock);
+  }
+
+  mem_lock_init(&thread_caches_lock);
+#ifdef WIN32
+  thread_cache_key = FlsAlloc(thread_cache_exit_cb);
+#else
+  pthread_key_create(&thread_cache_key, thread_cache_exit_cb);
+#endif
+}
+
+/** \} */
@@ -160,6 +160,55 @@ size_t MEM_lockfree_get_peak_memory(void) ATTR_WARN_UNUSED_RESULT;
 const char *MEM_lockfree_name_ptr(void *vmemh);
 #endif
 
+/* Prototypes for thread-caching allocator functions */
+size_t MEM_cached_allocN_len(const void *vmemh) ATTR_WARN_UNUSED_RESULT;
+void MEM_cached_freeN(void *vmemh);
+void *MEM_cached_dupallocN(const void *vmemh) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+void *MEM_cached_reallocN_id(void *vmemh,
+                             size_t len,
+                             const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(2);
+void *MEM_cached_recallocN_id(void *vmemh,
+                              size_t len,
+                              const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(2);
+void *MEM_cached_callocN(size_t len, const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1) ATTR_NONNULL(2);
+void *MEM_cached_calloc_arrayN(size_t len,
+                               size_t size,
+                               const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1, 2) ATTR_NONNULL(3);
+void *MEM_cached_mallocN(size_t len, const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1) ATTR_NONNULL(2);
+void *MEM_cached_malloc_arrayN(size_t len,
+                               size_t size,
+                               const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1, 2) ATTR_NONNULL(3);
+void *MEM_cached_mallocN_aligned(size_t len,
+                                 size_t alignment,
+                                 const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1) ATTR_NONNULL(3);
+void *MEM_cached_mapallocN(size_t len,
+                           const char *UNUSED(str)) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT
+    ATTR_ALLOC_SIZE(1) ATTR_NONNULL(2);
+void MEM_cached_printmemlist_pydict(void);
+void MEM_cached_printmemlist(void);
+void MEM_cached_callbackmemlist(void (*func)(void *));
+void MEM_cached_printmemlist_stats(void);
+void MEM_cached_set_error_callback(void (*func)(const char *));
+bool MEM_cached_consistency_check(void);
+void MEM_cached_set_lock_callback(void (*lock)(void), void (*unlock)(void));
+void MEM_cached_set_memory_debug(void);
+size_t MEM_cached_get_memory_in_use(void);
+size_t MEM_cached_get_mapped_memory_in_use(void);
+unsigned int MEM_cached_get_memory_blocks_in_use(void);
+void MEM_cached_reset_peak_memory(void);
+size_t MEM_cached_get_peak_memory(void) ATTR_WARN_UNUSED_RESULT;
+#ifndef NDEBUG
+const char *MEM_cached_name_ptr(void *vmemh);
+#endif
+void MEM_cached_init(void);
+
 /* Prototypes for fully guarded allocator functions */
 size_t MEM_guarded_allocN_len(const void *vmemh) ATTR_WARN_UNUSED_RESULT;
 void MEM_guarded_freeN(void *vmemh);
@@ -0,0 +1,163 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Multi-threaded allocation benchmark.
+ *
+ * Every thread runs the same pattern of small allocations as modifier evaluation and copy-on-write
+ * do: a ring of live blocks of mixed sizes where the oldest block is freed for every new one.
+ * A second pass frees blocks allocated by other threads.
+ */
+
+/* To compile run:
+ * gcc -O2 -pthread -I../../ -I../../../atomic/ membench.c ../../intern/mallocn*.c -o membench
+ *
+ * Usage:
+ * ./membench [lockfree|cached|guarded] [threads]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MEM_guardedalloc.h"
+
+/* Allocations done by every thread. */
+#define NUM_ITERATIONS 4000000
+/* Number of blocks every thread keeps alive. */
+#define NUM_LIVE_BLOCKS 1024
+/* Blocks every thread allocates for other threads to free. */
+#define NUM_SHARED_BLOCKS 200000
+
+typedef struct ThreadData {
+  pthread_t thread;
+  int index;
+  void **shared_blocks;
+} ThreadData;
+
+static int num_threads = 4;
+static ThreadData *threads_data;
+static pthread_barrier_t barrier;
+
+static double time_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Cheap deterministic random sizes, most of the blocks are small. */
+static size_t random_size(unsigned int *state)
+{
+  *state = *state * 1103515245u + 12345u;
+  const unsigned int value = *state >> 16;
+  if ((value & 63) == 0) {
+    return 4096 + (value & 16383);
+  }
+  return 8 + (value & 511);
+}
+
+static void *thread_func(void *thread_data_v)
+{
+  ThreadData *thread_data = thread_data_v;
+  unsigned int state = (unsigned int)thread_data->index + 1;
+  void *live_blocks[NUM_LIVE_BLOCKS] = {NULL};
+
+  /* Ring of live blocks. */
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    void **block = &live_blocks[i % NUM_LIVE_BLOCKS];
+    if (*block) {
+      MEM_freeN(*block);
+    }
+    const size_t len = random_size(&state);
+    *block = MEM_mallocN(len, "membench live");
+    memset(*block, 0, 8);
+  }
+  for (int i = 0; i < NUM_LIVE_BLOCKS; i++) {
+    MEM_freeN(live_blocks[i]);
+  }
+  pthread_barrier_wait(&barrier);
+
+  /* Free blocks allocated by another thread. */
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < NUM_SHARED_BLOCKS; i++) {
+    thread_data->shared_blocks[i] = MEM_mallocN(random_size(&state), "membench shared");
+  }
+  pthread_barrier_wait(&barrier);
+  void **other_blocks = threads_data[(thread_data->index + 1) % num_threads].shared_blocks;
+  for (int i = 0; i < NUM_SHARED_BLOCKS; i++) {
+    MEM_freeN(other_blocks[i]);
+  }
+  pthread_barrier_wait(&barrier);
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *allocator = (argc > 1) ? argv[1] : "lockfree";
+  if (strcmp(allocator, "cached") == 0) {
+    MEM_use_cached_allocator();
+  }
+  else if (strcmp(allocator, "guarded") == 0) {
+    MEM_use_guarded_allocator();
+  }
+  if (argc > 2) {
+    num_threads = atoi(argv[2]);
+  }
+
+  pthread_barrier_init(&barrier, NULL, (unsigned int)num_threads + 1);
+  threads_data = calloc((size_t)num_threads, sizeof(ThreadData));
+  for (int i = 0; i < num_threads; i++) {
+    threads_data[i].index = i;
+    threads_data[i].shared_blocks = calloc(NUM_SHARED_BLOCKS, sizeof(void *));
+    pthread_create(&threads_data[i].thread, NULL, thread_func, &threads_data[i]);
+  }
+
+  double time_start = time_seconds();
+  pthread_barrier_wait(&barrier);
+  pthread_barrier_wait(&barrier);
+  const double time_local = time_seconds() - time_start;
+
+  time_start = time_seconds();
+  pthread_barrier_wait(&barrier);
+  pthread_barrier_wait(&barrier);
+  const double time_alloc = time_seconds() - time_start;
+  time_start = time_seconds();
+  pthread_barrier_wait(&barrier);
+  const double time_free = time_seconds() - time_start;
+
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads_data[i].thread, NULL);
+    free(threads_data[i].shared_blocks);
+  }
+  free(threads_data);
+
+  const double num_local = (double)num_threads * NUM_ITERATIONS;
+  const double num_shared = (double)num_threads * NUM_SHARED_BLOCKS;
+  printf("%s allocator, %d threads:\n", allocator, num_threads);
+  printf("  alloc/free ring:   %8.3f s, %7.2f M op/s\n", time_local, num_local / time_local * 1e-6);
+  printf("  alloc shared:      %8.3f s, %7.2f M op/s\n", time_alloc, num_shared / time_alloc * 1e-6);
+  printf("  free from other:   %8.3f s, %7.2f M op/s\n", time_free, num_shared / time_free * 1e-6);
+  printf("  blocks in use:     %u\n", MEM_get_memory_blocks_in_use());
+  printf("  peak memory:       %.3f MB\n", (double)MEM_get_peak_memory() / (1024.0 * 1024.0));
+
+  pthread_barrier_destroy(&barrier);
+  return (MEM_get_memory_blocks_in_use() == 0) ? 0 : 1;
+}
@@ -48,6 +48,7 @@ const UserDef U_default = {
     .pythondir = "",
     .sounddir = "//",
     .i18ndir = "",
+    .sequencer_disk_cache_dir = "",
     .image_editor = "",
     .anim_player = "",
     .anim_player_preset = 0,
@@ -112,10 +113,12 @@ const UserDef U_default = {
     .gp_euclideandist = 2,
     .gp_eraser = 25,
     .gp_settings = 0,
+    .sequencer_disk_cache_compression = USER_SEQ_DISK_CACHE_COMPRESSION_LOW,
 
     /** Initialized by: #BKE_studiolight_default . */
     .light_param = {{0}},
     .light_ambient = {0, 0, 0},
+    .mesh_eval_cache_limit = 256,
 
     .gizmo_flag = USER_GIZMO_DRAW,
     .gizmo_size = 75,
@@ -131,6 +134,7 @@ const UserDef U_default = {
 
     .prefetchframes = 0,
     .pad_rot_angle = 15,
+    .sequencer_disk_cache_size_limit = 100,
     .rvisize = 25,
     .rvibright = 8,
     .recent_files = 10,
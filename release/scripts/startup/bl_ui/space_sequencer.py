@@ -1805,6 +1805,7 @@ class SEQUENCER_PT_cache_settings(SequencerButtonsPanel, Panel):
         col.prop(ed, "use_cache_preprocessed")
         col.prop(ed, "use_cache_composite")
         col.prop(ed, "use_cache_final")
+        col.prop(ed, "use_cache_disk")
         col.separator()
         col.prop(ed, "recycle_max_cost")
 
@@ -38,6 +38,22 @@ struct MeshStatVis;
 struct Object;
 struct Scene;
 
+/**
+ * Coordinates of vertices before an edit which keeps the topology,
+ * lets edit-mesh undo store only the vertices that changed (see editmesh_undo.c).
+ */
+typedef struct BMEditMeshJournalVert {
+  int index;
+  float co[3];
+} BMEditMeshJournalVert;
+
+typedef struct BMEditMeshJournal {
+  /** #BMEditMesh.undo_state_id the edit was done on. */
+  int undo_state_id;
+  int verts_len;
+  BMEditMeshJournalVert verts[];
+} BMEditMeshJournal;
+
 /**
  * This structure is used for mesh edit-mode.
  *
@@ -80,6 +96,11 @@ typedef struct BMEditMesh {
    */
   char needs_flush_to_id;
 
+  /** Undo state this mesh was last written to or read from, zero when unknown. */
+  int undo_state_id;
+  /** Vertices changed since #undo_state_id, NULL when the changes were not recorded. */
+  struct BMEditMeshJournal *undo_journal;
+
 } BMEditMesh;
 
 /* editmesh.c */
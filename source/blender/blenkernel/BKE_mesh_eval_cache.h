@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef __BKE_MESH_EVAL_CACHE_H__
+#define __BKE_MESH_EVAL_CACHE_H__
+
+/** \file
+ * \ingroup bke
+ *
+ * Results of the modifier stack, shared between evaluations and objects.
+ *
+ * A result is identified by a hash of the input mesh and of the settings of every modifier
+ * applied to it. Evaluation resumes from the last modifier with a cached result, so changing
+ * a setting of a late modifier doesn't evaluate the ones before it again, and objects with the
+ * same mesh and modifiers share results.
+ *
+ * A result is stored the second time it is evaluated, results which change on every evaluation
+ * (animated input, a setting being dragged) are never copied. Likewise the input mesh data is
+ * only hashed once it didn't change between two evaluations, the hash is kept in the mesh until
+ * it's updated again.
+ *
+ * Only modifiers with #eModifierTypeFlag_SupportsResultCache which don't use other data-blocks
+ * are supported. Memory use is limited by #UserDef.mesh_eval_cache_limit.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Mesh;
+struct ModifierData;
+struct Object;
+struct Scene;
+
+typedef struct MeshEvalCacheKey {
+  /** Two independent hashes, a collision would return the wrong mesh. */
+  unsigned int hash[2];
+} MeshEvalCacheKey;
+
+/** Cached mesh, referenced by the caller while in use. */
+typedef struct MeshEvalCacheItem MeshEvalCacheItem;
+
+bool BKE_mesh_eval_cache_key_init(MeshEvalCacheKey *key,
+                                  const struct Scene *scene,
+                                  struct Object *ob,
+                                  struct ModifierData *md_first,
+                                  struct Mesh *mesh_input,
+                                  const int apply_flag);
+bool BKE_mesh_eval_cache_key_add_modifier(MeshEvalCacheKey *key,
+                                          struct Object *ob,
+                                          struct ModifierData *md);
+void BKE_mesh_eval_cache_key_add_data(MeshEvalCacheKey *key, const void *data, size_t data_len);
+
+MeshEvalCacheItem *BKE_mesh_eval_cache_lookup(const MeshEvalCacheKey *key);
+struct Mesh *BKE_mesh_eval_cache_item_mesh_copy(MeshEvalCacheItem *item,
+                                                const struct Mesh *mesh_input);
+void BKE_mesh_eval_cache_item_release(MeshEvalCacheItem *item);
+void BKE_mesh_eval_cache_insert(const MeshEvalCacheKey *key, struct Mesh *mesh);
+
+void BKE_mesh_eval_cache_limit_update(void);
+void BKE_mesh_eval_cache_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BKE_MESH_EVAL_CACHE_H__ */
@@ -101,6 +101,10 @@ typedef enum {
   /* For modifiers that use CD_PREVIEW_MCOL for preview. */
   eModifierTypeFlag_UsesPreview = (1 << 9),
   eModifierTypeFlag_AcceptsLattice = (1 << 10),
+
+  /* The result only depends on the input mesh and the modifier settings, so it can be shared
+   * while the modifier doesn't use other data-blocks, see BKE_mesh_eval_cache.h. */
+  eModifierTypeFlag_SupportsResultCache = (1 << 11),
 } ModifierTypeFlag;
 
 /* IMPORTANT! Keep ObjectWalkFunc and IDWalkFunc signatures compatible. */
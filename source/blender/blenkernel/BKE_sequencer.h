@@ -86,9 +86,14 @@ void BKE_sequence_iterator_end(SeqIterator *iter);
   } \
   ((void)0)
 
+/* Maximum number of threads rendering frames ahead, see seqprefetch.c. */
+#define SEQ_PREFETCH_WORKERS_MAX 4
+
 typedef enum eSeqTaskId {
   SEQ_TASK_MAIN_RENDER,
+  /* Each prefetch thread uses its own ID, starting from this one. */
   SEQ_TASK_PREFETCH_RENDER,
+  SEQ_TASK_MAX = SEQ_TASK_PREFETCH_RENDER + SEQ_PREFETCH_WORKERS_MAX,
 } eSeqTaskId;
 
 typedef struct SeqRenderData {
@@ -211,6 +216,7 @@ struct SeqEffectHandle {
 double BKE_sequencer_rendersize_to_scale_factor(int size);
 
 struct ImBuf *BKE_sequencer_give_ibuf(const SeqRenderData *context, float cfra, int chanshown);
+void BKE_sequencer_render_inputs(const SeqRenderData *context, float cfra, int chanshown);
 struct ImBuf *BKE_sequencer_give_ibuf_threaded(const SeqRenderData *context,
                                                float cfra,
                                                int chanshown);
@@ -310,11 +316,23 @@ void BKE_sequencer_proxy_set(struct Sequence *seq, bool value);
 /* **********************************************************************
  * seqcache.c
  *
- * Sequencer memory cache management functions
+ * Sequencer memory and disk cache management functions
  * ********************************************************************** */
 
 #define SEQ_CACHE_COST_MAX 10.0f
 
+typedef struct SeqCacheStats {
+  /* Lookups of the memory cache. */
+  uint64_t ram_hits;
+  uint64_t ram_misses;
+  /* Lookups of the disk cache, only done after a memory cache miss. */
+  uint64_t disk_hits;
+  uint64_t disk_misses;
+  /* Images written to the disk cache and the size of the cache directory. */
+  uint64_t disk_writes;
+  uint64_t disk_size;
+} SeqCacheStats;
+
 struct ImBuf *BKE_sequencer_cache_get(const SeqRenderData *context,
                                       struct Sequence *seq,
                                       float cfra,
@@ -345,6 +363,8 @@ void BKE_sequencer_cache_iterate(
     void *userdata,
     bool callback(void *userdata, struct Sequence *seq, int cfra, int cache_type, float cost));
 bool BKE_sequencer_cache_is_full(struct Scene *scene);
+void BKE_sequencer_cache_cleanup_disk(struct Scene *scene);
+void BKE_sequencer_cache_stats_get(struct Scene *scene, SeqCacheStats *r_stats);
 
 /* **********************************************************************
  * seqprefetch.c
@@ -52,6 +52,7 @@
 #include "BKE_material.h"
 #include "BKE_modifier.h"
 #include "BKE_mesh.h"
+#include "BKE_mesh_eval_cache.h"
 #include "BKE_mesh_iterators.h"
 #include "BKE_mesh_mapping.h"
 #include "BKE_mesh_runtime.h"
@@ -855,6 +856,23 @@ static void mesh_calc_modifier_final_normals(const Mesh *mesh_input,
   }
 }
 
+/* Undeformed coordinates are evaluated in parallel with the modifier stack,
+ * those results are not stored in the evaluated mesh cache. */
+static bool mesh_calc_modifiers_need_orco(const CDMaskLink *datamasks,
+                                          const CustomData_MeshMasks *final_datamask)
+{
+  const uint64_t orco_mask = CD_MASK_ORCO | CD_MASK_CLOTH_ORCO;
+  if (final_datamask->vmask & orco_mask) {
+    return true;
+  }
+  for (const CDMaskLink *link = datamasks; link; link = link->next) {
+    if (link->mask.vmask & orco_mask) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /* Does final touches to the final evaluated mesh, making sure it is perfectly usable.
  *
  * This is needed because certain information is not passed along intermediate meshes allocated
@@ -952,6 +970,16 @@ static void mesh_calc_modifiers(struct Depsgraph *depsgraph,
   /* XXX Always copying POLYINDEX, else tessellated data are no more valid! */
   CustomData_MeshMasks append_mask = CD_MASK_BAREMESH_ORIGINDEX;
 
+  /* Results are shared with evaluations using the same input mesh and modifier settings, as
+   * long as all modifiers applied so far support it, see BKE_mesh_eval_cache.h. */
+  MeshEvalCacheKey cache_key;
+  bool use_eval_cache = ((index == -1) && (useDeform == 1) && (ob->mode == OB_MODE_OBJECT) &&
+                         !mesh_calc_modifiers_need_orco(datamasks, &final_datamask) &&
+                         BKE_mesh_eval_cache_key_init(
+                             &cache_key, scene, ob, md, mesh_input, (int)mectx.flag));
+  /* Cached result of the modifiers applied so far, copied once another modifier is applied. */
+  MeshEvalCacheItem *cache_item = NULL;
+
   /* Clear errors before evaluation. */
   modifiers_clearErrors(ob);
 
@@ -969,6 +997,10 @@ static void mesh_calc_modifiers(struct Depsgraph *depsgraph,
       }
 
       if (mti->type == eModifierTypeType_OnlyDeform && !sculpt_dyntopo) {
+        if (use_eval_cache) {
+          use_eval_cache = BKE_mesh_eval_cache_key_add_modifier(&cache_key, ob, md);
+        }
+
         if (!deformed_verts) {
           deformed_verts = BKE_mesh_vert_coords_alloc(mesh_input, &num_deformed_verts);
         }
@@ -1068,6 +1100,45 @@ static void mesh_calc_modifiers(struct Depsgraph *depsgraph,
       continue;
     }
 
+    if (use_eval_cache) {
+      use_eval_cache = BKE_mesh_eval_cache_key_add_modifier(&cache_key, ob, md);
+    }
+
+    if (use_eval_cache && (mti->type != eModifierTypeType_OnlyDeform)) {
+      /* Layers copied to the result, see below. */
+      const CustomData_MeshMasks cache_masks[3] = {
+          md_datamask->mask,
+          md_datamask->next ? md_datamask->next->mask : final_datamask,
+          append_mask,
+      };
+      const int cache_flags[2] = {need_mapping, (mesh_final != NULL) || (cache_item != NULL)};
+      BKE_mesh_eval_cache_key_add_data(&cache_key, cache_masks, sizeof(cache_masks));
+      BKE_mesh_eval_cache_key_add_data(&cache_key, cache_flags, sizeof(cache_flags));
+
+      MeshEvalCacheItem *item = BKE_mesh_eval_cache_lookup(&cache_key);
+      if (item) {
+        /* Replaces the result of all modifiers so far, skip this one. */
+        if (cache_item) {
+          BKE_mesh_eval_cache_item_release(cache_item);
+        }
+        cache_item = item;
+        if (mesh_final) {
+          BKE_id_free(NULL, mesh_final);
+          mesh_final = NULL;
+        }
+        MEM_SAFE_FREE(deformed_verts);
+        have_non_onlydeform_modifiers_appled = true;
+        isPrevDeform = false;
+        continue;
+      }
+    }
+
+    if (cache_item) {
+      mesh_final = BKE_mesh_eval_cache_item_mesh_copy(cache_item, mesh_input);
+      BKE_mesh_eval_cache_item_release(cache_item);
+      cache_item = NULL;
+    }
+
     /* Add orco mesh as layer if needed by this modifier. */
     if (mesh_final && mesh_orco && mti->requiredDataMask) {
       CustomData_MeshMasks mask = {0};
@@ -1267,6 +1338,11 @@ static void mesh_calc_modifiers(struct Depsgraph *depsgraph,
       }
 
       mesh_final->runtime.deformed_only = false;
+
+      /* Errors are only set when the modifier is applied, keep applying it then. */
+      if (use_eval_cache && (md->error == NULL)) {
+        BKE_mesh_eval_cache_insert(&cache_key, mesh_final);
+      }
     }
 
     isPrevDeform = (mti->type == eModifierTypeType_OnlyDeform);
@@ -1281,6 +1357,11 @@ static void mesh_calc_modifiers(struct Depsgraph *depsgraph,
     }
   }
 
+  if (cache_item) {
+    mesh_final = BKE_mesh_eval_cache_item_mesh_copy(cache_item, mesh_input);
+    BKE_mesh_eval_cache_item_release(cache_item);
+  }
+
   BLI_linklist_free((LinkNode *)datamasks, NULL);
 
   for (md = firstmd; md; md = md->next) {
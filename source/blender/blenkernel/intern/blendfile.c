@@ -364,6 +364,11 @@ static void setup_app_data(bContext *C,
     /* TODO(sergey): Can this be also move above? */
     RE_FreeAllPersistentData();
   }
+  else {
+    /* Render engines keep their depsgraph between renders, it refers to data of the previous
+     * main database. The rest of the engine data is kept for the next render. */
+    RE_FreePersistentDepsgraphs();
+  }
 
   if (mode == LOAD_UNDO) {
     /* In undo/redo case, we do a whole lot of magic tricks to avoid having to re-read linked
@@ -55,6 +55,7 @@ BMEditMesh *BKE_editmesh_copy(BMEditMesh *em)
 
   em_copy->mesh_eval_cage = em_copy->mesh_eval_final = NULL;
   em_copy->bb_cage = NULL;
+  em_copy->undo_journal = NULL;
 
   em_copy->bm = BM_mesh_copy(em->bm);
 
@@ -163,6 +164,8 @@ void BKE_editmesh_free(BMEditMesh *em)
     MEM_freeN(em->looptris);
   }
 
+  MEM_SAFE_FREE(em->undo_journal);
+
   if (em->bm) {
     BM_mesh_free(em->bm);
   }
@@ -0,0 +1,697 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/** \file
+ * \ingroup bke
+ */
+
+#include <string.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_modifier_types.h"
+#include "DNA_object_types.h"
+#include "DNA_scene_types.h"
+#include "DNA_userdef_types.h"
+
+#include "BLI_utildefines.h"
+
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
+#include "BLI_listbase.h"
+#include "BLI_math_base.h"
+#include "BLI_threads.h"
+
+#include "BKE_animsys.h"
+#include "BKE_customdata.h"
+#include "BKE_library.h"
+#include "BKE_mesh.h"
+#include "BKE_mesh_eval_cache.h"
+#include "BKE_modifier.h"
+
+#include "RNA_access.h"
+
+/* Nested structs of modifier settings, such as the custom bevel profile and its points. */
+#define MESH_EVAL_CACHE_RNA_DEPTH_MAX 3
+
+/* Keys of results evaluated once but not stored, forgotten all at once when there are more. */
+#define MESH_EVAL_CACHE_KEYS_SEEN_MAX 4096
+
+struct MeshEvalCacheItem {
+  struct MeshEvalCacheItem *next, *prev;
+  MeshEvalCacheKey key;
+  /** Copy of the result, without pointers to other data-blocks. */
+  Mesh *mesh;
+  size_t mem_size;
+  /** Evaluations copying the mesh, which isn't freed meanwhile. */
+  int users;
+  /** Removed from the cache while in use, the last user frees it. */
+  bool is_removed;
+};
+
+static struct {
+  GHash *items;
+  /** Least recently used first. */
+  ListBase lru;
+  size_t mem_in_use;
+  /**
+   * Keys of results which were evaluated once. Results are only stored when they are evaluated
+   * a second time, so that results which are never used again (changing every frame or while
+   * dragging a setting) are not copied.
+   */
+  GSet *keys_seen;
+} mesh_eval_cache = {NULL};
+
+static ThreadMutex mesh_eval_cache_mutex = BLI_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------------------- */
+/** \name Key
+ * \{ */
+
+static void mesh_eval_cache_key_add(MeshEvalCacheKey *key, const void *data, size_t data_len)
+{
+  key->hash[0] = BLI_hash_mm2(data, data_len, key->hash[0]);
+  key->hash[1] = BLI_hash_mm2(data, data_len, key->hash[1]);
+}
+
+static void mesh_eval_cache_key_add_int(MeshEvalCacheKey *key, int value)
+{
+  mesh_eval_cache_key_add(key, &value, sizeof(value));
+}
+
+static bool mesh_eval_cache_key_add_customdata(MeshEvalCacheKey *key,
+                                               const CustomData *data,
+                                               const int totelem)
+{
+  mesh_eval_cache_key_add_int(key, data->totlayer);
+
+  for (int i = 0; i < data->totlayer; i++) {
+    const CustomDataLayer *layer = &data->layers[i];
+    const int layer_info[5] = {
+        layer->type, layer->active, layer->active_rnd, layer->active_clone, layer->active_mask};
+    mesh_eval_cache_key_add(key, layer_info, sizeof(layer_info));
+    mesh_eval_cache_key_add(key, layer->name, strlen(layer->name));
+
+    if (layer->data == NULL || totelem == 0) {
+      continue;
+    }
+
+    switch (layer->type) {
+      case CD_MDEFORMVERT: {
+        const MDeformVert *dvert = layer->data;
+        for (int j = 0; j < totelem; j++, dvert++) {
+          mesh_eval_cache_key_add_int(key, dvert->totweight);
+          if (dvert->totweight) {
+            mesh_eval_cache_key_add(key, dvert->dw, sizeof(*dvert->dw) * dvert->totweight);
+          }
+        }
+        break;
+      }
+      case CD_MDISPS:
+      case CD_GRID_PAINT_MASK:
+        /* Multi-resolution data, not supported. */
+        return false;
+      default:
+        mesh_eval_cache_key_add(key, layer->data, (size_t)CustomData_sizeof(layer->type) * totelem);
+        break;
+    }
+  }
+
+  return true;
+}
+
+static void mesh_eval_cache_id_walk(void *user_data,
+                                    Object *UNUSED(ob),
+                                    ID **idpoin,
+                                    int UNUSED(cb_flag))
+{
+  if (*idpoin != NULL) {
+    *((bool *)user_data) = true;
+  }
+}
+
+static bool mesh_eval_cache_key_add_rna(MeshEvalCacheKey *key, PointerRNA *ptr, int depth)
+{
+  bool is_supported = true;
+
+  RNA_STRUCT_BEGIN_SKIP_RNA_TYPE (ptr, prop) {
+    const char *identifier = RNA_property_identifier(prop);
+    /* Don't affect the result, different names and UI state can still share it. */
+    if ((depth == 0) && (STREQ(identifier, "name") || STREQ(identifier, "show_expanded"))) {
+      continue;
+    }
+
+    const PropertyType type = RNA_property_type(prop);
+    const int array_len = ELEM(type, PROP_BOOLEAN, PROP_INT, PROP_FLOAT) ?
+                              RNA_property_array_length(ptr, prop) :
+                              0;
+
+    if (array_len > 0) {
+      /* Large enough for booleans, ints and floats. */
+      int *values = MEM_mallocN(sizeof(int) * array_len, __func__);
+      switch (type) {
+        case PROP_BOOLEAN: {
+          bool *values_bool = (bool *)values;
+          RNA_property_boolean_get_array(ptr, prop, values_bool);
+          mesh_eval_cache_key_add(key, values_bool, sizeof(*values_bool) * array_len);
+          break;
+        }
+        case PROP_INT:
+          RNA_property_int_get_array(ptr, prop, values);
+          mesh_eval_cache_key_add(key, values, sizeof(*values) * array_len);
+          break;
+        default:
+          RNA_property_float_get_array(ptr, prop, (float *)values);
+          mesh_eval_cache_key_add(key, values, sizeof(float) * array_len);
+          break;
+      }
+      MEM_freeN(values);
+      continue;
+    }
+
+    switch (type) {
+      case PROP_BOOLEAN:
+        mesh_eval_cache_key_add_int(key, RNA_property_boolean_get(ptr, prop));
+        break;
+      case PROP_INT:
+        mesh_eval_cache_key_add_int(key, RNA_property_int_get(ptr, prop));
+        break;
+      case PROP_FLOAT: {
+        const float value = RNA_property_float_get(ptr, prop);
+        mesh_eval_cache_key_add(key, &value, sizeof(value));
+        break;
+      }
+      case PROP_ENUM:
+        mesh_eval_cache_key_add_int(key, RNA_property_enum_get(ptr, prop));
+        break;
+      case PROP_STRING: {
+        char fixedbuf[256];
+        int str_len;
+        char *str = RNA_property_string_get_alloc(
+            ptr, prop, fixedbuf, sizeof(fixedbuf), &str_len);
+        mesh_eval_cache_key_add(key, str, (size_t)str_len + 1);
+        if (str != fixedbuf) {
+          MEM_freeN(str);
+        }
+        break;
+      }
+      case PROP_POINTER: {
+        PointerRNA child_ptr = RNA_property_pointer_get(ptr, prop);
+        if (child_ptr.data == NULL) {
+          mesh_eval_cache_key_add_int(key, 0);
+        }
+        else if (RNA_struct_is_ID(child_ptr.type) || (depth == MESH_EVAL_CACHE_RNA_DEPTH_MAX)) {
+          is_supported = false;
+        }
+        else {
+          is_supported = mesh_eval_cache_key_add_rna(key, &child_ptr, depth + 1);
+        }
+        break;
+      }
+      case PROP_COLLECTION: {
+        mesh_eval_cache_key_add_int(key, RNA_property_collection_length(ptr, prop));
+        RNA_PROP_BEGIN (ptr, item_ptr, prop) {
+          if ((depth == MESH_EVAL_CACHE_RNA_DEPTH_MAX) ||
+              !mesh_eval_cache_key_add_rna(key, &item_ptr, depth + 1)) {
+            is_supported = false;
+            break;
+          }
+        }
+        RNA_PROP_END;
+        break;
+      }
+    }
+
+    if (!is_supported) {
+      break;
+    }
+  }
+  RNA_STRUCT_END;
+
+  return is_supported;
+}
+
+/** Whether results of the modifier can be cached, without looking at its settings. */
+static bool mesh_eval_cache_modifier_is_supported(Object *ob, ModifierData *md)
+{
+  const ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+
+  if ((mti->flags & eModifierTypeFlag_SupportsResultCache) == 0) {
+    return false;
+  }
+  if (mti->dependsOnTime && mti->dependsOnTime(md)) {
+    return false;
+  }
+
+  /* Other data-blocks can change without changing the key. */
+  bool has_id = false;
+  if (mti->foreachIDLink) {
+    mti->foreachIDLink(md, ob, mesh_eval_cache_id_walk, &has_id);
+  }
+  else if (mti->foreachObjectLink) {
+    mti->foreachObjectLink(md, ob, (ObjectWalkFunc)mesh_eval_cache_id_walk, &has_id);
+  }
+  return !has_id;
+}
+
+/* Values of #Mesh_Runtime.eval_cache_input_state. */
+enum {
+  /** The data may have changed since the last evaluation using the mesh. */
+  MESH_EVAL_CACHE_INPUT_CHANGED = 0,
+  /** The data didn't change since the last evaluation, but isn't hashed yet. */
+  MESH_EVAL_CACHE_INPUT_UNCHANGED = 1,
+  MESH_EVAL_CACHE_INPUT_HASHED = 2,
+  /** The data can't be used as input of a cached result. */
+  MESH_EVAL_CACHE_INPUT_UNSUPPORTED = 3,
+};
+
+/** Hash the element counts and custom-data of the mesh, the expensive part of the key. */
+static bool mesh_eval_cache_input_hash(const Mesh *mesh_input, unsigned int r_hash[2])
+{
+  MeshEvalCacheKey key = {{0, 0x9e3779b9}};
+
+  const int totelem[] = {
+      mesh_input->totvert, mesh_input->totedge, mesh_input->totloop, mesh_input->totpoly};
+  mesh_eval_cache_key_add(&key, totelem, sizeof(totelem));
+
+  if (!(mesh_eval_cache_key_add_customdata(&key, &mesh_input->vdata, mesh_input->totvert) &&
+        mesh_eval_cache_key_add_customdata(&key, &mesh_input->edata, mesh_input->totedge) &&
+        mesh_eval_cache_key_add_customdata(&key, &mesh_input->ldata, mesh_input->totloop) &&
+        mesh_eval_cache_key_add_customdata(&key, &mesh_input->pdata, mesh_input->totpoly))) {
+    return false;
+  }
+
+  r_hash[0] = key.hash[0];
+  r_hash[1] = key.hash[1];
+  return true;
+}
+
+/**
+ * Get the hash of the input mesh data, stored in the mesh so it's only computed once while the
+ * data doesn't change. Copy-on-write updates reset it, see #BKE_mesh_runtime_reset_on_copy.
+ *
+ * The data is only hashed once an evaluation finds it unchanged since the previous one, inputs
+ * changing on every evaluation (animation, edits) never pay for it.
+ */
+static bool mesh_eval_cache_input_hash_get(Mesh *mesh_input, unsigned int r_hash[2])
+{
+  Mesh_Runtime *runtime = &mesh_input->runtime;
+
+  /* Objects sharing the mesh are evaluated in parallel. */
+  BLI_mutex_lock(runtime->eval_mutex);
+  if (mesh_input->id.recalc & ID_RECALC_GEOMETRY) {
+    runtime->eval_cache_input_state = MESH_EVAL_CACHE_INPUT_CHANGED;
+  }
+  switch (runtime->eval_cache_input_state) {
+    case MESH_EVAL_CACHE_INPUT_CHANGED:
+      runtime->eval_cache_input_state = MESH_EVAL_CACHE_INPUT_UNCHANGED;
+      break;
+    case MESH_EVAL_CACHE_INPUT_UNCHANGED:
+      runtime->eval_cache_input_state = mesh_eval_cache_input_hash(
+                                            mesh_input, runtime->eval_cache_input_hash) ?
+                                            MESH_EVAL_CACHE_INPUT_HASHED :
+                                            MESH_EVAL_CACHE_INPUT_UNSUPPORTED;
+      break;
+  }
+  const bool is_hashed = (runtime->eval_cache_input_state == MESH_EVAL_CACHE_INPUT_HASHED);
+  if (is_hashed) {
+    r_hash[0] = runtime->eval_cache_input_hash[0];
+    r_hash[1] = runtime->eval_cache_input_hash[1];
+  }
+  BLI_mutex_unlock(runtime->eval_mutex);
+
+  return is_hashed;
+}
+
+/**
+ * Start a key with the input of the modifier stack, starting at \a md_first.
+ *
+ * Checks from cheapest to most expensive: whether the modifiers can use the cache at all, then
+ * whether the input mesh is unchanged since the previous evaluation, the data is only hashed
+ * after that.
+ *
+ * \return false when the stack can't use the cache.
+ */
+bool BKE_mesh_eval_cache_key_init(MeshEvalCacheKey *key,
+                                  const Scene *scene,
+                                  Object *ob,
+                                  ModifierData *md_first,
+                                  Mesh *mesh_input,
+                                  const int apply_flag)
+{
+  /* Nothing to store without a modifier creating a new mesh, before the first modifier which
+   * doesn't support caching. */
+  const int required_mode = (apply_flag & MOD_APPLY_RENDER) ? eModifierMode_Render :
+                                                              eModifierMode_Realtime;
+  bool has_supported_modifier = false;
+  for (ModifierData *md = md_first; md; md = md->next) {
+    if (!modifier_isEnabled(scene, md, required_mode)) {
+      continue;
+    }
+    if (!mesh_eval_cache_modifier_is_supported(ob, md)) {
+      break;
+    }
+    if (modifierType_getInfo(md->type)->type != eModifierTypeType_OnlyDeform) {
+      has_supported_modifier = true;
+      break;
+    }
+  }
+  if (!has_supported_modifier) {
+    return false;
+  }
+
+  /* Legacy meshes with only tessellated faces. */
+  if ((mesh_input->totpoly == 0) && (mesh_input->totface != 0)) {
+    return false;
+  }
+
+  unsigned int input_hash[2];
+  if (!mesh_eval_cache_input_hash_get(mesh_input, input_hash)) {
+    return false;
+  }
+
+  key->hash[0] = 0;
+  key->hash[1] = 0x9e3779b9;
+  mesh_eval_cache_key_add(key, input_hash, sizeof(input_hash));
+
+  /* Settings of the scene, object and mesh which modifiers use. */
+  const int settings[] = {
+      apply_flag,
+      scene->r.mode & R_SIMPLIFY,
+      scene->r.simplify_subsurf,
+      scene->r.simplify_subsurf_render,
+      ob->totcol,
+      mesh_input->flag,
+      mesh_input->cd_flag,
+  };
+  mesh_eval_cache_key_add(key, settings, sizeof(settings));
+  mesh_eval_cache_key_add(key, &mesh_input->smoothresh, sizeof(mesh_input->smoothresh));
+
+  /* Vertex groups are looked up by name. */
+  LISTBASE_FOREACH (bDeformGroup *, dg, &ob->defbase) {
+    mesh_eval_cache_key_add(key, dg->name, strlen(dg->name) + 1);
+  }
+
+  return true;
+}
+
+/**
+ * Add a modifier applied to the result identified by the key.
+ *
+ * \return false when the modifier doesn't support caching, results of the modifiers which
+ * follow can't be cached either.
+ */
+bool BKE_mesh_eval_cache_key_add_modifier(MeshEvalCacheKey *key, Object *ob, ModifierData *md)
+{
+  if (!mesh_eval_cache_modifier_is_supported(ob, md)) {
+    return false;
+  }
+
+  mesh_eval_cache_key_add_int(key, md->type);
+
+  PointerRNA ptr;
+  RNA_pointer_create(&ob->id, &RNA_Modifier, md, &ptr);
+  return mesh_eval_cache_key_add_rna(key, &ptr, 0);
+}
+
+/** Add other state which changes the result, such as the custom-data layers copied. */
+void BKE_mesh_eval_cache_key_add_data(MeshEvalCacheKey *key, const void *data, size_t data_len)
+{
+  mesh_eval_cache_key_add(key, data, data_len);
+}
+
+static uint mesh_eval_cache_key_hash(const void *key_v)
+{
+  const MeshEvalCacheKey *key = key_v;
+  return key->hash[0];
+}
+
+static bool mesh_eval_cache_key_cmp(const void *a_v, const void *b_v)
+{
+  const MeshEvalCacheKey *a = a_v, *b = b_v;
+  return (a->hash[0] != b->hash[0]) || (a->hash[1] != b->hash[1]);
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Items
+ * \{ */
+
+static size_t mesh_eval_cache_customdata_size(const CustomData *data, const int totelem)
+{
+  size_t mem_size = 0;
+  for (int i = 0; i < data->totlayer; i++) {
+    const CustomDataLayer *layer = &data->layers[i];
+    mem_size += (size_t)CustomData_sizeof(layer->type) * totelem;
+
+    if ((layer->type == CD_MDEFORMVERT) && layer->data) {
+      const MDeformVert *dvert = layer->data;
+      for (int j = 0; j < totelem; j++) {
+        mem_size += sizeof(*dvert->dw) * dvert[j].totweight;
+      }
+    }
+  }
+  return mem_size;
+}
+
+static size_t mesh_eval_cache_mesh_size(const Mesh *mesh)
+{
+  return (sizeof(*mesh) + mesh_eval_cache_customdata_size(&mesh->vdata, mesh->totvert) +
+          mesh_eval_cache_customdata_size(&mesh->edata, mesh->totedge) +
+          mesh_eval_cache_customdata_size(&mesh->fdata, mesh->totface) +
+          mesh_eval_cache_customdata_size(&mesh->ldata, mesh->totloop) +
+          mesh_eval_cache_customdata_size(&mesh->pdata, mesh->totpoly));
+}
+
+/**
+ * Pointers to other data-blocks aren't valid once the evaluation which created the mesh is done,
+ * they are taken from the input mesh instead, see #BKE_mesh_eval_cache_item_mesh_copy.
+ */
+static void mesh_eval_cache_mesh_strip(Mesh *mesh)
+{
+  MEM_SAFE_FREE(mesh->mat);
+  mesh->totcol = 0;
+  mesh->key = NULL;
+  mesh->texcomesh = NULL;
+  mesh->edit_mesh = NULL;
+  if (mesh->adt) {
+    BKE_animdata_free(&mesh->id, false);
+  }
+}
+
+static void mesh_eval_cache_item_free(MeshEvalCacheItem *item)
+{
+  BKE_id_free(NULL, item->mesh);
+  MEM_freeN(item);
+}
+
+/**
+ * Remove least recently used items until the memory in use is below the limit.
+ * Items in use are freed by their last user, see #BKE_mesh_eval_cache_item_release.
+ *
+ * \note Must be called with the cache locked, items to free are added to \a r_items_free.
+ */
+static void mesh_eval_cache_limit_enforce(const size_t limit, ListBase *r_items_free)
+{
+  MeshEvalCacheItem *item = mesh_eval_cache.lru.first;
+  while (item && (mesh_eval_cache.mem_in_use > limit)) {
+    MeshEvalCacheItem *item_next = item->next;
+
+    BLI_ghash_remove(mesh_eval_cache.items, &item->key, NULL, NULL);
+    BLI_remlink(&mesh_eval_cache.lru, item);
+    mesh_eval_cache.mem_in_use -= item->mem_size;
+
+    if (item->users) {
+      item->is_removed = true;
+    }
+    else {
+      BLI_addtail(r_items_free, item);
+    }
+    item = item_next;
+  }
+}
+
+static size_t mesh_eval_cache_limit_get(void)
+{
+  return (size_t)max_ii(U.mesh_eval_cache_limit, 0) * 1024 * 1024;
+}
+
+/**
+ * Find the result for a key, the item must be released once the mesh is copied.
+ */
+MeshEvalCacheItem *BKE_mesh_eval_cache_lookup(const MeshEvalCacheKey *key)
+{
+  MeshEvalCacheItem *item = NULL;
+
+  BLI_mutex_lock(&mesh_eval_cache_mutex);
+  if (mesh_eval_cache.items) {
+    item = BLI_ghash_lookup(mesh_eval_cache.items, key);
+    if (item) {
+      item->users += 1;
+      BLI_remlink(&mesh_eval_cache.lru, item);
+      BLI_addtail(&mesh_eval_cache.lru, item);
+    }
+  }
+  BLI_mutex_unlock(&mesh_eval_cache_mutex);
+
+  return item;
+}
+
+/** Copy of the cached mesh, using the materials and settings of the input mesh. */
+Mesh *BKE_mesh_eval_cache_item_mesh_copy(MeshEvalCacheItem *item, const Mesh *mesh_input)
+{
+  /* Not modified while there are users, no need to lock. */
+  Mesh *mesh = BKE_mesh_copy_for_eval(item->mesh, false);
+  BKE_mesh_copy_settings(mesh, mesh_input);
+  return mesh;
+}
+
+void BKE_mesh_eval_cache_item_release(MeshEvalCacheItem *item)
+{
+  BLI_mutex_lock(&mesh_eval_cache_mutex);
+  BLI_assert(item->users > 0);
+  item->users -= 1;
+  const bool do_free = (item->users == 0) && item->is_removed;
+  BLI_mutex_unlock(&mesh_eval_cache_mutex);
+
+  if (do_free) {
+    mesh_eval_cache_item_free(item);
+  }
+}
+
+/**
+ * Remember the key of a result which is not stored,
+ * returns true when the result was evaluated before (and should be stored now).
+ *
+ * \note Must be called with the cache locked.
+ */
+static bool mesh_eval_cache_key_seen_ensure(const MeshEvalCacheKey *key)
+{
+  if (mesh_eval_cache.keys_seen == NULL) {
+    mesh_eval_cache.keys_seen = BLI_gset_new(
+        mesh_eval_cache_key_hash, mesh_eval_cache_key_cmp, __func__);
+  }
+  else if (BLI_gset_haskey(mesh_eval_cache.keys_seen, key)) {
+    BLI_gset_remove(mesh_eval_cache.keys_seen, key, MEM_freeN);
+    return true;
+  }
+  else if (BLI_gset_len(mesh_eval_cache.keys_seen) >= MESH_EVAL_CACHE_KEYS_SEEN_MAX) {
+    BLI_gset_clear(mesh_eval_cache.keys_seen, MEM_freeN);
+  }
+
+  MeshEvalCacheKey *key_seen = MEM_mallocN(sizeof(*key_seen), __func__);
+  *key_seen = *key;
+  BLI_gset_insert(mesh_eval_cache.keys_seen, key_seen);
+  return false;
+}
+
+/**
+ * Store a copy of the result identified by the key,
+ * removing least recently used results when over the memory limit.
+ *
+ * The first time a key is inserted only the key is remembered, the mesh is copied when the same
+ * result is evaluated again. So evaluations which never repeat don't pay for the copy.
+ */
+void BKE_mesh_eval_cache_insert(const MeshEvalCacheKey *key, Mesh *mesh)
+{
+  const size_t limit = mesh_eval_cache_limit_get();
+  const size_t mem_size = mesh_eval_cache_mesh_size(mesh);
+  if (mem_size > limit) {
+    return;
+  }
+
+  /* Another object with the same input may have stored it already. */
+  BLI_mutex_lock(&mesh_eval_cache_mutex);
+  const bool is_cached = mesh_eval_cache.items && BLI_ghash_haskey(mesh_eval_cache.items, key);
+  const bool do_insert = !is_cached && mesh_eval_cache_key_seen_ensure(key);
+  BLI_mutex_unlock(&mesh_eval_cache_mutex);
+  if (!do_insert) {
+    return;
+  }
+
+  /* Copy without the lock held, other objects are evaluated meanwhile. */
+  MeshEvalCacheItem *item = MEM_callocN(sizeof(*item), __func__);
+  item->key = *key;
+  item->mesh = BKE_mesh_copy_for_eval(mesh, false);
+  item->mem_size = mem_size;
+  mesh_eval_cache_mesh_strip(item->mesh);
+
+  ListBase items_free = {NULL, NULL};
+
+  BLI_mutex_lock(&mesh_eval_cache_mutex);
+  if (mesh_eval_cache.items == NULL) {
+    mesh_eval_cache.items = BLI_ghash_new(
+        mesh_eval_cache_key_hash, mesh_eval_cache_key_cmp, __func__);
+  }
+  void **item_p;
+  if (BLI_ghash_ensure_p(mesh_eval_cache.items, &item->key, &item_p)) {
+    BLI_addtail(&items_free, item);
+  }
+  else {
+    *item_p = item;
+    BLI_addtail(&mesh_eval_cache.lru, item);
+    mesh_eval_cache.mem_in_use += mem_size;
+    mesh_eval_cache_limit_enforce(limit, &items_free);
+  }
+  BLI_mutex_unlock(&mesh_eval_cache_mutex);
+
+  LISTBASE_FOREACH_MUTABLE (MeshEvalCacheItem *, item_free, &items_free) {
+    mesh_eval_cache_item_free(item_free);
+  }
+}
+
+/** Apply a change of #UserDef.mesh_eval_cache_limit. */
+void BKE_mesh_eval_cache_limit_update(void)
+{
+  ListBase items_free = {NULL, NULL};
+
+  BLI_mutex_lock(&mesh_eval_cache_mutex);
+  if (mesh_eval_cache.items) {
+    mesh_eval_cache_limit_enforce(mesh_eval_cache_limit_get(), &items_free);
+  }
+  BLI_mutex_unlock(&mesh_eval_cache_mutex);
+
+  LISTBASE_FOREACH_MUTABLE (MeshEvalCacheItem *, item, &items_free) {
+    mesh_eval_cache_item_free(item);
+  }
+}
+
+void BKE_mesh_eval_cache_exit(void)
+{
+  if (mesh_eval_cache.keys_seen) {
+    BLI_gset_free(mesh_eval_cache.keys_seen, MEM_freeN);
+    mesh_eval_cache.keys_seen = NULL;
+  }
+
+  if (mesh_eval_cache.items == NULL) {
+    return;
+  }
+
+  LISTBASE_FOREACH_MUTABLE (MeshEvalCacheItem *, item, &mesh_eval_cache.lru) {
+    BLI_assert(item->users == 0);
+    mesh_eval_cache_item_free(item);
+  }
+  BLI_ghash_free(mesh_eval_cache.items, NULL, NULL);
+
+  mesh_eval_cache.items = NULL;
+  BLI_listbase_clear(&mesh_eval_cache.lru);
+  mesh_eval_cache.mem_in_use = 0;
+}
+
+/** \} */
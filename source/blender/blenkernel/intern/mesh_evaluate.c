@@ -44,6 +44,7 @@
 #include "BLI_alloca.h"
 #include "BLI_stack.h"
 #include "BLI_task.h"
+#include "BLI_threads.h"
 
 #include "BKE_customdata.h"
 #include "BKE_global.h"
@@ -213,11 +214,33 @@ typedef struct MeshCalcNormalsData {
   const MPoly *mpolys;
   const MLoop *mloop;
   MVert *mverts;
+  const MLoopTri *looptri;
   float (*pnors)[3];
-  float (*lnors_weighted)[3];
   float (*vnors)[3];
+  /**
+   * When faces are split between threads, the angle weighted face normal of every face corner
+   * (a loop, or a corner of a #MLoopTri) is stored, then every vertex adds up the normals of its
+   * corners in corner order. This gives the same normals whatever the number of threads.
+   */
+  float (*lnors_weighted)[3];
+  /** Number of corners of every vertex, then the end of its corners in `vert_corners`. */
+  int *vert_corners_end;
+  int *vert_corners;
 } MeshCalcNormalsData;
 
+/**
+ * Only split the faces between threads when there is more than one core to run them on, storing
+ * the corner normals and adding them up afterwards costs more than adding them up directly.
+ * This also disables threading in `settings` otherwise.
+ */
+static bool mesh_calc_normals_use_threading(const int faces_num, TaskParallelSettings *settings)
+{
+  if (faces_num <= settings->min_iter_per_thread || BLI_system_thread_count() == 1) {
+    settings->use_threading = false;
+  }
+  return settings->use_threading;
+}
+
 static void mesh_calc_normals_poly_cb(void *__restrict userdata,
                                       const int pidx,
                                       const TaskParallelTLS *__restrict UNUSED(tls))
@@ -228,22 +251,35 @@ static void mesh_calc_normals_poly_cb(void *__restrict userdata,
   BKE_mesh_calc_poly_normal(mp, data->mloop + mp->loopstart, data->mverts, data->pnors[pidx]);
 }
 
-static void mesh_calc_normals_poly_prepare_cb(void *__restrict userdata,
-                                              const int pidx,
-                                              const TaskParallelTLS *__restrict UNUSED(tls))
+/**
+ * Add the angle weighted face normal to the normal of the corner vertex, or store it for
+ * #mesh_calc_normals_vert_gather_cb when faces are split between threads.
+ */
+BLI_INLINE void mesh_calc_normals_corner_accum(const MeshCalcNormalsData *data,
+                                               const int corner,
+                                               const unsigned int vert,
+                                               const float pnor[3],
+                                               const float fac)
 {
-  MeshCalcNormalsData *data = userdata;
-  const MPoly *mp = &data->mpolys[pidx];
-  const MLoop *ml = &data->mloop[mp->loopstart];
-  const MVert *mverts = data->mverts;
-
-  float pnor_temp[3];
-  float *pnor = data->pnors ? data->pnors[pidx] : pnor_temp;
-  float(*lnors_weighted)[3] = data->lnors_weighted;
+  if (data->lnors_weighted) {
+    mul_v3_v3fl(data->lnors_weighted[corner], pnor, fac);
+    atomic_add_and_fetch_int32(&data->vert_corners_end[vert], 1);
+  }
+  else {
+    madd_v3_v3fl(data->vnors[vert], pnor, fac);
+  }
+}
 
-  const int nverts = mp->totloop;
-  float(*edgevecbuf)[3] = BLI_array_alloca(edgevecbuf, (size_t)nverts);
-  int i;
+/* Inlined with a constant number of vertices for triangles and quads,
+ * which unrolls the loops and keeps the edge vectors in registers. */
+BLI_INLINE void mesh_calc_normals_poly_accum(const MeshCalcNormalsData *data,
+                                             const int loopstart,
+                                             float pnor[3],
+                                             float (*edgevecbuf)[3],
+                                             const int nverts)
+{
+  const MVert *mverts = data->mverts;
+  const MLoop *ml = &data->mloop[loopstart];
 
   /* Polygon Normal and edge-vector */
   /* inline version of #BKE_mesh_calc_poly_normal, also does edge-vectors */
@@ -254,7 +290,7 @@ static void mesh_calc_normals_poly_prepare_cb(void *__restrict userdata,
 
     zero_v3(pnor);
     /* Newell's Method */
-    for (i = 0; i < nverts; i++) {
+    for (int i = 0; i < nverts; i++) {
       v_curr = mverts[ml[i].v].co;
       add_newell_cross_v3_v3v3(pnor, v_prev, v_curr);
 
@@ -271,33 +307,55 @@ static void mesh_calc_normals_poly_prepare_cb(void *__restrict userdata,
   }
 
   /* accumulate angle weighted face normal */
-  /* inline version of #accumulate_vertex_normals_poly_v3,
-   * split between this threaded callback and #mesh_calc_normals_poly_accum_cb. */
+  /* inline version of #accumulate_vertex_normals_poly_v3 */
   {
     const float *prev_edge = edgevecbuf[nverts - 1];
 
-    for (i = 0; i < nverts; i++) {
-      const int lidx = mp->loopstart + i;
+    for (int i = 0; i < nverts; i++) {
       const float *cur_edge = edgevecbuf[i];
 
       /* calculate angle between the two poly edges incident on
        * this vertex */
       const float fac = saacos(-dot_v3v3(cur_edge, prev_edge));
 
-      /* Store for later accumulation */
-      mul_v3_v3fl(lnors_weighted[lidx], pnor, fac);
+      mesh_calc_normals_corner_accum(data, loopstart + i, ml[i].v, pnor, fac);
 
       prev_edge = cur_edge;
     }
   }
 }
 
-static void mesh_calc_normals_poly_finalize_cb(void *__restrict userdata,
-                                               const int vidx,
-                                               const TaskParallelTLS *__restrict UNUSED(tls))
+static void mesh_calc_normals_poly_accum_cb(void *__restrict userdata,
+                                            const int pidx,
+                                            const TaskParallelTLS *__restrict UNUSED(tls))
 {
   MeshCalcNormalsData *data = userdata;
+  const MPoly *mp = &data->mpolys[pidx];
 
+  float pnor_temp[3];
+  float *pnor = data->pnors ? data->pnors[pidx] : pnor_temp;
+
+  switch (mp->totloop) {
+    case 3: {
+      float edgevecbuf[3][3];
+      mesh_calc_normals_poly_accum(data, mp->loopstart, pnor, edgevecbuf, 3);
+      break;
+    }
+    case 4: {
+      float edgevecbuf[4][3];
+      mesh_calc_normals_poly_accum(data, mp->loopstart, pnor, edgevecbuf, 4);
+      break;
+    }
+    default: {
+      float(*edgevecbuf)[3] = BLI_array_alloca(edgevecbuf, (size_t)mp->totloop);
+      mesh_calc_normals_poly_accum(data, mp->loopstart, pnor, edgevecbuf, mp->totloop);
+      break;
+    }
+  }
+}
+
+BLI_INLINE void mesh_calc_normals_vert_finalize(const MeshCalcNormalsData *data, const int vidx)
+{
   MVert *mv = &data->mverts[vidx];
   float *no = data->vnors[vidx];
 
@@ -309,6 +367,93 @@ static void mesh_calc_normals_poly_finalize_cb(void *__restrict userdata,
   normal_float_to_short_v3(mv->no, no);
 }
 
+static void mesh_calc_normals_poly_finalize_cb(void *__restrict userdata,
+                                               const int vidx,
+                                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  mesh_calc_normals_vert_finalize(userdata, vidx);
+}
+
+static void mesh_calc_normals_vert_corners_fill_cb(void *__restrict userdata,
+                                                   const int corner,
+                                                   const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshCalcNormalsData *data = userdata;
+  const unsigned int lidx = data->looptri ? data->looptri[corner / 3].tri[corner % 3] :
+                                            (unsigned int)corner;
+  const unsigned int vidx = data->mloop[lidx].v;
+
+  const int index = atomic_fetch_and_add_int32(&data->vert_corners_end[vidx], 1);
+  data->vert_corners[index] = corner;
+}
+
+static int mesh_calc_normals_corner_cmp(const void *a, const void *b)
+{
+  const int corner_a = *(const int *)a, corner_b = *(const int *)b;
+  return (corner_a > corner_b) - (corner_a < corner_b);
+}
+
+static void mesh_calc_normals_vert_gather_cb(void *__restrict userdata,
+                                             const int vidx,
+                                             const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshCalcNormalsData *data = userdata;
+  int *corners = &data->vert_corners[vidx ? data->vert_corners_end[vidx - 1] : 0];
+  const int corners_num = (int)(&data->vert_corners[data->vert_corners_end[vidx]] - corners);
+
+  /* Corners were added by multiple threads, sort them so they are always added up in the same
+   * order. Threads handle ranges of faces, so they are mostly sorted already. */
+  if (corners_num > 32) {
+    qsort(corners, (size_t)corners_num, sizeof(*corners), mesh_calc_normals_corner_cmp);
+  }
+  else {
+    for (int i = 1; i < corners_num; i++) {
+      const int corner = corners[i];
+      int j = i;
+      for (; j > 0 && corners[j - 1] > corner; j--) {
+        corners[j] = corners[j - 1];
+      }
+      corners[j] = corner;
+    }
+  }
+
+  float *no = data->vnors[vidx];
+  for (int i = 0; i < corners_num; i++) {
+    add_v3_v3(no, data->lnors_weighted[corners[i]]);
+  }
+
+  mesh_calc_normals_vert_finalize(data, vidx);
+}
+
+/**
+ * Add up the corner normals stored by the threaded face pass into vertex normals and finalize
+ * them, then free the corner data. Vertex normals are expected to be zeroed.
+ */
+static void mesh_calc_normals_vert_gather(MeshCalcNormalsData *data,
+                                          const int numVerts,
+                                          const int corners_num,
+                                          TaskParallelSettings *settings)
+{
+  /* Turn the number of corners of every vertex into the start of its corners,
+   * the fill pass moves them to the end. */
+  int *vert_corners_end = data->vert_corners_end;
+  int corners_start = 0;
+  for (int vidx = 0; vidx < numVerts; vidx++) {
+    const int vert_corners_num = vert_corners_end[vidx];
+    vert_corners_end[vidx] = corners_start;
+    corners_start += vert_corners_num;
+  }
+  BLI_assert(corners_start == corners_num);
+
+  data->vert_corners = MEM_malloc_arrayN((size_t)corners_num, sizeof(int), __func__);
+  BLI_task_parallel_range(0, corners_num, data, mesh_calc_normals_vert_corners_fill_cb, settings);
+  BLI_task_parallel_range(0, numVerts, data, mesh_calc_normals_vert_gather_cb, settings);
+
+  MEM_freeN(data->vert_corners);
+  MEM_freeN(data->vert_corners_end);
+  MEM_freeN(data->lnors_weighted);
+}
+
 void BKE_mesh_calc_normals_poly(MVert *mverts,
                                 float (*r_vertnors)[3],
                                 int numVerts,
@@ -341,8 +486,6 @@ void BKE_mesh_calc_normals_poly(MVert *mverts,
   }
 
   float(*vnors)[3] = r_vertnors;
-  float(*lnors_weighted)[3] = MEM_malloc_arrayN(
-      (size_t)numLoops, sizeof(*lnors_weighted), __func__);
   bool free_vnors = false;
 
   /* first go through and calculate normals for all the polys */
@@ -354,33 +497,35 @@ void BKE_mesh_calc_normals_poly(MVert *mverts,
     memset(vnors, 0, sizeof(*vnors) * (size_t)numVerts);
   }
 
+  TaskParallelSettings settings_accum = settings;
+  const bool use_threading = mesh_calc_normals_use_threading(numPolys, &settings_accum);
   MeshCalcNormalsData data = {
       .mpolys = mpolys,
       .mloop = mloop,
       .mverts = mverts,
       .pnors = pnors,
-      .lnors_weighted = lnors_weighted,
       .vnors = vnors,
   };
-
-  /* Compute poly normals, and prepare weighted loop normals. */
-  BLI_task_parallel_range(0, numPolys, &data, mesh_calc_normals_poly_prepare_cb, &settings);
-
-  /* Actually accumulate weighted loop normals into vertex ones. */
-  /* Unfortunately, not possible to thread that
-   * (not in a reasonable, totally lock- and barrier-free fashion),
-   * since several loops will point to the same vertex... */
-  for (int lidx = 0; lidx < numLoops; lidx++) {
-    add_v3_v3(vnors[mloop[lidx].v], data.lnors_weighted[lidx]);
+  if (use_threading) {
+    data.lnors_weighted = MEM_malloc_arrayN(
+        (size_t)numLoops, sizeof(*data.lnors_weighted), __func__);
+    data.vert_corners_end = MEM_calloc_arrayN((size_t)numVerts, sizeof(int), __func__);
   }
 
+  /* Compute poly normals, and accumulate them into vertex ones. */
+  BLI_task_parallel_range(0, numPolys, &data, mesh_calc_normals_poly_accum_cb, &settings_accum);
+
   /* Normalize and validate computed vertex normals. */
-  BLI_task_parallel_range(0, numVerts, &data, mesh_calc_normals_poly_finalize_cb, &settings);
+  if (use_threading) {
+    mesh_calc_normals_vert_gather(&data, numVerts, numLoops, &settings);
+  }
+  else {
+    BLI_task_parallel_range(0, numVerts, &data, mesh_calc_normals_poly_finalize_cb, &settings);
+  }
 
   if (free_vnors) {
     MEM_freeN(vnors);
   }
-  MEM_freeN(lnors_weighted);
 }
 
 void BKE_mesh_ensure_normals(Mesh *mesh)
@@ -448,6 +593,43 @@ void BKE_mesh_calc_normals(Mesh *mesh)
   mesh->runtime.cd_dirty_vert &= ~CD_MASK_NORMAL;
 }
 
+static void mesh_calc_normals_looptri_accum_cb(void *__restrict userdata,
+                                               const int i,
+                                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshCalcNormalsData *data = userdata;
+  const MLoopTri *lt = &data->looptri[i];
+  const MVert *mverts = data->mverts;
+  float *f_no = data->pnors[i];
+  const unsigned int vtri[3] = {
+      data->mloop[lt->tri[0]].v,
+      data->mloop[lt->tri[1]].v,
+      data->mloop[lt->tri[2]].v,
+  };
+  const float *co[3] = {mverts[vtri[0]].co, mverts[vtri[1]].co, mverts[vtri[2]].co};
+
+  normal_tri_v3(f_no, co[0], co[1], co[2]);
+
+  /* inline version of #accumulate_vertex_normals_tri_v3 */
+  float edgevecbuf[3][3];
+  sub_v3_v3v3(edgevecbuf[0], co[1], co[0]);
+  sub_v3_v3v3(edgevecbuf[1], co[2], co[1]);
+  sub_v3_v3v3(edgevecbuf[2], co[0], co[2]);
+  normalize_v3(edgevecbuf[0]);
+  normalize_v3(edgevecbuf[1]);
+  normalize_v3(edgevecbuf[2]);
+
+  const float *prev_edge = edgevecbuf[2];
+  for (int j = 0; j < 3; j++) {
+    const float *cur_edge = edgevecbuf[j];
+    const float fac = saacos(-dot_v3v3(cur_edge, prev_edge));
+
+    mesh_calc_normals_corner_accum(data, i * 3 + j, vtri[j], f_no, fac);
+
+    prev_edge = cur_edge;
+  }
+}
+
 void BKE_mesh_calc_normals_looptri(MVert *mverts,
                                    int numVerts,
                                    const MLoop *mloop,
@@ -458,46 +640,38 @@ void BKE_mesh_calc_normals_looptri(MVert *mverts,
   float(*tnorms)[3] = MEM_calloc_arrayN((size_t)numVerts, sizeof(*tnorms), "tnorms");
   float(*fnors)[3] = (r_tri_nors) ?
                          r_tri_nors :
-                         MEM_calloc_arrayN((size_t)looptri_num, sizeof(*fnors), "meshnormals");
-  int i;
-
-  if (!tnorms || !fnors) {
-    goto cleanup;
-  }
+                         MEM_malloc_arrayN((size_t)looptri_num, sizeof(*fnors), "meshnormals");
 
-  for (i = 0; i < looptri_num; i++) {
-    const MLoopTri *lt = &looptri[i];
-    float *f_no = fnors[i];
-    const unsigned int vtri[3] = {
-        mloop[lt->tri[0]].v,
-        mloop[lt->tri[1]].v,
-        mloop[lt->tri[2]].v,
-    };
-
-    normal_tri_v3(f_no, mverts[vtri[0]].co, mverts[vtri[1]].co, mverts[vtri[2]].co);
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1024;
 
-    accumulate_vertex_normals_tri_v3(tnorms[vtri[0]],
-                                     tnorms[vtri[1]],
-                                     tnorms[vtri[2]],
-                                     f_no,
-                                     mverts[vtri[0]].co,
-                                     mverts[vtri[1]].co,
-                                     mverts[vtri[2]].co);
+  TaskParallelSettings settings_accum = settings;
+  const bool use_threading = mesh_calc_normals_use_threading(looptri_num, &settings_accum);
+  MeshCalcNormalsData data = {
+      .mloop = mloop,
+      .mverts = mverts,
+      .looptri = looptri,
+      .pnors = fnors,
+      .vnors = tnorms,
+  };
+  if (use_threading) {
+    data.lnors_weighted = MEM_malloc_arrayN(
+        (size_t)looptri_num * 3, sizeof(*data.lnors_weighted), __func__);
+    data.vert_corners_end = MEM_calloc_arrayN((size_t)numVerts, sizeof(int), __func__);
   }
 
-  /* following Mesh convention; we use vertex coordinate itself for normal in this case */
-  for (i = 0; i < numVerts; i++) {
-    MVert *mv = &mverts[i];
-    float *no = tnorms[i];
-
-    if (UNLIKELY(normalize_v3(no) == 0.0f)) {
-      normalize_v3_v3(no, mv->co);
-    }
+  BLI_task_parallel_range(
+      0, looptri_num, &data, mesh_calc_normals_looptri_accum_cb, &settings_accum);
 
-    normal_float_to_short_v3(mv->no, no);
+  /* following Mesh convention; we use vertex coordinate itself for normal in this case */
+  if (use_threading) {
+    mesh_calc_normals_vert_gather(&data, numVerts, looptri_num * 3, &settings);
+  }
+  else {
+    BLI_task_parallel_range(0, numVerts, &data, mesh_calc_normals_poly_finalize_cb, &settings);
   }
 
-cleanup:
   MEM_freeN(tnorms);
 
   if (fnors != r_tri_nors) {
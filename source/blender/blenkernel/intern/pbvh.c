@@ -50,6 +50,10 @@
 
 //#define PERFCNTRS
 
+#ifdef PERFCNTRS
+#  include "PIL_time.h"
+#endif
+
 #define STACK_FIXED_DEPTH 100
 
 typedef struct PBVHStack {
@@ -171,28 +175,6 @@ static bool grid_materials_match(const DMFlagMat *f1, const DMFlagMat *f2)
   return ((f1->flag & ME_SMOOTH) == (f2->flag & ME_SMOOTH) && (f1->mat_nr == f2->mat_nr));
 }
 
-/* Adapted from BLI_kdopbvh.c */
-/* Returns the index of the first element on the right of the partition */
-static int partition_indices(int *prim_indices, int lo, int hi, int axis, float mid, BBC *prim_bbc)
-{
-  int i = lo, j = hi;
-  for (;;) {
-    for (; prim_bbc[prim_indices[i]].bcentroid[axis] < mid; i++) {
-      /* pass */
-    }
-    for (; mid < prim_bbc[prim_indices[j]].bcentroid[axis]; j--) {
-      /* pass */
-    }
-
-    if (!(i < j)) {
-      return i;
-    }
-
-    SWAP(int, prim_indices[i], prim_indices[j]);
-    i++;
-  }
-}
-
 /* Returns the index of the first element on the right of the partition */
 static int partition_indices_material(PBVH *bvh, int lo, int hi)
 {
@@ -250,6 +232,18 @@ void pbvh_grow_nodes(PBVH *bvh, int totnode)
   bvh->totnode = totnode;
 }
 
+/* Leaves are built in parallel, the first leaf to use a vertex owns it. */
+static bool map_claim_vert(PBVH *bvh, int vertex)
+{
+  BLI_bitmap *block = &bvh->vert_bitmap[vertex >> _BITMAP_POWER];
+  const uint32_t mask = 1u << (vertex & _BITMAP_MASK);
+
+  if (*block & mask) {
+    return false;
+  }
+  return (atomic_fetch_and_or_uint32(block, mask) & mask) == 0;
+}
+
 /* Add a vertex to the map, with a positive value for unique vertices and
  * a negative value for additional vertices */
 static int map_insert_vert(
@@ -260,8 +254,7 @@ static int map_insert_vert(
   key = POINTER_FROM_INT(vertex);
   if (!BLI_ghash_ensure_p(map, key, &value_p)) {
     int value_i;
-    if (BLI_BITMAP_TEST(bvh->vert_bitmap, vertex) == 0) {
-      BLI_BITMAP_ENABLE(bvh->vert_bitmap, vertex);
+    if (map_claim_vert(bvh, vertex)) {
       value_i = *uniq_verts;
       (*uniq_verts)++;
     }
@@ -338,15 +331,6 @@ static void build_mesh_leaf_node(PBVH *bvh, PBVHNode *node)
   BLI_ghash_free(map, NULL, NULL);
 }
 
-static void update_vb(PBVH *bvh, PBVHNode *node, BBC *prim_bbc, int offset, int count)
-{
-  BB_reset(&node->vb);
-  for (int i = offset + count - 1; i >= offset; i--) {
-    BB_expand_with_bb(&node->vb, (BB *)(&prim_bbc[bvh->prim_indices[i]]));
-  }
-  node->orig_vb = node->vb;
-}
-
 /* Returns the number of visible quads in the nodes' grids. */
 int BKE_pbvh_count_grid_quads(BLI_bitmap **grid_hidden,
                               int *grid_indices,
@@ -388,24 +372,6 @@ static void build_grid_leaf_node(PBVH *bvh, PBVHNode *node)
   BKE_pbvh_node_mark_rebuild_draw(node);
 }
 
-static void build_leaf(PBVH *bvh, int node_index, BBC *prim_bbc, int offset, int count)
-{
-  bvh->nodes[node_index].flag |= PBVH_Leaf;
-
-  bvh->nodes[node_index].prim_indices = bvh->prim_indices + offset;
-  bvh->nodes[node_index].totprim = count;
-
-  /* Still need vb for searches */
-  update_vb(bvh, &bvh->nodes[node_index], prim_bbc, offset, count);
-
-  if (bvh->looptri) {
-    build_mesh_leaf_node(bvh, bvh->nodes + node_index);
-  }
-  else {
-    build_grid_leaf_node(bvh, bvh->nodes + node_index);
-  }
-}
-
 /* Return zero if all primitives in the node can be drawn with the
  * same material (including flat/smooth shading), non-zero otherwise */
 static bool leaf_needs_material_split(PBVH *bvh, int offset, int count)
@@ -440,70 +406,360 @@ static bool leaf_needs_material_split(PBVH *bvh, int offset, int count)
   return false;
 }
 
-/* Recursively build a node in the tree
- *
- * vb is the voxel box around all of the primitives contained in
- * this node.
- *
- * cb is the bounding box around all the centroids of the primitives
- * contained in this node
+/* -------------------------------------------------------------------- */
+/** \name Tree Building
  *
- * offset and start indicate a range in the array of primitive indices
- */
+ * The hierarchy is first split top-down into temporary #PBVHBuildNode's, choosing splits with
+ * a binned surface area heuristic (SAH) and splitting large sub-trees in their own tasks.
+ * It is then flattened into #PBVH.nodes, after which all leaves are built in parallel.
+ * \{ */
+
+/* Number of bins the primitive centroids are sorted into to evaluate the SAH. */
+#define BUILD_BINS_NUM 16
+/* Nodes with more primitives are binned in parallel. */
+#define BUILD_PARALLEL_BIN_THRESHOLD 65536
+/* Sub-trees with more primitives are split in their own task. */
+#define BUILD_TASK_THRESHOLD 4096
+
+typedef struct PBVHBuildNode {
+  /* Both NULL for leaves. */
+  struct PBVHBuildNode *children[2];
+  /* Bounding box of the primitives and of their centroids. */
+  BB vb, cb;
+  /* Range in #PBVH.prim_indices. */
+  int offset, count;
+} PBVHBuildNode;
+
+typedef struct PBVHBuildBin {
+  BB vb, cb;
+  int count;
+} PBVHBuildBin;
+
+typedef struct PBVHBuildBins {
+  PBVHBuildBin bins[BUILD_BINS_NUM];
+} PBVHBuildBins;
+
+typedef struct PBVHBuildData {
+  PBVH *bvh;
+  BBC *prim_bbc;
+  /* NULL when the tree is small enough to be split on a single thread. */
+  TaskPool *task_pool;
+} PBVHBuildData;
+
+typedef struct PBVHBinData {
+  PBVH *bvh;
+  BBC *prim_bbc;
+  int axis;
+  float bin_min, bin_scale;
+} PBVHBinData;
+
+static void build_bin_init(PBVHBuildBin *bin)
+{
+  BB_reset(&bin->vb);
+  BB_reset(&bin->cb);
+  bin->count = 0;
+}
+
+static void build_bin_merge(PBVHBuildBin *bin, PBVHBuildBin *other)
+{
+  BB_expand_with_bb(&bin->vb, &other->vb);
+  BB_expand_with_bb(&bin->cb, &other->cb);
+  bin->count += other->count;
+}
+
+static void build_bin_add_prim(PBVHBuildBin *bin, BBC *bbc)
+{
+  BB_expand_with_bb(&bin->vb, (BB *)bbc);
+  BB_expand(&bin->cb, bbc->bcentroid);
+  bin->count++;
+}
+
+static void build_bin_reduce(const void *__restrict UNUSED(userdata),
+                             void *__restrict chunk_join,
+                             void *__restrict chunk)
+{
+  build_bin_merge(chunk_join, chunk);
+}
+
+BLI_INLINE int build_bin_index(const PBVHBinData *data, const BBC *bbc)
+{
+  const int index = (int)((bbc->bcentroid[data->axis] - data->bin_min) * data->bin_scale);
+  return min_ii(index, BUILD_BINS_NUM - 1);
+}
+
+static void build_bins_task_cb(void *__restrict userdata,
+                               const int i,
+                               const TaskParallelTLS *__restrict tls)
+{
+  PBVHBinData *data = userdata;
+  PBVHBuildBins *bins = tls->userdata_chunk;
+  BBC *bbc = &data->prim_bbc[data->bvh->prim_indices[i]];
+
+  build_bin_add_prim(&bins->bins[build_bin_index(data, bbc)], bbc);
+}
+
+static void build_bins_reduce(const void *__restrict UNUSED(userdata),
+                              void *__restrict chunk_join,
+                              void *__restrict chunk)
+{
+  PBVHBuildBins *join = chunk_join;
+  PBVHBuildBins *bins = chunk;
+
+  for (int i = 0; i < BUILD_BINS_NUM; i++) {
+    build_bin_merge(&join->bins[i], &bins->bins[i]);
+  }
+}
+
+/* Half of the surface area, the factor does not matter when comparing costs. */
+static float build_bb_half_area(const BB *bb)
+{
+  const float x = bb->bmax[0] - bb->bmin[0];
+  const float y = bb->bmax[1] - bb->bmin[1];
+  const float z = bb->bmax[2] - bb->bmin[2];
+  return x * y + y * z + z * x;
+}
+
+/* Sweep the bins for the split with the lowest cost, a split puts the bins [0, split) in the
+ * first child. Returns zero if there are no two non-empty bins. */
+static int build_bins_best_split(PBVHBuildBins *bins)
+{
+  float right_cost[BUILD_BINS_NUM];
+  float best_cost = FLT_MAX;
+  int best_split = 0;
+  PBVHBuildBin sum;
+
+  build_bin_init(&sum);
+  for (int split = BUILD_BINS_NUM - 1; split > 0; split--) {
+    build_bin_merge(&sum, &bins->bins[split]);
+    right_cost[split] = sum.count ? build_bb_half_area(&sum.vb) * sum.count : FLT_MAX;
+  }
+
+  build_bin_init(&sum);
+  for (int split = 1; split < BUILD_BINS_NUM; split++) {
+    build_bin_merge(&sum, &bins->bins[split - 1]);
+    if (sum.count == 0 || right_cost[split] == FLT_MAX) {
+      continue;
+    }
+
+    const float cost = build_bb_half_area(&sum.vb) * sum.count + right_cost[split];
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_split = split;
+    }
+  }
+
+  return best_split;
+}
+
+/* Returns the index of the first element on the right of the partition */
+static int partition_indices_bins(
+    const PBVHBinData *data, int *prim_indices, int lo, int hi, int split)
+{
+  int i = lo, j = hi;
+  while (i <= j) {
+    if (build_bin_index(data, &data->prim_bbc[prim_indices[i]]) < split) {
+      i++;
+    }
+    else {
+      SWAP(int, prim_indices[i], prim_indices[j]);
+      j--;
+    }
+  }
+  return i;
+}
+
+static void build_node_calc_bounds(PBVHBuildData *data, PBVHBuildNode *node)
+{
+  PBVHBuildBin sum;
+
+  build_bin_init(&sum);
+  for (int i = node->offset + node->count - 1; i >= node->offset; i--) {
+    build_bin_add_prim(&sum, &data->prim_bbc[data->bvh->prim_indices[i]]);
+  }
+  node->vb = sum.vb;
+  node->cb = sum.cb;
+}
+
+/* Partition the primitives of the node using the binned SAH along the axis with the widest range
+ * of centroids, falling back to an even split when all centroids are too close to be binned.
+ * Also calculates the bounds of the children. */
+static void build_node_split(PBVHBuildData *data, PBVHBuildNode *node, PBVHBuildNode *children[2])
+{
+  PBVH *bvh = data->bvh;
+  const int offset = node->offset;
+  const int count = node->count;
+  const int axis = BB_widest_axis(&node->cb);
+  const float extent = node->cb.bmax[axis] - node->cb.bmin[axis];
+  const bool use_bins = extent > FLT_EPSILON;
+  int end, split = 0;
+
+  PBVHBinData bin_data = {
+      .bvh = bvh,
+      .prim_bbc = data->prim_bbc,
+      .axis = axis,
+      .bin_min = node->cb.bmin[axis],
+      .bin_scale = use_bins ? (float)BUILD_BINS_NUM / extent : 0.0f,
+  };
+  PBVHBuildBins bins;
+
+  if (use_bins) {
+    for (int i = 0; i < BUILD_BINS_NUM; i++) {
+      build_bin_init(&bins.bins[i]);
+    }
+
+    PBVHParallelSettings settings;
+    BKE_pbvh_parallel_range_settings(&settings, count > BUILD_PARALLEL_BIN_THRESHOLD, count);
+    settings.userdata_chunk = &bins;
+    settings.userdata_chunk_size = sizeof(bins);
+    settings.func_reduce = build_bins_reduce;
+    BKE_pbvh_parallel_range(offset, offset + count, &bin_data, build_bins_task_cb, &settings);
+
+    split = build_bins_best_split(&bins);
+  }
+
+  if (split == 0) {
+    end = offset + count / 2;
+  }
+  else {
+    end = partition_indices_bins(&bin_data, bvh->prim_indices, offset, offset + count - 1, split);
+  }
+
+  children[0]->offset = offset;
+  children[0]->count = end - offset;
+  children[1]->offset = end;
+  children[1]->count = offset + count - end;
+
+  if (split == 0) {
+    build_node_calc_bounds(data, children[0]);
+    build_node_calc_bounds(data, children[1]);
+  }
+  else {
+    PBVHBuildBin sum[2];
+    build_bin_init(&sum[0]);
+    build_bin_init(&sum[1]);
+    for (int i = 0; i < BUILD_BINS_NUM; i++) {
+      build_bin_merge(&sum[i >= split], &bins.bins[i]);
+    }
+    BLI_assert(children[0]->count == sum[0].count);
+
+    for (int i = 0; i < 2; i++) {
+      children[i]->vb = sum[i].vb;
+      children[i]->cb = sum[i].cb;
+    }
+  }
+}
+
+static void build_node_task_cb(TaskPool *__restrict pool, void *taskdata, int thread_id);
 
-static void build_sub(PBVH *bvh, int node_index, BB *cb, BBC *prim_bbc, int offset, int count)
+/* Recursively split a node until all leaves are below the leaf limit and use a single material.
+ *
+ * The node bounds, the vb around all of its primitives and the cb around their centroids, must
+ * already be set. Only touches the node's range of the primitive indices, so separate sub-trees
+ * can be split in parallel. */
+static void build_node(PBVHBuildData *data, PBVHBuildNode *node, int thread_id)
 {
-  int end;
-  BB cb_backing;
+  PBVH *bvh = data->bvh;
+  const int offset = node->offset;
+  const int count = node->count;
 
   /* Decide whether this is a leaf or not */
   const bool below_leaf_limit = count <= bvh->leaf_limit;
   if (below_leaf_limit) {
     if (!leaf_needs_material_split(bvh, offset, count)) {
-      build_leaf(bvh, node_index, prim_bbc, offset, count);
       return;
     }
   }
 
-  /* Add two child nodes */
-  bvh->nodes[node_index].children_offset = bvh->totnode;
-  pbvh_grow_nodes(bvh, bvh->totnode + 2);
-
-  /* Update parent node bounding box */
-  update_vb(bvh, &bvh->nodes[node_index], prim_bbc, offset, count);
+  PBVHBuildNode *children[2];
+  for (int i = 0; i < 2; i++) {
+    children[i] = MEM_callocN(sizeof(PBVHBuildNode), "PBVHBuildNode");
+    node->children[i] = children[i];
+  }
 
   if (!below_leaf_limit) {
-    /* Find axis with widest range of primitive centroids */
-    if (!cb) {
-      cb = &cb_backing;
-      BB_reset(cb);
-      for (int i = offset + count - 1; i >= offset; i--) {
-        BB_expand(cb, prim_bbc[bvh->prim_indices[i]].bcentroid);
-      }
-    }
-    const int axis = BB_widest_axis(cb);
-
-    /* Partition primitives along that axis */
-    end = partition_indices(bvh->prim_indices,
-                            offset,
-                            offset + count - 1,
-                            axis,
-                            (cb->bmax[axis] + cb->bmin[axis]) * 0.5f,
-                            prim_bbc);
+    build_node_split(data, node, children);
   }
   else {
     /* Partition primitives by material */
-    end = partition_indices_material(bvh, offset, offset + count - 1);
+    const int end = partition_indices_material(bvh, offset, offset + count - 1);
+    children[0]->offset = offset;
+    children[0]->count = end - offset;
+    children[1]->offset = end;
+    children[1]->count = offset + count - end;
+    build_node_calc_bounds(data, children[0]);
+    build_node_calc_bounds(data, children[1]);
+  }
+
+  /* Build children, the first one in a new task if it is large enough. */
+  if (data->task_pool && children[0]->count > BUILD_TASK_THRESHOLD) {
+    BLI_task_pool_push_from_thread(
+        data->task_pool, build_node_task_cb, children[0], false, TASK_PRIORITY_HIGH, thread_id);
+  }
+  else {
+    build_node(data, children[0], thread_id);
   }
+  build_node(data, children[1], thread_id);
+}
 
-  /* Build children */
-  build_sub(bvh, bvh->nodes[node_index].children_offset, NULL, prim_bbc, offset, end - offset);
-  build_sub(
-      bvh, bvh->nodes[node_index].children_offset + 1, NULL, prim_bbc, end, offset + count - end);
+static void build_node_task_cb(TaskPool *__restrict pool, void *taskdata, int thread_id)
+{
+  build_node(BLI_task_pool_userdata(pool), taskdata, thread_id);
 }
 
-static void pbvh_build(PBVH *bvh, BB *cb, BBC *prim_bbc, int totprim)
+/* Move the temporary hierarchy into the PBVH nodes, depth first with the children of every node
+ * stored next to each other. Frees the build nodes. */
+static void build_flatten(PBVH *bvh, PBVHBuildNode *build_node, int node_index)
 {
+  PBVHNode *node = &bvh->nodes[node_index];
+
+  node->vb = build_node->vb;
+  node->orig_vb = build_node->vb;
+
+  if (build_node->children[0] == NULL) {
+    node->flag |= PBVH_Leaf;
+    node->prim_indices = bvh->prim_indices + build_node->offset;
+    node->totprim = build_node->count;
+  }
+  else {
+    /* Add two child nodes, this may reallocate the nodes. */
+    const int children_offset = bvh->totnode;
+    node->children_offset = children_offset;
+    pbvh_grow_nodes(bvh, bvh->totnode + 2);
+
+    build_flatten(bvh, build_node->children[0], children_offset);
+    build_flatten(bvh, build_node->children[1], children_offset + 1);
+  }
+
+  MEM_freeN(build_node);
+}
+
+static void build_leaf_task_cb(void *__restrict userdata,
+                               const int n,
+                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PBVH *bvh = userdata;
+  PBVHNode *node = &bvh->nodes[n];
+
+  if (!(node->flag & PBVH_Leaf)) {
+    return;
+  }
+
+  if (bvh->looptri) {
+    build_mesh_leaf_node(bvh, node);
+  }
+  else {
+    build_grid_leaf_node(bvh, node);
+  }
+}
+
+/* Build the tree, `bounds` contains the vb around all primitives and the cb around all of
+ * their centroids. */
+static void pbvh_build(PBVH *bvh, const PBVHBuildBin *bounds, BBC *prim_bbc, int totprim)
+{
+#ifdef PERFCNTRS
+  const double time_start = PIL_check_seconds_timer();
+#endif
+
   if (totprim != bvh->totprim) {
     bvh->totprim = totprim;
     if (bvh->nodes) {
@@ -523,10 +779,130 @@ static void pbvh_build(PBVH *bvh, BB *cb, BBC *prim_bbc, int totprim)
     }
   }
 
+  PBVHBuildNode *root = MEM_callocN(sizeof(PBVHBuildNode), "PBVHBuildNode");
+  root->vb = bounds->vb;
+  root->cb = bounds->cb;
+  root->offset = 0;
+  root->count = totprim;
+
+  PBVHBuildData data = {
+      .bvh = bvh,
+      .prim_bbc = prim_bbc,
+  };
+
+  if (totprim > BUILD_TASK_THRESHOLD) {
+    data.task_pool = BLI_task_pool_create(BLI_task_scheduler_get(), &data);
+    BLI_task_pool_push(data.task_pool, build_node_task_cb, root, false, TASK_PRIORITY_HIGH);
+    BLI_task_pool_work_and_wait(data.task_pool);
+    BLI_task_pool_free(data.task_pool);
+  }
+  else {
+    build_node(&data, root, 0);
+  }
+
   bvh->totnode = 1;
-  build_sub(bvh, 0, cb, prim_bbc, 0, totprim);
+  build_flatten(bvh, root, 0);
+
+  PBVHParallelSettings settings;
+  BKE_pbvh_parallel_range_settings(&settings, true, bvh->totnode);
+  BKE_pbvh_parallel_range(0, bvh->totnode, bvh, build_leaf_task_cb, &settings);
+
+#ifdef PERFCNTRS
+  int totleaf = 0;
+  for (int i = 0; i < bvh->totnode; i++) {
+    if (bvh->nodes[i].flag & PBVH_Leaf) {
+      totleaf++;
+    }
+  }
+  printf("%s: %d primitives, %d nodes, %d leaves, %.3f seconds\n",
+         __func__,
+         totprim,
+         bvh->totnode,
+         totleaf,
+         PIL_check_seconds_timer() - time_start);
+#endif
+}
+
+typedef struct PBVHPrimBBCData {
+  PBVH *bvh;
+  BBC *prim_bbc;
+  CCGElem **grids;
+  const CCGKey *key;
+} PBVHPrimBBCData;
+
+static void build_mesh_prim_bbc_task_cb(void *__restrict userdata,
+                                        const int i,
+                                        const TaskParallelTLS *__restrict tls)
+{
+  PBVHPrimBBCData *data = userdata;
+  PBVH *bvh = data->bvh;
+  const MLoopTri *lt = &bvh->looptri[i];
+  const int sides = 3;
+  BBC *bbc = &data->prim_bbc[i];
+
+  BB_reset((BB *)bbc);
+
+  for (int j = 0; j < sides; j++) {
+    BB_expand((BB *)bbc, bvh->verts[bvh->mloop[lt->tri[j]].v].co);
+  }
+
+  BBC_update_centroid(bbc);
+
+  build_bin_add_prim(tls->userdata_chunk, bbc);
+}
+
+static void build_grids_prim_bbc_task_cb(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict tls)
+{
+  PBVHPrimBBCData *data = userdata;
+  const CCGKey *key = data->key;
+  CCGElem *grid = data->grids[i];
+  BBC *bbc = &data->prim_bbc[i];
+
+  BB_reset((BB *)bbc);
+
+  for (int j = 0; j < key->grid_size * key->grid_size; j++) {
+    BB_expand((BB *)bbc, CCG_elem_offset_co(key, grid, j));
+  }
+
+  BBC_update_centroid(bbc);
+
+  build_bin_add_prim(tls->userdata_chunk, bbc);
+}
+
+/* For each primitive, store the AABB and the AABB centroid. Returns the bounds of all of them in
+ * `r_bounds`. */
+static BBC *build_prim_bbc(PBVH *bvh,
+                           int totprim,
+                           PBVHParallelRangeFunc func,
+                           CCGElem **grids,
+                           const CCGKey *key,
+                           PBVHBuildBin *r_bounds)
+{
+  BBC *prim_bbc = MEM_mallocN(sizeof(BBC) * totprim, "prim_bbc");
+
+  PBVHPrimBBCData data = {
+      .bvh = bvh,
+      .prim_bbc = prim_bbc,
+      .grids = grids,
+      .key = key,
+  };
+
+  build_bin_init(r_bounds);
+
+  PBVHParallelSettings settings;
+  BKE_pbvh_parallel_range_settings(&settings, true, totprim);
+  settings.userdata_chunk = r_bounds;
+  settings.userdata_chunk_size = sizeof(*r_bounds);
+  settings.func_reduce = build_bin_reduce;
+  BKE_pbvh_parallel_range(0, totprim, &data, func, &settings);
+
+  return prim_bbc;
 }
 
+/** \} */
+
 /**
  * Do a full rebuild with on Mesh data structure.
  *
@@ -544,8 +920,7 @@ void BKE_pbvh_build_mesh(PBVH *bvh,
                          const MLoopTri *looptri,
                          int looptri_num)
 {
-  BBC *prim_bbc = NULL;
-  BB cb;
+  PBVHBuildBin bounds;
 
   bvh->mesh = mesh;
   bvh->type = PBVH_FACES;
@@ -559,29 +934,11 @@ void BKE_pbvh_build_mesh(PBVH *bvh,
   bvh->vdata = vdata;
   bvh->ldata = ldata;
 
-  BB_reset(&cb);
-
-  /* For each face, store the AABB and the AABB centroid */
-  prim_bbc = MEM_mallocN(sizeof(BBC) * looptri_num, "prim_bbc");
-
-  for (int i = 0; i < looptri_num; i++) {
-    const MLoopTri *lt = &looptri[i];
-    const int sides = 3;
-    BBC *bbc = prim_bbc + i;
-
-    BB_reset((BB *)bbc);
-
-    for (int j = 0; j < sides; j++) {
-      BB_expand((BB *)bbc, verts[bvh->mloop[lt->tri[j]].v].co);
-    }
-
-    BBC_update_centroid(bbc);
-
-    BB_expand(&cb, bbc->bcentroid);
-  }
+  BBC *prim_bbc = build_prim_bbc(
+      bvh, looptri_num, build_mesh_prim_bbc_task_cb, NULL, NULL, &bounds);
 
   if (looptri_num) {
-    pbvh_build(bvh, &cb, prim_bbc, looptri_num);
+    pbvh_build(bvh, &bounds, prim_bbc, looptri_num);
   }
 
   MEM_freeN(prim_bbc);
@@ -608,29 +965,12 @@ void BKE_pbvh_build_grids(PBVH *bvh,
   bvh->grid_hidden = grid_hidden;
   bvh->leaf_limit = max_ii(LEAF_LIMIT / ((gridsize - 1) * (gridsize - 1)), 1);
 
-  BB cb;
-  BB_reset(&cb);
-
-  /* For each grid, store the AABB and the AABB centroid */
-  BBC *prim_bbc = MEM_mallocN(sizeof(BBC) * totgrid, "prim_bbc");
-
-  for (int i = 0; i < totgrid; i++) {
-    CCGElem *grid = grids[i];
-    BBC *bbc = prim_bbc + i;
-
-    BB_reset((BB *)bbc);
-
-    for (int j = 0; j < gridsize * gridsize; j++) {
-      BB_expand((BB *)bbc, CCG_elem_offset_co(key, grid, j));
-    }
-
-    BBC_update_centroid(bbc);
-
-    BB_expand(&cb, bbc->bcentroid);
-  }
+  PBVHBuildBin bounds;
+  BBC *prim_bbc = build_prim_bbc(
+      bvh, totgrid, build_grids_prim_bbc_task_cb, grids, key, &bounds);
 
   if (totgrid) {
-    pbvh_build(bvh, &cb, prim_bbc, totgrid);
+    pbvh_build(bvh, &bounds, prim_bbc, totgrid);
   }
 
   MEM_freeN(prim_bbc);
@@ -97,6 +97,7 @@
 #include "DEG_depsgraph_query.h"
 
 #include "RE_engine.h"
+#include "RE_pipeline.h"
 
 #include "engines/eevee/eevee_lightcache.h"
 
@@ -498,6 +499,10 @@ void BKE_scene_make_local(Main *bmain, Scene *sce, const bool lib_local)
 /** Free (or release) any data used by this scene (does not free the scene itself). */
 void BKE_scene_free_ex(Scene *sce, const bool do_id_user)
 {
+  if ((sce->id.tag & LIB_TAG_COPIED_ON_WRITE) == 0) {
+    RE_FreePersistentDataForScene(sce, NULL);
+  }
+
   BKE_animdata_free((ID *)sce, false);
 
   BKE_sequencer_editing_free(sce, do_id_user);
@@ -1402,6 +1407,15 @@ void BKE_scene_graph_evaluated_ensure(Depsgraph *depsgraph, Main *bmain)
 
 /* applies changes right away, does all sets too */
 void BKE_scene_graph_update_for_newframe(Depsgraph *depsgraph, Main *bmain)
+{
+  BKE_scene_graph_update_for_newframe_ex(depsgraph, bmain, true);
+}
+
+/* Same as above, optionally keeping the recalc flags so that render engines can query which
+ * data changed since the previous frame. They are then cleared with DEG_ids_clear_recalc(). */
+void BKE_scene_graph_update_for_newframe_ex(Depsgraph *depsgraph,
+                                            Main *bmain,
+                                            const bool clear_recalc)
 {
   Scene *scene = DEG_get_input_scene(depsgraph);
   ViewLayer *view_layer = DEG_get_input_view_layer(depsgraph);
@@ -1447,7 +1461,9 @@ void BKE_scene_graph_update_for_newframe(Depsgraph *depsgraph, Main *bmain)
     /* Inform editors about possible changes. */
     DEG_ids_check_recalc(bmain, depsgraph, scene, view_layer, true);
     /* clear recalc flags */
-    DEG_ids_clear_recalc(bmain, depsgraph);
+    if (clear_recalc) {
+      DEG_ids_clear_recalc(bmain, depsgraph);
+    }
 
     /* If user callback did not tag anything for update we can skip second iteration.
      * Otherwise we update scene once again, but without running callbacks to bring
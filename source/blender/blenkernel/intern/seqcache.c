@@ -21,13 +21,20 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
 #include <memory.h>
 
+#include "zlib.h"
+
 #include "MEM_guardedalloc.h"
 
+#include "atomic_ops.h"
+
 #include "DNA_sequence_types.h"
 #include "DNA_scene_types.h"
+#include "DNA_userdef_types.h"
 
+#include "IMB_colormanagement.h"
 #include "IMB_imbuf.h"
 #include "IMB_imbuf_types.h"
 
@@ -35,7 +42,15 @@
 #include "BLI_threads.h"
 #include "BLI_listbase.h"
 #include "BLI_ghash.h"
-
+#include "BLI_fileops.h"
+#include "BLI_fileops_types.h"
+#include "BLI_hash.h"
+#include "BLI_path_util.h"
+#include "BLI_string.h"
+#include "BLI_task.h"
+
+#include "BKE_appdir.h"
+#include "BKE_global.h"
 #include "BKE_sequencer.h"
 #include "BKE_scene.h"
 #include "BKE_main.h"
@@ -54,7 +69,8 @@
  * If the cache is full all entries for pending frame will have is_temp_cache set.
  *
  * Linking: We use links to reduce number of iterations over entries needed to manage cache.
- * Entries are linked in order as they are put into cache.
+ * Entries are linked in order as they are put into cache, separately for each #eSeqTaskId,
+ * so frames rendered at the same time by prefetch threads don't mix their links.
  * Only permanent (is_temp_cache = 0) cache entries are linked.
  * Putting #SEQ_CACHE_STORE_FINAL_OUT will reset linking
  *
@@ -63,15 +79,59 @@
  * entries one by one in reverse order to their creation.
  *
  * User can exclude caching of some images. Such entries will have is_temp_cache set.
+ *
+ * Disk cache:
+ * With #SEQ_CACHE_DISK_CACHE_ENABLE, permanent raw and final images are also compressed and
+ * written to files by a background task pool, so they don't block rendering. Images waiting to
+ * be written are kept in memory, when they use more than #SEQ_DISK_CACHE_WRITE_PENDING_FACTOR of
+ * the memory cache limit (while scrubbing quickly for example), new images aren't written. When
+ * an image is
+ * not in memory (because it was recycled, or after reloading the file or restarting Blender),
+ * it is read back from its file and put in the memory cache again.
+ *
+ * Files are stored in a directory per blend file, their names are made of a hash of the render
+ * size and strip timing, the image type, frame, a hash of the scene name and the names of the
+ * scene and strip, so they stay valid across sessions (unlike the pointers the memory cache uses
+ * in its keys). The scene name hash keeps scenes apart whose names share a prefix.
+ * Files are removed when strips are invalidated and when the directory exceeds its size limit
+ * (oldest files first). Clearing the memory cache keeps them.
  */
 
+typedef struct SeqDiskCacheFile {
+  struct SeqDiskCacheFile *next, *prev;
+  char path[FILE_MAX];
+  size_t size;
+} SeqDiskCacheFile;
+
+typedef struct SeqDiskCache {
+  /* Protects everything below, written files are added from tasks of `write_pool`. */
+  ThreadMutex mutex;
+  /* Created and freed on the main thread, NULL until the cache is used from the main thread. */
+  struct TaskPool *write_pool;
+  /* Directory of the blend file the files were scanned from. */
+  char dirpath[FILE_MAX];
+  /* SeqDiskCacheFile, oldest first, and the same files by path. */
+  ListBase files;
+  struct GHash *files_hash;
+  size_t size_total;
+  /* Incremented when files are removed, so writes started before are discarded. */
+  int generation;
+  /* Memory used by the images waiting to be written. */
+  size_t writes_pending_size;
+} SeqDiskCache;
+
 typedef struct SeqCache {
   struct GHash *hash;
   ThreadMutex iterator_mutex;
   struct BLI_mempool *keys_pool;
   struct BLI_mempool *items_pool;
-  struct SeqCacheKey *last_key;
+  /* Last key put by each render task, indexed by #eSeqTaskId. */
+  struct SeqCacheKey *last_key[SEQ_TASK_MAX];
   size_t memory_used;
+  SeqDiskCache disk_cache;
+  /* Statistics, updated atomically. */
+  uint64_t ram_hits, ram_misses;
+  uint64_t disk_hits, disk_misses, disk_writes;
 } SeqCache;
 
 typedef struct SeqCacheItem {
@@ -175,7 +235,14 @@ static size_t seq_cache_get_mem_total(void)
 static void seq_cache_keyfree(void *val)
 {
   SeqCacheKey *key = val;
-  BLI_mempool_free(key->cache_owner->keys_pool, key);
+  SeqCache *cache = key->cache_owner;
+
+  /* The frame of this task may still be rendering, don't link new items to freed keys. */
+  if (cache->last_key[key->task_id] == key) {
+    cache->last_key[key->task_id] = NULL;
+  }
+
+  BLI_mempool_free(cache->keys_pool, key);
 }
 
 static void seq_cache_valfree(void *val)
@@ -200,7 +267,7 @@ static void seq_cache_put(SeqCache *cache, SeqCacheKey *key, ImBuf *ibuf)
 
   if (BLI_ghash_reinsert(cache->hash, key, item, seq_cache_keyfree, seq_cache_valfree)) {
     IMB_refImBuf(ibuf);
-    cache->last_key = key;
+    cache->last_key[key->task_id] = key;
     cache->memory_used += IMB_get_size_in_memory(ibuf);
   }
 }
@@ -218,6 +285,11 @@ static ImBuf *seq_cache_get(SeqCache *cache, void *key)
   return NULL;
 }
 
+static void seq_cache_last_keys_clear(SeqCache *cache)
+{
+  memset(cache->last_key, 0, sizeof(cache->last_key));
+}
+
 static void seq_cache_relink_keys(SeqCacheKey *link_next, SeqCacheKey *link_prev)
 {
   if (link_next) {
@@ -432,6 +504,647 @@ static void seq_cache_set_temp_cache_linked(Scene *scene, SeqCacheKey *base)
   }
 }
 
+/* ************************** Disk Cache **************************** */
+
+#define SEQ_DISK_CACHE_FILE_EXT ".dcf"
+#define SEQ_DISK_CACHE_MAGIC "BSDC"
+#define SEQ_DISK_CACHE_VERSION 1
+/* Same as MAX_COLORSPACE_NAME. */
+#define SEQ_DISK_CACHE_COLORSPACE_NAME 64
+/* Part of the memory cache limit that images waiting to be written may use. */
+#define SEQ_DISK_CACHE_WRITE_PENDING_FACTOR 0.25
+
+enum {
+  SEQ_DISK_CACHE_HAS_RECT = (1 << 0),
+  SEQ_DISK_CACHE_HAS_RECT_FLOAT = (1 << 1),
+};
+
+/* Files are only read on the machine they were written on, no need to care about endianness. */
+typedef struct SeqDiskCacheHeader {
+  char magic[4];
+  int version;
+  int x, y;
+  int planes;
+  int flag;
+  char rect_colorspace[SEQ_DISK_CACHE_COLORSPACE_NAME];
+  char float_colorspace[SEQ_DISK_CACHE_COLORSPACE_NAME];
+  /* Compressed size of the buffers, which follow the header. */
+  uint64_t rect_size;
+  uint64_t rect_float_size;
+} SeqDiskCacheHeader;
+
+typedef struct SeqDiskCacheWriteTask {
+  struct ImBuf *ibuf;
+  /* Buffers of the image when the task was added, drawing code may add a byte buffer later. */
+  unsigned int *rect;
+  float *rect_float;
+  char rect_colorspace[SEQ_DISK_CACHE_COLORSPACE_NAME];
+  char float_colorspace[SEQ_DISK_CACHE_COLORSPACE_NAME];
+  int generation;
+  size_t mem_size;
+  char path[FILE_MAX];
+} SeqDiskCacheWriteTask;
+
+static bool seq_disk_cache_is_enabled(const SeqRenderData *context, float cfra, int type)
+{
+  return (context->scene->ed->cache_flag & SEQ_CACHE_DISK_CACHE_ENABLE) &&
+         (type & (SEQ_CACHE_STORE_RAW | SEQ_CACHE_STORE_FINAL_OUT)) && !context->skip_cache &&
+         !context->is_proxy_render && (cfra == (float)(int)cfra) &&
+         BKE_main_blendfile_path_from_global()[0] != '\0';
+}
+
+/* Directory for the files of the current blend file, empty when it was never saved. */
+static void seq_disk_cache_dirpath_get(char *r_dirpath)
+{
+  const char *blendfile_path = BKE_main_blendfile_path_from_global();
+  char cache_dir[FILE_MAX];
+  char filename[FILE_MAXFILE];
+
+  if (blendfile_path[0] == '\0') {
+    r_dirpath[0] = '\0';
+    return;
+  }
+
+  if (U.sequencer_disk_cache_dir[0] != '\0') {
+    BLI_strncpy(cache_dir, U.sequencer_disk_cache_dir, sizeof(cache_dir));
+    BLI_path_abs(cache_dir, blendfile_path);
+  }
+  else {
+    BLI_strncpy(cache_dir, BKE_tempdir_base(), sizeof(cache_dir));
+  }
+
+  BLI_split_file_part(blendfile_path, filename, sizeof(filename));
+  BLI_path_extension_replace(filename, sizeof(filename), "_seq_cache");
+  BLI_join_dirfile(r_dirpath, FILE_MAX, cache_dir, filename);
+}
+
+/**
+ * Like #seq_hash_render_data, without the pointers which change between sessions.
+ * The strip timing is included as well, so moved or trimmed strips don't find old images.
+ */
+static unsigned int seq_disk_cache_hash(const SeqRenderData *context, const Sequence *seq)
+{
+  unsigned int rval = BLI_hash_int_2d(context->rectx, context->recty);
+
+  rval = BLI_hash_int_2d(rval, context->preview_render_size);
+  rval = BLI_hash_int_2d(rval, (unsigned int)(context->motion_blur_shutter * 100.0f));
+  rval = BLI_hash_int_2d(rval, context->motion_blur_samples);
+  rval = BLI_hash_int_2d(rval, (context->scene->r.views_format * 2) + context->view_id);
+  rval = BLI_hash_int_2d(rval, seq->start);
+  rval = BLI_hash_int_2d(rval, seq->anim_startofs);
+  rval = BLI_hash_int_2d(rval, seq->anim_endofs);
+
+  return rval;
+}
+
+/* Scene and strip names used in file names, "<scene>-<strip>". */
+static void seq_disk_cache_names_get(const Scene *scene,
+                                     const Sequence *seq,
+                                     char *r_names,
+                                     size_t maxlen)
+{
+  if (seq) {
+    BLI_snprintf(r_names, maxlen, "%s-%s", scene->id.name + 2, seq->name + 2);
+  }
+  else {
+    BLI_snprintf(r_names, maxlen, "%s-", scene->id.name + 2);
+  }
+  BLI_filename_make_safe(r_names);
+}
+
+static unsigned int seq_disk_cache_scene_hash(const Scene *scene)
+{
+  return BLI_ghashutil_strhash_p(scene->id.name + 2);
+}
+
+static void seq_disk_cache_filepath_get(const SeqRenderData *context,
+                                        const Sequence *seq,
+                                        float cfra,
+                                        int type,
+                                        const char *dirpath,
+                                        char *r_path)
+{
+  char names[FILE_MAXFILE];
+  char filename[FILE_MAXFILE];
+
+  seq_disk_cache_names_get(context->scene, seq, names, sizeof(names));
+  BLI_snprintf(filename,
+               sizeof(filename),
+               "%08x-%d-%d-%08x-%s" SEQ_DISK_CACHE_FILE_EXT,
+               seq_disk_cache_hash(context, seq),
+               type,
+               (int)cfra,
+               seq_disk_cache_scene_hash(context->scene),
+               names);
+  BLI_join_dirfile(r_path, FILE_MAX, dirpath, filename);
+}
+
+/* Parse a file name written by #seq_disk_cache_filepath_get, `r_names` includes the extension. */
+static bool seq_disk_cache_filepath_parse(const char *path,
+                                          int *r_type,
+                                          int *r_cfra,
+                                          unsigned int *r_scene_hash,
+                                          const char **r_names)
+{
+  const char *filename = BLI_path_basename(path);
+  unsigned int hash;
+  int len = 0;
+
+  if (sscanf(filename, "%x-%d-%d-%x-%n", &hash, r_type, r_cfra, r_scene_hash, &len) != 4 ||
+      len == 0) {
+    return false;
+  }
+
+  *r_names = filename + len;
+  return true;
+}
+
+static void seq_disk_cache_file_add(SeqDiskCache *disk_cache, const char *path, size_t size)
+{
+  SeqDiskCacheFile *file = BLI_ghash_lookup(disk_cache->files_hash, path);
+
+  if (file) {
+    /* Rewritten, it's the newest file now. */
+    BLI_remlink(&disk_cache->files, file);
+    disk_cache->size_total -= file->size;
+  }
+  else {
+    file = MEM_mallocN(sizeof(*file), "SeqDiskCacheFile");
+    BLI_strncpy(file->path, path, sizeof(file->path));
+    BLI_ghash_insert(disk_cache->files_hash, file->path, file);
+  }
+
+  file->size = size;
+  disk_cache->size_total += size;
+  BLI_addtail(&disk_cache->files, file);
+}
+
+static void seq_disk_cache_file_remove(SeqDiskCache *disk_cache, SeqDiskCacheFile *file)
+{
+  BLI_delete(file->path, false, false);
+  BLI_ghash_remove(disk_cache->files_hash, file->path, NULL, NULL);
+  BLI_remlink(&disk_cache->files, file);
+  disk_cache->size_total -= file->size;
+  MEM_freeN(file);
+}
+
+static void seq_disk_cache_files_free(SeqDiskCache *disk_cache)
+{
+  BLI_ghash_clear(disk_cache->files_hash, NULL, NULL);
+  BLI_freelistN(&disk_cache->files);
+  disk_cache->size_total = 0;
+}
+
+static void seq_disk_cache_enforce_limit(SeqDiskCache *disk_cache)
+{
+  const size_t size_limit = ((size_t)U.sequencer_disk_cache_size_limit) * 1024 * 1024 * 1024;
+
+  while (disk_cache->size_total > size_limit && disk_cache->files.first) {
+    seq_disk_cache_file_remove(disk_cache, disk_cache->files.first);
+  }
+}
+
+static int seq_disk_cache_direntry_cmp_mtime(const void *a_, const void *b_)
+{
+  const struct direntry *a = a_;
+  const struct direntry *b = b_;
+
+  if (a->s.st_mtime < b->s.st_mtime) {
+    return -1;
+  }
+  if (a->s.st_mtime > b->s.st_mtime) {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Use the files of `dirpath`, scanning the directory once when it changed.
+ * Must be called without the disk cache mutex locked: the thread which sees the change scans the
+ * directory without holding it, so other threads don't wait for the scan (they find the files
+ * once it's done).
+ */
+static void seq_disk_cache_dirpath_ensure(SeqDiskCache *disk_cache, const char *dirpath)
+{
+  BLI_mutex_lock(&disk_cache->mutex);
+  if (STREQ(disk_cache->dirpath, dirpath)) {
+    BLI_mutex_unlock(&disk_cache->mutex);
+    return;
+  }
+  seq_disk_cache_files_free(disk_cache);
+  BLI_strncpy(disk_cache->dirpath, dirpath, sizeof(disk_cache->dirpath));
+  /* Pending writes belong to another directory. */
+  disk_cache->generation++;
+  BLI_mutex_unlock(&disk_cache->mutex);
+
+  if (dirpath[0] == '\0' || !BLI_is_dir(dirpath)) {
+    return;
+  }
+
+  struct direntry *entries;
+  unsigned int entries_len = BLI_filelist_dir_contents(dirpath, &entries);
+
+  qsort(entries, entries_len, sizeof(*entries), seq_disk_cache_direntry_cmp_mtime);
+
+  BLI_mutex_lock(&disk_cache->mutex);
+  /* The directory may have changed again while scanning. */
+  if (STREQ(disk_cache->dirpath, dirpath)) {
+    for (unsigned int i = 0; i < entries_len; i++) {
+      /* Files written while scanning are newer, keep them. */
+      if (S_ISREG(entries[i].type) &&
+          BLI_path_extension_check(entries[i].relname, SEQ_DISK_CACHE_FILE_EXT) &&
+          !BLI_ghash_haskey(disk_cache->files_hash, entries[i].path)) {
+        seq_disk_cache_file_add(disk_cache, entries[i].path, (size_t)entries[i].s.st_size);
+      }
+    }
+  }
+  BLI_mutex_unlock(&disk_cache->mutex);
+
+  BLI_filelist_free(entries, entries_len);
+}
+
+static int seq_disk_cache_compression_level(void)
+{
+  switch (U.sequencer_disk_cache_compression) {
+    case USER_SEQ_DISK_CACHE_COMPRESSION_NONE:
+      return Z_NO_COMPRESSION;
+    case USER_SEQ_DISK_CACHE_COMPRESSION_HIGH:
+      return Z_DEFAULT_COMPRESSION;
+    case USER_SEQ_DISK_CACHE_COMPRESSION_LOW:
+    default:
+      return Z_BEST_SPEED;
+  }
+}
+
+static bool seq_disk_cache_buffer_write(
+    FILE *file, const void *data, size_t size, int level, uint64_t *r_size_compressed)
+{
+  uLongf size_compressed = compressBound((uLong)size);
+  Bytef *data_compressed = MEM_mallocN(size_compressed, "seq_disk_cache_buffer_write");
+  bool ok = (compress2(data_compressed, &size_compressed, data, (uLong)size, level) == Z_OK) &&
+            (fwrite(data_compressed, 1, size_compressed, file) == size_compressed);
+
+  MEM_freeN(data_compressed);
+  *r_size_compressed = size_compressed;
+  return ok;
+}
+
+static bool seq_disk_cache_buffer_read(FILE *file,
+                                       void *data,
+                                       size_t size,
+                                       uint64_t size_compressed)
+{
+  Bytef *data_compressed = MEM_mallocN((size_t)size_compressed, "seq_disk_cache_buffer_read");
+  uLongf size_uncompressed = (uLongf)size;
+  bool ok = (fread(data_compressed, 1, (size_t)size_compressed, file) == size_compressed) &&
+            (uncompress(data, &size_uncompressed, data_compressed, (uLong)size_compressed) ==
+             Z_OK) &&
+            (size_uncompressed == size);
+
+  MEM_freeN(data_compressed);
+  return ok;
+}
+
+static bool seq_disk_cache_file_write(const char *path,
+                                      const SeqDiskCacheWriteTask *task,
+                                      size_t *r_size)
+{
+  if (!BLI_make_existing_file(path)) {
+    return false;
+  }
+
+  FILE *file = BLI_fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  const ImBuf *ibuf = task->ibuf;
+  const size_t pixels_len = (size_t)ibuf->x * (size_t)ibuf->y;
+  const int level = seq_disk_cache_compression_level();
+  SeqDiskCacheHeader header = {{0}};
+
+  memcpy(header.magic, SEQ_DISK_CACHE_MAGIC, sizeof(header.magic));
+  header.version = SEQ_DISK_CACHE_VERSION;
+  header.x = ibuf->x;
+  header.y = ibuf->y;
+  header.planes = ibuf->planes;
+  if (task->rect) {
+    header.flag |= SEQ_DISK_CACHE_HAS_RECT;
+    BLI_strncpy(header.rect_colorspace, task->rect_colorspace, sizeof(header.rect_colorspace));
+  }
+  if (task->rect_float) {
+    header.flag |= SEQ_DISK_CACHE_HAS_RECT_FLOAT;
+    BLI_strncpy(header.float_colorspace, task->float_colorspace, sizeof(header.float_colorspace));
+  }
+
+  /* Written again at the end, when the compressed sizes are known. */
+  bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+  if (ok && task->rect) {
+    ok = seq_disk_cache_buffer_write(
+        file, task->rect, pixels_len * sizeof(*task->rect), level, &header.rect_size);
+  }
+  if (ok && task->rect_float) {
+    ok = seq_disk_cache_buffer_write(file,
+                                     task->rect_float,
+                                     pixels_len * 4 * sizeof(*task->rect_float),
+                                     level,
+                                     &header.rect_float_size);
+  }
+  if (ok) {
+    ok = (fseek(file, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, file) == 1);
+  }
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+
+  if (!ok) {
+    BLI_delete(path, false, false);
+    return false;
+  }
+
+  *r_size = sizeof(header) + (size_t)header.rect_size + (size_t)header.rect_float_size;
+  return true;
+}
+
+static ImBuf *seq_disk_cache_file_read(const char *path)
+{
+  FILE *file = BLI_fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  SeqDiskCacheHeader header;
+  ImBuf *ibuf = NULL;
+
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      memcmp(header.magic, SEQ_DISK_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == SEQ_DISK_CACHE_VERSION && header.x > 0 && header.y > 0 &&
+      (header.flag & (SEQ_DISK_CACHE_HAS_RECT | SEQ_DISK_CACHE_HAS_RECT_FLOAT))) {
+    int flags = 0;
+    if (header.flag & SEQ_DISK_CACHE_HAS_RECT) {
+      flags |= IB_rect;
+    }
+    if (header.flag & SEQ_DISK_CACHE_HAS_RECT_FLOAT) {
+      flags |= IB_rectfloat;
+    }
+    ibuf = IMB_allocImBuf(header.x, header.y, header.planes, flags);
+  }
+
+  if (ibuf) {
+    const size_t pixels_len = (size_t)ibuf->x * (size_t)ibuf->y;
+    bool ok = true;
+
+    header.rect_colorspace[sizeof(header.rect_colorspace) - 1] = '\0';
+    header.float_colorspace[sizeof(header.float_colorspace) - 1] = '\0';
+
+    if (header.flag & SEQ_DISK_CACHE_HAS_RECT) {
+      ok = seq_disk_cache_buffer_read(
+          file, ibuf->rect, pixels_len * sizeof(*ibuf->rect), header.rect_size);
+      if (header.rect_colorspace[0] != '\0') {
+        IMB_colormanagement_assign_rect_colorspace(ibuf, header.rect_colorspace);
+      }
+    }
+    if (ok && (header.flag & SEQ_DISK_CACHE_HAS_RECT_FLOAT)) {
+      ok = seq_disk_cache_buffer_read(file,
+                                      ibuf->rect_float,
+                                      pixels_len * 4 * sizeof(*ibuf->rect_float),
+                                      header.rect_float_size);
+      if (header.float_colorspace[0] != '\0') {
+        IMB_colormanagement_assign_float_colorspace(ibuf, header.float_colorspace);
+      }
+    }
+
+    if (!ok) {
+      IMB_freeImBuf(ibuf);
+      ibuf = NULL;
+    }
+  }
+
+  fclose(file);
+  return ibuf;
+}
+
+static void seq_disk_cache_write_task(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+  SeqCache *cache = BLI_task_pool_userdata(pool);
+  SeqDiskCache *disk_cache = &cache->disk_cache;
+  SeqDiskCacheWriteTask *task = taskdata;
+  char path_temp[FILE_MAX];
+  size_t size;
+
+  /* Write to a temporary file first, so incomplete files are never read. */
+  BLI_snprintf(path_temp, sizeof(path_temp), "%s.%d.tmp", task->path, threadid);
+  if (!seq_disk_cache_file_write(path_temp, task, &size)) {
+    return;
+  }
+
+  BLI_mutex_lock(&disk_cache->mutex);
+  if (task->generation == disk_cache->generation && BLI_rename(path_temp, task->path) == 0) {
+    seq_disk_cache_file_add(disk_cache, task->path, size);
+    seq_disk_cache_enforce_limit(disk_cache);
+    atomic_add_and_fetch_uint64(&cache->disk_writes, 1);
+  }
+  else {
+    BLI_delete(path_temp, false, false);
+  }
+  BLI_mutex_unlock(&disk_cache->mutex);
+}
+
+static void seq_disk_cache_write_task_free(TaskPool *__restrict pool,
+                                           void *taskdata,
+                                           int UNUSED(threadid))
+{
+  SeqDiskCacheWriteTask *task = taskdata;
+
+  /* Tasks which weren't added to the pool are freed without it. */
+  if (pool) {
+    SeqCache *cache = BLI_task_pool_userdata(pool);
+    SeqDiskCache *disk_cache = &cache->disk_cache;
+    BLI_mutex_lock(&disk_cache->mutex);
+    disk_cache->writes_pending_size -= task->mem_size;
+    BLI_mutex_unlock(&disk_cache->mutex);
+  }
+
+  IMB_freeImBuf(task->ibuf);
+  MEM_freeN(task);
+}
+
+/* Compress and write the image in the background, the image is kept alive until then. */
+static void seq_disk_cache_write_async(SeqCache *cache,
+                                       const SeqRenderData *context,
+                                       Sequence *seq,
+                                       float cfra,
+                                       int type,
+                                       ImBuf *ibuf)
+{
+  SeqDiskCache *disk_cache = &cache->disk_cache;
+  char dirpath[FILE_MAX];
+
+  /* Float buffers with other channel counts are rare, just don't store them. */
+  if ((ibuf->rect == NULL && ibuf->rect_float == NULL) ||
+      (ibuf->rect_float && ibuf->channels != 4)) {
+    return;
+  }
+
+  seq_disk_cache_dirpath_get(dirpath);
+
+  SeqDiskCacheWriteTask *task = MEM_callocN(sizeof(*task), "SeqDiskCacheWriteTask");
+  seq_disk_cache_filepath_get(context, seq, cfra, type, dirpath, task->path);
+  task->ibuf = ibuf;
+  task->mem_size = IMB_get_size_in_memory(ibuf);
+  task->rect = ibuf->rect;
+  task->rect_float = ibuf->rect_float;
+  if (ibuf->rect) {
+    BLI_strncpy(task->rect_colorspace,
+                IMB_colormanagement_get_rect_colorspace(ibuf),
+                sizeof(task->rect_colorspace));
+  }
+  if (ibuf->rect_float) {
+    BLI_strncpy(task->float_colorspace,
+                IMB_colormanagement_get_float_colorspace(ibuf),
+                sizeof(task->float_colorspace));
+  }
+  IMB_refImBuf(ibuf);
+
+  seq_disk_cache_dirpath_ensure(disk_cache, dirpath);
+
+  const size_t writes_pending_max = (size_t)(seq_cache_get_mem_total() *
+                                             SEQ_DISK_CACHE_WRITE_PENDING_FACTOR);
+
+  BLI_mutex_lock(&disk_cache->mutex);
+  task->generation = disk_cache->generation;
+  /* Always allow one image, so images larger than the limit are written too. */
+  if (disk_cache->write_pool &&
+      (disk_cache->writes_pending_size == 0 ||
+       disk_cache->writes_pending_size + task->mem_size <= writes_pending_max)) {
+    disk_cache->writes_pending_size += task->mem_size;
+    BLI_task_pool_push_ex(disk_cache->write_pool,
+                          seq_disk_cache_write_task,
+                          task,
+                          true,
+                          seq_disk_cache_write_task_free,
+                          TASK_PRIORITY_LOW);
+    task = NULL;
+  }
+  BLI_mutex_unlock(&disk_cache->mutex);
+
+  if (task) {
+    /* Not used from the main thread yet or too many images are waiting to be written,
+     * the image is only kept in memory. */
+    seq_disk_cache_write_task_free(NULL, task, 0);
+  }
+}
+
+static ImBuf *seq_disk_cache_read(SeqCache *cache,
+                                  const SeqRenderData *context,
+                                  Sequence *seq,
+                                  float cfra,
+                                  int type)
+{
+  SeqDiskCache *disk_cache = &cache->disk_cache;
+  char dirpath[FILE_MAX];
+  char path[FILE_MAX];
+  ImBuf *ibuf = NULL;
+
+  seq_disk_cache_dirpath_get(dirpath);
+  seq_disk_cache_filepath_get(context, seq, cfra, type, dirpath, path);
+
+  /* Avoid trying to open files which don't exist, that's the common case. */
+  seq_disk_cache_dirpath_ensure(disk_cache, dirpath);
+  BLI_mutex_lock(&disk_cache->mutex);
+  const bool exists = BLI_ghash_haskey(disk_cache->files_hash, path);
+  BLI_mutex_unlock(&disk_cache->mutex);
+
+  if (exists) {
+    ibuf = seq_disk_cache_file_read(path);
+  }
+
+  atomic_add_and_fetch_uint64(ibuf ? &cache->disk_hits : &cache->disk_misses, 1);
+
+  return ibuf;
+}
+
+/* Remove the files of the strip or scene (when `seq` is NULL) matching `types`,
+ * in the frame range. */
+static void seq_disk_cache_remove(
+    SeqCache *cache, Scene *scene, Sequence *seq, int types, int range_start, int range_end)
+{
+  SeqDiskCache *disk_cache = &cache->disk_cache;
+  char dirpath[FILE_MAX];
+  char names[FILE_MAXFILE];
+
+  seq_disk_cache_dirpath_get(dirpath);
+  seq_disk_cache_names_get(scene, seq, names, sizeof(names));
+  const size_t names_len = strlen(names);
+  const unsigned int scene_hash = seq_disk_cache_scene_hash(scene);
+
+  seq_disk_cache_dirpath_ensure(disk_cache, dirpath);
+  BLI_mutex_lock(&disk_cache->mutex);
+
+  SeqDiskCacheFile *file = disk_cache->files.first;
+  while (file) {
+    SeqDiskCacheFile *file_next = file->next;
+    const char *file_names;
+    unsigned int file_scene_hash;
+    int type, cfra;
+
+    if (seq_disk_cache_filepath_parse(file->path, &type, &cfra, &file_scene_hash, &file_names) &&
+        (type & types) && cfra >= range_start && cfra <= range_end &&
+        file_scene_hash == scene_hash && STREQLEN(file_names, names, names_len) &&
+        (seq == NULL || STREQ(file_names + names_len, SEQ_DISK_CACHE_FILE_EXT))) {
+      seq_disk_cache_file_remove(disk_cache, file);
+    }
+    file = file_next;
+  }
+
+  /* Images being written may be outdated now. */
+  disk_cache->generation++;
+  BLI_mutex_unlock(&disk_cache->mutex);
+}
+
+static void seq_disk_cache_init(SeqDiskCache *disk_cache)
+{
+  BLI_mutex_init(&disk_cache->mutex);
+  disk_cache->files_hash = BLI_ghash_str_new("SeqDiskCache files");
+}
+
+/**
+ * Background pools are created and freed on the main thread. When the cache was created from a
+ * render or prefetch thread, the next use from the main thread creates the pool, images are only
+ * kept in memory until then.
+ */
+static void seq_disk_cache_write_pool_ensure(SeqCache *cache)
+{
+  SeqDiskCache *disk_cache = &cache->disk_cache;
+
+  if (disk_cache->write_pool != NULL || !BLI_thread_is_main()) {
+    return;
+  }
+
+  TaskPool *write_pool = BLI_task_pool_create_background(BLI_task_scheduler_get(), cache);
+  BLI_mutex_lock(&disk_cache->mutex);
+  disk_cache->write_pool = write_pool;
+  BLI_mutex_unlock(&disk_cache->mutex);
+}
+
+/* Called on the main thread once no more images are put, see #BKE_sequencer_cache_destruct. */
+static void seq_disk_cache_free(SeqDiskCache *disk_cache)
+{
+  BLI_mutex_lock(&disk_cache->mutex);
+  TaskPool *write_pool = disk_cache->write_pool;
+  disk_cache->write_pool = NULL;
+  BLI_mutex_unlock(&disk_cache->mutex);
+
+  if (write_pool) {
+    BLI_assert(BLI_thread_is_main());
+    BLI_task_pool_work_and_wait(write_pool);
+    BLI_task_pool_free(write_pool);
+  }
+  seq_disk_cache_files_free(disk_cache);
+  BLI_ghash_free(disk_cache->files_hash, NULL, NULL);
+  BLI_mutex_end(&disk_cache->mutex);
+}
+
 static void BKE_sequencer_cache_create(Scene *scene)
 {
   BLI_mutex_lock(&cache_create_lock);
@@ -440,8 +1153,9 @@ static void BKE_sequencer_cache_create(Scene *scene)
     cache->keys_pool = BLI_mempool_create(sizeof(SeqCacheKey), 0, 64, BLI_MEMPOOL_NOP);
     cache->items_pool = BLI_mempool_create(sizeof(SeqCacheItem), 0, 64, BLI_MEMPOOL_NOP);
     cache->hash = BLI_ghash_new(seq_cache_hashhash, seq_cache_hashcmp, "SeqCache hash");
-    cache->last_key = NULL;
     BLI_mutex_init(&cache->iterator_mutex);
+    seq_disk_cache_init(&cache->disk_cache);
+    seq_disk_cache_write_pool_ensure(cache);
     scene->ed->cache = cache;
   }
   BLI_mutex_unlock(&cache_create_lock);
@@ -478,6 +1192,25 @@ void BKE_sequencer_cache_destruct(Scene *scene)
     return;
   }
 
+  if (G.debug & G_DEBUG) {
+    SeqCacheStats stats;
+    BKE_sequencer_cache_stats_get(scene, &stats);
+    printf("Sequencer cache of scene \"%s\": memory %llu hits, %llu misses, "
+           "disk %llu hits, %llu misses, %llu writes\n",
+           scene->id.name + 2,
+           (unsigned long long)stats.ram_hits,
+           (unsigned long long)stats.ram_misses,
+           (unsigned long long)stats.disk_hits,
+           (unsigned long long)stats.disk_misses,
+           (unsigned long long)stats.disk_writes);
+  }
+
+  /* Prefetch threads put images from the original scene, stop them before the write pool is
+   * freed. The pool only exists for caches used from the main thread, which also free them. */
+  BKE_sequencer_prefetch_stop(scene);
+
+  /* Finish writing images, they are still referenced by the write tasks. */
+  seq_disk_cache_free(&cache->disk_cache);
   BLI_ghash_free(cache->hash, seq_cache_keyfree, seq_cache_valfree);
   BLI_mempool_destroy(cache->keys_pool);
   BLI_mempool_destroy(cache->items_pool);
@@ -511,7 +1244,7 @@ void BKE_sequencer_cache_cleanup(Scene *scene)
     BLI_ghashIterator_step(&gh_iter);
     BLI_ghash_remove(cache->hash, key, seq_cache_keyfree, seq_cache_valfree);
   }
-  cache->last_key = NULL;
+  seq_cache_last_keys_clear(cache);
   seq_cache_unlock(scene);
 }
 
@@ -568,10 +1301,52 @@ void BKE_sequencer_cache_cleanup_sequence(Scene *scene,
       BLI_ghash_remove(cache->hash, key, seq_cache_keyfree, seq_cache_valfree);
     }
   }
-  cache->last_key = NULL;
+  seq_cache_last_keys_clear(cache);
   seq_cache_unlock(scene);
+
+  /* Files are removed even when the disk cache is disabled now, it may be enabled again. */
+  if (invalidate_composite) {
+    seq_disk_cache_remove(cache, scene, NULL, invalidate_composite, range_start, range_end);
+  }
+  if (invalidate_source) {
+    seq_disk_cache_remove(
+        cache, scene, seq, invalidate_source, seq_changed->startdisp, seq_changed->enddisp);
+  }
 }
 
+/* Look up an image in memory, the reference count of the returned image is increased. */
+static ImBuf *seq_cache_lookup(const SeqRenderData *context, Sequence *seq, float cfra, int type)
+{
+  Scene *scene = context->scene;
+  SeqCache *cache = seq_cache_get_from_scene(scene);
+  ImBuf *ibuf = NULL;
+
+  if (cache && seq) {
+    seq_cache_lock(scene);
+
+    SeqCacheKey key;
+
+    key.seq = seq;
+    key.context = *context;
+    key.nfra = cfra - seq->start;
+    key.type = type;
+
+    ibuf = seq_cache_get(cache, &key);
+
+    seq_cache_unlock(scene);
+  }
+
+  return ibuf;
+}
+
+static void seq_cache_put_ex(const SeqRenderData *context,
+                             Sequence *seq,
+                             float cfra,
+                             int type,
+                             ImBuf *i,
+                             float cost,
+                             bool use_disk_cache);
+
 struct ImBuf *BKE_sequencer_cache_get(const SeqRenderData *context,
                                       Sequence *seq,
                                       float cfra,
@@ -587,24 +1362,26 @@ struct ImBuf *BKE_sequencer_cache_get(const SeqRenderData *context,
 
   if (!scene->ed->cache) {
     BKE_sequencer_cache_create(scene);
-    return NULL;
   }
 
-  seq_cache_lock(scene);
   SeqCache *cache = seq_cache_get_from_scene(scene);
-  ImBuf *ibuf = NULL;
+  seq_disk_cache_write_pool_ensure(cache);
+  ImBuf *ibuf = seq_cache_lookup(context, seq, cfra, type);
 
-  if (cache && seq) {
-    SeqCacheKey key;
+  if (cache == NULL || seq == NULL) {
+    return ibuf;
+  }
 
-    key.seq = seq;
-    key.context = *context;
-    key.nfra = cfra - seq->start;
-    key.type = type;
+  atomic_add_and_fetch_uint64(ibuf ? &cache->ram_hits : &cache->ram_misses, 1);
 
-    ibuf = seq_cache_get(cache, &key);
+  if (ibuf == NULL && seq_disk_cache_is_enabled(context, cfra, type)) {
+    ibuf = seq_disk_cache_read(cache, context, seq, cfra, type);
+
+    if (ibuf) {
+      /* Keep it in memory as if it was rendered, it doesn't need to be written again. */
+      seq_cache_put_ex(context, seq, cfra, type, ibuf, 0.0f, false);
+    }
   }
-  seq_cache_unlock(scene);
 
   return ibuf;
 }
@@ -625,34 +1402,26 @@ bool BKE_sequencer_cache_put_if_possible(
     return true;
   }
   else {
-    seq_cache_set_temp_cache_linked(scene, scene->ed->cache->last_key);
-    scene->ed->cache->last_key = NULL;
+    seq_cache_set_temp_cache_linked(scene, scene->ed->cache->last_key[context->task_id]);
+    scene->ed->cache->last_key[context->task_id] = NULL;
     return false;
   }
 }
 
-void BKE_sequencer_cache_put(
-    const SeqRenderData *context, Sequence *seq, float cfra, int type, ImBuf *i, float cost)
+static void seq_cache_put_ex(const SeqRenderData *context,
+                             Sequence *seq,
+                             float cfra,
+                             int type,
+                             ImBuf *i,
+                             float cost,
+                             bool use_disk_cache)
 {
   Scene *scene = context->scene;
 
-  if (context->is_prefetch_render) {
-    context = BKE_sequencer_prefetch_get_original_context(context);
-    scene = context->scene;
-    seq = BKE_sequencer_prefetch_get_original_sequence(seq, scene);
-  }
-
   if (i == NULL || context->skip_cache || context->is_proxy_render || !seq) {
     return;
   }
 
-  /* Prevent reinserting, it breaks cache key linking */
-  ImBuf *test = BKE_sequencer_cache_get(context, seq, cfra, type);
-  if (test) {
-    IMB_freeImBuf(test);
-    return;
-  }
-
   if (!scene->ed->cache) {
     BKE_sequencer_cache_create(scene);
   }
@@ -660,6 +1429,22 @@ void BKE_sequencer_cache_put(
   seq_cache_lock(scene);
 
   SeqCache *cache = seq_cache_get_from_scene(scene);
+  SeqCacheKey *key;
+  key = BLI_mempool_alloc(cache->keys_pool);
+  key->cache_owner = cache;
+  key->seq = seq;
+  key->context = *context;
+  key->nfra = cfra - seq->start;
+  key->type = type;
+
+  /* Prevent reinserting, it breaks cache key linking.
+   * Checked with the lock held, prefetch threads may put the same image as the main thread. */
+  if (BLI_ghash_haskey(cache->hash, key)) {
+    BLI_mempool_free(cache->keys_pool, key);
+    seq_cache_unlock(scene);
+    return;
+  }
+
   int flag;
 
   if (seq->cache_flag & SEQ_CACHE_OVERRIDE) {
@@ -674,47 +1459,60 @@ void BKE_sequencer_cache_put(
     cost = SEQ_CACHE_COST_MAX;
   }
 
-  SeqCacheKey *key;
-  key = BLI_mempool_alloc(cache->keys_pool);
-  key->cache_owner = cache;
-  key->seq = seq;
-  key->context = *context;
-  key->nfra = cfra - seq->start;
-  key->type = type;
   key->cost = cost;
-  key->cache_owner = cache;
   key->link_prev = NULL;
   key->link_next = NULL;
   key->is_temp_cache = true;
   key->task_id = context->task_id;
 
+  SeqCacheKey **last_key = &cache->last_key[key->task_id];
+
   /* Item stored for later use */
   if (flag & type) {
     key->is_temp_cache = false;
-    key->link_prev = cache->last_key;
+    key->link_prev = *last_key;
   }
 
-  SeqCacheKey *temp_last_key = cache->last_key;
+  SeqCacheKey *temp_last_key = *last_key;
   seq_cache_put(cache, key, i);
 
   /* Restore pointer to previous item as this one will be freed when stack is rendered */
   if (key->is_temp_cache) {
-    cache->last_key = temp_last_key;
+    *last_key = temp_last_key;
   }
 
   /* Set last_key's reference to this key so we can look up chain backwards
-   * Item is already put in cache, so cache->last_key points to current key;
+   * Item is already put in cache, so last_key points to current key;
    */
   if (flag & type && temp_last_key) {
-    temp_last_key->link_next = cache->last_key;
+    temp_last_key->link_next = *last_key;
   }
 
   /* Reset linking */
   if (key->type == SEQ_CACHE_STORE_FINAL_OUT) {
-    cache->last_key = NULL;
+    *last_key = NULL;
   }
 
+  const bool use_disk_write = use_disk_cache && !key->is_temp_cache &&
+                              seq_disk_cache_is_enabled(context, cfra, type);
+
   seq_cache_unlock(scene);
+
+  /* Outside of the lock, the image is still referenced by the caller. */
+  if (use_disk_write) {
+    seq_disk_cache_write_async(cache, context, seq, cfra, type, i);
+  }
+}
+
+void BKE_sequencer_cache_put(
+    const SeqRenderData *context, Sequence *seq, float cfra, int type, ImBuf *i, float cost)
+{
+  if (context->is_prefetch_render) {
+    context = BKE_sequencer_prefetch_get_original_context(context);
+    seq = BKE_sequencer_prefetch_get_original_sequence(seq, context->scene);
+  }
+
+  seq_cache_put_ex(context, seq, cfra, type, i, cost, true);
 }
 
 void BKE_sequencer_cache_iterate(
@@ -739,7 +1537,7 @@ void BKE_sequencer_cache_iterate(
     interrupt = callback(userdata, key->seq, key->nfra, key->type, key->cost);
   }
 
-  cache->last_key = NULL;
+  seq_cache_last_keys_clear(cache);
   seq_cache_unlock(scene);
 }
 
@@ -753,3 +1551,34 @@ bool BKE_sequencer_cache_is_full(Scene *scene)
 
   return memory_total < cache->memory_used;
 }
+
+/* Remove all files of the scene from the disk cache, the memory cache is kept. */
+void BKE_sequencer_cache_cleanup_disk(Scene *scene)
+{
+  SeqCache *cache = seq_cache_get_from_scene(scene);
+  if (!cache) {
+    return;
+  }
+
+  seq_disk_cache_remove(cache, scene, NULL, SEQ_CACHE_ALL_TYPES, INT_MIN, INT_MAX);
+}
+
+void BKE_sequencer_cache_stats_get(Scene *scene, SeqCacheStats *r_stats)
+{
+  memset(r_stats, 0, sizeof(*r_stats));
+
+  SeqCache *cache = seq_cache_get_from_scene(scene);
+  if (!cache) {
+    return;
+  }
+
+  r_stats->ram_hits = cache->ram_hits;
+  r_stats->ram_misses = cache->ram_misses;
+  r_stats->disk_hits = cache->disk_hits;
+  r_stats->disk_misses = cache->disk_misses;
+  r_stats->disk_writes = cache->disk_writes;
+
+  BLI_mutex_lock(&cache->disk_cache.mutex);
+  r_stats->disk_size = cache->disk_cache.size_total;
+  BLI_mutex_unlock(&cache->disk_cache.mutex);
+}
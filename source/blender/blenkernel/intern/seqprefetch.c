@@ -21,6 +21,7 @@
  * \ingroup bke
  */
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 #include "DNA_anim_types.h"
 
 #include "BLI_listbase.h"
+#include "BLI_math_base.h"
 #include "BLI_threads.h"
 
 #include "IMB_imbuf.h"
@@ -52,29 +54,56 @@
 #include "DEG_depsgraph_debug.h"
 #include "DEG_depsgraph_query.h"
 
+/**
+ * Prefetching renders several frames at once, one per worker thread.
+ *
+ * Each worker has its own depsgraph and scene copy, so it can evaluate animation for its frame
+ * and render it in parallel with the others. Only strips which use data shared between threads
+ * are rendered one frame at a time, see #BKE_sequencer_give_ibuf.
+ *
+ * The depsgraph of a worker holds copies of the scene and the ID's its strips use, so memory
+ * grows with the number of workers. Scene strips pull in whole scenes (and are rendered one frame
+ * at a time anyway), so a single worker is used when there are any, see #seq_prefetch_num_workers.
+ *
+ * Frames are handed out in order from a shared counter, so the prefetched range stays contiguous
+ * and workers wait while the cache is full, see #seq_prefetch_is_cache_full.
+ */
+typedef struct PrefetchWorker {
+  struct PrefetchJob *pfjob;
+
+  struct Main *bmain_eval;
+  struct Scene *scene_eval;
+  struct Depsgraph *depsgraph;
+
+  /* Frame being rendered, INT_MAX when idle. */
+  int cfra_rendering;
+
+  /* context */
+  struct SeqRenderData context;
+  struct SeqRenderData context_cpy;
+} PrefetchWorker;
+
 typedef struct PrefetchJob {
   struct PrefetchJob *next, *prev;
 
   struct Main *bmain;
-  struct Main *bmain_eval;
   struct Scene *scene;
-  struct Scene *scene_eval;
-  struct Depsgraph *depsgraph;
 
   ThreadMutex prefetch_suspend_mutex;
   ThreadCondition prefetch_suspend_cond;
 
   ListBase threads;
-
-  /* context */
-  struct SeqRenderData context;
-  struct SeqRenderData context_cpy;
-  struct ListBase *seqbasep;
-  struct ListBase *seqbasep_cpy;
+  PrefetchWorker workers[SEQ_PREFETCH_WORKERS_MAX];
+  /* Workers used since prefetching was last started, the others have no depsgraph. */
+  int num_workers;
+  int num_workers_running;
 
   /* prefetch area */
   float cfra;
+  /* Frames after `cfra` stored in the cache (frames being rendered are not included). */
   int num_frames_prefetched;
+  /* Next frame handed out to a worker. */
+  int cfra_next;
 
   /* control */
   bool running;
@@ -153,7 +182,15 @@ SeqRenderData *BKE_sequencer_prefetch_get_original_context(const SeqRenderData *
 {
   PrefetchJob *pfjob = seq_prefetch_job_get(context->scene);
 
-  return &pfjob->context;
+  /* Each worker renders its own scene copy. */
+  for (int i = 0; i < pfjob->num_workers; i++) {
+    if (pfjob->workers[i].scene_eval == context->scene) {
+      return &pfjob->workers[i].context;
+    }
+  }
+
+  BLI_assert(!"Prefetch context of unknown scene");
+  return &pfjob->workers[0].context;
 }
 
 static bool seq_prefetch_is_cache_full(Scene *scene)
@@ -167,46 +204,61 @@ static bool seq_prefetch_is_cache_full(Scene *scene)
   return BKE_sequencer_cache_recycle_item(pfjob->scene) == false;
 }
 
+/* Range of frames which are prefetched or being rendered, their cache entries are kept. */
 void BKE_sequencer_prefetch_get_time_range(Scene *scene, int *start, int *end)
 {
   PrefetchJob *pfjob = seq_prefetch_job_get(scene);
 
   *start = pfjob->cfra;
-  *end = pfjob->cfra + pfjob->num_frames_prefetched;
+  *end = pfjob->cfra_next;
+}
+
+/**
+ * Frames are finished out of order by the workers,
+ * only count them as prefetched once all frames before them are stored.
+ * Must be called with the suspend mutex locked.
+ */
+static void seq_prefetch_update_frames_prefetched(PrefetchJob *pfjob)
+{
+  int cfra_done_end = pfjob->cfra_next;
+  for (int i = 0; i < pfjob->num_workers; i++) {
+    cfra_done_end = min_ii(cfra_done_end, pfjob->workers[i].cfra_rendering);
+  }
+  pfjob->num_frames_prefetched = max_ii(cfra_done_end - (int)pfjob->cfra, 1);
 }
 
-static void seq_prefetch_free_depsgraph(PrefetchJob *pfjob)
+static void seq_prefetch_free_depsgraph(PrefetchWorker *worker)
 {
-  if (pfjob->depsgraph != NULL) {
-    DEG_graph_free(pfjob->depsgraph);
+  if (worker->depsgraph != NULL) {
+    DEG_graph_free(worker->depsgraph);
   }
-  pfjob->depsgraph = NULL;
-  pfjob->scene_eval = NULL;
+  worker->depsgraph = NULL;
+  worker->scene_eval = NULL;
 }
 
-static void seq_prefetch_update_depsgraph(PrefetchJob *pfjob)
+static void seq_prefetch_update_depsgraph(PrefetchWorker *worker, int cfra)
 {
-  DEG_evaluate_on_framechange(
-      pfjob->bmain_eval, pfjob->depsgraph, pfjob->cfra + pfjob->num_frames_prefetched);
+  DEG_evaluate_on_framechange(worker->bmain_eval, worker->depsgraph, cfra);
 }
 
-static void seq_prefetch_init_depsgraph(PrefetchJob *pfjob)
+static void seq_prefetch_init_depsgraph(PrefetchWorker *worker)
 {
-  Main *bmain = pfjob->bmain_eval;
+  PrefetchJob *pfjob = worker->pfjob;
+  Main *bmain = worker->bmain_eval;
   Scene *scene = pfjob->scene;
   ViewLayer *view_layer = BKE_view_layer_default_render(scene);
 
-  pfjob->depsgraph = DEG_graph_new(bmain, scene, view_layer, DAG_EVAL_RENDER);
-  DEG_debug_name_set(pfjob->depsgraph, "SEQUENCER PREFETCH");
+  worker->depsgraph = DEG_graph_new(bmain, scene, view_layer, DAG_EVAL_RENDER);
+  DEG_debug_name_set(worker->depsgraph, "SEQUENCER PREFETCH");
 
   /* Make sure there is a correct evaluated scene pointer. */
-  DEG_graph_build_for_render_pipeline(pfjob->depsgraph, bmain, scene, view_layer);
+  DEG_graph_build_for_render_pipeline(worker->depsgraph, bmain, scene, view_layer);
 
   /* Update immediately so we have proper evaluated scene. */
-  seq_prefetch_update_depsgraph(pfjob);
+  seq_prefetch_update_depsgraph(worker, pfjob->cfra_next);
 
-  pfjob->scene_eval = DEG_get_evaluated_scene(pfjob->depsgraph);
-  pfjob->scene_eval->ed->cache_flag = 0;
+  worker->scene_eval = DEG_get_evaluated_scene(worker->depsgraph);
+  worker->scene_eval->ed->cache_flag = 0;
 }
 
 static void seq_prefetch_update_area(PrefetchJob *pfjob)
@@ -215,20 +267,17 @@ static void seq_prefetch_update_area(PrefetchJob *pfjob)
 
   /* rebase */
   if (cfra > pfjob->cfra) {
-    int delta = cfra - pfjob->cfra;
     pfjob->cfra = cfra;
-    pfjob->num_frames_prefetched -= delta;
-
-    if (pfjob->num_frames_prefetched <= 1) {
-      pfjob->num_frames_prefetched = 1;
-    }
+    pfjob->cfra_next = max_ii(pfjob->cfra_next, cfra + 1);
   }
 
   /* reset */
   if (cfra < pfjob->cfra) {
     pfjob->cfra = cfra;
-    pfjob->num_frames_prefetched = 1;
+    pfjob->cfra_next = cfra + 1;
   }
+
+  seq_prefetch_update_frames_prefetched(pfjob);
 }
 
 /* Use also to update scene and context changes
@@ -246,7 +295,7 @@ void BKE_sequencer_prefetch_stop(Scene *scene)
   pfjob->stop = true;
 
   while (pfjob->running) {
-    BLI_condition_notify_one(&pfjob->prefetch_suspend_cond);
+    BLI_condition_notify_all(&pfjob->prefetch_suspend_cond);
   }
 }
 
@@ -255,32 +304,56 @@ static void seq_prefetch_update_context(const SeqRenderData *context)
   PrefetchJob *pfjob;
   pfjob = seq_prefetch_job_get(context->scene);
 
-  BKE_sequencer_new_render_data(pfjob->bmain_eval,
-                                pfjob->depsgraph,
-                                pfjob->scene_eval,
-                                context->rectx,
-                                context->recty,
-                                context->preview_render_size,
-                                false,
-                                &pfjob->context_cpy);
-  pfjob->context_cpy.is_prefetch_render = true;
-  pfjob->context_cpy.task_id = SEQ_TASK_PREFETCH_RENDER;
-
-  BKE_sequencer_new_render_data(pfjob->bmain,
-                                pfjob->depsgraph,
-                                pfjob->scene,
-                                context->rectx,
-                                context->recty,
-                                context->preview_render_size,
-                                false,
-                                &pfjob->context);
-  pfjob->context.is_prefetch_render = false;
-
-  /* Same ID as prefetch context, because context will be swapped, but we still
-   * want to assign this ID to cache entries created in this thread.
-   * This is to allow "temp cache" work correctly for both threads.
-   */
-  pfjob->context.task_id = SEQ_TASK_PREFETCH_RENDER;
+  for (int i = 0; i < pfjob->num_workers; i++) {
+    PrefetchWorker *worker = &pfjob->workers[i];
+    const eSeqTaskId task_id = SEQ_TASK_PREFETCH_RENDER + i;
+
+    BKE_sequencer_new_render_data(worker->bmain_eval,
+                                  worker->depsgraph,
+                                  worker->scene_eval,
+                                  context->rectx,
+                                  context->recty,
+                                  context->preview_render_size,
+                                  false,
+                                  &worker->context_cpy);
+    worker->context_cpy.is_prefetch_render = true;
+    worker->context_cpy.task_id = task_id;
+
+    BKE_sequencer_new_render_data(pfjob->bmain,
+                                  worker->depsgraph,
+                                  pfjob->scene,
+                                  context->rectx,
+                                  context->recty,
+                                  context->preview_render_size,
+                                  false,
+                                  &worker->context);
+    worker->context.is_prefetch_render = false;
+
+    /* Same ID as prefetch context, because context will be swapped, but we still
+     * want to assign this ID to cache entries created in this thread.
+     * This is to allow "temp cache" work correctly for all threads.
+     */
+    worker->context.task_id = task_id;
+  }
+}
+
+/**
+ * Number of workers to use: each has its own depsgraph, a single one is used for scenes with
+ * scene strips because those copy whole scenes and are rendered one frame at a time anyway.
+ */
+static int seq_prefetch_num_workers(Scene *scene)
+{
+  Sequence *seq;
+  SEQ_BEGIN (scene->ed, seq) {
+    if (seq->type == SEQ_TYPE_SCENE) {
+      BKE_sequence_iterator_end(&iter_macro);
+      return 1;
+    }
+  }
+  SEQ_END;
+
+  /* Leave threads for the main thread and for effects, which are multi-threaded. */
+  return min_ii(max_ii(BLI_system_thread_count() / 2, 1), SEQ_PREFETCH_WORKERS_MAX);
 }
 
 static void seq_prefetch_update_scene(Scene *scene)
@@ -291,8 +364,23 @@ static void seq_prefetch_update_scene(Scene *scene)
     return;
   }
 
-  seq_prefetch_free_depsgraph(pfjob);
-  seq_prefetch_init_depsgraph(pfjob);
+  pfjob->num_workers = seq_prefetch_num_workers(scene);
+
+  for (int i = 0; i < SEQ_PREFETCH_WORKERS_MAX; i++) {
+    PrefetchWorker *worker = &pfjob->workers[i];
+    seq_prefetch_free_depsgraph(worker);
+
+    if (i < pfjob->num_workers) {
+      if (worker->bmain_eval == NULL) {
+        worker->bmain_eval = BKE_main_new();
+      }
+      seq_prefetch_init_depsgraph(worker);
+    }
+    else if (worker->bmain_eval != NULL) {
+      BKE_main_free(worker->bmain_eval);
+      worker->bmain_eval = NULL;
+    }
+  }
 }
 
 static void seq_prefetch_resume(Scene *scene)
@@ -300,7 +388,7 @@ static void seq_prefetch_resume(Scene *scene)
   PrefetchJob *pfjob = seq_prefetch_job_get(scene);
 
   if (pfjob && pfjob->waiting) {
-    BLI_condition_notify_one(&pfjob->prefetch_suspend_cond);
+    BLI_condition_notify_all(&pfjob->prefetch_suspend_cond);
   }
 }
 
@@ -313,75 +401,116 @@ void BKE_sequencer_prefetch_free(Scene *scene)
 
   BKE_sequencer_prefetch_stop(scene);
 
-  BLI_threadpool_remove(&pfjob->threads, pfjob);
   BLI_threadpool_end(&pfjob->threads);
   BLI_mutex_end(&pfjob->prefetch_suspend_mutex);
   BLI_condition_end(&pfjob->prefetch_suspend_cond);
-  seq_prefetch_free_depsgraph(pfjob);
-  BKE_main_free(pfjob->bmain_eval);
+  for (int i = 0; i < SEQ_PREFETCH_WORKERS_MAX; i++) {
+    seq_prefetch_free_depsgraph(&pfjob->workers[i]);
+    if (pfjob->workers[i].bmain_eval != NULL) {
+      BKE_main_free(pfjob->workers[i].bmain_eval);
+    }
+  }
   MEM_freeN(pfjob);
   scene->ed->prefetch_job = NULL;
 }
 
-static void *seq_prefetch_frames(void *job)
+static void seq_prefetch_frame_render(PrefetchWorker *worker, int cfra)
 {
-  PrefetchJob *pfjob = (PrefetchJob *)job;
-
-  while (pfjob->cfra + pfjob->num_frames_prefetched <= pfjob->scene->r.efra) {
-    pfjob->scene_eval->ed->prefetch_job = NULL;
-
-    AnimData *adt = BKE_animdata_from_id(&pfjob->context_cpy.scene->id);
-    BKE_animsys_evaluate_animdata(pfjob->context_cpy.scene,
-                                  &pfjob->context_cpy.scene->id,
-                                  adt,
-                                  pfjob->cfra + pfjob->num_frames_prefetched,
-                                  ADT_RECALC_ALL,
-                                  false);
-    seq_prefetch_update_depsgraph(pfjob);
-
-    /* This is quite hacky solution:
-     * We need cross-reference original scene with copy for cache.
-     * However depsgraph must not have this data, because it will try to kill this job.
-     * Scene copy don't reference original scene. Perhaps, this could be done by depsgraph.
-     * Set to NULL before return!
-     */
-    pfjob->scene_eval->ed->prefetch_job = pfjob;
-
-    ImBuf *ibuf = BKE_sequencer_give_ibuf(
-        &pfjob->context_cpy, pfjob->cfra + pfjob->num_frames_prefetched, 0);
-    BKE_sequencer_cache_free_temp_cache(
-        pfjob->scene, pfjob->context.task_id, pfjob->cfra + pfjob->num_frames_prefetched);
-    IMB_freeImBuf(ibuf);
-
-    /* suspend thread */
-    BLI_mutex_lock(&pfjob->prefetch_suspend_mutex);
-    while ((seq_prefetch_is_cache_full(pfjob->scene) || seq_prefetch_is_scrubbing(pfjob->bmain)) &&
-           pfjob->scene->ed->cache_flag & SEQ_CACHE_PREFETCH_ENABLE && !pfjob->stop) {
-      pfjob->waiting = true;
-      BLI_condition_wait(&pfjob->prefetch_suspend_cond, &pfjob->prefetch_suspend_mutex);
-      seq_prefetch_update_area(pfjob);
-    }
-    pfjob->waiting = false;
-    BLI_mutex_unlock(&pfjob->prefetch_suspend_mutex);
+  PrefetchJob *pfjob = worker->pfjob;
+
+  worker->scene_eval->ed->prefetch_job = NULL;
+
+  AnimData *adt = BKE_animdata_from_id(&worker->context_cpy.scene->id);
+  BKE_animsys_evaluate_animdata(worker->context_cpy.scene,
+                                &worker->context_cpy.scene->id,
+                                adt,
+                                cfra,
+                                ADT_RECALC_ALL,
+                                false);
+  seq_prefetch_update_depsgraph(worker, cfra);
+
+  /* This is quite hacky solution:
+   * We need cross-reference original scene with copy for cache.
+   * However depsgraph must not have this data, because it will try to kill this job.
+   * Scene copy don't reference original scene. Perhaps, this could be done by depsgraph.
+   * Set to NULL before return!
+   */
+  worker->scene_eval->ed->prefetch_job = pfjob;
 
-    /* Avoid "collision" with main thread, but make sure to fetch at least few frames */
-    if (pfjob->num_frames_prefetched > 5 &&
-        (pfjob->cfra + pfjob->num_frames_prefetched - pfjob->scene->r.cfra) < 2) {
-      break;
-    }
+  /* Decode inputs while other workers may be rendering effects, then render the frame. */
+  BKE_sequencer_render_inputs(&worker->context_cpy, cfra, 0);
+  ImBuf *ibuf = BKE_sequencer_give_ibuf(&worker->context_cpy, cfra, 0);
+  BKE_sequencer_cache_free_temp_cache(pfjob->scene, worker->context.task_id, cfra);
+  IMB_freeImBuf(ibuf);
+}
 
-    if (!(pfjob->scene->ed->cache_flag & SEQ_CACHE_PREFETCH_ENABLE) || pfjob->stop) {
-      break;
-    }
+/**
+ * Get the next frame to render, returns false when prefetching should stop.
+ * The frame rendered before by the worker (if any) is stored in the cache by now.
+ */
+static bool seq_prefetch_next_frame(PrefetchWorker *worker, int *r_cfra)
+{
+  PrefetchJob *pfjob = worker->pfjob;
+  bool has_frame = true;
+
+  BLI_mutex_lock(&pfjob->prefetch_suspend_mutex);
 
+  worker->cfra_rendering = INT_MAX;
+  seq_prefetch_update_frames_prefetched(pfjob);
+
+  /* suspend thread */
+  while ((seq_prefetch_is_cache_full(pfjob->scene) || seq_prefetch_is_scrubbing(pfjob->bmain)) &&
+         pfjob->scene->ed->cache_flag & SEQ_CACHE_PREFETCH_ENABLE && !pfjob->stop) {
+    pfjob->waiting = true;
+    BLI_condition_wait(&pfjob->prefetch_suspend_cond, &pfjob->prefetch_suspend_mutex);
     seq_prefetch_update_area(pfjob);
-    pfjob->num_frames_prefetched++;
   }
+  pfjob->waiting = false;
 
-  BKE_sequencer_cache_free_temp_cache(
-      pfjob->scene, pfjob->context.task_id, pfjob->cfra + pfjob->num_frames_prefetched);
-  pfjob->running = false;
-  pfjob->scene_eval->ed->prefetch_job = NULL;
+  /* Avoid "collision" with main thread, but make sure to fetch at least few frames */
+  if (pfjob->num_frames_prefetched > 5 && (pfjob->cfra_next - pfjob->scene->r.cfra) < 2) {
+    has_frame = false;
+  }
+
+  if (!(pfjob->scene->ed->cache_flag & SEQ_CACHE_PREFETCH_ENABLE) || pfjob->stop) {
+    has_frame = false;
+  }
+
+  if (has_frame) {
+    seq_prefetch_update_area(pfjob);
+    *r_cfra = pfjob->cfra_next;
+    has_frame = *r_cfra <= pfjob->scene->r.efra;
+  }
+
+  if (has_frame) {
+    worker->cfra_rendering = *r_cfra;
+    pfjob->cfra_next++;
+  }
+
+  BLI_mutex_unlock(&pfjob->prefetch_suspend_mutex);
+
+  return has_frame;
+}
+
+static void *seq_prefetch_frames(void *worker_v)
+{
+  PrefetchWorker *worker = (PrefetchWorker *)worker_v;
+  PrefetchJob *pfjob = worker->pfjob;
+  int cfra = pfjob->cfra;
+
+  while (seq_prefetch_next_frame(worker, &cfra)) {
+    seq_prefetch_frame_render(worker, cfra);
+  }
+
+  BKE_sequencer_cache_free_temp_cache(pfjob->scene, worker->context.task_id, cfra);
+  worker->scene_eval->ed->prefetch_job = NULL;
+
+  BLI_mutex_lock(&pfjob->prefetch_suspend_mutex);
+  pfjob->num_workers_running--;
+  if (pfjob->num_workers_running == 0) {
+    pfjob->running = false;
+  }
+  BLI_mutex_unlock(&pfjob->prefetch_suspend_mutex);
 
   return 0;
 }
@@ -395,29 +524,41 @@ static PrefetchJob *seq_prefetch_start(const SeqRenderData *context, float cfra)
       pfjob = (PrefetchJob *)MEM_callocN(sizeof(PrefetchJob), "PrefetchJob");
       context->scene->ed->prefetch_job = pfjob;
 
-      BLI_threadpool_init(&pfjob->threads, seq_prefetch_frames, 1);
+      BLI_threadpool_init(&pfjob->threads, seq_prefetch_frames, SEQ_PREFETCH_WORKERS_MAX);
       BLI_mutex_init(&pfjob->prefetch_suspend_mutex);
       BLI_condition_init(&pfjob->prefetch_suspend_cond);
 
       pfjob->bmain = context->bmain;
-      pfjob->bmain_eval = BKE_main_new();
-
       pfjob->scene = context->scene;
-      seq_prefetch_init_depsgraph(pfjob);
+
+      for (int i = 0; i < SEQ_PREFETCH_WORKERS_MAX; i++) {
+        pfjob->workers[i].pfjob = pfjob;
+      }
     }
   }
-  seq_prefetch_update_scene(context->scene);
-  seq_prefetch_update_context(context);
+  /* Workers which didn't start rendering yet. */
+  for (int i = 0; i < SEQ_PREFETCH_WORKERS_MAX; i++) {
+    pfjob->workers[i].cfra_rendering = INT_MAX;
+  }
 
   pfjob->cfra = cfra;
+  pfjob->cfra_next = (int)cfra + 1;
   pfjob->num_frames_prefetched = 1;
 
+  seq_prefetch_update_scene(context->scene);
+  seq_prefetch_update_context(context);
+
   pfjob->waiting = false;
   pfjob->stop = false;
   pfjob->running = true;
+  pfjob->num_workers_running = pfjob->num_workers;
 
-  BLI_threadpool_remove(&pfjob->threads, pfjob);
-  BLI_threadpool_insert(&pfjob->threads, pfjob);
+  for (int i = 0; i < SEQ_PREFETCH_WORKERS_MAX; i++) {
+    BLI_threadpool_remove(&pfjob->threads, &pfjob->workers[i]);
+  }
+  for (int i = 0; i < pfjob->num_workers; i++) {
+    BLI_threadpool_insert(&pfjob->threads, &pfjob->workers[i]);
+  }
 
   return pfjob;
 }
@@ -4064,6 +4064,90 @@ static ImBuf *seq_render_strip_stack(const SeqRenderData *context,
   return out;
 }
 
+static void seq_render_inputs_recursive(const SeqRenderData *context,
+                                        SeqRenderState *state,
+                                        Sequence *seq,
+                                        float cfra)
+{
+  if (ELEM(seq->type, SEQ_TYPE_IMAGE, SEQ_TYPE_MOVIE)) {
+    ImBuf *ibuf = seq_render_strip(context, state, seq, cfra);
+    IMB_freeImBuf(ibuf);
+  }
+  /* Speed effect inputs are rendered at other frames. */
+  else if ((seq->type & SEQ_TYPE_EFFECT) && seq->type != SEQ_TYPE_SPEED) {
+    Sequence *inputs[] = {seq->seq1, seq->seq2, seq->seq3};
+    for (int i = 0; i < ARRAY_SIZE(inputs); i++) {
+      if (inputs[i]) {
+        seq_render_inputs_recursive(context, state, inputs[i], cfra);
+      }
+    }
+  }
+}
+
+/**
+ * Decode and preprocess the image and movie strips used by the frame, putting them in the cache.
+ *
+ * This doesn't lock the render mutex: only image and movie strips are rendered, which don't use
+ * data shared with other threads. Each scene copy opens its own movie handles (copying a strip
+ * clears them) and the cache has its own lock. It may only be used for a scene copy that is not
+ * rendered by other threads (each prefetch thread has its own).
+ * Rendering the frame afterwards then only needs to apply effects and blend strips.
+ */
+void BKE_sequencer_render_inputs(const SeqRenderData *context, float cfra, int chanshown)
+{
+  Editing *ed = BKE_sequencer_editing_get(context->scene, false);
+
+  if (ed == NULL) {
+    return;
+  }
+
+  SeqRenderState state;
+  sequencer_state_init(&state);
+  Sequence *seq_arr[MAXSEQ + 1];
+  int count = get_shown_sequences(ed->seqbasep, cfra, chanshown, seq_arr);
+
+  for (int i = 0; i < count; i++) {
+    seq_render_inputs_recursive(context, &state, seq_arr[i], cfra);
+  }
+}
+
+/**
+ * Strips using data which is shared between scene copies and can't be rendered by several
+ * threads at once: scenes (render pipeline and OpenGL context), movies (`anim` handles and their
+ * FFmpeg decoding state), movie clips (clip cache), text (font state). Adjustment and multicam
+ * strips render the channels below them.
+ */
+static bool seq_render_strip_needs_lock(Sequence *seq)
+{
+  if (ELEM(seq->type,
+           SEQ_TYPE_SCENE,
+           SEQ_TYPE_MOVIE,
+           SEQ_TYPE_MOVIECLIP,
+           SEQ_TYPE_TEXT,
+           SEQ_TYPE_ADJUSTMENT,
+           SEQ_TYPE_MULTICAM)) {
+    return true;
+  }
+
+  if (seq->type == SEQ_TYPE_META) {
+    for (Sequence *seq_meta = seq->seqbase.first; seq_meta; seq_meta = seq_meta->next) {
+      if (seq_render_strip_needs_lock(seq_meta)) {
+        return true;
+      }
+    }
+  }
+  else if (seq->type & SEQ_TYPE_EFFECT) {
+    Sequence *inputs[] = {seq->seq1, seq->seq2, seq->seq3};
+    for (int i = 0; i < ARRAY_SIZE(inputs); i++) {
+      if (inputs[i] && seq_render_strip_needs_lock(inputs[i])) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
 /*
  * returned ImBuf is refed!
  * you have to free after usage!
@@ -4106,7 +4190,15 @@ ImBuf *BKE_sequencer_give_ibuf(const SeqRenderData *context, float cfra, int cha
   float cost = 0;
 
   if (count && !out) {
-    BLI_mutex_lock(&seq_render_mutex);
+    /* Effects, blending and color management of other strips run in parallel. */
+    bool use_lock = false;
+    for (int i = 0; i < count && !use_lock; i++) {
+      use_lock = seq_render_strip_needs_lock(seq_arr[i]);
+    }
+
+    if (use_lock) {
+      BLI_mutex_lock(&seq_render_mutex);
+    }
     out = seq_render_strip_stack(context, &state, seqbasep, cfra, chanshown);
     cost = seq_estimate_render_cost_end(context->scene, begin);
 
@@ -4118,7 +4210,9 @@ ImBuf *BKE_sequencer_give_ibuf(const SeqRenderData *context, float cfra, int cha
       BKE_sequencer_cache_put_if_possible(
           context, seq_arr[count - 1], cfra, SEQ_CACHE_STORE_FINAL_OUT, out, cost);
     }
-    BLI_mutex_unlock(&seq_render_mutex);
+    if (use_lock) {
+      BLI_mutex_unlock(&seq_render_mutex);
+    }
   }
 
   BKE_sequencer_prefetch_start(context, cfra, cost);
@@ -38,6 +38,7 @@
 #include "BKE_subdiv.h"
 #include "BKE_subdiv_eval.h"
 
+#include "opensubdiv_capi_type.h"
 #include "opensubdiv_topology_refiner_capi.h"
 
 /* =============================================================================
@@ -170,34 +171,97 @@ typedef struct CCGEvalGridsData {
   SubdivCCGMaterialFlagsEvaluator *material_flags_evaluator;
 } CCGEvalGridsData;
 
+/* Patch coordinates of all grid elements of a face, and the evaluated limit surface at them.
+ * Evaluating a whole face with one call to the evaluator is much cheaper than going point by
+ * point. */
+typedef struct CCGEvalGridsTLSData {
+  OpenSubdiv_PatchCoord *patch_coords;
+  float (*P)[3];
+  float (*dPdu)[3];
+  float (*dPdv)[3];
+  int buffer_size;
+} CCGEvalGridsTLSData;
+
+static void subdiv_ccg_eval_tls_ensure(CCGEvalGridsTLSData *tls, const int num_points)
+{
+  if (tls->buffer_size >= num_points) {
+    return;
+  }
+  MEM_SAFE_FREE(tls->patch_coords);
+  MEM_SAFE_FREE(tls->P);
+  MEM_SAFE_FREE(tls->dPdu);
+  MEM_SAFE_FREE(tls->dPdv);
+  tls->patch_coords = MEM_malloc_arrayN(num_points, sizeof(OpenSubdiv_PatchCoord), __func__);
+  tls->P = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+  tls->dPdu = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+  tls->dPdv = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+  tls->buffer_size = num_points;
+}
+
+static void subdiv_ccg_eval_regular_grid_patch_coords(CCGEvalGridsData *data,
+                                                      const int face_index,
+                                                      OpenSubdiv_PatchCoord *patch_coords)
+{
+  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
+  const int ptex_face_index = data->face_ptex_offset[face_index];
+  const int grid_size = subdiv_ccg->grid_size;
+  const float grid_size_1_inv = 1.0f / (float)(grid_size - 1);
+  const SubdivCCGFace *face = &subdiv_ccg->faces[face_index];
+  OpenSubdiv_PatchCoord *patch_coord = patch_coords;
+  for (int corner = 0; corner < face->num_grids; corner++) {
+    for (int y = 0; y < grid_size; y++) {
+      const float grid_v = (float)y * grid_size_1_inv;
+      for (int x = 0; x < grid_size; x++, patch_coord++) {
+        const float grid_u = (float)x * grid_size_1_inv;
+        patch_coord->ptex_face = ptex_face_index;
+        BKE_subdiv_rotate_grid_to_quad(
+            corner, grid_u, grid_v, &patch_coord->u, &patch_coord->v);
+      }
+    }
+  }
+}
+
+static void subdiv_ccg_eval_special_grid_patch_coords(CCGEvalGridsData *data,
+                                                      const int face_index,
+                                                      OpenSubdiv_PatchCoord *patch_coords)
+{
+  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
+  const int grid_size = subdiv_ccg->grid_size;
+  const float grid_size_1_inv = 1.0f / (float)(grid_size - 1);
+  const SubdivCCGFace *face = &subdiv_ccg->faces[face_index];
+  OpenSubdiv_PatchCoord *patch_coord = patch_coords;
+  for (int corner = 0; corner < face->num_grids; corner++) {
+    const int ptex_face_index = data->face_ptex_offset[face_index] + corner;
+    for (int y = 0; y < grid_size; y++) {
+      const float u = 1.0f - ((float)y * grid_size_1_inv);
+      for (int x = 0; x < grid_size; x++, patch_coord++) {
+        const float v = 1.0f - ((float)x * grid_size_1_inv);
+        patch_coord->ptex_face = ptex_face_index;
+        patch_coord->u = u;
+        patch_coord->v = v;
+      }
+    }
+  }
+}
+
 static void subdiv_ccg_eval_grid_element_limit(CCGEvalGridsData *data,
-                                               const int ptex_face_index,
-                                               const float u,
-                                               const float v,
+                                               CCGEvalGridsTLSData *tls,
+                                               const int point_index,
                                                unsigned char *element)
 {
   Subdiv *subdiv = data->subdiv;
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  if (subdiv->displacement_evaluator != NULL) {
-    BKE_subdiv_eval_final_point(subdiv, ptex_face_index, u, v, (float *)element);
-  }
-  else if (subdiv_ccg->has_normal) {
-    BKE_subdiv_eval_limit_point_and_normal(subdiv,
-                                           ptex_face_index,
-                                           u,
-                                           v,
-                                           (float *)element,
-                                           (float *)(element + subdiv_ccg->normal_offset));
-  }
-  else {
-    BKE_subdiv_eval_limit_point(subdiv, ptex_face_index, u, v, (float *)element);
+  copy_v3_v3((float *)element, tls->P[point_index]);
+  /* With displacement normals are calculated after all final coordinates are known. */
+  if (subdiv_ccg->has_normal && subdiv->displacement_evaluator == NULL) {
+    float *N = (float *)(element + subdiv_ccg->normal_offset);
+    cross_v3_v3v3(N, tls->dPdu[point_index], tls->dPdv[point_index]);
+    normalize_v3(N);
   }
 }
 
 static void subdiv_ccg_eval_grid_element_mask(CCGEvalGridsData *data,
-                                              const int ptex_face_index,
-                                              const float u,
-                                              const float v,
+                                              const OpenSubdiv_PatchCoord *patch_coord,
                                               unsigned char *element)
 {
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
@@ -206,76 +270,57 @@ static void subdiv_ccg_eval_grid_element_mask(CCGEvalGridsData *data,
   }
   float *mask_value_ptr = (float *)(element + subdiv_ccg->mask_offset);
   if (data->mask_evaluator != NULL) {
-    *mask_value_ptr = data->mask_evaluator->eval_mask(data->mask_evaluator, ptex_face_index, u, v);
+    *mask_value_ptr = data->mask_evaluator->eval_mask(
+        data->mask_evaluator, patch_coord->ptex_face, patch_coord->u, patch_coord->v);
   }
   else {
     *mask_value_ptr = 0.0f;
   }
 }
 
-static void subdiv_ccg_eval_grid_element(CCGEvalGridsData *data,
-                                         const int ptex_face_index,
-                                         const float u,
-                                         const float v,
-                                         unsigned char *element)
-{
-  subdiv_ccg_eval_grid_element_limit(data, ptex_face_index, u, v, element);
-  subdiv_ccg_eval_grid_element_mask(data, ptex_face_index, u, v, element);
-}
-
-static void subdiv_ccg_eval_regular_grid(CCGEvalGridsData *data, const int face_index)
+static void subdiv_ccg_eval_face_grids(CCGEvalGridsData *data,
+                                       CCGEvalGridsTLSData *tls,
+                                       const int face_index)
 {
+  Subdiv *subdiv = data->subdiv;
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  const int ptex_face_index = data->face_ptex_offset[face_index];
   const int grid_size = subdiv_ccg->grid_size;
-  const float grid_size_1_inv = 1.0f / (float)(grid_size - 1);
+  const int grid_area = grid_size * grid_size;
   const int element_size = element_size_bytes_get(subdiv_ccg);
   SubdivCCGFace *faces = subdiv_ccg->faces;
   SubdivCCGFace **grid_faces = subdiv_ccg->grid_faces;
   const SubdivCCGFace *face = &faces[face_index];
-  for (int corner = 0; corner < face->num_grids; corner++) {
-    const int grid_index = face->start_grid_index + corner;
-    unsigned char *grid = (unsigned char *)subdiv_ccg->grids[grid_index];
-    for (int y = 0; y < grid_size; y++) {
-      const float grid_v = (float)y * grid_size_1_inv;
-      for (int x = 0; x < grid_size; x++) {
-        const float grid_u = (float)x * grid_size_1_inv;
-        float u, v;
-        BKE_subdiv_rotate_grid_to_quad(corner, grid_u, grid_v, &u, &v);
-        const size_t grid_element_index = (size_t)y * grid_size + x;
-        const size_t grid_element_offset = grid_element_index * element_size;
-        subdiv_ccg_eval_grid_element(data, ptex_face_index, u, v, &grid[grid_element_offset]);
-      }
-    }
-    /* Assign grid's face. */
-    grid_faces[grid_index] = &faces[face_index];
-    /* Assign material flags. */
-    subdiv_ccg->grid_flag_mats[grid_index] = data->material_flags_evaluator->eval_material_flags(
-        data->material_flags_evaluator, face_index);
+  const int num_points = face->num_grids * grid_area;
+  subdiv_ccg_eval_tls_ensure(tls, num_points);
+  /* Gather patch coordinates of all grids of the face. */
+  if (face->num_grids == 4) {
+    subdiv_ccg_eval_regular_grid_patch_coords(data, face_index, tls->patch_coords);
   }
-}
-
-static void subdiv_ccg_eval_special_grid(CCGEvalGridsData *data, const int face_index)
-{
-  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  const int grid_size = subdiv_ccg->grid_size;
-  const float grid_size_1_inv = 1.0f / (float)(grid_size - 1);
-  const int element_size = element_size_bytes_get(subdiv_ccg);
-  SubdivCCGFace *faces = subdiv_ccg->faces;
-  SubdivCCGFace **grid_faces = subdiv_ccg->grid_faces;
-  const SubdivCCGFace *face = &faces[face_index];
+  else {
+    subdiv_ccg_eval_special_grid_patch_coords(data, face_index, tls->patch_coords);
+  }
+  /* Evaluate all of them at once. */
+  if (subdiv->displacement_evaluator != NULL) {
+    BKE_subdiv_eval_final_points(
+        subdiv, tls->patch_coords, num_points, tls->P, tls->dPdu, tls->dPdv);
+  }
+  else if (subdiv_ccg->has_normal) {
+    BKE_subdiv_eval_limit_points(
+        subdiv, tls->patch_coords, num_points, tls->P, tls->dPdu, tls->dPdv);
+  }
+  else {
+    BKE_subdiv_eval_limit_points(subdiv, tls->patch_coords, num_points, tls->P, NULL, NULL);
+  }
+  /* Scatter evaluated data to the grids. */
   for (int corner = 0; corner < face->num_grids; corner++) {
     const int grid_index = face->start_grid_index + corner;
-    const int ptex_face_index = data->face_ptex_offset[face_index] + corner;
     unsigned char *grid = (unsigned char *)subdiv_ccg->grids[grid_index];
-    for (int y = 0; y < grid_size; y++) {
-      const float u = 1.0f - ((float)y * grid_size_1_inv);
-      for (int x = 0; x < grid_size; x++) {
-        const float v = 1.0f - ((float)x * grid_size_1_inv);
-        const size_t grid_element_index = (size_t)y * grid_size + x;
-        const size_t grid_element_offset = grid_element_index * element_size;
-        subdiv_ccg_eval_grid_element(data, ptex_face_index, u, v, &grid[grid_element_offset]);
-      }
+    for (int grid_element_index = 0; grid_element_index < grid_area; grid_element_index++) {
+      const int point_index = corner * grid_area + grid_element_index;
+      const size_t grid_element_offset = (size_t)grid_element_index * element_size;
+      unsigned char *element = &grid[grid_element_offset];
+      subdiv_ccg_eval_grid_element_limit(data, tls, point_index, element);
+      subdiv_ccg_eval_grid_element_mask(data, &tls->patch_coords[point_index], element);
     }
     /* Assign grid's face. */
     grid_faces[grid_index] = &faces[face_index];
@@ -287,17 +332,21 @@ static void subdiv_ccg_eval_special_grid(CCGEvalGridsData *data, const int face_
 
 static void subdiv_ccg_eval_grids_task(void *__restrict userdata_v,
                                        const int face_index,
-                                       const TaskParallelTLS *__restrict UNUSED(tls))
+                                       const TaskParallelTLS *__restrict tls_v)
 {
   CCGEvalGridsData *data = userdata_v;
-  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  SubdivCCGFace *face = &subdiv_ccg->faces[face_index];
-  if (face->num_grids == 4) {
-    subdiv_ccg_eval_regular_grid(data, face_index);
-  }
-  else {
-    subdiv_ccg_eval_special_grid(data, face_index);
-  }
+  CCGEvalGridsTLSData *tls = tls_v->userdata_chunk;
+  subdiv_ccg_eval_face_grids(data, tls, face_index);
+}
+
+static void subdiv_ccg_eval_grids_finalize(void *__restrict UNUSED(userdata),
+                                           void *__restrict tls_v)
+{
+  CCGEvalGridsTLSData *tls = tls_v;
+  MEM_SAFE_FREE(tls->patch_coords);
+  MEM_SAFE_FREE(tls->P);
+  MEM_SAFE_FREE(tls->dPdu);
+  MEM_SAFE_FREE(tls->dPdv);
 }
 
 static bool subdiv_ccg_evaluate_grids(SubdivCCG *subdiv_ccg,
@@ -314,9 +363,13 @@ static bool subdiv_ccg_evaluate_grids(SubdivCCG *subdiv_ccg,
   data.face_ptex_offset = BKE_subdiv_face_ptex_offset_get(subdiv);
   data.mask_evaluator = mask_evaluator;
   data.material_flags_evaluator = material_flags_evaluator;
+  CCGEvalGridsTLSData tls_data = {NULL};
   /* Threaded grids evaluation. */
   TaskParallelSettings parallel_range_settings;
   BLI_parallel_range_settings_defaults(&parallel_range_settings);
+  parallel_range_settings.userdata_chunk = &tls_data;
+  parallel_range_settings.userdata_chunk_size = sizeof(tls_data);
+  parallel_range_settings.func_finalize = subdiv_ccg_eval_grids_finalize;
   BLI_task_parallel_range(
       0, num_faces, &data, subdiv_ccg_eval_grids_task, &parallel_range_settings);
   /* If displacement is used, need to calculate normals after all final
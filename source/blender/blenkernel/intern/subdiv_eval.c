@@ -35,6 +35,7 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "opensubdiv_capi_type.h"
 #include "opensubdiv_evaluator_capi.h"
 #include "opensubdiv_topology_refiner_capi.h"
 
@@ -244,6 +245,48 @@ void BKE_subdiv_eval_final_point(
   }
 }
 
+/* ============================ Batched queries ============================= */
+
+void BKE_subdiv_eval_limit_points(Subdiv *subdiv,
+                                  const OpenSubdiv_PatchCoord *patch_coords,
+                                  const int num_patch_coords,
+                                  float (*r_P)[3],
+                                  float (*r_dPdu)[3],
+                                  float (*r_dPdv)[3])
+{
+  subdiv->evaluator->evaluatePatchesLimit(subdiv->evaluator,
+                                          patch_coords,
+                                          num_patch_coords,
+                                          (float *)r_P,
+                                          (float *)r_dPdu,
+                                          (float *)r_dPdv);
+}
+
+void BKE_subdiv_eval_final_points(Subdiv *subdiv,
+                                  const OpenSubdiv_PatchCoord *patch_coords,
+                                  const int num_patch_coords,
+                                  float (*r_P)[3],
+                                  float (*r_dPdu)[3],
+                                  float (*r_dPdv)[3])
+{
+  BKE_subdiv_eval_limit_points(subdiv, patch_coords, num_patch_coords, r_P, r_dPdu, r_dPdv);
+  if (subdiv->displacement_evaluator == NULL) {
+    return;
+  }
+  for (int i = 0; i < num_patch_coords; i++) {
+    const OpenSubdiv_PatchCoord *patch_coord = &patch_coords[i];
+    float D[3];
+    BKE_subdiv_eval_displacement(subdiv,
+                                 patch_coord->ptex_face,
+                                 patch_coord->u,
+                                 patch_coord->v,
+                                 r_dPdu[i],
+                                 r_dPdv[i],
+                                 D);
+    add_v3_v3(r_P[i], D);
+  }
+}
+
 /* ===================  Patch queries at given resolution =================== */
 
 /* Move buffer forward by a given number of bytes. */
@@ -264,6 +307,43 @@ static void buffer_write_short_value(void **buffer, const short *values_buffer,
   memcpy(*buffer, values_buffer, sizeof(short) * num_values);
 }
 
+/* Evaluate limit surface of the whole patch with a single batched evaluator call.
+ * Derivatives are only evaluated when r_dPdu is not NULL, arrays are to be freed by caller. */
+static int patch_resolution_eval(Subdiv *subdiv,
+                                 const int ptex_face_index,
+                                 const int resolution,
+                                 float (**r_P)[3],
+                                 float (**r_dPdu)[3],
+                                 float (**r_dPdv)[3])
+{
+  const int num_points = resolution * resolution;
+  OpenSubdiv_PatchCoord *patch_coords = MEM_malloc_arrayN(
+      num_points, sizeof(OpenSubdiv_PatchCoord), __func__);
+  const float inv_resolution_1 = 1.0f / (float)(resolution - 1);
+  OpenSubdiv_PatchCoord *patch_coord = patch_coords;
+  for (int y = 0; y < resolution; y++) {
+    const float v = y * inv_resolution_1;
+    for (int x = 0; x < resolution; x++, patch_coord++) {
+      patch_coord->ptex_face = ptex_face_index;
+      patch_coord->u = x * inv_resolution_1;
+      patch_coord->v = v;
+    }
+  }
+  *r_P = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+  if (r_dPdu != NULL) {
+    *r_dPdu = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+    *r_dPdv = MEM_malloc_arrayN(num_points, sizeof(float[3]), __func__);
+  }
+  BKE_subdiv_eval_limit_points(subdiv,
+                               patch_coords,
+                               num_points,
+                               *r_P,
+                               (r_dPdu != NULL) ? *r_dPdu : NULL,
+                               (r_dPdu != NULL) ? *r_dPdv : NULL);
+  MEM_freeN(patch_coords);
+  return num_points;
+}
+
 void BKE_subdiv_eval_limit_patch_resolution_point(Subdiv *subdiv,
                                                   const int ptex_face_index,
                                                   const int resolution,
@@ -271,16 +351,15 @@ void BKE_subdiv_eval_limit_patch_resolution_point(Subdiv *subdiv,
                                                   const int offset,
                                                   const int stride)
 {
+  float(*P)[3];
+  const int num_points = patch_resolution_eval(
+      subdiv, ptex_face_index, resolution, &P, NULL, NULL);
   buffer_apply_offset(&buffer, offset);
-  const float inv_resolution_1 = 1.0f / (float)(resolution - 1);
-  for (int y = 0; y < resolution; y++) {
-    const float v = y * inv_resolution_1;
-    for (int x = 0; x < resolution; x++) {
-      const float u = x * inv_resolution_1;
-      BKE_subdiv_eval_limit_point(subdiv, ptex_face_index, u, v, buffer);
-      buffer_apply_offset(&buffer, stride);
-    }
+  for (int i = 0; i < num_points; i++) {
+    buffer_write_float_value(&buffer, P[i], 3);
+    buffer_apply_offset(&buffer, stride);
   }
+  MEM_freeN(P);
 }
 
 void BKE_subdiv_eval_limit_patch_resolution_point_and_derivatives(Subdiv *subdiv,
@@ -296,21 +375,23 @@ void BKE_subdiv_eval_limit_patch_resolution_point_and_derivatives(Subdiv *subdiv
                                                                   const int dv_offset,
                                                                   const int dv_stride)
 {
+  float(*P)[3], (*dPdu)[3], (*dPdv)[3];
+  const int num_points = patch_resolution_eval(
+      subdiv, ptex_face_index, resolution, &P, &dPdu, &dPdv);
   buffer_apply_offset(&point_buffer, point_offset);
   buffer_apply_offset(&du_buffer, du_offset);
   buffer_apply_offset(&dv_buffer, dv_offset);
-  const float inv_resolution_1 = 1.0f / (float)(resolution - 1);
-  for (int y = 0; y < resolution; y++) {
-    const float v = y * inv_resolution_1;
-    for (int x = 0; x < resolution; x++) {
-      const float u = x * inv_resolution_1;
-      BKE_subdiv_eval_limit_point_and_derivatives(
-          subdiv, ptex_face_index, u, v, point_buffer, du_buffer, dv_buffer);
-      buffer_apply_offset(&point_buffer, point_stride);
-      buffer_apply_offset(&du_buffer, du_stride);
-      buffer_apply_offset(&dv_buffer, dv_stride);
-    }
+  for (int i = 0; i < num_points; i++) {
+    buffer_write_float_value(&point_buffer, P[i], 3);
+    buffer_write_float_value(&du_buffer, dPdu[i], 3);
+    buffer_write_float_value(&dv_buffer, dPdv[i], 3);
+    buffer_apply_offset(&point_buffer, point_stride);
+    buffer_apply_offset(&du_buffer, du_stride);
+    buffer_apply_offset(&dv_buffer, dv_stride);
   }
+  MEM_freeN(P);
+  MEM_freeN(dPdu);
+  MEM_freeN(dPdv);
 }
 
 void BKE_subdiv_eval_limit_patch_resolution_point_and_normal(Subdiv *subdiv,
@@ -323,20 +404,23 @@ void BKE_subdiv_eval_limit_patch_resolution_point_and_normal(Subdiv *subdiv,
                                                              const int normal_offset,
                                                              const int normal_stride)
 {
+  float(*P)[3], (*dPdu)[3], (*dPdv)[3];
+  const int num_points = patch_resolution_eval(
+      subdiv, ptex_face_index, resolution, &P, &dPdu, &dPdv);
   buffer_apply_offset(&point_buffer, point_offset);
   buffer_apply_offset(&normal_buffer, normal_offset);
-  const float inv_resolution_1 = 1.0f / (float)(resolution - 1);
-  for (int y = 0; y < resolution; y++) {
-    const float v = y * inv_resolution_1;
-    for (int x = 0; x < resolution; x++) {
-      const float u = x * inv_resolution_1;
-      float normal[3];
-      BKE_subdiv_eval_limit_point_and_normal(subdiv, ptex_face_index, u, v, point_buffer, normal);
-      buffer_write_float_value(&normal_buffer, normal, 3);
-      buffer_apply_offset(&point_buffer, point_stride);
-      buffer_apply_offset(&normal_buffer, normal_stride);
-    }
+  for (int i = 0; i < num_points; i++) {
+    float normal[3];
+    cross_v3_v3v3(normal, dPdu[i], dPdv[i]);
+    normalize_v3(normal);
+    buffer_write_float_value(&point_buffer, P[i], 3);
+    buffer_write_float_value(&normal_buffer, normal, 3);
+    buffer_apply_offset(&point_buffer, point_stride);
+    buffer_apply_offset(&normal_buffer, normal_stride);
   }
+  MEM_freeN(P);
+  MEM_freeN(dPdu);
+  MEM_freeN(dPdv);
 }
 
 void BKE_subdiv_eval_limit_patch_resolution_point_and_short_normal(Subdiv *subdiv,
@@ -349,19 +433,23 @@ void BKE_subdiv_eval_limit_patch_resolution_point_and_short_normal(Subdiv *subdi
                                                                    const int normal_offset,
                                                                    const int normal_stride)
 {
+  float(*P)[3], (*dPdu)[3], (*dPdv)[3];
+  const int num_points = patch_resolution_eval(
+      subdiv, ptex_face_index, resolution, &P, &dPdu, &dPdv);
   buffer_apply_offset(&point_buffer, point_offset);
   buffer_apply_offset(&normal_buffer, normal_offset);
-  const float inv_resolution_1 = 1.0f / (float)(resolution - 1);
-  for (int y = 0; y < resolution; y++) {
-    const float v = y * inv_resolution_1;
-    for (int x = 0; x < resolution; x++) {
-      const float u = x * inv_resolution_1;
-      short normal[3];
-      BKE_subdiv_eval_limit_point_and_short_normal(
-          subdiv, ptex_face_index, u, v, point_buffer, normal);
-      buffer_write_short_value(&normal_buffer, normal, 3);
-      buffer_apply_offset(&point_buffer, point_stride);
-      buffer_apply_offset(&normal_buffer, normal_stride);
-    }
+  for (int i = 0; i < num_points; i++) {
+    float normal[3];
+    short short_normal[3];
+    cross_v3_v3v3(normal, dPdu[i], dPdv[i]);
+    normalize_v3(normal);
+    normal_float_to_short_v3(short_normal, normal);
+    buffer_write_float_value(&point_buffer, P[i], 3);
+    buffer_write_short_value(&normal_buffer, short_normal, 3);
+    buffer_apply_offset(&point_buffer, point_stride);
+    buffer_apply_offset(&normal_buffer, normal_stride);
   }
+  MEM_freeN(P);
+  MEM_freeN(dPdu);
+  MEM_freeN(dPdv);
 }
@@ -41,6 +41,8 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "opensubdiv_capi_type.h"
+
 /* =============================================================================
  * Subdivision context.
  */
@@ -413,6 +415,100 @@ static void loop_interpolation_end(LoopsForInterpolation *loop_interpolation)
   }
 }
 
+/* =============================================================================
+ * Batched evaluation.
+ *
+ * Inner vertices are not shared with other threads, and nothing reads their coordinates until
+ * the traversal is over. This allows to queue their limit surface evaluation and evaluate many
+ * of them with a single call to the evaluator, which is much cheaper than going vertex by
+ * vertex.
+ */
+
+/* Number of vertices which are evaluated with a single call to the evaluator. */
+#define EVAL_BATCH_SIZE 1024
+
+typedef struct SubdivMeshEvalBatch {
+  Subdiv *subdiv;
+  MVert *subdiv_mvert;
+  int num_points;
+  OpenSubdiv_PatchCoord *patch_coords;
+  int *subdiv_vertex_indices;
+  float (*P)[3];
+  float (*dPdu)[3];
+  float (*dPdv)[3];
+} SubdivMeshEvalBatch;
+
+static void eval_batch_flush(SubdivMeshEvalBatch *batch)
+{
+  if (batch->num_points == 0) {
+    return;
+  }
+  Subdiv *subdiv = batch->subdiv;
+  if (subdiv->displacement_evaluator == NULL) {
+    BKE_subdiv_eval_limit_points(
+        subdiv, batch->patch_coords, batch->num_points, batch->P, batch->dPdu, batch->dPdv);
+  }
+  else {
+    BKE_subdiv_eval_final_points(
+        subdiv, batch->patch_coords, batch->num_points, batch->P, batch->dPdu, batch->dPdv);
+  }
+  for (int i = 0; i < batch->num_points; i++) {
+    MVert *subdiv_vert = &batch->subdiv_mvert[batch->subdiv_vertex_indices[i]];
+    copy_v3_v3(subdiv_vert->co, batch->P[i]);
+    /* With displacement normals are calculated once all final coordinates are known. */
+    if (subdiv->displacement_evaluator == NULL) {
+      float N[3];
+      cross_v3_v3v3(N, batch->dPdu[i], batch->dPdv[i]);
+      normalize_v3(N);
+      normal_float_to_short_v3(subdiv_vert->no, N);
+    }
+  }
+  batch->num_points = 0;
+}
+
+static void eval_batch_add(SubdivMeshContext *ctx,
+                           SubdivMeshEvalBatch *batch,
+                           const int ptex_face_index,
+                           const float u,
+                           const float v,
+                           const int subdiv_vertex_index)
+{
+  if (batch->patch_coords == NULL) {
+    batch->subdiv = ctx->subdiv;
+    batch->subdiv_mvert = ctx->subdiv_mesh->mvert;
+    batch->patch_coords = MEM_malloc_arrayN(
+        EVAL_BATCH_SIZE, sizeof(OpenSubdiv_PatchCoord), "eval batch patch coords");
+    batch->subdiv_vertex_indices = MEM_malloc_arrayN(
+        EVAL_BATCH_SIZE, sizeof(int), "eval batch vertex indices");
+    batch->P = MEM_malloc_arrayN(EVAL_BATCH_SIZE, sizeof(float[3]), "eval batch P");
+    batch->dPdu = MEM_malloc_arrayN(EVAL_BATCH_SIZE, sizeof(float[3]), "eval batch dPdu");
+    batch->dPdv = MEM_malloc_arrayN(EVAL_BATCH_SIZE, sizeof(float[3]), "eval batch dPdv");
+  }
+  OpenSubdiv_PatchCoord *patch_coord = &batch->patch_coords[batch->num_points];
+  patch_coord->ptex_face = ptex_face_index;
+  patch_coord->u = u;
+  patch_coord->v = v;
+  batch->subdiv_vertex_indices[batch->num_points] = subdiv_vertex_index;
+  batch->num_points++;
+  if (batch->num_points == EVAL_BATCH_SIZE) {
+    eval_batch_flush(batch);
+  }
+}
+
+/* Evaluates all the queued vertices. */
+static void eval_batch_end(SubdivMeshEvalBatch *batch)
+{
+  if (batch->patch_coords == NULL) {
+    return;
+  }
+  eval_batch_flush(batch);
+  MEM_freeN(batch->patch_coords);
+  MEM_freeN(batch->subdiv_vertex_indices);
+  MEM_freeN(batch->P);
+  MEM_freeN(batch->dPdu);
+  MEM_freeN(batch->dPdv);
+}
+
 /* =============================================================================
  * TLS.
  */
@@ -427,11 +523,14 @@ typedef struct SubdivMeshTLS {
   LoopsForInterpolation loop_interpolation;
   const MPoly *loop_interpolation_coarse_poly;
   int loop_interpolation_coarse_corner;
+
+  SubdivMeshEvalBatch eval_batch;
 } SubdivMeshTLS;
 
 static void subdiv_mesh_tls_free(void *tls_v)
 {
   SubdivMeshTLS *tls = tls_v;
+  eval_batch_end(&tls->eval_batch);
   if (tls->vertex_interpolation_initialized) {
     vertex_interpolation_end(&tls->vertex_interpolation);
   }
@@ -440,25 +539,6 @@ static void subdiv_mesh_tls_free(void *tls_v)
   }
 }
 
-/* =============================================================================
- * Evaluation helper functions.
- */
-
-static void eval_final_point_and_vertex_normal(Subdiv *subdiv,
-                                               const int ptex_face_index,
-                                               const float u,
-                                               const float v,
-                                               float r_P[3],
-                                               short r_N[3])
-{
-  if (subdiv->displacement_evaluator == NULL) {
-    BKE_subdiv_eval_limit_point_and_short_normal(subdiv, ptex_face_index, u, v, r_P, r_N);
-  }
-  else {
-    BKE_subdiv_eval_final_point(subdiv, ptex_face_index, u, v, r_P);
-  }
-}
-
 /* =============================================================================
  * Accumulation helpers.
  */
@@ -764,7 +844,6 @@ static void subdiv_mesh_vertex_inner(const SubdivForeachContext *foreach_context
 {
   SubdivMeshContext *ctx = foreach_context->user_data;
   SubdivMeshTLS *tls = tls_v;
-  Subdiv *subdiv = ctx->subdiv;
   const Mesh *coarse_mesh = ctx->coarse_mesh;
   const MPoly *coarse_mpoly = coarse_mesh->mpoly;
   const MPoly *coarse_poly = &coarse_mpoly[coarse_poly_index];
@@ -773,8 +852,7 @@ static void subdiv_mesh_vertex_inner(const SubdivForeachContext *foreach_context
   MVert *subdiv_vert = &subdiv_mvert[subdiv_vertex_index];
   subdiv_mesh_ensure_vertex_interpolation(ctx, tls, coarse_poly, coarse_corner);
   subdiv_vertex_data_interpolate(ctx, subdiv_vert, &tls->vertex_interpolation, u, v);
-  eval_final_point_and_vertex_normal(
-      subdiv, ptex_face_index, u, v, subdiv_vert->co, subdiv_vert->no);
+  eval_batch_add(ctx, &tls->eval_batch, ptex_face_index, u, v, subdiv_vertex_index);
   subdiv_mesh_tag_center_vertex(coarse_poly, subdiv_vert, u, v);
 }
 
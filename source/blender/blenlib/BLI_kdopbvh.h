@@ -231,6 +231,25 @@ void BLI_bvhtree_ray_cast_all(BVHTree *tree,
                               BVHTree_RayCastCallback callback,
                               void *userdata);
 
+/* batch queries: answer many queries at once, sorted for coherence and split over threads
+ * (callbacks must be thread-safe) */
+void BLI_bvhtree_ray_cast_batch(BVHTree *tree,
+                                const float (*co)[3],
+                                const float (*dir)[3],
+                                float radius,
+                                BVHTreeRayHit *hits,
+                                int rays_num,
+                                BVHTree_RayCastCallback callback,
+                                void *userdata,
+                                int flag);
+void BLI_bvhtree_find_nearest_batch(BVHTree *tree,
+                                    const float (*co)[3],
+                                    BVHTreeNearest *nearest,
+                                    int points_num,
+                                    BVHTree_NearestPointCallback callback,
+                                    void *userdata,
+                                    int flag);
+
 float BLI_bvhtree_bb_raycast(const float bv[6],
                              const float light_start[3],
                              const float light_end[3],
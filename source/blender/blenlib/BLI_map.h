@@ -193,6 +193,15 @@ template<typename KeyT, typename ValueT, typename Allocator = GuardedAllocator>
     new (this) Map();
   }
 
+  /**
+   * Remove all elements from the map, without freeing the hash table.
+   * Useful when the map is filled again with a similar number of elements.
+   */
+  void clear_and_keep_capacity()
+  {
+    m_array.clear_and_keep_capacity();
+  }
+
   /**
    * Insert a new key-value-pair in the map.
    * Asserts when the key existed before.
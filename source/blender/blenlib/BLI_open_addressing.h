@@ -183,6 +183,19 @@ class OpenAddressingArray {
     return grown;
   }
 
+  /**
+   * Reset all items to be empty, keeping the array allocated.
+   */
+  void clear_and_keep_capacity()
+  {
+    for (uint32_t i = 0; i < m_item_amount; i++) {
+      m_items[i].~Item();
+      new (m_items + i) Item();
+    }
+    m_slots_set_or_dummy = 0;
+    m_slots_dummy = 0;
+  }
+
   /**
    * Amount of items in the array times the number of slots per item.
    */
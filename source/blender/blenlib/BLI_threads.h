@@ -131,6 +131,7 @@ ThreadRWMutex *BLI_rw_mutex_alloc(void);
 void BLI_rw_mutex_free(ThreadRWMutex *mutex);
 
 void BLI_rw_mutex_lock(ThreadRWMutex *mutex, int mode);
+bool BLI_rw_mutex_trylock(ThreadRWMutex *mutex, int mode);
 void BLI_rw_mutex_unlock(ThreadRWMutex *mutex);
 
 /* Ticket Mutex Lock
@@ -32,6 +32,8 @@
  *   #BLI_bvhtree_ray_cast, #BVHRayCastData
  * - Nearest point on surface:
  *   #BLI_bvhtree_find_nearest, #BVHNearestData
+ * - Batches of ray-casts or nearest point queries:
+ *   #BLI_bvhtree_ray_cast_batch, #BLI_bvhtree_find_nearest_batch, #BVHRayCastPacket
  * - Overlapping 2 trees:
  *   #BLI_bvhtree_overlap, #BVHOverlapData_Shared, #BVHOverlapData_Thread
  * - Range Query:
@@ -47,9 +49,14 @@
 #include "BLI_stack.h"
 #include "BLI_kdopbvh.h"
 #include "BLI_math.h"
+#include "BLI_math_bits.h"
 #include "BLI_task.h"
 #include "BLI_heap_simple.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #include "BLI_strict_flags.h"
 
 /* used for iterative_raycast */
@@ -1984,6 +1991,371 @@ void BLI_bvhtree_ray_cast_all(BVHTree *tree,
 
 /** \} */
 
+/* -------------------------------------------------------------------- */
+/** \name BLI_bvhtree_ray_cast_batch / BLI_bvhtree_find_nearest_batch
+ *
+ * Batch queries are sorted along a Morton curve (rays by direction octant first),
+ * so consecutive queries traverse the same nodes. Rays are traced in packets,
+ * where a node is visited once for all rays of the packet which hit it,
+ * the packets are split over threads.
+ *
+ * \{ */
+
+#define BVH_RAY_PACKET_SIZE 4
+/* Bits of Morton code per axis, leaving room for the ray direction octant. */
+#define BVH_BATCH_MORTON_BITS 9
+#define BVH_BATCH_THREAD_THRESHOLD 1024
+
+typedef struct BVHRayCastPacket {
+  const BVHTree *tree;
+
+  BVHTree_RayCastCallback callback;
+  void *userdata;
+
+  /* Lanes are stored per axis, to test all of them against a node at once. */
+  float origin[3][BVH_RAY_PACKET_SIZE];
+  float idir[3][BVH_RAY_PACKET_SIZE];
+  float hit_dist[BVH_RAY_PACKET_SIZE];
+  float radius;
+
+  BVHTreeRay ray[BVH_RAY_PACKET_SIZE];
+#ifdef USE_KDOPBVH_WATERTIGHT
+  struct IsectRayPrecalc isect_precalc[BVH_RAY_PACKET_SIZE];
+#endif
+  BVHTreeRayHit *hit[BVH_RAY_PACKET_SIZE];
+} BVHRayCastPacket;
+
+typedef struct BVHBatchData {
+  BVHTree *tree;
+  const float (*co)[3];
+  const float (*dir)[3];
+  float radius;
+  BVHTreeRayHit *hits;
+  BVHTreeNearest *nearest;
+  int queries_num;
+  /* Query indices in traversal order. */
+  const int *order;
+
+  BVHTree_RayCastCallback raycast_callback;
+  BVHTree_NearestPointCallback nearest_callback;
+  void *userdata;
+  int flag;
+} BVHBatchData;
+
+static uint bvh_batch_morton_expand(uint x)
+{
+  /* Insert two zero bits after each of the lower 10 bits. */
+  x &= 0x000003ff;
+  x = (x | (x << 16)) & 0xff0000ff;
+  x = (x | (x << 8)) & 0x0300f00f;
+  x = (x | (x << 4)) & 0x030c30c3;
+  x = (x | (x << 2)) & 0x09249249;
+  return x;
+}
+
+/**
+ * Calculate the order to answer queries in, for rays \a dir is given.
+ * \return Array of \a queries_num indices, to be freed by the caller.
+ */
+static int *bvh_batch_order_calc(const float (*co)[3], const float (*dir)[3], int queries_num)
+{
+  float min[3], max[3], scale[3];
+  INIT_MINMAX(min, max);
+  for (int i = 0; i < queries_num; i++) {
+    minmax_v3v3_v3(min, max, co[i]);
+  }
+  const float cells = (float)((1 << BVH_BATCH_MORTON_BITS) - 1);
+  for (int axis = 0; axis < 3; axis++) {
+    scale[axis] = (max[axis] > min[axis]) ? cells / (max[axis] - min[axis]) : 0.0f;
+  }
+
+  uint *keys = MEM_mallocN(sizeof(*keys) * (size_t)queries_num * 2, __func__);
+  uint *keys_tmp = keys + queries_num;
+  int *order = MEM_mallocN(sizeof(*order) * (size_t)queries_num * 2, __func__);
+  int *order_tmp = order + queries_num;
+
+  for (int i = 0; i < queries_num; i++) {
+    uint key = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      const uint cell = (uint)((co[i][axis] - min[axis]) * scale[axis]);
+      key |= bvh_batch_morton_expand(cell) << axis;
+    }
+    if (dir) {
+      const uint octant = (uint)(dir[i][0] < 0.0f) | ((uint)(dir[i][1] < 0.0f) << 1) |
+                          ((uint)(dir[i][2] < 0.0f) << 2);
+      key |= octant << (3 * BVH_BATCH_MORTON_BITS);
+    }
+    keys[i] = key;
+    order[i] = i;
+  }
+
+  /* Radix sort, one byte at a time. */
+  const int key_bits = 3 * BVH_BATCH_MORTON_BITS + 3;
+  for (int shift = 0; shift < key_bits; shift += 8) {
+    int count[257] = {0};
+    for (int i = 0; i < queries_num; i++) {
+      count[((keys[i] >> shift) & 0xff) + 1]++;
+    }
+    for (int i = 0; i < 256; i++) {
+      count[i + 1] += count[i];
+    }
+    for (int i = 0; i < queries_num; i++) {
+      const int dst = count[(keys[i] >> shift) & 0xff]++;
+      keys_tmp[dst] = keys[i];
+      order_tmp[dst] = order[i];
+    }
+    SWAP(uint *, keys, keys_tmp);
+    SWAP(int *, order, order_tmp);
+  }
+
+  /* Four passes, the sorted data is back in the first half. */
+  BLI_assert(keys < keys_tmp);
+  MEM_freeN(keys);
+  return order;
+}
+
+/**
+ * Test all lanes in \a mask against the bounds of \a node, same as #fast_ray_nearest_hit
+ * (but taking the radius into account).
+ * \return Mask of the lanes which hit the node closer than their current hit.
+ */
+static int ray_packet_nearest_hit(const BVHRayCastPacket *packet,
+                                  const BVHNode *node,
+                                  const int mask,
+                                  float r_dist[BVH_RAY_PACKET_SIZE])
+{
+  const float *bv = node->bv;
+#ifdef __SSE2__
+  __m128 tnear = _mm_set1_ps(-FLT_MAX);
+  __m128 tfar = _mm_set1_ps(FLT_MAX);
+  for (int axis = 0; axis < 3; axis++) {
+    const __m128 origin = _mm_loadu_ps(packet->origin[axis]);
+    const __m128 idir = _mm_loadu_ps(packet->idir[axis]);
+    const __m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bv[2 * axis] - packet->radius), origin),
+                                 idir);
+    const __m128 tb = _mm_mul_ps(
+        _mm_sub_ps(_mm_set1_ps(bv[2 * axis + 1] + packet->radius), origin), idir);
+    tnear = _mm_max_ps(tnear, _mm_min_ps(ta, tb));
+    tfar = _mm_min_ps(tfar, _mm_max_ps(ta, tb));
+  }
+  const __m128 is_hit = _mm_and_ps(
+      _mm_and_ps(_mm_cmple_ps(tnear, tfar), _mm_cmpge_ps(tfar, _mm_setzero_ps())),
+      _mm_cmplt_ps(tnear, _mm_loadu_ps(packet->hit_dist)));
+  _mm_storeu_ps(r_dist, tnear);
+  return _mm_movemask_ps(is_hit) & mask;
+#else
+  int hit_mask = 0;
+  for (int lane = 0; lane < BVH_RAY_PACKET_SIZE; lane++) {
+    float tnear = -FLT_MAX, tfar = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+      const float ta = (bv[2 * axis] - packet->radius - packet->origin[axis][lane]) *
+                       packet->idir[axis][lane];
+      const float tb = (bv[2 * axis + 1] + packet->radius - packet->origin[axis][lane]) *
+                       packet->idir[axis][lane];
+      tnear = max_ff(tnear, min_ff(ta, tb));
+      tfar = min_ff(tfar, max_ff(ta, tb));
+    }
+    if (tnear <= tfar && tfar >= 0.0f && tnear < packet->hit_dist[lane]) {
+      hit_mask |= 1 << lane;
+    }
+    r_dist[lane] = tnear;
+  }
+  return hit_mask & mask;
+#endif
+}
+
+static void dfs_raycast_packet(BVHRayCastPacket *packet, BVHNode *node, int mask)
+{
+  float dist[BVH_RAY_PACKET_SIZE];
+  mask = ray_packet_nearest_hit(packet, node, mask, dist);
+  if (mask == 0) {
+    return;
+  }
+
+  if (node->totnode == 0) {
+    for (int lane = 0; lane < BVH_RAY_PACKET_SIZE; lane++) {
+      if ((mask & (1 << lane)) == 0) {
+        continue;
+      }
+      BVHTreeRayHit *hit = packet->hit[lane];
+      if (packet->callback) {
+        packet->callback(packet->userdata, node->index, &packet->ray[lane], hit);
+      }
+      else {
+        hit->index = node->index;
+        hit->dist = dist[lane];
+        madd_v3_v3v3fl(hit->co, packet->ray[lane].origin, packet->ray[lane].direction, dist[lane]);
+      }
+      packet->hit_dist[lane] = hit->dist;
+    }
+  }
+  else {
+    /* Pick loop direction from the first ray, rays in a packet mostly share their octant. */
+    const int lane = bitscan_forward_i(mask);
+    if (packet->idir[(int)node->main_axis][lane] > 0.0f) {
+      for (int i = 0; i != node->totnode; i++) {
+        dfs_raycast_packet(packet, node->children[i], mask);
+      }
+    }
+    else {
+      for (int i = node->totnode - 1; i >= 0; i--) {
+        dfs_raycast_packet(packet, node->children[i], mask);
+      }
+    }
+  }
+}
+
+static void bvhtree_ray_cast_batch_task_cb(void *__restrict userdata,
+                                           const int packet_index,
+                                           const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const BVHBatchData *data = userdata;
+  BVHNode *root = data->tree->nodes[data->tree->totleaf];
+
+  BVHRayCastPacket packet = {
+      .tree = data->tree,
+      .callback = data->raycast_callback,
+      .userdata = data->userdata,
+      .radius = data->radius,
+  };
+
+  const int query_start = packet_index * BVH_RAY_PACKET_SIZE;
+  const int lanes_num = min_ii(BVH_RAY_PACKET_SIZE, data->queries_num - query_start);
+  int mask = 0;
+  for (int lane = 0; lane < lanes_num; lane++) {
+    const int query = data->order[query_start + lane];
+    BVHTreeRay *ray = &packet.ray[lane];
+
+    BLI_ASSERT_UNIT_V3(data->dir[query]);
+    copy_v3_v3(ray->origin, data->co[query]);
+    copy_v3_v3(ray->direction, data->dir[query]);
+    ray->radius = data->radius;
+#ifdef USE_KDOPBVH_WATERTIGHT
+    if (data->flag & BVH_RAYCAST_WATERTIGHT) {
+      isect_ray_tri_watertight_v3_precalc(&packet.isect_precalc[lane], ray->direction);
+      ray->isect_precalc = &packet.isect_precalc[lane];
+    }
+    else {
+      ray->isect_precalc = NULL;
+    }
+#endif
+
+    for (int axis = 0; axis < 3; axis++) {
+      packet.origin[axis][lane] = ray->origin[axis];
+      packet.idir[axis][lane] = 1.0f / ray->direction[axis];
+    }
+    packet.hit[lane] = &data->hits[query];
+    packet.hit_dist[lane] = data->hits[query].dist;
+    mask |= 1 << lane;
+  }
+
+  dfs_raycast_packet(&packet, root, mask);
+}
+
+static void bvhtree_find_nearest_batch_task_cb(void *__restrict userdata,
+                                               const int index,
+                                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const BVHBatchData *data = userdata;
+  const int query = data->order[index];
+  BLI_bvhtree_find_nearest_ex(data->tree,
+                              data->co[query],
+                              &data->nearest[query],
+                              data->nearest_callback,
+                              data->userdata,
+                              data->flag);
+}
+
+/**
+ * Cast \a rays_num rays, same as calling #BLI_bvhtree_ray_cast_ex for each of them.
+ *
+ * \param hits: Array of \a rays_num hits, to be initialized by the caller
+ * (as the \a hit argument of #BLI_bvhtree_ray_cast_ex).
+ * \note The \a callback is called from multiple threads.
+ */
+void BLI_bvhtree_ray_cast_batch(BVHTree *tree,
+                                const float (*co)[3],
+                                const float (*dir)[3],
+                                float radius,
+                                BVHTreeRayHit *hits,
+                                int rays_num,
+                                BVHTree_RayCastCallback callback,
+                                void *userdata,
+                                int flag)
+{
+  if (rays_num == 0 || tree->nodes[tree->totleaf] == NULL) {
+    return;
+  }
+
+  int *order = bvh_batch_order_calc(co, dir, rays_num);
+
+  BVHBatchData data = {
+      .tree = tree,
+      .co = co,
+      .dir = dir,
+      .radius = radius,
+      .hits = hits,
+      .queries_num = rays_num,
+      .order = order,
+      .raycast_callback = callback,
+      .userdata = userdata,
+      .flag = flag,
+  };
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (rays_num > BVH_BATCH_THREAD_THRESHOLD);
+  settings.min_iter_per_thread = BVH_BATCH_THREAD_THRESHOLD / BVH_RAY_PACKET_SIZE;
+  const int packets_num = (rays_num + BVH_RAY_PACKET_SIZE - 1) / BVH_RAY_PACKET_SIZE;
+  BLI_task_parallel_range(0, packets_num, &data, bvhtree_ray_cast_batch_task_cb, &settings);
+
+  MEM_freeN(order);
+}
+
+/**
+ * Find the nearest node of \a points_num points,
+ * same as calling #BLI_bvhtree_find_nearest_ex for each of them.
+ *
+ * \param nearest: Array of \a points_num results, to be initialized by the caller
+ * (as the \a nearest argument of #BLI_bvhtree_find_nearest_ex).
+ * \note The \a callback is called from multiple threads.
+ */
+void BLI_bvhtree_find_nearest_batch(BVHTree *tree,
+                                    const float (*co)[3],
+                                    BVHTreeNearest *nearest,
+                                    int points_num,
+                                    BVHTree_NearestPointCallback callback,
+                                    void *userdata,
+                                    int flag)
+{
+  if (points_num == 0) {
+    return;
+  }
+
+  int *order = bvh_batch_order_calc(co, NULL, points_num);
+
+  BVHBatchData data = {
+      .tree = tree,
+      .co = co,
+      .nearest = nearest,
+      .queries_num = points_num,
+      .order = order,
+      .nearest_callback = callback,
+      .userdata = userdata,
+      .flag = flag,
+  };
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (points_num > BVH_BATCH_THREAD_THRESHOLD);
+  settings.min_iter_per_thread = BVH_BATCH_THREAD_THRESHOLD;
+  BLI_task_parallel_range(0, points_num, &data, bvhtree_find_nearest_batch_task_cb, &settings);
+
+  MEM_freeN(order);
+}
+
+/** \} */
+
 /* -------------------------------------------------------------------- */
 /** \name BLI_bvhtree_range_query
  *
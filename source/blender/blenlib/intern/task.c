@@ -201,15 +201,37 @@ struct TaskPool {
 #endif
 };
 
+/* Double-ended queue of tasks owned by a single thread.
+ *
+ * The owning thread pushes and pops tasks at the head, so the most recently
+ * spawned (and likely cache-hot) work is handled first. Idle threads steal
+ * from the tail, which holds the oldest tasks. Every queue has its own lock,
+ * so threads only contend when they touch the same queue.
+ */
+typedef struct TaskQueue {
+  ListBase tasks;
+  SpinLock lock;
+} TaskQueue;
+
 struct TaskScheduler {
   pthread_t *threads;
   struct TaskThread *task_threads;
   int num_threads;
   bool background_thread_only;
 
-  ListBase queue;
-  ThreadMutex queue_mutex;
-  ThreadCondition queue_cond;
+  /* Per-thread task queues, indexed by thread ID. Queue 0 belongs to the main
+   * thread and is shared with threads which are not managed by the scheduler.
+   */
+  TaskQueue *queues;
+
+  /* Number of queued tasks which can be picked up by worker threads. Idle
+   * workers only go to sleep when this drops to zero.
+   */
+  size_t num_queued;
+  /* Number of worker threads waiting on wakeup_cond. */
+  uint32_t num_sleeping;
+  ThreadMutex wakeup_mutex;
+  ThreadCondition wakeup_cond;
 
   ThreadMutex startup_mutex;
   ThreadCondition startup_cond;
@@ -353,55 +375,127 @@ static void task_pool_num_increase(TaskPool *pool, size_t new)
   BLI_mutex_unlock(&pool->num_mutex);
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+BLI_INLINE int task_scheduler_thread_id_get(TaskScheduler *scheduler)
+{
+  TaskThread *thread = pthread_getspecific(scheduler->tls_id_key);
+  return (thread != NULL) ? thread->id : 0;
+}
+
+/* In the single-threaded case the only worker is the background fallback
+ * thread, which must not pick up tasks from regular pools.
+ */
+BLI_INLINE bool task_pool_is_worker_runnable(const TaskScheduler *scheduler, const TaskPool *pool)
 {
-  bool found_task = false;
-  BLI_mutex_lock(&scheduler->queue_mutex);
+  return !scheduler->background_thread_only || pool->run_in_background;
+}
 
-  while (!scheduler->queue.first && !scheduler->do_exit) {
-    BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+/* Account for new tasks in the queues, and wake up sleeping workers. */
+static void task_scheduler_queued_add(TaskScheduler *scheduler, size_t num)
+{
+  if (num == 0) {
+    return;
   }
 
-  do {
-    Task *current_task;
+  atomic_add_and_fetch_z(&scheduler->num_queued, num);
 
-    /* Assuming we can only have a void queue in 'exit' case here seems logical
-     * (we should only be here after our worker thread has been woken up from a
-     * condition_wait(), which only happens after a new task was added to the queue),
-     * but it is wrong.
-     * Waiting on condition may wake up the thread even if condition is not signaled
-     * (spurious wake-ups), and some race condition may also empty the queue **after**
-     * condition has been signaled, but **before** awoken thread reaches this point...
-     * See http://stackoverflow.com/questions/8594591
-     *
-     * So we only abort here if do_exit is set.
-     */
-    if (scheduler->do_exit) {
-      BLI_mutex_unlock(&scheduler->queue_mutex);
-      return false;
+  /* Both this counter update and the one of num_sleeping in the worker sleep
+   * path are full barriers: either the worker sees the new tasks before going
+   * to sleep, or we see it sleeping here and wake it up.
+   */
+  if (atomic_add_and_fetch_uint32(&scheduler->num_sleeping, 0) != 0) {
+    BLI_mutex_lock(&scheduler->wakeup_mutex);
+    if (num == 1) {
+      BLI_condition_notify_one(&scheduler->wakeup_cond);
+    }
+    else {
+      BLI_condition_notify_all(&scheduler->wakeup_cond);
     }
+    BLI_mutex_unlock(&scheduler->wakeup_mutex);
+  }
+}
 
-    for (current_task = scheduler->queue.first; current_task != NULL;
-         current_task = current_task->next) {
-      TaskPool *pool = current_task->pool;
+/* Remove and return the first task, starting at the head of the queue (or at
+ * its tail when stealing), which belongs to the given pool. When pool is NULL
+ * any task which can be run by a worker thread is returned.
+ */
+static Task *task_queue_pop(TaskScheduler *scheduler,
+                            TaskQueue *queue,
+                            TaskPool *pool,
+                            const bool from_tail)
+{
+  /* Cheap unlocked early out. A missed task is not a problem: the caller
+   * checks the queued tasks counter before going to sleep.
+   */
+  if (queue->tasks.first == NULL) {
+    return NULL;
+  }
 
-      if (scheduler->background_thread_only && !pool->run_in_background) {
-        continue;
-      }
+  Task *found_task = NULL;
 
-      *task = current_task;
-      found_task = true;
-      BLI_remlink(&scheduler->queue, *task);
+  BLI_spin_lock(&queue->lock);
+  for (Task *task = from_tail ? queue->tasks.last : queue->tasks.first; task != NULL;
+       task = from_tail ? task->prev : task->next) {
+    if ((pool != NULL) ? (task->pool == pool) :
+                         task_pool_is_worker_runnable(scheduler, task->pool)) {
+      BLI_remlink(&queue->tasks, task);
+      found_task = task;
       break;
     }
-    if (!found_task) {
-      BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+  }
+  BLI_spin_unlock(&queue->lock);
+
+  if (found_task != NULL && task_pool_is_worker_runnable(scheduler, found_task->pool)) {
+    atomic_sub_and_fetch_z(&scheduler->num_queued, 1);
+  }
+
+  return found_task;
+}
+
+/* Get next task for the given thread: from its own queue first, and when that
+ * one is empty steal from the other threads' queues.
+ *
+ * When pool is not NULL only tasks from that pool are considered. Picking
+ * tasks from another pool while waiting for this one could lead to deadlocks.
+ */
+static Task *task_scheduler_pop(TaskScheduler *scheduler, TaskPool *pool, const int thread_id)
+{
+  const int num_queues = scheduler->num_threads + 1;
+
+  Task *task = task_queue_pop(scheduler, &scheduler->queues[thread_id], pool, false);
+  for (int i = 1; task == NULL && i < num_queues; i++) {
+    TaskQueue *victim_queue = &scheduler->queues[(thread_id + i) % num_queues];
+    task = task_queue_pop(scheduler, victim_queue, pool, true);
+  }
+
+  return task;
+}
+
+static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler,
+                                           const int thread_id,
+                                           Task **task)
+{
+  while (!scheduler->do_exit) {
+    *task = task_scheduler_pop(scheduler, NULL, thread_id);
+    if (*task != NULL) {
+      return true;
     }
-  } while (!found_task);
 
-  BLI_mutex_unlock(&scheduler->queue_mutex);
+    /* Nothing to steal, sleep until new tasks are pushed.
+     *
+     * Waiting on condition may wake up the thread even if condition is not
+     * signaled (spurious wake-ups), which is fine since the queues are scanned
+     * again anyway. See http://stackoverflow.com/questions/8594591
+     */
+    BLI_mutex_lock(&scheduler->wakeup_mutex);
+    atomic_add_and_fetch_uint32(&scheduler->num_sleeping, 1);
+    while (atomic_add_and_fetch_z(&scheduler->num_queued, 0) == 0 && !scheduler->do_exit) {
+      BLI_condition_wait(&scheduler->wakeup_cond, &scheduler->wakeup_mutex);
+    }
+    atomic_sub_and_fetch_uint32(&scheduler->num_sleeping, 1);
+    BLI_mutex_unlock(&scheduler->wakeup_mutex);
+  }
 
-  return true;
+  return false;
 }
 
 BLI_INLINE void handle_local_queue(TaskThreadLocalStorage *tls, const int thread_id)
@@ -442,7 +536,7 @@ static void *task_scheduler_thread_run(void *thread_p)
   BLI_mutex_unlock(&scheduler->startup_mutex);
 
   /* keep popping off tasks */
-  while (task_scheduler_thread_wait_pop(scheduler, &task)) {
+  while (task_scheduler_thread_wait_pop(scheduler, thread_id, &task)) {
     TaskPool *pool = task->pool;
 
     /* run task */
@@ -471,9 +565,10 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
    * threads, so we keep track of the number of users. */
   scheduler->do_exit = false;
 
-  BLI_listbase_clear(&scheduler->queue);
-  BLI_mutex_init(&scheduler->queue_mutex);
-  BLI_condition_init(&scheduler->queue_cond);
+  scheduler->num_queued = 0;
+  scheduler->num_sleeping = 0;
+  BLI_mutex_init(&scheduler->wakeup_mutex);
+  BLI_condition_init(&scheduler->wakeup_cond);
 
   BLI_mutex_init(&scheduler->startup_mutex);
   BLI_condition_init(&scheduler->startup_cond);
@@ -499,6 +594,13 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
   /* Initialize TLS for main thread. */
   initialize_task_tls(&scheduler->task_threads[0].tls);
 
+  /* One queue per worker thread, plus one for the main thread. */
+  scheduler->queues = MEM_mallocN(sizeof(TaskQueue) * (num_threads + 1), "TaskScheduler queues");
+  for (int i = 0; i < num_threads + 1; i++) {
+    BLI_listbase_clear(&scheduler->queues[i].tasks);
+    BLI_spin_init(&scheduler->queues[i].lock);
+  }
+
   pthread_key_create(&scheduler->tls_id_key, NULL);
 
   /* launch threads that will be waiting for work */
@@ -539,10 +641,10 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
   Task *task;
 
   /* stop all waiting threads */
-  BLI_mutex_lock(&scheduler->queue_mutex);
+  BLI_mutex_lock(&scheduler->wakeup_mutex);
   scheduler->do_exit = true;
-  BLI_condition_notify_all(&scheduler->queue_cond);
-  BLI_mutex_unlock(&scheduler->queue_mutex);
+  BLI_condition_notify_all(&scheduler->wakeup_cond);
+  BLI_mutex_unlock(&scheduler->wakeup_mutex);
 
   pthread_key_delete(scheduler->tls_id_key);
 
@@ -570,14 +672,19 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
   }
 
   /* delete leftover tasks */
-  for (task = scheduler->queue.first; task; task = task->next) {
-    task_data_free(task, 0);
+  for (int i = 0; i < scheduler->num_threads + 1; i++) {
+    TaskQueue *queue = &scheduler->queues[i];
+    for (task = queue->tasks.first; task; task = task->next) {
+      task_data_free(task, 0);
+    }
+    BLI_freelistN(&queue->tasks);
+    BLI_spin_end(&queue->lock);
   }
-  BLI_freelistN(&scheduler->queue);
+  MEM_freeN(scheduler->queues);
 
   /* delete mutex/condition */
-  BLI_mutex_end(&scheduler->queue_mutex);
-  BLI_condition_end(&scheduler->queue_cond);
+  BLI_mutex_end(&scheduler->wakeup_mutex);
+  BLI_condition_end(&scheduler->wakeup_cond);
   BLI_mutex_end(&scheduler->startup_mutex);
   BLI_condition_end(&scheduler->startup_cond);
 
@@ -589,28 +696,40 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
   return scheduler->num_threads + 1;
 }
 
-static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
+static void task_scheduler_push(TaskScheduler *scheduler,
+                                Task *task,
+                                TaskPriority priority,
+                                int thread_id)
 {
   task_pool_num_increase(task->pool, 1);
 
-  /* add task to queue */
-  BLI_mutex_lock(&scheduler->queue_mutex);
+  /* add task to the queue of the pushing thread */
+  if (thread_id == -1) {
+    thread_id = task_scheduler_thread_id_get(scheduler);
+  }
+  TaskQueue *queue = &scheduler->queues[thread_id];
+
+  BLI_spin_lock(&queue->lock);
 
   if (priority == TASK_PRIORITY_HIGH) {
-    BLI_addhead(&scheduler->queue, task);
+    BLI_addhead(&queue->tasks, task);
   }
   else {
-    BLI_addtail(&scheduler->queue, task);
+    BLI_addtail(&queue->tasks, task);
   }
 
-  BLI_condition_notify_one(&scheduler->queue_cond);
-  BLI_mutex_unlock(&scheduler->queue_mutex);
+  BLI_spin_unlock(&queue->lock);
+
+  if (task_pool_is_worker_runnable(scheduler, task->pool)) {
+    task_scheduler_queued_add(scheduler, 1);
+  }
 }
 
 static void task_scheduler_push_all(TaskScheduler *scheduler,
                                     TaskPool *pool,
                                     Task **tasks,
-                                    int num_tasks)
+                                    int num_tasks,
+                                    int thread_id)
 {
   if (num_tasks == 0) {
     return;
@@ -618,14 +737,19 @@ static void task_scheduler_push_all(TaskScheduler *scheduler,
 
   task_pool_num_increase(pool, num_tasks);
 
-  BLI_mutex_lock(&scheduler->queue_mutex);
+  TaskQueue *queue = &scheduler->queues[thread_id];
+
+  BLI_spin_lock(&queue->lock);
 
   for (int i = 0; i < num_tasks; i++) {
-    BLI_addhead(&scheduler->queue, tasks[i]);
+    BLI_addhead(&queue->tasks, tasks[i]);
   }
 
-  BLI_condition_notify_all(&scheduler->queue_cond);
-  BLI_mutex_unlock(&scheduler->queue_mutex);
+  BLI_spin_unlock(&queue->lock);
+
+  if (task_pool_is_worker_runnable(scheduler, pool)) {
+    task_scheduler_queued_add(scheduler, (size_t)num_tasks);
+  }
 }
 
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
@@ -633,21 +757,29 @@ static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
   Task *task, *nexttask;
   size_t done = 0;
 
-  BLI_mutex_lock(&scheduler->queue_mutex);
+  /* free all tasks from this pool from the queues */
+  for (int i = 0; i < scheduler->num_threads + 1; i++) {
+    TaskQueue *queue = &scheduler->queues[i];
 
-  /* free all tasks from this pool from the queue */
-  for (task = scheduler->queue.first; task; task = nexttask) {
-    nexttask = task->next;
+    BLI_spin_lock(&queue->lock);
 
-    if (task->pool == pool) {
-      task_data_free(task, pool->thread_id);
-      BLI_freelinkN(&scheduler->queue, task);
+    for (task = queue->tasks.first; task; task = nexttask) {
+      nexttask = task->next;
 
-      done++;
+      if (task->pool == pool) {
+        task_data_free(task, pool->thread_id);
+        BLI_freelinkN(&queue->tasks, task);
+
+        done++;
+      }
     }
+
+    BLI_spin_unlock(&queue->lock);
   }
 
-  BLI_mutex_unlock(&scheduler->queue_mutex);
+  if (task_pool_is_worker_runnable(scheduler, pool)) {
+    atomic_sub_and_fetch_z(&scheduler->num_queued, done);
+  }
 
   /* notify done */
   task_pool_num_decrease(pool, done);
@@ -852,7 +984,7 @@ static void task_pool_push(TaskPool *pool,
   /* Do push to a global execution pool, slowest possible method,
    * causes quite reasonable amount of threading overhead.
    */
-  task_scheduler_push(pool->scheduler, task, priority);
+  task_scheduler_push(pool->scheduler, task, priority, thread_id);
 }
 
 void BLI_task_pool_push_ex(TaskPool *pool,
@@ -888,13 +1020,18 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 
   if (atomic_fetch_and_and_uint8((uint8_t *)&pool->is_suspended, 0)) {
     if (pool->num_suspended) {
+      TaskQueue *queue = &scheduler->queues[pool->thread_id];
+
       task_pool_num_increase(pool, pool->num_suspended);
-      BLI_mutex_lock(&scheduler->queue_mutex);
+      BLI_spin_lock(&queue->lock);
 
-      BLI_movelisttolist(&scheduler->queue, &pool->suspended_queue);
+      BLI_movelisttolist(&queue->tasks, &pool->suspended_queue);
 
-      BLI_condition_notify_all(&scheduler->queue_cond);
-      BLI_mutex_unlock(&scheduler->queue_mutex);
+      BLI_spin_unlock(&queue->lock);
+
+      if (task_pool_is_worker_runnable(scheduler, pool)) {
+        task_scheduler_queued_add(scheduler, pool->num_suspended);
+      }
 
       pool->num_suspended = 0;
     }
@@ -909,26 +1046,16 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
   BLI_mutex_lock(&pool->num_mutex);
 
   while (pool->num != 0) {
-    Task *task, *work_task = NULL;
-    bool found_task = false;
+    Task *work_task;
+    bool found_task;
 
     BLI_mutex_unlock(&pool->num_mutex);
 
-    BLI_mutex_lock(&scheduler->queue_mutex);
-
-    /* find task from this pool. if we get a task from another pool,
+    /* find task from this pool, in our own queue first and then in the
+     * queues of other threads. if we get a task from another pool,
      * we can get into deadlock */
-
-    for (task = scheduler->queue.first; task; task = task->next) {
-      if (task->pool == pool) {
-        work_task = task;
-        found_task = true;
-        BLI_remlink(&scheduler->queue, task);
-        break;
-      }
-    }
-
-    BLI_mutex_unlock(&scheduler->queue_mutex);
+    work_task = task_scheduler_pop(scheduler, pool, pool->thread_id);
+    found_task = (work_task != NULL);
 
     /* if found task, do it, otherwise wait until other tasks are done */
     if (found_task) {
@@ -938,7 +1065,7 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
       BLI_assert(!tls->do_delayed_push);
 
       /* delete task */
-      task_free(pool, task, pool->thread_id);
+      task_free(pool, work_task, pool->thread_id);
 
       /* Handle all tasks from local queue. */
       handle_local_queue(tls, pool->thread_id);
@@ -1016,7 +1143,8 @@ void BLI_task_pool_delayed_push_end(TaskPool *pool, int thread_id)
     ASSERT_THREAD_ID(pool->scheduler, thread_id);
     TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
     BLI_assert(tls->do_delayed_push);
-    task_scheduler_push_all(pool->scheduler, pool, tls->delayed_queue, tls->num_delayed_queue);
+    task_scheduler_push_all(
+        pool->scheduler, pool, tls->delayed_queue, tls->num_delayed_queue, thread_id);
     tls->do_delayed_push = false;
     tls->num_delayed_queue = 0;
   }
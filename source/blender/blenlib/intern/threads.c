@@ -544,6 +544,16 @@ void BLI_rw_mutex_lock(ThreadRWMutex *mutex, int mode)
   }
 }
 
+bool BLI_rw_mutex_trylock(ThreadRWMutex *mutex, int mode)
+{
+  if (mode == THREAD_LOCK_READ) {
+    return (pthread_rwlock_tryrdlock(mutex) == 0);
+  }
+  else {
+    return (pthread_rwlock_trywrlock(mutex) == 0);
+  }
+}
+
 void BLI_rw_mutex_unlock(ThreadRWMutex *mutex)
 {
   pthread_rwlock_unlock(mutex);
@@ -73,4 +73,26 @@ enum {
 
 #define BLEN_THUMB_MEMSIZE_FILE(_x, _y) (sizeof(int) * (2 + (size_t)(_x) * (size_t)(_y)))
 
+/**
+ * Compressed blend-files are written as a sequence of independent gzip members (frames),
+ * so they remain readable by any gzip reader while allowing parallel compression and
+ * decompression.
+ *
+ * Each frame header has the #FEXTRA flag set and holds a single extra sub-field with
+ * the size of the whole gzip member and the size of its uncompressed data
+ * (both 32bit little endian), so readers can build an index of all frames by walking
+ * the headers, and seek without inflating the whole file:
+ *
+ * - Header: `1f 8b 08 04`, MTIME (4), XFL, OS, XLEN (2),
+ *   `'B' 'F'`, LEN (2), MEMBER_SIZE (4), DATA_SIZE (4).
+ * - Raw deflate stream.
+ * - Trailer: CRC32 (4), ISIZE (4).
+ */
+#define BLEN_GZIP_FRAME_SI1 'B'
+#define BLEN_GZIP_FRAME_SI2 'F'
+#define BLEN_GZIP_FRAME_HEADER_SIZE 24
+#define BLEN_GZIP_FRAME_TRAILER_SIZE 8
+/** Maximum size of the uncompressed data of a single frame. */
+#define BLEN_GZIP_FRAME_DATA_SIZE (1 << 20)
+
 #endif /* __BLO_BLEND_DEFS_H__ */
@@ -25,6 +25,7 @@
  * \ingroup blenloader
  */
 
+struct MemFileChunkData;
 struct Scene;
 
 typedef struct {
@@ -32,13 +33,20 @@ typedef struct {
   const char *buf;
   /** Size in bytes. */
   unsigned int size;
-  /** When true, this chunk doesn't own the memory, it's shared with a previous #MemFileChunk */
+  /** When true, the data was already stored when this chunk was added,
+   * it's shared with a previous #MemFileChunk */
   bool is_identical;
+  /** Reference counted storage of #MemFileChunk.buf,
+   * shared between all chunks with identical content. */
+  struct MemFileChunkData *data;
 } MemFileChunk;
 
 typedef struct MemFile {
   ListBase chunks;
+  /** Size in bytes of the data which was stored by this memfile (not shared with previous ones). */
   size_t size;
+  /** Size in bytes of all data of this memfile, including the data shared with others. */
+  size_t size_total;
 } MemFile;
 
 typedef struct MemFileUndoData {
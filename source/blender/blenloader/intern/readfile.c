@@ -34,6 +34,13 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h>  // for read close
+#  include <sys/mman.h> /* for mmap. */
+#  include <sys/stat.h> /* for fstat. */
+#  ifdef __linux__
+#    include <sys/vfs.h> /* for fstatfs. */
+#  else
+#    include <sys/mount.h> /* for fstatfs. */
+#  endif
 #else
 #  include <io.h>  // for open close read
 #  include "winsock2.h"
@@ -101,6 +108,9 @@
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
 #include "BLI_ghash.h"
+#include "BLI_task.h"
+
+#include "PIL_time.h"
 
 #include "BLT_translation.h"
 
@@ -157,6 +167,7 @@
 #include "RE_engine.h"
 
 #include "readfile.h"
+#include "readfile_oldnewmap.h"
 
 #include <errno.h>
 
@@ -222,6 +233,23 @@
  */
 #define USE_BHEAD_READ_ON_DEMAND
 
+/**
+ * Map uncompressed files into memory instead of reading them with system calls.
+ * Blocks read on demand are then used from the mapped pages, without a seek & read per block
+ * and without allocating a #BHeadN for every block. Blocks which don't need to be converted
+ * are only copied out of the mapping once they are used, see #read_data_into_oldnewmap.
+ *
+ * When the file is truncated while mapped, accessing the pages past its end raises SIGBUS.
+ * Blender saves files by renaming a new file over the old one, which doesn't change mapped
+ * files, so only files on local file systems are mapped: files on network or user space file
+ * systems may be changed by other computers or programs, they are read with system calls.
+ *
+ * \note Requires #USE_BHEAD_READ_ON_DEMAND, falls back to regular reading when mapping fails.
+ */
+#if defined(USE_BHEAD_READ_ON_DEMAND) && !defined(WIN32)
+#  define USE_FILE_READ_MMAP
+#endif
+
 /* use GHash for BHead name-based lookups (speeds up linking) */
 #define USE_GHASH_BHEAD
 
@@ -303,129 +331,6 @@ static const char *library_parent_filepath(Library *lib)
 /** \name OldNewMap API
  * \{ */
 
-typedef struct OldNew {
-  const void *oldp;
-  void *newp;
-  /* `nr` is "user count" for data, and ID code for libdata. */
-  int nr;
-} OldNew;
-
-typedef struct OldNewMap {
-  /* Array that stores the actual entries. */
-  OldNew *entries;
-  int nentries;
-  /* Hashmap that stores indices into the `entries` array. */
-  int32_t *map;
-
-  int capacity_exp;
-} OldNewMap;
-
-#define ENTRIES_CAPACITY(onm) (1ll << (onm)->capacity_exp)
-#define MAP_CAPACITY(onm) (1ll << ((onm)->capacity_exp + 1))
-#define SLOT_MASK(onm) (MAP_CAPACITY(onm) - 1)
-#define DEFAULT_SIZE_EXP 6
-#define PERTURB_SHIFT 5
-
-/* based on the probing algorithm used in Python dicts. */
-#define ITER_SLOTS(onm, KEY, SLOT_NAME, INDEX_NAME) \
-  uint32_t hash = BLI_ghashutil_ptrhash(KEY); \
-  uint32_t mask = SLOT_MASK(onm); \
-  uint perturb = hash; \
-  int SLOT_NAME = mask & hash; \
-  int INDEX_NAME = onm->map[SLOT_NAME]; \
-  for (;; SLOT_NAME = mask & ((5 * SLOT_NAME) + 1 + perturb), \
-          perturb >>= PERTURB_SHIFT, \
-          INDEX_NAME = onm->map[SLOT_NAME])
-
-static void oldnewmap_insert_index_in_map(OldNewMap *onm, const void *ptr, int index)
-{
-  ITER_SLOTS (onm, ptr, slot, stored_index) {
-    if (stored_index == -1) {
-      onm->map[slot] = index;
-      break;
-    }
-  }
-}
-
-static void oldnewmap_insert_or_replace(OldNewMap *onm, OldNew entry)
-{
-  ITER_SLOTS (onm, entry.oldp, slot, index) {
-    if (index == -1) {
-      onm->entries[onm->nentries] = entry;
-      onm->map[slot] = onm->nentries;
-      onm->nentries++;
-      break;
-    }
-    else if (onm->entries[index].oldp == entry.oldp) {
-      onm->entries[index] = entry;
-      break;
-    }
-  }
-}
-
-static OldNew *oldnewmap_lookup_entry(const OldNewMap *onm, const void *addr)
-{
-  ITER_SLOTS (onm, addr, slot, index) {
-    if (index >= 0) {
-      OldNew *entry = &onm->entries[index];
-      if (entry->oldp == addr) {
-        return entry;
-      }
-    }
-    else {
-      return NULL;
-    }
-  }
-}
-
-static void oldnewmap_clear_map(OldNewMap *onm)
-{
-  memset(onm->map, 0xFF, MAP_CAPACITY(onm) * sizeof(*onm->map));
-}
-
-static void oldnewmap_increase_size(OldNewMap *onm)
-{
-  onm->capacity_exp++;
-  onm->entries = MEM_reallocN(onm->entries, sizeof(*onm->entries) * ENTRIES_CAPACITY(onm));
-  onm->map = MEM_reallocN(onm->map, sizeof(*onm->map) * MAP_CAPACITY(onm));
-  oldnewmap_clear_map(onm);
-  for (int i = 0; i < onm->nentries; i++) {
-    oldnewmap_insert_index_in_map(onm, onm->entries[i].oldp, i);
-  }
-}
-
-/* Public OldNewMap API */
-
-static OldNewMap *oldnewmap_new(void)
-{
-  OldNewMap *onm = MEM_callocN(sizeof(*onm), "OldNewMap");
-
-  onm->capacity_exp = DEFAULT_SIZE_EXP;
-  onm->entries = MEM_malloc_arrayN(
-      ENTRIES_CAPACITY(onm), sizeof(*onm->entries), "OldNewMap.entries");
-  onm->map = MEM_malloc_arrayN(MAP_CAPACITY(onm), sizeof(*onm->map), "OldNewMap.map");
-  oldnewmap_clear_map(onm);
-
-  return onm;
-}
-
-static void oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
-{
-  if (oldaddr == NULL || newaddr == NULL) {
-    return;
-  }
-
-  if (UNLIKELY(onm->nentries == ENTRIES_CAPACITY(onm))) {
-    oldnewmap_increase_size(onm);
-  }
-
-  OldNew entry;
-  entry.oldp = oldaddr;
-  entry.newp = newaddr;
-  entry.nr = nr;
-  oldnewmap_insert_or_replace(onm, entry);
-}
-
 void blo_do_versions_oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
 {
   oldnewmap_insert(onm, oldaddr, newaddr, nr);
@@ -440,6 +345,13 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool inc
   if (increase_users) {
     entry->nr++;
   }
+  if (entry->mapped_len != 0) {
+    /* Data of a mapped file is copied once it's used, see #read_data_into_oldnewmap. */
+    void *data = MEM_mallocN(entry->mapped_len, "read struct mapped");
+    memcpy(data, entry->newp, entry->mapped_len);
+    entry->newp = data;
+    entry->mapped_len = 0;
+  }
   return entry->newp;
 }
 
@@ -465,33 +377,14 @@ static void oldnewmap_free_unused(OldNewMap *onm)
   for (int i = 0; i < onm->nentries; i++) {
     OldNew *entry = &onm->entries[i];
     if (entry->nr == 0) {
-      MEM_freeN(entry->newp);
+      if (entry->mapped_len == 0) {
+        MEM_freeN(entry->newp);
+      }
       entry->newp = NULL;
     }
   }
 }
 
-static void oldnewmap_clear(OldNewMap *onm)
-{
-  onm->capacity_exp = DEFAULT_SIZE_EXP;
-  oldnewmap_clear_map(onm);
-  onm->nentries = 0;
-}
-
-static void oldnewmap_free(OldNewMap *onm)
-{
-  MEM_freeN(onm->entries);
-  MEM_freeN(onm->map);
-  MEM_freeN(onm);
-}
-
-#undef ENTRIES_CAPACITY
-#undef MAP_CAPACITY
-#undef SLOT_MASK
-#undef DEFAULT_SIZE_EXP
-#undef PERTURB_SHIFT
-#undef ITER_SLOTS
-
 /** \} */
 
 /* -------------------------------------------------------------------- */
@@ -989,6 +882,24 @@ static BHead *blo_bhead_read_full(FileData *fd, BHead *thisblock)
   }
   return &new_bhead_data->bhead;
 }
+
+/**
+ * Return the data of a block which hasn't been read, when it can be accessed directly
+ * from the mapped file, NULL otherwise.
+ */
+static const void *blo_bhead_data_mapped(FileData *fd, BHead *thisblock)
+{
+#  ifdef USE_FILE_READ_MMAP
+  BHeadN *new_bhead = BHEADN_FROM_BHEAD(thisblock);
+  if (fd->mmap_data != NULL && new_bhead->has_data == false) {
+    BLI_assert((size_t)new_bhead->file_offset + (size_t)thisblock->len <= fd->mmap_size);
+    return fd->mmap_data + new_bhead->file_offset;
+  }
+#  else
+  UNUSED_VARS(fd, thisblock);
+#  endif
+  return NULL;
+}
 #endif /* USE_BHEAD_READ_ON_DEMAND */
 
 /* Warning! Caller's responsibility to ensure given bhead **is** and ID one! */
@@ -1155,6 +1066,95 @@ static off64_t fd_seek_data_from_file(FileData *filedata, off64_t offset, int wh
   return filedata->file_offset;
 }
 
+#ifdef USE_FILE_READ_MMAP
+
+/* Memory mapped file reading. */
+
+static int fd_read_from_mmap(FileData *filedata, void *buffer, uint size)
+{
+  /* don't read more bytes then there are available in the mapping */
+  int readsize = (int)MIN2((size_t)size, filedata->mmap_size - (size_t)filedata->file_offset);
+
+  memcpy(buffer, filedata->mmap_data + filedata->file_offset, readsize);
+  filedata->file_offset += readsize;
+
+  return (readsize);
+}
+
+static off64_t fd_seek_from_mmap(FileData *filedata, off64_t offset, int whence)
+{
+  off64_t offset_new;
+  switch (whence) {
+    case SEEK_SET:
+      offset_new = offset;
+      break;
+    case SEEK_CUR:
+      offset_new = filedata->file_offset + offset;
+      break;
+    case SEEK_END:
+      offset_new = (off64_t)filedata->mmap_size + offset;
+      break;
+    default:
+      return -1;
+  }
+  if (offset_new < 0 || offset_new > (off64_t)filedata->mmap_size) {
+    return -1;
+  }
+  filedata->file_offset = offset_new;
+  return filedata->file_offset;
+}
+
+/**
+ * Check the file is on a local file system, where it's only changed by programs on this computer,
+ * see #USE_FILE_READ_MMAP.
+ */
+static bool fd_mmap_is_safe(int file)
+{
+  struct statfs st;
+  if (fstatfs(file, &st) == -1) {
+    return false;
+  }
+#  ifdef __linux__
+  /* Magic numbers from `linux/magic.h`, which isn't available everywhere. */
+  switch ((uint64_t)st.f_type) {
+    case 0x6969:     /* NFS. */
+    case 0x517b:     /* SMB. */
+    case 0xfe534d42: /* SMB2. */
+    case 0xff534d42: /* CIFS. */
+    case 0x01021997: /* 9P. */
+    case 0x5346414f: /* AFS. */
+    case 0x00c36400: /* CEPH. */
+    case 0x73757245: /* CODA. */
+    case 0x65735546: /* FUSE. */
+      return false;
+  }
+  return true;
+#  else
+  return (st.f_flags & MNT_LOCAL) != 0;
+#  endif
+}
+
+/**
+ * Map the whole file for reading, return NULL when this isn't possible or safe
+ * (the caller falls back to regular file reading).
+ */
+static const char *fd_mmap_from_file_descriptor(int file, size_t *r_size)
+{
+  struct stat st;
+  if (fstat(file, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (uint64_t)st.st_size > (uint64_t)SIZE_MAX || !fd_mmap_is_safe(file)) {
+    return NULL;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  *r_size = (size_t)st.st_size;
+  return data;
+}
+
+#endif /* USE_FILE_READ_MMAP */
+
 /* GZip file reading. */
 
 static int fd_read_gzip_from_file(FileData *filedata, void *buffer, uint size)
@@ -1171,6 +1171,312 @@ static int fd_read_gzip_from_file(FileData *filedata, void *buffer, uint size)
   return (readsize);
 }
 
+/* Multi-threaded reading of gzip files written in independent frames,
+ * see #BLEN_GZIP_FRAME_HEADER_SIZE. */
+
+typedef struct GzipFrame {
+  /** Position and size of the whole gzip member in the file. */
+  off64_t file_offset;
+  uint file_len;
+  /** Position and size of the frame in the uncompressed data. */
+  off64_t data_offset;
+  uint data_len;
+} GzipFrame;
+
+typedef struct GzipFrameReader {
+  GzipFrame *frames;
+  int frames_len;
+  /** Total size of the uncompressed data. */
+  off64_t data_len;
+
+  /**
+   * Range of consecutive frames currently decompressed,
+   * all frames of a window are decompressed in parallel.
+   */
+  int window_first, window_len;
+  /** Maximum number of frames in a window. */
+  int window_len_max;
+  /**
+   * Number of frames decompressed ahead when reading sequentially, doubled for every window up
+   * to the maximum. Reset after a seek, so small reads don't decompress frames they don't need.
+   */
+  int window_len_ahead;
+  /** Uncompressed data of each frame of the window, allocated when first used. */
+  uchar **window_data;
+  bool *window_is_ok;
+
+  /** Compressed data of the window, as read from the file. */
+  uchar *compressed;
+  size_t compressed_len_max;
+} GzipFrameReader;
+
+static uint gzip_frame_read_uint16(const uchar *buf)
+{
+  return (uint)buf[0] | ((uint)buf[1] << 8);
+}
+
+static uint gzip_frame_read_uint32(const uchar *buf)
+{
+  return gzip_frame_read_uint16(buf) | (gzip_frame_read_uint16(buf + 2) << 16);
+}
+
+/**
+ * Build the frame index by walking the headers of all gzip members of the file.
+ *
+ * \return NULL when the file is not (entirely) made of frames,
+ * it should then be read as a regular gzip stream.
+ */
+static GzipFrameReader *gzip_frames_reader_create(int file)
+{
+  GzipFrame *frames = NULL;
+  int frames_len = 0, frames_len_alloc = 0;
+  off64_t file_offset = 0, data_offset = 0;
+  bool is_ok = true;
+
+  while (is_ok) {
+    uchar header[BLEN_GZIP_FRAME_HEADER_SIZE];
+
+    if (lseek(file, file_offset, SEEK_SET) == -1) {
+      is_ok = false;
+      break;
+    }
+    const int readsize = read(file, header, sizeof(header));
+    if (readsize == 0) {
+      /* End of file. */
+      break;
+    }
+    if ((readsize != sizeof(header)) || (header[0] != 0x1f) || (header[1] != 0x8b) ||
+        (header[2] != 8) || (header[3] != 4) || (gzip_frame_read_uint16(header + 10) != 12) ||
+        (header[12] != BLEN_GZIP_FRAME_SI1) || (header[13] != BLEN_GZIP_FRAME_SI2) ||
+        (gzip_frame_read_uint16(header + 14) != 8)) {
+      is_ok = false;
+      break;
+    }
+
+    const uint file_len = gzip_frame_read_uint32(header + 16);
+    const uint data_len = gzip_frame_read_uint32(header + 20);
+    if ((file_len < BLEN_GZIP_FRAME_HEADER_SIZE + BLEN_GZIP_FRAME_TRAILER_SIZE) ||
+        (data_len == 0) || (data_len > BLEN_GZIP_FRAME_DATA_SIZE)) {
+      is_ok = false;
+      break;
+    }
+
+    if (frames_len == frames_len_alloc) {
+      frames_len_alloc = max_ii(frames_len_alloc * 2, 256);
+      frames = MEM_reallocN(frames, sizeof(*frames) * (size_t)frames_len_alloc);
+    }
+    GzipFrame *frame = &frames[frames_len++];
+    frame->file_offset = file_offset;
+    frame->file_len = file_len;
+    frame->data_offset = data_offset;
+    frame->data_len = data_len;
+
+    file_offset += file_len;
+    data_offset += data_len;
+  }
+
+  if (!is_ok || frames_len == 0) {
+    MEM_SAFE_FREE(frames);
+    return NULL;
+  }
+
+  GzipFrameReader *reader = MEM_callocN(sizeof(*reader), __func__);
+  reader->frames = frames;
+  reader->frames_len = frames_len;
+  reader->data_len = data_offset;
+  reader->window_len_max = min_ii(
+      frames_len, min_ii(BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) * 2, 64));
+  reader->window_data = MEM_calloc_arrayN(
+      reader->window_len_max, sizeof(*reader->window_data), __func__);
+  reader->window_is_ok = MEM_calloc_arrayN(
+      reader->window_len_max, sizeof(*reader->window_is_ok), __func__);
+  reader->window_len_ahead = 1;
+
+  return reader;
+}
+
+static void gzip_frames_reader_free(GzipFrameReader *reader)
+{
+  for (int i = 0; i < reader->window_len_max; i++) {
+    MEM_SAFE_FREE(reader->window_data[i]);
+  }
+  MEM_freeN(reader->window_data);
+  MEM_freeN(reader->window_is_ok);
+  MEM_SAFE_FREE(reader->compressed);
+  MEM_freeN(reader->frames);
+  MEM_freeN(reader);
+}
+
+static void gzip_frame_decompress_cb(void *__restrict userdata,
+                                     const int index,
+                                     const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  GzipFrameReader *reader = userdata;
+  const GzipFrame *frame = &reader->frames[reader->window_first + index];
+  const GzipFrame *frame_first = &reader->frames[reader->window_first];
+  const uchar *member = reader->compressed + (frame->file_offset - frame_first->file_offset);
+  uchar *data = reader->window_data[index];
+  z_stream strm = {NULL};
+
+  reader->window_is_ok[index] = false;
+
+  if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+    return;
+  }
+  strm.next_in = (Bytef *)member + BLEN_GZIP_FRAME_HEADER_SIZE;
+  strm.avail_in = frame->file_len - BLEN_GZIP_FRAME_HEADER_SIZE - BLEN_GZIP_FRAME_TRAILER_SIZE;
+  strm.next_out = data;
+  strm.avail_out = frame->data_len;
+  const int err = inflate(&strm, Z_FINISH);
+  const uLong data_len = strm.total_out;
+  inflateEnd(&strm);
+
+  const uchar *trailer = member + frame->file_len - BLEN_GZIP_FRAME_TRAILER_SIZE;
+  reader->window_is_ok[index] = (err == Z_STREAM_END) && (data_len == frame->data_len) &&
+                                (gzip_frame_read_uint32(trailer) ==
+                                 (uint)crc32(0, data, frame->data_len));
+}
+
+/**
+ * Make sure the given frame is decompressed, along with the following ones up to
+ * \a frame_index_last that the current read needs. When reading sequentially, more frames are
+ * decompressed ahead.
+ */
+static bool gzip_frames_window_ensure(FileData *filedata,
+                                      const int frame_index,
+                                      const int frame_index_last)
+{
+  GzipFrameReader *reader = filedata->gzip_frames;
+
+  if ((frame_index >= reader->window_first) &&
+      (frame_index < reader->window_first + reader->window_len)) {
+    return reader->window_is_ok[frame_index - reader->window_first];
+  }
+
+  if (frame_index == reader->window_first + reader->window_len) {
+    reader->window_len_ahead = min_ii(reader->window_len_ahead * 2, reader->window_len_max);
+  }
+  else {
+    reader->window_len_ahead = 1;
+  }
+
+  const int window_len = min_ii(
+      min_ii(reader->window_len_max, reader->frames_len - frame_index),
+      max_ii(frame_index_last - frame_index + 1, reader->window_len_ahead));
+  const GzipFrame *frame_first = &reader->frames[frame_index];
+  const GzipFrame *frame_last = &reader->frames[frame_index + window_len - 1];
+  const size_t compressed_len = (size_t)(frame_last->file_offset + frame_last->file_len -
+                                         frame_first->file_offset);
+
+  reader->window_len = 0;
+
+  if (compressed_len > reader->compressed_len_max) {
+    MEM_SAFE_FREE(reader->compressed);
+    reader->compressed = MEM_mallocN(compressed_len, "gzip frames compressed");
+    reader->compressed_len_max = compressed_len;
+  }
+
+  if (lseek(filedata->filedes, frame_first->file_offset, SEEK_SET) == -1) {
+    return false;
+  }
+  for (size_t done = 0; done < compressed_len;) {
+    const int readsize = read(filedata->filedes,
+                              reader->compressed + done,
+                              (uint)MIN2(compressed_len - done, INT_MAX));
+    if (readsize <= 0) {
+      return false;
+    }
+    done += (size_t)readsize;
+  }
+
+  reader->window_first = frame_index;
+  reader->window_len = window_len;
+
+  for (int i = 0; i < window_len; i++) {
+    if (reader->window_data[i] == NULL) {
+      reader->window_data[i] = MEM_mallocN(BLEN_GZIP_FRAME_DATA_SIZE, "gzip frame data");
+    }
+  }
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (window_len > 1);
+  settings.min_iter_per_thread = 1;
+  BLI_task_parallel_range(0, window_len, reader, gzip_frame_decompress_cb, &settings);
+
+  return reader->window_is_ok[0];
+}
+
+/* Index of the frame containing given offset in uncompressed data, -1 when out of range. */
+static int gzip_frames_find(const GzipFrameReader *reader, const off64_t data_offset)
+{
+  if (data_offset < 0 || data_offset >= reader->data_len) {
+    return -1;
+  }
+
+  int first = 0, last = reader->frames_len - 1;
+  while (first < last) {
+    const int mid = (first + last + 1) / 2;
+    if (reader->frames[mid].data_offset <= data_offset) {
+      first = mid;
+    }
+    else {
+      last = mid - 1;
+    }
+  }
+  return first;
+}
+
+static int fd_read_gzip_frames_from_file(FileData *filedata, void *buffer, uint size)
+{
+  GzipFrameReader *reader = filedata->gzip_frames;
+  uint readsize = 0;
+
+  while (readsize < size) {
+    const int frame_index = gzip_frames_find(reader, filedata->file_offset);
+    if (frame_index == -1) {
+      /* End of file. */
+      break;
+    }
+    const int frame_index_last = gzip_frames_find(
+        reader, MIN2(filedata->file_offset + (size - readsize), reader->data_len) - 1);
+    if (!gzip_frames_window_ensure(filedata, frame_index, frame_index_last)) {
+      return EOF;
+    }
+
+    const GzipFrame *frame = &reader->frames[frame_index];
+    const uint frame_offset = (uint)(filedata->file_offset - frame->data_offset);
+    const uint len = MIN2(size - readsize, frame->data_len - frame_offset);
+
+    memcpy(POINTER_OFFSET(buffer, readsize),
+           reader->window_data[frame_index - reader->window_first] + frame_offset,
+           len);
+    readsize += len;
+    filedata->file_offset += len;
+  }
+
+  return (int)readsize;
+}
+
+static off64_t fd_seek_gzip_frames_from_file(FileData *filedata, off64_t offset, int whence)
+{
+  GzipFrameReader *reader = filedata->gzip_frames;
+
+  if (whence == SEEK_CUR) {
+    offset += filedata->file_offset;
+  }
+  else if (whence == SEEK_END) {
+    offset += reader->data_len;
+  }
+
+  /* Nothing to do until data is actually read. */
+  if (offset < 0 || offset > reader->data_len) {
+    return -1;
+  }
+  filedata->file_offset = offset;
+  return offset;
+}
+
 /* Memory reading. */
 
 static int fd_read_from_memory(FileData *filedata, void *buffer, uint size)
@@ -1297,6 +1603,9 @@ static FileData *blo_filedata_from_file_descriptor(const char *filepath,
   FileDataSeekFn *seek_fn = NULL; /* Optional. */
 
   gzFile gzfile = (gzFile)Z_NULL;
+  GzipFrameReader *gzip_frames = NULL;
+  const char *mmap_data = NULL;
+  size_t mmap_size = 0;
 
   char header[7];
 
@@ -1316,8 +1625,30 @@ static FileData *blo_filedata_from_file_descriptor(const char *filepath,
 
   /* Regular file. */
   if (memcmp(header, "BLENDER", sizeof(header)) == 0) {
-    read_fn = fd_read_data_from_file;
-    seek_fn = fd_seek_data_from_file;
+#ifdef USE_FILE_READ_MMAP
+    mmap_data = fd_mmap_from_file_descriptor(file, &mmap_size);
+    if (mmap_data != NULL) {
+      read_fn = fd_read_from_mmap;
+      seek_fn = fd_seek_from_mmap;
+      /* The mapping remains valid once the file is closed, caller must close. */
+      file = -1;
+    }
+    else
+#endif
+    {
+      read_fn = fd_read_data_from_file;
+      seek_fn = fd_seek_data_from_file;
+    }
+  }
+
+  /* Gzip file written in independent frames. */
+  if ((read_fn == NULL) && (header[0] == 0x1f && header[1] == 0x8b)) {
+    gzip_frames = gzip_frames_reader_create(file);
+    lseek(file, 0, SEEK_SET);
+    if (gzip_frames != NULL) {
+      read_fn = fd_read_gzip_frames_from_file;
+      seek_fn = fd_seek_gzip_frames_from_file;
+    }
   }
 
   /* Gzip file. */
@@ -1350,7 +1681,10 @@ static FileData *blo_filedata_from_file_descriptor(const char *filepath,
   FileData *fd = filedata_new();
 
   fd->filedes = file;
+  fd->mmap_data = mmap_data;
+  fd->mmap_size = mmap_size;
   fd->gzfiledes = gzfile;
+  fd->gzip_frames = gzip_frames;
 
   fd->read = read_fn;
   fd->seek = seek_fn;
@@ -1418,6 +1752,19 @@ static int fd_read_gzip_from_memory(FileData *filedata, void *buffer, uint size)
   // Inflate another chunk.
   err = inflate(&filedata->strm, Z_SYNC_FLUSH);
 
+  /* Compressed blend-files are made of several gzip members (see #BLEN_GZIP_FRAME_HEADER_SIZE),
+   * continue with the next one when the current member ends. */
+  while (err == Z_STREAM_END && filedata->strm.avail_in != 0) {
+    if (inflateReset(&filedata->strm) != Z_OK) {
+      break;
+    }
+    if (filedata->strm.avail_out == 0) {
+      err = Z_OK;
+      break;
+    }
+    err = inflate(&filedata->strm, Z_SYNC_FLUSH);
+  }
+
   if (err == Z_STREAM_END) {
     return 0;
   }
@@ -1503,10 +1850,20 @@ void blo_filedata_free(FileData *fd)
       close(fd->filedes);
     }
 
+#ifdef USE_FILE_READ_MMAP
+    if (fd->mmap_data != NULL) {
+      munmap((void *)fd->mmap_data, fd->mmap_size);
+    }
+#endif
+
     if (fd->gzfiledes != NULL) {
       gzclose(fd->gzfiledes);
     }
 
+    if (fd->gzip_frames != NULL) {
+      gzip_frames_reader_free(fd->gzip_frames);
+    }
+
     if (fd->strm.next_in) {
       if (inflateEnd(&fd->strm) != Z_OK) {
         printf("close gzip stream error\n");
@@ -2247,25 +2604,39 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 
     if (fd->compflags[bh->SDNAnr] != SDNA_CMP_REMOVED) {
       if (fd->compflags[bh->SDNAnr] == SDNA_CMP_NOT_EQUAL) {
+        const void *data = (bh + 1);
 #ifdef USE_BHEAD_READ_ON_DEMAND
         if (BHEADN_FROM_BHEAD(bh)->has_data == false) {
-          bh = blo_bhead_read_full(fd, bh);
-          if (UNLIKELY(bh == NULL)) {
-            fd->flags &= ~FD_FLAGS_FILE_OK;
-            return NULL;
+          /* Reconstruct from the mapped file when possible, this doesn't use the file position
+           * (so it can run from multiple threads) and doesn't allocate a #BHeadN. */
+          const void *data_mapped = blo_bhead_data_mapped(fd, bh);
+          if (data_mapped != NULL) {
+            data = data_mapped;
+          }
+          else {
+            bh = blo_bhead_read_full(fd, bh);
+            if (UNLIKELY(bh == NULL)) {
+              fd->flags &= ~FD_FLAGS_FILE_OK;
+              return NULL;
+            }
+            data = (bh + 1);
           }
         }
 #endif
         temp = DNA_struct_reconstruct(
-            fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh + 1));
+            fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, data);
       }
       else {
         /* SDNA_CMP_EQUAL */
         temp = MEM_mallocN(bh->len, blockname);
 #ifdef USE_BHEAD_READ_ON_DEMAND
+        const void *data_mapped;
         if (BHEADN_FROM_BHEAD(bh)->has_data) {
           memcpy(temp, (bh + 1), bh->len);
         }
+        else if ((data_mapped = blo_bhead_data_mapped(fd, bh))) {
+          memcpy(temp, data_mapped, bh->len);
+        }
         else {
           /* Instead of allocating the bhead, then copying it,
            * read the data from the file directly into the memory. */
@@ -9279,8 +9650,39 @@ static const char *dataname(short id_code)
   return "Data from Lib Block";
 }
 
+/**
+ * Return the data of a block when it can be used from the mapped file as it is,
+ * NULL when it needs to be read or converted by #read_struct.
+ */
+static const void *read_struct_mapped(FileData *fd, BHead *bh)
+{
+#ifdef USE_BHEAD_READ_ON_DEMAND
+  if (bh->len == 0 || (fd->flags & FD_FLAGS_SWITCH_ENDIAN) ||
+      fd->compflags[bh->SDNAnr] != SDNA_CMP_EQUAL) {
+    return NULL;
+  }
+  return blo_bhead_data_mapped(fd, bh);
+#else
+  UNUSED_VARS(fd, bh);
+  return NULL;
+#endif
+}
+
+/**
+ * Blocks of a mapped file which don't need to be converted are added to the map without copying
+ * them, they're only copied when #newdataadr & co. use them. Blocks which aren't used are never
+ * copied, this relies on the file staying mapped while the map is used.
+ */
 static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *allocname)
 {
+  /* Pre-size the map to avoid growing it while adding the blocks. */
+  int bheads_len = 0;
+  for (BHead *bhead_iter = blo_bhead_next(fd, bhead); bhead_iter && bhead_iter->code == DATA;
+       bhead_iter = blo_bhead_next(fd, bhead_iter)) {
+    bheads_len++;
+  }
+  oldnewmap_reserve(fd->datamap, fd->datamap->nentries + bheads_len);
+
   bhead = blo_bhead_next(fd, bhead);
 
   while (bhead && bhead->code == DATA) {
@@ -9293,7 +9695,14 @@ static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *a
     strcpy(tmp, allocname);
     data = read_struct(fd, bhead, tmp);
 #else
-    data = read_struct(fd, bhead, allocname);
+    const void *data_mapped = read_struct_mapped(fd, bhead);
+    if (data_mapped != NULL) {
+      oldnewmap_insert_mapped(fd->datamap, bhead->old, data_mapped, (uint)bhead->len);
+      data = NULL;
+    }
+    else {
+      data = read_struct(fd, bhead, allocname);
+    }
 #endif
 
     if (data) {
@@ -9939,8 +10348,45 @@ static BHead *read_userdef(BlendFileData *bfd, FileData *fd, BHead *bhead)
 /** \name Read File (Internal)
  * \{ */
 
+/**
+ * Pre-size the library map from the number of blocks (one entry is added for every ID).
+ */
+static void read_file_libmap_reserve(FileData *fd)
+{
+  int bheads_len = 0;
+  for (BHead *bhead = blo_bhead_first(fd); bhead; bhead = blo_bhead_next(fd, bhead)) {
+    if (bhead->code != DATA) {
+      bheads_len++;
+    }
+  }
+  oldnewmap_reserve(fd->libmap, fd->libmap->nentries + bheads_len);
+}
+
+/**
+ * Print the time spent in a step of #blo_read_file_internal, with `--debug-io`.
+ */
+static void read_file_timing_step(const char *step, double *r_time_step)
+{
+  if (G.debug & G_DEBUG_IO) {
+    const double time = PIL_check_seconds_timer();
+    printf("  %-26s %8.4fs\n", step, time - *r_time_step);
+    *r_time_step = time;
+  }
+}
+
 BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 {
+  const double time_start = PIL_check_seconds_timer();
+  double time_step = time_start;
+
+  if (G.debug & G_DEBUG_IO) {
+    printf("Read blend: \"%s\"\n", filepath);
+  }
+
+  if ((fd->skip_flags & BLO_READ_SKIP_DATA) == 0) {
+    read_file_libmap_reserve(fd);
+  }
+
   BHead *bhead = blo_bhead_first(fd);
   BlendFileData *bfd;
   ListBase mainlist = {NULL, NULL};
@@ -10030,6 +10476,7 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
         }
     }
   }
+  read_file_timing_step("Read ID's & direct link:", &time_step);
 
   /* do before read_libraries, but skip undo case */
   if (fd->memfile == NULL) {
@@ -10040,14 +10487,17 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
     if ((fd->skip_flags & BLO_READ_SKIP_USERDEF) == 0) {
       do_versions_userdef(fd, bfd);
     }
+    read_file_timing_step("Versioning:", &time_step);
   }
 
   if ((fd->skip_flags & BLO_READ_SKIP_DATA) == 0) {
     read_libraries(fd, &mainlist);
+    read_file_timing_step("Read libraries:", &time_step);
 
     blo_join_main(&mainlist);
 
     lib_link_all(fd, bfd->main);
+    read_file_timing_step("Lib link:", &time_step);
 
     /* Skip in undo case. */
     if (fd->memfile == NULL) {
@@ -10061,6 +10511,7 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 
       /* After all data has been read and versioned, uses LIB_TAG_NEW. */
       ntreeUpdateAllNew(bfd->main);
+      read_file_timing_step("Versioning after linking:", &time_step);
     }
 
     placeholders_ensure_valid(bfd->main);
@@ -10080,10 +10531,15 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
     fix_relpaths_library(fd->relabase, bfd->main);
 
     link_global(fd, bfd); /* as last */
+    read_file_timing_step("Finalize:", &time_step);
   }
 
   fd->mainlist = NULL; /* Safety, this is local variable, shall not be used afterward. */
 
+  if (G.debug & G_DEBUG_IO) {
+    printf("  %-26s %8.4fs\n", "Total:", PIL_check_seconds_timer() - time_start);
+  }
+
   return bfd;
 }
 
@@ -73,6 +73,9 @@ typedef struct FileData {
 
   /** Regular file reading. */
   int filedes;
+  /** Read-only mapping of an uncompressed file, when supported (NULL otherwise). */
+  const char *mmap_data;
+  size_t mmap_size;
 
   /** Variables needed for reading from memory / stream. */
   const char *buffer;
@@ -81,6 +84,8 @@ typedef struct FileData {
 
   /** Variables needed for reading from file. */
   gzFile gzfiledes;
+  /** Frame index and decompressed frames, for reading compressed files written in frames. */
+  struct GzipFrameReader *gzip_frames;
   /** Gzip stream for memory decompression. */
   z_stream strm;
 
@@ -0,0 +1,221 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/** \file
+ * \ingroup blenloader
+ *
+ * The entries are stored in an array, so they can be iterated in order from C.
+ * Lookups go through a #BLI::Map from old pointers to entry indices: it stores keys in groups
+ * of four next to each other, so probing mostly stays within one cache line.
+ */
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_map.h"
+#include "BLI_utildefines.h"
+
+#include "readfile_oldnewmap.h"
+
+/* Initial capacity (the data map is cleared for every ID, most of them have less data blocks). */
+#define CAPACITY_DEFAULT 64
+
+namespace {
+
+/**
+ * Old pointers are addresses of allocations, aligned to (at least) 8 bytes and often to pages,
+ * while the map uses the lowest bits of the hash to find a slot.
+ * Use a multiplicative hash so all bits of the address are taken into account.
+ */
+struct OldPtr {
+  const void *ptr;
+
+  friend bool operator==(const OldPtr &a, const OldPtr &b)
+  {
+    return a.ptr == b.ptr;
+  }
+};
+
+}  // namespace
+
+namespace BLI {
+
+template<> struct DefaultHash<OldPtr> {
+  uint32_t operator()(const OldPtr &value) const
+  {
+    const uint64_t ptr = (uint64_t)(uintptr_t)value.ptr;
+    return (uint32_t)((ptr * 0x9E3779B97F4A7C15ull) >> 32);
+  }
+};
+
+}  // namespace BLI
+
+/**
+ * Clearing a table larger than the default only resets the number of entries, so it doesn't
+ * depend on the size of the table (which stays large after an ID with many data blocks).
+ * Keys of cleared entries stay in the table with indices that are out of range or point to
+ * entries of other keys, they are removed when the table is full of them,
+ * see #oldnewmap_index_ensure_add.
+ */
+struct OldNewMapIndex {
+  BLI::Map<OldPtr, int> map;
+  /** Number of keys (including cleared ones) at which cleared keys are removed. */
+  uint keys_capacity;
+
+  MEM_CXX_CLASS_ALLOC_FUNCS("OldNewMapIndex")
+};
+
+static bool oldnewmap_index_is_valid(const OldNewMap *onm, const void *oldaddr, int index)
+{
+  return index < onm->nentries && onm->entries[index].oldp == oldaddr;
+}
+
+/**
+ * Called before adding a key, removes the keys of cleared entries when the table is full.
+ * When most keys are used, the table grows instead, so this runs at most once
+ * for every `keys_capacity / 2` keys added.
+ */
+static void oldnewmap_index_ensure_add(OldNewMap *onm)
+{
+  OldNewMapIndex *index = onm->index;
+  if (index->map.size() < index->keys_capacity) {
+    return;
+  }
+  if ((uint)onm->nentries > index->keys_capacity / 2) {
+    index->keys_capacity *= 2;
+    return;
+  }
+  index->map.clear_and_keep_capacity();
+  for (int i = 0; i < onm->nentries; i++) {
+    index->map.add_new(OldPtr{onm->entries[i].oldp}, i);
+  }
+}
+
+static void oldnewmap_entries_ensure(OldNewMap *onm, int entries_len)
+{
+  if (entries_len > onm->entries_capacity) {
+    int capacity = onm->entries_capacity;
+    while (capacity < entries_len) {
+      capacity *= 2;
+    }
+    onm->entries = (OldNew *)MEM_reallocN(onm->entries, sizeof(*onm->entries) * capacity);
+    onm->entries_capacity = capacity;
+  }
+}
+
+OldNewMap *oldnewmap_new(void)
+{
+  OldNewMap *onm = (OldNewMap *)MEM_callocN(sizeof(*onm), "OldNewMap");
+
+  onm->entries_capacity = CAPACITY_DEFAULT;
+  onm->entries = (OldNew *)MEM_malloc_arrayN(
+      onm->entries_capacity, sizeof(*onm->entries), "OldNewMap.entries");
+  onm->index = new OldNewMapIndex();
+  onm->index->map.reserve(CAPACITY_DEFAULT);
+  onm->index->keys_capacity = CAPACITY_DEFAULT;
+
+  return onm;
+}
+
+void oldnewmap_free(OldNewMap *onm)
+{
+  delete onm->index;
+  MEM_freeN(onm->entries);
+  MEM_freeN(onm);
+}
+
+void oldnewmap_reserve(OldNewMap *onm, int entries_len)
+{
+  oldnewmap_entries_ensure(onm, entries_len);
+  onm->index->map.reserve((uint)entries_len);
+  onm->index->keys_capacity = MAX2(onm->index->keys_capacity, (uint)entries_len);
+}
+
+void oldnewmap_clear(OldNewMap *onm)
+{
+  /* The default size table is quick to reset, keeping cleared keys would only make it fill up
+   * sooner. Larger tables keep them, until #oldnewmap_index_ensure_add removes them. */
+  if (onm->index->keys_capacity <= CAPACITY_DEFAULT) {
+    onm->index->map.clear_and_keep_capacity();
+  }
+  onm->nentries = 0;
+}
+
+static void oldnewmap_insert_entry(OldNewMap *onm, const OldNew &entry)
+{
+  const void *oldaddr = entry.oldp;
+
+  auto add_entry = [&](int *r_index) {
+    oldnewmap_entries_ensure(onm, onm->nentries + 1);
+    onm->entries[onm->nentries] = entry;
+    *r_index = onm->nentries;
+    onm->nentries++;
+  };
+
+  oldnewmap_index_ensure_add(onm);
+  onm->index->map.add_or_modify(
+      OldPtr{oldaddr},
+      [&](int *r_index) {
+        add_entry(r_index);
+        return true;
+      },
+      [&](int *index) {
+        if (oldnewmap_index_is_valid(onm, oldaddr, *index)) {
+          onm->entries[*index] = entry;
+        }
+        else {
+          /* Key of a cleared entry. */
+          add_entry(index);
+        }
+        return false;
+      });
+}
+
+void oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
+{
+  if (oldaddr == NULL || newaddr == NULL) {
+    return;
+  }
+
+  OldNew entry;
+  entry.oldp = oldaddr;
+  entry.newp = newaddr;
+  entry.nr = nr;
+  entry.mapped_len = 0;
+  oldnewmap_insert_entry(onm, entry);
+}
+
+void oldnewmap_insert_mapped(OldNewMap *onm, const void *oldaddr, const void *data, uint len)
+{
+  if (oldaddr == NULL || data == NULL) {
+    return;
+  }
+
+  OldNew entry;
+  entry.oldp = oldaddr;
+  entry.newp = const_cast<void *>(data);
+  entry.nr = 0;
+  entry.mapped_len = len;
+  oldnewmap_insert_entry(onm, entry);
+}
+
+OldNew *oldnewmap_lookup_entry(const OldNewMap *onm, const void *addr)
+{
+  const int *index = onm->index->map.lookup_ptr(OldPtr{addr});
+  if (index == NULL || !oldnewmap_index_is_valid(onm, addr, *index)) {
+    return NULL;
+  }
+  return &onm->entries[*index];
+}
@@ -0,0 +1,67 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __READFILE_OLDNEWMAP_H__
+#define __READFILE_OLDNEWMAP_H__
+
+/** \file
+ * \ingroup blenloader
+ *
+ * Maps the pointers stored in a file to the data read from it,
+ * used for every pointer of every struct while reading.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct OldNew {
+  const void *oldp;
+  void *newp;
+  /* `nr` is "user count" for data, and ID code for libdata. */
+  int nr;
+  /* When not zero, `newp` is the data of a mapped file, copied when it's first looked up. */
+  uint mapped_len;
+} OldNew;
+
+typedef struct OldNewMap {
+  /* Array that stores the actual entries, in the order they were added. */
+  OldNew *entries;
+  int nentries;
+  int entries_capacity;
+  /* Hash table that stores indices into the `entries` array. */
+  struct OldNewMapIndex *index;
+} OldNewMap;
+
+OldNewMap *oldnewmap_new(void);
+void oldnewmap_free(OldNewMap *onm);
+
+/** Ensure \a entries_len entries can be added without growing the map. */
+void oldnewmap_reserve(OldNewMap *onm, int entries_len);
+/** Remove all entries, keeping the entries array allocated. */
+void oldnewmap_clear(OldNewMap *onm);
+
+/** Add an entry, replacing the entry of \a oldaddr when it exists. */
+void oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr);
+/** Add an entry for data of a mapped file, see #OldNew.mapped_len. */
+void oldnewmap_insert_mapped(OldNewMap *onm, const void *oldaddr, const void *data, uint len);
+OldNew *oldnewmap_lookup_entry(const OldNewMap *onm, const void *addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __READFILE_OLDNEWMAP_H__ */
@@ -41,6 +41,9 @@
 #include "DNA_listBase.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
+#include "BLI_threads.h"
 
 #include "BLO_undofile.h"
 #include "BLO_readfile.h"
@@ -52,43 +55,122 @@
 
 /* **************** support for memory-write, for undo buffers *************** */
 
+/* -------------------------------------------------------------------- */
+/** \name Shared Chunk Data
+ *
+ * Chunk data is reference counted and shared between all chunks with identical content.
+ * Identical content is found by hash among all chunks in memory, so a chunk is de-duplicated
+ * even when its position changed since the previous undo step, or when it only exists
+ * in an older undo step.
+ * \{ */
+
+typedef struct MemFileChunkData {
+  const char *buf;
+  /** Size in bytes. */
+  uint size;
+  uint hash;
+  /** Number of #MemFileChunk using this data. */
+  uint users;
+} MemFileChunkData;
+
+/**
+ * All chunk data in memory, only accessed when writing undo steps and freeing them,
+ * which happens from the main thread.
+ */
+static GSet *memfile_chunk_data_set = NULL;
+
+static uint memfile_chunk_data_hash(const void *key)
+{
+  return ((const MemFileChunkData *)key)->hash;
+}
+
+static bool memfile_chunk_data_cmp(const void *a, const void *b)
+{
+  const MemFileChunkData *data_a = a;
+  const MemFileChunkData *data_b = b;
+  return (data_a->hash != data_b->hash) || (data_a->size != data_b->size) ||
+         (memcmp(data_a->buf, data_b->buf, data_a->size) != 0);
+}
+
+/**
+ * Find data identical to \a buf or store a copy of it, adding a user in both cases.
+ * \return true when the data was already stored.
+ */
+static bool memfile_chunk_data_ensure(const char *buf, uint size, MemFileChunkData **r_data)
+{
+  BLI_assert(BLI_thread_is_main());
+
+  MemFileChunkData key = {
+      .buf = buf,
+      .size = size,
+      .hash = BLI_hash_mm2((const uchar *)buf, size, 0),
+  };
+
+  if (memfile_chunk_data_set == NULL) {
+    memfile_chunk_data_set = BLI_gset_new(
+        memfile_chunk_data_hash, memfile_chunk_data_cmp, __func__);
+  }
+
+  void **data_p;
+  if (BLI_gset_ensure_p_ex(memfile_chunk_data_set, &key, &data_p)) {
+    MemFileChunkData *data = *data_p;
+    data->users++;
+    *r_data = data;
+    return true;
+  }
+
+  /* Store data right after its header, so a chunk needs a single allocation. */
+  MemFileChunkData *data = MEM_mallocN(sizeof(MemFileChunkData) + size, "MemFileChunkData");
+  char *buf_new = (char *)(data + 1);
+  memcpy(buf_new, buf, size);
+  *data = key;
+  data->buf = buf_new;
+  data->users = 1;
+
+  *data_p = data;
+  *r_data = data;
+  return false;
+}
+
+static void memfile_chunk_data_release(MemFileChunkData *data)
+{
+  BLI_assert(BLI_thread_is_main());
+  BLI_assert(data->users > 0);
+
+  if (--data->users != 0) {
+    return;
+  }
+
+  BLI_gset_remove(memfile_chunk_data_set, data, NULL);
+  MEM_freeN(data);
+
+  /* Don't keep the set around once all undo steps are gone. */
+  if (BLI_gset_len(memfile_chunk_data_set) == 0) {
+    BLI_gset_free(memfile_chunk_data_set, NULL);
+    memfile_chunk_data_set = NULL;
+  }
+}
+
+/** \} */
+
 /* not memfile itself */
 void BLO_memfile_free(MemFile *memfile)
 {
   MemFileChunk *chunk;
 
   while ((chunk = BLI_pophead(&memfile->chunks))) {
-    if (chunk->is_identical == false) {
-      MEM_freeN((void *)chunk->buf);
-    }
+    memfile_chunk_data_release(chunk->data);
     MEM_freeN(chunk);
   }
   memfile->size = 0;
+  memfile->size_total = 0;
 }
 
 /* to keep list of memfiles consistent, 'first' is always first in list */
 /* result is that 'first' is being freed */
-void BLO_memfile_merge(MemFile *first, MemFile *second)
+void BLO_memfile_merge(MemFile *first, MemFile *UNUSED(second))
 {
-  MemFileChunk *fc, *sc;
-
-  fc = first->chunks.first;
-  sc = second->chunks.first;
-  while (fc || sc) {
-    if (fc && sc) {
-      if (sc->is_identical) {
-        sc->is_identical = false;
-        fc->is_identical = true;
-      }
-    }
-    if (fc) {
-      fc = fc->next;
-    }
-    if (sc) {
-      sc = sc->next;
-    }
-  }
-
+  /* Chunk data is reference counted, the data shared with 'second' stays in memory. */
   BLO_memfile_free(first);
 }
 
@@ -98,27 +180,32 @@ void memfile_chunk_add(MemFile *memfile, const char *buf, uint size, MemFileChun
   curchunk->size = size;
   curchunk->buf = NULL;
   curchunk->is_identical = false;
+  curchunk->data = NULL;
   BLI_addtail(&memfile->chunks, curchunk);
 
-  /* we compare compchunk with buf */
+  /* we compare compchunk with buf, this is the common case and avoids hashing the data */
   if (*compchunk_step != NULL) {
     MemFileChunk *compchunk = *compchunk_step;
     if (compchunk->size == curchunk->size) {
       if (memcmp(compchunk->buf, buf, size) == 0) {
-        curchunk->buf = compchunk->buf;
+        curchunk->data = compchunk->data;
+        curchunk->data->users++;
         curchunk->is_identical = true;
       }
     }
     *compchunk_step = compchunk->next;
   }
 
-  /* not equal... */
-  if (curchunk->buf == NULL) {
-    char *buf_new = MEM_mallocN(size, "Chunk buffer");
-    memcpy(buf_new, buf, size);
-    curchunk->buf = buf_new;
-    memfile->size += size;
+  /* not equal, look for the same data anywhere else */
+  if (curchunk->data == NULL) {
+    curchunk->is_identical = memfile_chunk_data_ensure(buf, size, &curchunk->data);
+    if (!curchunk->is_identical) {
+      memfile->size += size;
+    }
   }
+
+  curchunk->buf = curchunk->data->buf;
+  memfile->size_total += size;
 }
 
 struct Main *BLO_memfile_main_get(struct MemFile *memfile,
@@ -714,6 +714,17 @@ void BLO_version_defaults_userpref_blend(Main *bmain, UserDef *userdef)
    */
   {
     /* Keep this block, even when empty. */
+
+    /* The limit can't be set to zero, use it to detect preferences without the disk cache. */
+    if (userdef->sequencer_disk_cache_size_limit == 0) {
+      userdef->sequencer_disk_cache_size_limit = U_default.sequencer_disk_cache_size_limit;
+      userdef->sequencer_disk_cache_compression = U_default.sequencer_disk_cache_compression;
+    }
+
+    /* The limit can't be set to zero either. */
+    if (userdef->mesh_eval_cache_limit == 0) {
+      userdef->mesh_eval_cache_limit = U_default.mesh_eval_cache_limit;
+    }
   }
 
   if (userdef->pixelsize == 0.0f) {
@@ -145,6 +145,7 @@
 #include "BLI_bitmap.h"
 #include "BLI_blenlib.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 
 #include "BKE_action.h"
 #include "BKE_blender_version.h"
@@ -202,6 +203,8 @@ typedef enum {
   WW_WRAP_ZLIB,
 } eWriteWrapType;
 
+struct ZlibFramesWrap;
+
 typedef struct WriteWrap WriteWrap;
 struct WriteWrap {
   /* callbacks */
@@ -215,7 +218,7 @@ struct WriteWrap {
   /* internal */
   union {
     int file_handle;
-    gzFile gz_handle;
+    struct ZlibFramesWrap *zlib_frames;
   } _user_data;
 };
 
@@ -246,32 +249,195 @@ static size_t ww_write_none(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
-/* zlib */
-#define FILE_HANDLE(ww) (ww)->_user_data.gz_handle
+/* zlib
+ *
+ * Data is split in frames of #BLEN_GZIP_FRAME_DATA_SIZE, each one written as an independent
+ * gzip member (see #BLEN_GZIP_FRAME_HEADER_SIZE). Frames are collected until there are enough
+ * of them to keep all threads busy, then compressed in parallel and written out in order. */
+
+typedef struct ZlibFrame {
+  /** Uncompressed data. */
+  uchar *data;
+  uint data_len;
+  /** The whole gzip member (header, deflate stream and trailer). */
+  uchar *member;
+  uint member_len;
+  bool is_ok;
+} ZlibFrame;
+
+typedef struct ZlibFramesWrap {
+  int file_handle;
+  ZlibFrame *frames;
+  /** Number of frames compressed at once. */
+  int frames_len;
+  /** Index of the frame being filled. */
+  int frame_active;
+  /** Allocated size of #ZlibFrame.member. */
+  uint member_len_max;
+} ZlibFramesWrap;
+
+#define ZLIB_FRAMES(ww) (ww)->_user_data.zlib_frames
+
+static void zlib_frame_write_uint16(uchar *buf, uint value)
+{
+  buf[0] = (uchar)(value & 0xff);
+  buf[1] = (uchar)((value >> 8) & 0xff);
+}
 
-static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+static void zlib_frame_write_uint32(uchar *buf, uint value)
+{
+  zlib_frame_write_uint16(buf, value & 0xffff);
+  zlib_frame_write_uint16(buf + 2, value >> 16);
+}
+
+static void zlib_frame_compress_cb(void *__restrict userdata,
+                                   const int index,
+                                   const TaskParallelTLS *__restrict UNUSED(tls))
 {
-  gzFile file;
+  ZlibFramesWrap *zfw = userdata;
+  ZlibFrame *frame = &zfw->frames[index];
+  uchar *header = frame->member;
+  uchar *deflate_data = frame->member + BLEN_GZIP_FRAME_HEADER_SIZE;
+  z_stream strm = {NULL};
 
-  file = BLI_gzopen(filepath, "wb1");
+  frame->is_ok = false;
 
-  if (file != Z_NULL) {
-    FILE_HANDLE(ww) = file;
+  /* Negative window bits: raw deflate stream, we write gzip header and trailer ourselves. */
+  if (deflateInit2(&strm, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+  strm.next_in = frame->data;
+  strm.avail_in = frame->data_len;
+  strm.next_out = deflate_data;
+  strm.avail_out = zfw->member_len_max - BLEN_GZIP_FRAME_HEADER_SIZE -
+                   BLEN_GZIP_FRAME_TRAILER_SIZE;
+  const int err = deflate(&strm, Z_FINISH);
+  const uint deflate_len = (uint)strm.total_out;
+  deflateEnd(&strm);
+  if (err != Z_STREAM_END) {
+    return;
+  }
+
+  frame->member_len = BLEN_GZIP_FRAME_HEADER_SIZE + deflate_len + BLEN_GZIP_FRAME_TRAILER_SIZE;
+
+  /* ID1, ID2, CM (deflate), FLG (FEXTRA), MTIME, XFL, OS (unknown). */
+  const uchar header_magic[10] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff};
+  memcpy(header, header_magic, sizeof(header_magic));
+  zlib_frame_write_uint16(header + 10, 12);
+  header[12] = BLEN_GZIP_FRAME_SI1;
+  header[13] = BLEN_GZIP_FRAME_SI2;
+  zlib_frame_write_uint16(header + 14, 8);
+  zlib_frame_write_uint32(header + 16, frame->member_len);
+  zlib_frame_write_uint32(header + 20, frame->data_len);
+
+  uchar *trailer = deflate_data + deflate_len;
+  zlib_frame_write_uint32(trailer, (uint)crc32(0, frame->data, frame->data_len));
+  zlib_frame_write_uint32(trailer + 4, frame->data_len);
+
+  frame->is_ok = true;
+}
+
+/* Compress the first \a frames_num frames, and write them to the file. */
+static bool ww_flush_zlib(ZlibFramesWrap *zfw, const int frames_num)
+{
+  if (frames_num == 0) {
     return true;
   }
-  else {
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (frames_num > 1);
+  settings.min_iter_per_thread = 1;
+  BLI_task_parallel_range(0, frames_num, zfw, zlib_frame_compress_cb, &settings);
+
+  bool is_ok = true;
+  for (int i = 0; i < frames_num; i++) {
+    ZlibFrame *frame = &zfw->frames[i];
+    if (is_ok) {
+      is_ok = frame->is_ok && (write(zfw->file_handle, frame->member, frame->member_len) ==
+                               (int)frame->member_len);
+    }
+    frame->data_len = 0;
+  }
+  zfw->frame_active = 0;
+
+  return is_ok;
+}
+
+static void ww_frames_free_zlib(ZlibFramesWrap *zfw)
+{
+  for (int i = 0; i < zfw->frames_len; i++) {
+    MEM_SAFE_FREE(zfw->frames[i].data);
+    MEM_SAFE_FREE(zfw->frames[i].member);
+  }
+  MEM_freeN(zfw->frames);
+  MEM_freeN(zfw);
+}
+
+static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+{
+  int file;
+
+  file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+  if (file == -1) {
     return false;
   }
+
+  ZlibFramesWrap *zfw = MEM_callocN(sizeof(*zfw), __func__);
+  zfw->file_handle = file;
+  /* Use more frames than threads, so the load stays balanced when some frames compress
+   * faster than others. */
+  zfw->frames_len = MIN2(BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) * 2, 64);
+  zfw->frames = MEM_calloc_arrayN(zfw->frames_len, sizeof(*zfw->frames), __func__);
+  zfw->member_len_max = BLEN_GZIP_FRAME_HEADER_SIZE +
+                        (uint)compressBound(BLEN_GZIP_FRAME_DATA_SIZE) +
+                        BLEN_GZIP_FRAME_TRAILER_SIZE;
+  for (int i = 0; i < zfw->frames_len; i++) {
+    zfw->frames[i].data = MEM_mallocN(BLEN_GZIP_FRAME_DATA_SIZE, "zlib frame data");
+    zfw->frames[i].member = MEM_mallocN(zfw->member_len_max, "zlib frame member");
+  }
+
+  ZLIB_FRAMES(ww) = zfw;
+  return true;
 }
 static bool ww_close_zlib(WriteWrap *ww)
 {
-  return (gzclose(FILE_HANDLE(ww)) == Z_OK);
+  ZlibFramesWrap *zfw = ZLIB_FRAMES(ww);
+  const int frames_num = zfw->frame_active + (zfw->frames[zfw->frame_active].data_len ? 1 : 0);
+  bool is_ok = ww_flush_zlib(zfw, frames_num);
+  is_ok &= (close(zfw->file_handle) != -1);
+  ww_frames_free_zlib(zfw);
+  ZLIB_FRAMES(ww) = NULL;
+  return is_ok;
 }
 static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 {
-  return gzwrite(FILE_HANDLE(ww), buf, buf_len);
+  ZlibFramesWrap *zfw = ZLIB_FRAMES(ww);
+  size_t written = 0;
+
+  while (written < buf_len) {
+    ZlibFrame *frame = &zfw->frames[zfw->frame_active];
+    const uint len = (uint)MIN2(buf_len - written, BLEN_GZIP_FRAME_DATA_SIZE - frame->data_len);
+
+    memcpy(frame->data + frame->data_len, buf + written, len);
+    frame->data_len += len;
+    written += len;
+
+    if (frame->data_len == BLEN_GZIP_FRAME_DATA_SIZE) {
+      zfw->frame_active++;
+      if (zfw->frame_active == zfw->frames_len) {
+        /* All frames are filled, compress them. */
+        if (!ww_flush_zlib(zfw, zfw->frames_len)) {
+          return 0;
+        }
+      }
+    }
+  }
+
+  return written;
 }
-#undef FILE_HANDLE
+#undef ZLIB_FRAMES
 
 /* --- end compression types --- */
 
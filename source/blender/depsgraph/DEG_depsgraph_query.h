@@ -40,6 +40,7 @@ struct Depsgraph;
 struct DupliObject;
 struct ID;
 struct ListBase;
+struct Main;
 struct PointerRNA;
 struct Scene;
 struct ViewLayer;
@@ -50,6 +51,9 @@ extern "C" {
 
 /* *********************** DEG input data ********************* */
 
+/* Get main database that depsgraph was built for. */
+struct Main *DEG_get_bmain(const Depsgraph *graph);
+
 /* Get scene that depsgraph was built for. */
 struct Scene *DEG_get_input_scene(const Depsgraph *graph);
 
@@ -32,6 +32,7 @@
 #include "BLI_task.h"
 #include "BLI_ghash.h"
 #include "BLI_gsqueue.h"
+#include "BLI_vector.h"
 
 #include "BKE_global.h"
 
@@ -60,6 +61,10 @@ namespace {
 
 struct DepsgraphEvalState;
 
+/* Operations which became ready for evaluation. They are handed over to the scheduler at once, so
+ * they can be ordered by their critical path. */
+using ReadyOperations = BLI::Vector<OperationNode *, 16>;
+
 void deg_task_run_func(TaskPool *pool, void *taskdata, int thread_id);
 
 template<typename ScheduleFunction, typename... ScheduleFunctionArgs>
@@ -105,15 +110,11 @@ void evaluate_node(const DepsgraphEvalState *state, OperationNode *operation_nod
 
   /* Sanity checks. */
   BLI_assert(!operation_node->is_noop() && "NOOP nodes should not actually be scheduled");
-  /* Perform operation. */
-  if (state->do_stats) {
-    const double start_time = PIL_check_seconds_timer();
-    operation_node->evaluate(depsgraph);
-    operation_node->stats.current_time += PIL_check_seconds_timer() - start_time;
-  }
-  else {
-    operation_node->evaluate(depsgraph);
-  }
+  /* Perform operation. Timing is always gathered, it is used to estimate the critical path of
+   * the following evaluations. */
+  const double start_time = PIL_check_seconds_timer();
+  operation_node->evaluate(depsgraph);
+  operation_node->stats.current_time += PIL_check_seconds_timer() - start_time;
 }
 
 void deg_task_run_func(TaskPool *pool, void *taskdata, int thread_id)
@@ -142,6 +143,22 @@ bool check_operation_node_visible(OperationNode *op_node)
   return comp_node->affects_directly_visible;
 }
 
+bool check_operation_node_needs_evaluation(OperationNode *op_node)
+{
+  return check_operation_node_visible(op_node) && (op_node->flag & DEPSOP_FLAG_NEEDS_UPDATE);
+}
+
+/* Relation which the evaluation waits for: both operations are to be evaluated, and the relation
+ * is not ignored because of a dependency cycle. */
+bool check_relation_is_evaluation_order(const Relation *rel)
+{
+  if (rel->from->type != NodeType::OPERATION || (rel->flag & RELATION_FLAG_CYCLIC)) {
+    return false;
+  }
+  return check_operation_node_needs_evaluation((OperationNode *)rel->from) &&
+         check_operation_node_needs_evaluation((OperationNode *)rel->to);
+}
+
 void calculate_pending_parents_for_node(OperationNode *node)
 {
   /* Update counters, applies for both visible and invisible IDs. */
@@ -181,16 +198,91 @@ void calculate_pending_parents(Depsgraph *graph)
   }
 }
 
-void initialize_execution(DepsgraphEvalState *state, Depsgraph *graph)
+/* Calculate critical path time of all operations which are to be evaluated, from either the
+ * average timing of previous evaluations or the timing of the current evaluation.
+ *
+ * Operations are visited in reverse topological order, using custom_flags to count children which
+ * are not visited yet. */
+void calculate_critical_path(Depsgraph *graph, const bool use_current_time)
+{
+  vector<OperationNode *> ready_nodes;
+  for (OperationNode *node : graph->operations) {
+    node->critical_path_time = 0.0;
+    if (!check_operation_node_needs_evaluation(node)) {
+      continue;
+    }
+    node->custom_flags = 0;
+    for (Relation *rel : node->outlinks) {
+      if (check_relation_is_evaluation_order(rel)) {
+        ++node->custom_flags;
+      }
+    }
+    if (node->custom_flags == 0) {
+      ready_nodes.push_back(node);
+    }
+  }
+  while (!ready_nodes.empty()) {
+    OperationNode *node = ready_nodes.back();
+    ready_nodes.pop_back();
+    /* Children are all visited, so critical path time holds their maximum at this point. */
+    node->critical_path_time += use_current_time ? node->stats.current_time :
+                                                   node->stats.average_time;
+    for (Relation *rel : node->inlinks) {
+      if (!check_relation_is_evaluation_order(rel)) {
+        continue;
+      }
+      OperationNode *from = (OperationNode *)rel->from;
+      from->critical_path_time = max(from->critical_path_time, node->critical_path_time);
+      if (--from->custom_flags == 0) {
+        ready_nodes.push_back(from);
+      }
+    }
+  }
+}
+
+void initialize_execution(DepsgraphEvalState * /*state*/, Depsgraph *graph)
 {
-  const bool do_stats = state->do_stats;
   calculate_pending_parents(graph);
   /* Clear tags and other things which needs to be clear. */
   for (OperationNode *node : graph->operations) {
-    if (do_stats) {
-      node->stats.reset_current();
+    node->stats.reset_current();
+  }
+  calculate_critical_path(graph, false);
+}
+
+/* Print chain of operations with the highest critical path time, which is to be calculated
+ * beforehand. Both the time predicted from previous evaluations and the actual time of the current
+ * evaluation are printed for every operation. */
+void print_critical_path(Depsgraph *graph, const char *label)
+{
+  OperationNode *node = nullptr;
+  for (OperationNode *op_node : graph->operations) {
+    if (check_operation_node_needs_evaluation(op_node) &&
+        (node == nullptr || op_node->critical_path_time > node->critical_path_time)) {
+      node = op_node;
     }
   }
+  if (node == nullptr) {
+    return;
+  }
+  printf("%s critical path: %f seconds (predicted, actual):\n", label, node->critical_path_time);
+  while (node != nullptr) {
+    if (!node->is_noop()) {
+      printf("  %f %f %s\n",
+             node->stats.average_time,
+             node->stats.current_time,
+             node->full_identifier().c_str());
+    }
+    OperationNode *next_node = nullptr;
+    for (Relation *rel : node->outlinks) {
+      OperationNode *child = (OperationNode *)rel->to;
+      if (check_relation_is_evaluation_order(rel) &&
+          (next_node == nullptr || child->critical_path_time > next_node->critical_path_time)) {
+        next_node = child;
+      }
+    }
+    node = next_node;
+  }
 }
 
 bool is_metaball_object_operation(const OperationNode *operation_node)
@@ -230,17 +322,21 @@ bool need_evaluate_operation_at_stage(DepsgraphEvalState *state,
   return false;
 }
 
+void gather_ready_children(DepsgraphEvalState *state,
+                           OperationNode *node,
+                           ReadyOperations *ready_operations);
+
 /* Schedule a node if it needs evaluation.
  *   dec_parents: Decrement pending parents count, true when child nodes are
  *                scheduled after a task has been completed.
+ *
+ * Operations are not handed over to the scheduler right away, but are gathered
+ * into ready_operations, see schedule_ready_operations().
  */
-template<typename ScheduleFunction, typename... ScheduleFunctionArgs>
 void schedule_node(DepsgraphEvalState *state,
                    OperationNode *node,
                    bool dec_parents,
-                   const int thread_id,
-                   ScheduleFunction *schedule_function,
-                   ScheduleFunctionArgs... schedule_function_args)
+                   ReadyOperations *ready_operations)
 {
   /* No need to schedule nodes of invisible ID. */
   if (!check_operation_node_visible(node)) {
@@ -271,23 +367,60 @@ void schedule_node(DepsgraphEvalState *state,
   if (!is_scheduled) {
     if (node->is_noop()) {
       /* skip NOOP node, schedule children right away */
-      schedule_children(state, node, thread_id, schedule_function, schedule_function_args...);
+      gather_ready_children(state, node, ready_operations);
     }
     else {
       /* children are scheduled once this task is completed */
-      schedule_function(node, thread_id, schedule_function_args...);
+      ready_operations->append(node);
     }
   }
 }
 
+void gather_ready_children(DepsgraphEvalState *state,
+                           OperationNode *node,
+                           ReadyOperations *ready_operations)
+{
+  for (Relation *rel : node->outlinks) {
+    OperationNode *child = (OperationNode *)rel->to;
+    BLI_assert(child->type == NodeType::OPERATION);
+    if (child->scheduled) {
+      /* Happens when having cyclic dependencies. */
+      continue;
+    }
+    schedule_node(state, child, (rel->flag & RELATION_FLAG_CYCLIC) == 0, ready_operations);
+  }
+}
+
+/* Hand ready operations over to the scheduler, the ones with the most expensive chain of
+ * dependent operations first. The first pushed operation is picked up by the pushing thread
+ * next, and the task pool gives the following ones out to other threads in the order they were
+ * pushed in, so the critical path is not left waiting behind cheap operations. */
+template<typename ScheduleFunction, typename... ScheduleFunctionArgs>
+void schedule_ready_operations(ReadyOperations *ready_operations,
+                               const int thread_id,
+                               ScheduleFunction *schedule_function,
+                               ScheduleFunctionArgs... schedule_function_args)
+{
+  std::sort(ready_operations->begin(),
+            ready_operations->end(),
+            [](const OperationNode *a, const OperationNode *b) {
+              return a->critical_path_time > b->critical_path_time;
+            });
+  for (OperationNode *node : *ready_operations) {
+    schedule_function(node, thread_id, schedule_function_args...);
+  }
+}
+
 template<typename ScheduleFunction, typename... ScheduleFunctionArgs>
 void schedule_graph(DepsgraphEvalState *state,
                     ScheduleFunction *schedule_function,
                     ScheduleFunctionArgs... schedule_function_args)
 {
+  ReadyOperations ready_operations;
   for (OperationNode *node : state->graph->operations) {
-    schedule_node(state, node, false, -1, schedule_function, schedule_function_args...);
+    schedule_node(state, node, false, &ready_operations);
   }
+  schedule_ready_operations(&ready_operations, -1, schedule_function, schedule_function_args...);
 }
 
 template<typename ScheduleFunction, typename... ScheduleFunctionArgs>
@@ -297,20 +430,10 @@ void schedule_children(DepsgraphEvalState *state,
                        ScheduleFunction *schedule_function,
                        ScheduleFunctionArgs... schedule_function_args)
 {
-  for (Relation *rel : node->outlinks) {
-    OperationNode *child = (OperationNode *)rel->to;
-    BLI_assert(child->type == NodeType::OPERATION);
-    if (child->scheduled) {
-      /* Happens when having cyclic dependencies. */
-      continue;
-    }
-    schedule_node(state,
-                  child,
-                  (rel->flag & RELATION_FLAG_CYCLIC) == 0,
-                  thread_id,
-                  schedule_function,
-                  schedule_function_args...);
-  }
+  ReadyOperations ready_operations;
+  gather_ready_children(state, node, &ready_operations);
+  schedule_ready_operations(
+      &ready_operations, thread_id, schedule_function, schedule_function_args...);
 }
 
 void schedule_node_to_queue(OperationNode *node,
@@ -413,7 +536,11 @@ void deg_evaluate_on_refresh(Depsgraph *graph)
    * synchronization. */
   if (state.do_stats) {
     deg_eval_stats_aggregate(graph);
+    print_critical_path(graph, "Predicted");
+    calculate_critical_path(graph, true);
+    print_critical_path(graph, "Actual");
   }
+  deg_eval_stats_update_average(graph);
   /* Clear any uncleared tags - just in case. */
   deg_graph_clear_tags(graph);
   if (need_free_scheduler) {
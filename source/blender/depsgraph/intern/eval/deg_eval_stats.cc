@@ -56,4 +56,24 @@ void deg_eval_stats_aggregate(Depsgraph *graph)
   }
 }
 
+void deg_eval_stats_update_average(Depsgraph *graph)
+{
+  /* Weight of the current evaluation in the average. Is high enough to follow changes in the
+   * scene quickly, while smoothing out timing noise of a single evaluation. */
+  const double current_weight = 0.25;
+  for (OperationNode *op_node : graph->operations) {
+    /* Keep timing of operations which were not evaluated this time. */
+    if (!op_node->scheduled || op_node->is_noop()) {
+      continue;
+    }
+    Node::Stats &stats = op_node->stats;
+    if (stats.average_time == 0.0) {
+      stats.average_time = stats.current_time;
+    }
+    else {
+      stats.average_time += (stats.current_time - stats.average_time) * current_weight;
+    }
+  }
+}
+
 }  // namespace DEG
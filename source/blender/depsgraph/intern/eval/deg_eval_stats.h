@@ -30,4 +30,8 @@ struct Depsgraph;
 /* Aggregate operation timings to overall component and ID nodes timing. */
 void deg_eval_stats_aggregate(Depsgraph *graph);
 
+/* Accumulate timings of operations evaluated during the current graph evaluation into their
+ * average evaluation time. */
+void deg_eval_stats_update_average(Depsgraph *graph);
+
 }  // namespace DEG
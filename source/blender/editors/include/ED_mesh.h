@@ -32,6 +32,7 @@ struct ARegion;
 struct BMBVHTree;
 struct BMEdge;
 struct BMEditMesh;
+struct BMEditMeshJournal;
 struct BMElem;
 struct BMFace;
 struct BMLoop;
@@ -150,6 +151,7 @@ void EDBM_automerge_and_split(struct Object *ob,
 
 /* editmesh_undo.c */
 void ED_mesh_undosys_type(struct UndoType *ut);
+struct BMEditMeshJournal *EDBM_undo_journal_begin(struct BMEditMesh *em, int verts_len_max);
 
 /* editmesh_select.c */
 void EDBM_select_mirrored(struct BMEditMesh *em,
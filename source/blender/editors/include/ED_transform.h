@@ -94,6 +94,8 @@ enum TfmMode {
 /** Transform object parents without moving their children. */
 #define CTX_OBMODE_XFORM_SKIP_CHILDREN (1 << 12)
 #define CTX_SCULPT (1 << 13)
+/** The operator pushes its own undo step when done, edit-mesh changes are journaled for it. */
+#define CTX_UNDO_JOURNAL (1 << 14)
 
 /* Standalone call to get the transformation center corresponding to the current situation
  * returns 1 if successful, 0 otherwise (usually means there's no selection)
@@ -30,8 +30,10 @@
 
 #include "BLI_listbase.h"
 #include "BLI_array_utils.h"
+#include "BLI_math_vector.h"
 
 #include "BKE_context.h"
+#include "BKE_customdata.h"
 #include "BKE_key.h"
 #include "BKE_layer.h"
 #include "BKE_main.h"
@@ -90,6 +92,8 @@ typedef struct BArrayCustomData {
 #endif
 
 typedef struct UndoMesh {
+  struct UndoMesh *next, *prev;
+
   Mesh me;
   int selectmode;
 
@@ -113,8 +117,50 @@ typedef struct UndoMesh {
 #endif /* USE_ARRAY_STORE */
 
   size_t undo_size;
+#ifdef USE_ARRAY_STORE
+  /**
+   * Memory the de-duplicated arrays of this mesh added to the array store, set once it's done.
+   * Replaces #undo_size with #undomesh_size_compacted_apply, zero when there is nothing to apply.
+   */
+  size_t undo_size_compacted;
+#endif
+
+  /** Identifies the state stored here, see #BMEditMesh.undo_state_id. */
+  int state_id;
+  /** Undo steps using this mesh, steps storing only changed vertices share it. */
+  int users;
+  /** #UndoMeshDelta's based on this mesh. */
+  ListBase deltas;
+  /**
+   * The newest undo step using this mesh, #undo_size is counted in its #UndoStep.data_size.
+   * Steps are freed oldest first to stay within the memory limit, so while this step is kept
+   * the mesh is counted, and once it is freed so are the older steps using the mesh.
+   */
+  UndoStep *size_step;
 } UndoMesh;
 
+/** Vertex locations changed relative to a full copy of the mesh. */
+typedef struct UndoMeshDelta {
+  struct UndoMeshDelta *next, *prev;
+  /** The full copy these changes apply to, this delta is one of its users. */
+  UndoMesh *um_base;
+  int state_id;
+
+  /** Sorted indices of the changed vertices. */
+  int *verts_index;
+  /** Vertex locations in #um_base and in this state. */
+  float (*verts_co_base)[3];
+  float (*verts_co)[3];
+  int verts_len;
+} UndoMeshDelta;
+
+static struct {
+  /** The last identifier given to an undo state, zero is never used. */
+  int state_id_last;
+  /** All #UndoMesh, to find the state an edit-mesh was last written to or read from. */
+  ListBase undo_meshes;
+} um_journal = {0};
+
 #ifdef USE_ARRAY_STORE
 
 /** \name Array Store
@@ -350,8 +396,25 @@ static void um_arraystore_compact(UndoMesh *um, const UndoMesh *um_ref)
   um_arraystore_compact_ex(um, um_ref, true);
 }
 
+/** Memory used by the de-duplicated chunks of all array stores. */
+static size_t um_arraystore_size_compacted_get(void)
+{
+  size_t size_compacted = 0;
+  for (int i = 0; i < um_arraystore.bs_stride.stride_table_len; i++) {
+    const BArrayStore *bs = um_arraystore.bs_stride.stride_table[i];
+    if (bs) {
+      size_compacted += BLI_array_store_calc_size_compacted_get(bs);
+    }
+  }
+  return size_compacted;
+}
+
 static void um_arraystore_compact_with_info(UndoMesh *um, const UndoMesh *um_ref)
 {
+  /* States are only freed on the main thread, which waits for compacting to finish first,
+   * so the store only grows meanwhile. */
+  const size_t size_store_prev = um_arraystore_size_compacted_get();
+
 #  ifdef DEBUG_PRINT
   size_t size_expanded_prev, size_compacted_prev;
   BLI_array_store_at_size_calc_memory_usage(
@@ -368,6 +431,9 @@ static void um_arraystore_compact_with_info(UndoMesh *um, const UndoMesh *um_ref
   TIMEIT_END(mesh_undo_compact);
 #  endif
 
+  const size_t size_store = um_arraystore_size_compacted_get();
+  um->undo_size_compacted = sizeof(*um) + (size_store - min_zz(size_store_prev, size_store));
+
 #  ifdef DEBUG_PRINT
   {
     size_t size_expanded, size_compacted;
@@ -498,6 +564,60 @@ static void um_arraystore_free(UndoMesh *um)
 
 #endif /* USE_ARRAY_STORE */
 
+static size_t undomesh_customdata_size(const CustomData *data, const int totelem)
+{
+  size_t mem_size = 0;
+  for (int i = 0; i < data->totlayer; i++) {
+    mem_size += (size_t)CustomData_sizeof(data->layers[i].type) * (size_t)totelem;
+  }
+  return mem_size;
+}
+
+/**
+ * Size of the mesh arrays before de-duplication (#USE_ARRAY_STORE), which is done in the
+ * background and may share most of the memory with other steps, so this is an upper bound
+ * until #undomesh_size_compacted_apply_all replaces it.
+ */
+static size_t undomesh_size_calc(const UndoMesh *um)
+{
+  const Mesh *me = &um->me;
+  size_t mem_size = sizeof(*um);
+  mem_size += undomesh_customdata_size(&me->vdata, me->totvert);
+  mem_size += undomesh_customdata_size(&me->edata, me->totedge);
+  mem_size += undomesh_customdata_size(&me->ldata, me->totloop);
+  mem_size += undomesh_customdata_size(&me->pdata, me->totpoly);
+  if (me->key) {
+    LISTBASE_FOREACH (const KeyBlock *, kb, &me->key->block) {
+      mem_size += (size_t)kb->totelem * (size_t)me->key->elemsize;
+    }
+  }
+  return mem_size;
+}
+
+#ifdef USE_ARRAY_STORE
+/**
+ * Count the memory de-duplication added to the array store instead of the upper bound, for the
+ * meshes compacted since the last call. Compacting must have finished.
+ */
+static void undomesh_size_compacted_apply_all(void)
+{
+  /* Meshes are compacted in the order they are added, the ones applied already come first. */
+  LISTBASE_FOREACH_BACKWARD (LinkData *, link, &um_arraystore.local_links) {
+    UndoMesh *um = link->data;
+    if (um->undo_size_compacted == 0) {
+      break;
+    }
+    if (um->size_step) {
+      BLI_assert(um->size_step->data_size >= um->undo_size);
+      um->size_step->data_size -= um->undo_size;
+      um->size_step->data_size += um->undo_size_compacted;
+    }
+    um->undo_size = um->undo_size_compacted;
+    um->undo_size_compacted = 0;
+  }
+}
+#endif
+
 /* for callbacks */
 /* undo simply makes copies of a bmesh */
 static void *undomesh_from_editmesh(UndoMesh *um, BMEditMesh *em, Key *key)
@@ -507,6 +627,7 @@ static void *undomesh_from_editmesh(UndoMesh *um, BMEditMesh *em, Key *key)
   /* changes this waits is low, but must have finished */
   if (um_arraystore.task_pool) {
     BLI_task_pool_work_and_wait(um_arraystore.task_pool);
+    undomesh_size_compacted_apply_all();
   }
 #endif
   /* make sure shape keys work */
@@ -527,6 +648,7 @@ static void *undomesh_from_editmesh(UndoMesh *um, BMEditMesh *em, Key *key)
 
   um->selectmode = em->selectmode;
   um->shapenr = em->bm->shapenr;
+  um->undo_size = undomesh_size_calc(um);
 
 #ifdef USE_ARRAY_STORE
   {
@@ -553,10 +675,16 @@ static void *undomesh_from_editmesh(UndoMesh *um, BMEditMesh *em, Key *key)
         um_arraystore.task_pool, um_arraystore_compact_cb, um_data, true, TASK_PRIORITY_LOW);
 #  else
     um_arraystore_compact_with_info(um, um_ref);
+    undomesh_size_compacted_apply_all();
 #  endif
   }
 #endif
 
+  um->users = 1;
+  um->state_id = ++um_journal.state_id_last;
+  em->undo_state_id = um->state_id;
+  BLI_addtail(&um_journal.undo_meshes, um);
+
   return um;
 }
 
@@ -569,6 +697,7 @@ static void undomesh_to_editmesh(UndoMesh *um, Object *ob, BMEditMesh *em, Key *
 #  ifdef USE_ARRAY_STORE_THREAD
   /* changes this waits is low, but must have finished */
   BLI_task_pool_work_and_wait(um_arraystore.task_pool);
+  undomesh_size_compacted_apply_all();
 #  endif
 
 #  ifdef DEBUG_TIME
@@ -635,6 +764,8 @@ static void undomesh_to_editmesh(UndoMesh *um, Object *ob, BMEditMesh *em, Key *
 
   MEM_freeN(em_tmp);
 
+  em->undo_state_id = um->state_id;
+
 #ifdef USE_ARRAY_STORE
   um_arraystore_expand_clear(um);
 #endif
@@ -649,6 +780,7 @@ static void undomesh_free_data(UndoMesh *um)
 #  ifdef USE_ARRAY_STORE_THREAD
   /* changes this waits is low, but must have finished */
   BLI_task_pool_work_and_wait(um_arraystore.task_pool);
+  undomesh_size_compacted_apply_all();
 #  endif
 
   /* we need to expand so any allocations in custom-data are freed with the mesh */
@@ -668,6 +800,19 @@ static void undomesh_free_data(UndoMesh *um)
   }
 
   BKE_mesh_free(me);
+
+  BLI_assert(BLI_listbase_is_empty(&um->deltas));
+  BLI_remlink(&um_journal.undo_meshes, um);
+}
+
+static void undomesh_user_remove(UndoMesh *um)
+{
+  BLI_assert(um->users > 0);
+  um->users -= 1;
+  if (um->users == 0) {
+    undomesh_free_data(um);
+    MEM_freeN(um);
+  }
 }
 
 static Object *editmesh_object_from_context(bContext *C)
@@ -684,6 +829,244 @@ static Object *editmesh_object_from_context(bContext *C)
 
 /** \} */
 
+/* -------------------------------------------------------------------- */
+/** \name Undo Journal
+ *
+ * Transform records the initial location of the vertices it moves in #BMEditMesh.undo_journal,
+ * so the undo push which follows only stores those vertices, as changes to the last full copy
+ * of the mesh. Other edits are not journaled and store a full copy.
+ * \{ */
+
+/**
+ * Start recording an edit, the caller adds the index and initial location of every vertex
+ * the edit moves to the journal. The topology must not change.
+ *
+ * \return NULL when the undo state of the edit-mesh isn't known, a full copy is stored then.
+ */
+BMEditMeshJournal *EDBM_undo_journal_begin(BMEditMesh *em, int verts_len_max)
+{
+  MEM_SAFE_FREE(em->undo_journal);
+
+  if (em->undo_state_id == 0) {
+    return NULL;
+  }
+
+  BM_mesh_elem_index_ensure(em->bm, BM_VERT);
+
+  BMEditMeshJournal *journal = MEM_mallocN(
+      sizeof(*journal) + (size_t)verts_len_max * sizeof(*journal->verts), __func__);
+  journal->undo_state_id = em->undo_state_id;
+  journal->verts_len = 0;
+  em->undo_journal = journal;
+  return journal;
+}
+
+static UndoMesh *undomesh_from_state_id(const int state_id, UndoMeshDelta **r_delta)
+{
+  *r_delta = NULL;
+  if (state_id == 0) {
+    return NULL;
+  }
+
+  LISTBASE_FOREACH (UndoMesh *, um, &um_journal.undo_meshes) {
+    if (um->state_id == state_id) {
+      return um;
+    }
+    LISTBASE_FOREACH (UndoMeshDelta *, delta, &um->deltas) {
+      if (delta->state_id == state_id) {
+        *r_delta = delta;
+        return um;
+      }
+    }
+  }
+  return NULL;
+}
+
+static bool undomesh_topology_matches(const UndoMesh *um, const BMesh *bm)
+{
+  return ((um->me.totvert == bm->totvert) && (um->me.totedge == bm->totedge) &&
+          (um->me.totloop == bm->totloop) && (um->me.totpoly == bm->totface));
+}
+
+static int undomesh_journal_vert_cmp(const void *a_v, const void *b_v)
+{
+  const BMEditMeshJournalVert *a = a_v, *b = b_v;
+  if (a->index < b->index) {
+    return -1;
+  }
+  else if (a->index > b->index) {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Store the journaled vertices as changes to the full copy of the mesh the edit started from.
+ * Changes of the previous state are merged in, so a step only depends on the full copy.
+ *
+ * \return NULL when a full copy must be stored instead.
+ */
+static UndoMeshDelta *undomesh_delta_from_editmesh(BMEditMesh *em, Key *key)
+{
+  BMEditMeshJournal *journal = em->undo_journal;
+  BMesh *bm = em->bm;
+
+  /* Shape keys are updated from the full copy on undo, see #undomesh_to_editmesh. */
+  if ((journal == NULL) || (journal->undo_state_id != em->undo_state_id) || (key != NULL)) {
+    return NULL;
+  }
+
+  UndoMeshDelta *delta_prev;
+  UndoMesh *um = undomesh_from_state_id(em->undo_state_id, &delta_prev);
+  if ((um == NULL) || !undomesh_topology_matches(um, bm)) {
+    return NULL;
+  }
+
+  BMEditMeshJournalVert *jverts = journal->verts;
+  const int jverts_len = journal->verts_len;
+  qsort(jverts, (size_t)jverts_len, sizeof(*jverts), undomesh_journal_vert_cmp);
+  if (jverts_len && ((jverts[0].index < 0) || (jverts[jverts_len - 1].index >= bm->totvert))) {
+    return NULL;
+  }
+
+  const int prev_len = delta_prev ? delta_prev->verts_len : 0;
+  const int verts_len_max = prev_len + jverts_len;
+  int *verts_index = MEM_mallocN(sizeof(*verts_index) * (size_t)verts_len_max, __func__);
+  float(*verts_co_base)[3] = MEM_mallocN(sizeof(*verts_co_base) * (size_t)verts_len_max,
+                                         __func__);
+  float(*verts_co)[3] = MEM_mallocN(sizeof(*verts_co) * (size_t)verts_len_max, __func__);
+  int verts_len = 0;
+
+  BM_mesh_elem_table_ensure(bm, BM_VERT);
+
+  int i_prev = 0, i_journal = 0;
+  while ((i_prev < prev_len) || (i_journal < jverts_len)) {
+    const int index_prev = (i_prev < prev_len) ? delta_prev->verts_index[i_prev] : INT_MAX;
+    const int index_journal = (i_journal < jverts_len) ? jverts[i_journal].index : INT_MAX;
+    const int index = min_ii(index_prev, index_journal);
+    const float *co_base;
+
+    if (index == index_prev) {
+      co_base = delta_prev->verts_co_base[i_prev++];
+    }
+    else {
+      co_base = jverts[i_journal].co;
+    }
+    /* Skip duplicates, the first location recorded is the initial one. */
+    while ((i_journal < jverts_len) && (jverts[i_journal].index == index)) {
+      i_journal++;
+    }
+
+    const float *co = BM_vert_at_index(bm, index)->co;
+    /* Proportional editing journals vertices which didn't move. */
+    if (equals_v3v3(co, co_base)) {
+      continue;
+    }
+    verts_index[verts_len] = index;
+    copy_v3_v3(verts_co_base[verts_len], co_base);
+    copy_v3_v3(verts_co[verts_len], co);
+    verts_len++;
+  }
+
+  /* When most of the mesh moved, a de-duplicated full copy is smaller. */
+  if (verts_len > bm->totvert / 4) {
+    MEM_freeN(verts_index);
+    MEM_freeN(verts_co_base);
+    MEM_freeN(verts_co);
+    return NULL;
+  }
+
+  UndoMeshDelta *delta = MEM_callocN(sizeof(*delta), __func__);
+  delta->um_base = um;
+  delta->state_id = ++um_journal.state_id_last;
+  delta->verts_index = verts_index;
+  delta->verts_co_base = verts_co_base;
+  delta->verts_co = verts_co;
+  delta->verts_len = verts_len;
+
+  um->users += 1;
+  BLI_addtail(&um->deltas, delta);
+
+  em->undo_state_id = delta->state_id;
+
+  return delta;
+}
+
+static void undomesh_delta_to_editmesh(UndoMeshDelta *delta,
+                                       Object *ob,
+                                       BMEditMesh *em,
+                                       Key *key)
+{
+  UndoMesh *um = delta->um_base;
+  UndoMeshDelta *delta_prev;
+
+  if ((undomesh_from_state_id(em->undo_state_id, &delta_prev) != um) ||
+      !undomesh_topology_matches(um, em->bm)) {
+    /* Not based on the same full copy, load it first. */
+    undomesh_to_editmesh(um, ob, em, key);
+    delta_prev = NULL;
+  }
+
+  BMesh *bm = em->bm;
+  BM_mesh_elem_table_ensure(bm, BM_VERT);
+
+  if (delta_prev) {
+    for (int i = 0; i < delta_prev->verts_len; i++) {
+      BMVert *v = BM_vert_at_index(bm, delta_prev->verts_index[i]);
+      copy_v3_v3(v->co, delta_prev->verts_co_base[i]);
+    }
+  }
+  for (int i = 0; i < delta->verts_len; i++) {
+    BMVert *v = BM_vert_at_index(bm, delta->verts_index[i]);
+    copy_v3_v3(v->co, delta->verts_co[i]);
+  }
+
+  em->selectmode = um->selectmode;
+  bm->selectmode = um->selectmode;
+  bm->spacearr_dirty = BM_SPACEARR_DIRTY_ALL;
+
+  EDBM_mesh_normals_update(em);
+  BKE_editmesh_looptri_calc(em);
+
+  MEM_SAFE_FREE(em->undo_journal);
+  em->undo_state_id = delta->state_id;
+}
+
+static void undomesh_delta_free(UndoMeshDelta *delta)
+{
+  UndoMesh *um = delta->um_base;
+
+  BLI_remlink(&um->deltas, delta);
+  MEM_freeN(delta->verts_index);
+  MEM_freeN(delta->verts_co_base);
+  MEM_freeN(delta->verts_co);
+  MEM_freeN(delta);
+
+  undomesh_user_remove(um);
+}
+
+/** Count the memory of the full copy in the newest step using it. */
+static void undomesh_size_step_set(UndoMesh *um, UndoStep *us)
+{
+  if (um->size_step) {
+    BLI_assert(um->size_step->data_size >= um->undo_size);
+    um->size_step->data_size -= um->undo_size;
+  }
+  if (us) {
+    us->data_size += um->undo_size;
+  }
+  um->size_step = us;
+}
+
+static size_t undomesh_delta_size(const UndoMeshDelta *delta)
+{
+  return sizeof(*delta) + (size_t)delta->verts_len * (sizeof(*delta->verts_index) +
+                                                       sizeof(*delta->verts_co_base) +
+                                                       sizeof(*delta->verts_co));
+}
+
+/** \} */
+
 /* -------------------------------------------------------------------- */
 /** \name Implements ED Undo System
  *
@@ -693,7 +1076,10 @@ static Object *editmesh_object_from_context(bContext *C)
 typedef struct MeshUndoStep_Elem {
   struct MeshUndoStep_Elem *next, *prev;
   UndoRefID_Object obedit_ref;
-  UndoMesh data;
+  /** Full copy of the mesh, shared with later steps storing changes to it. */
+  UndoMesh *um;
+  /** Changes to #um, NULL when #um is the state of this step. */
+  UndoMeshDelta *delta;
 } MeshUndoStep_Elem;
 
 typedef struct MeshUndoStep {
@@ -728,9 +1114,18 @@ static bool mesh_undosys_step_encode(struct bContext *C, struct Main *bmain, Und
     elem->obedit_ref.ptr = ob;
     Mesh *me = elem->obedit_ref.ptr->data;
     BMEditMesh *em = me->edit_mesh;
-    undomesh_from_editmesh(&elem->data, me->edit_mesh, me->key);
+    elem->delta = undomesh_delta_from_editmesh(em, me->key);
+    if (elem->delta) {
+      elem->um = elem->delta->um_base;
+      us->step.data_size += undomesh_delta_size(elem->delta);
+    }
+    else {
+      elem->um = MEM_callocN(sizeof(*elem->um), __func__);
+      undomesh_from_editmesh(elem->um, em, me->key);
+    }
+    undomesh_size_step_set(elem->um, &us->step);
+    MEM_SAFE_FREE(em->undo_journal);
     em->needs_flush_to_id = 1;
-    us->step.data_size += elem->data.undo_size;
   }
   MEM_freeN(objects);
 
@@ -763,7 +1158,12 @@ static void mesh_undosys_step_decode(
       continue;
     }
     BMEditMesh *em = me->edit_mesh;
-    undomesh_to_editmesh(&elem->data, obedit, em, me->key);
+    if (elem->delta) {
+      undomesh_delta_to_editmesh(elem->delta, obedit, em, me->key);
+    }
+    else {
+      undomesh_to_editmesh(elem->um, obedit, em, me->key);
+    }
     em->needs_flush_to_id = 1;
     DEG_id_tag_update(&obedit->id, ID_RECALC_GEOMETRY);
   }
@@ -773,20 +1173,46 @@ static void mesh_undosys_step_decode(
       CTX_data_view_layer(C), us->elems[0].obedit_ref.ptr, us_p->name, &LOG);
 
   Scene *scene = CTX_data_scene(C);
-  scene->toolsettings->selectmode = us->elems[0].data.selectmode;
+  scene->toolsettings->selectmode = us->elems[0].um->selectmode;
 
   bmain->is_memfile_undo_flush_needed = true;
 
   WM_event_add_notifier(C, NC_GEOM | ND_DATA, NULL);
 }
 
+/** The newest step before \a us_p using \a um, NULL when there is none. */
+static UndoStep *mesh_undosys_step_find_prev_user(UndoStep *us_p, const UndoMesh *um)
+{
+  for (UndoStep *us_iter = us_p->prev; us_iter; us_iter = us_iter->prev) {
+    if (us_iter->type != us_p->type) {
+      continue;
+    }
+    MeshUndoStep *us = (MeshUndoStep *)us_iter;
+    for (uint i = 0; i < us->elems_len; i++) {
+      if (us->elems[i].um == um) {
+        return us_iter;
+      }
+    }
+  }
+  return NULL;
+}
+
 static void mesh_undosys_step_free(UndoStep *us_p)
 {
   MeshUndoStep *us = (MeshUndoStep *)us_p;
 
   for (uint i = 0; i < us->elems_len; i++) {
     MeshUndoStep_Elem *elem = &us->elems[i];
-    undomesh_free_data(&elem->data);
+    if (elem->um->size_step == us_p) {
+      /* Newer steps were freed (after undo), count the mesh in the newest step left using it. */
+      undomesh_size_step_set(elem->um, mesh_undosys_step_find_prev_user(us_p, elem->um));
+    }
+    if (elem->delta) {
+      undomesh_delta_free(elem->delta);
+    }
+    else {
+      undomesh_user_remove(elem->um);
+    }
   }
   MEM_freeN(us->elems);
 }
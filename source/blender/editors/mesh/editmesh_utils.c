@@ -1453,6 +1453,10 @@ void EDBM_update_generic(Mesh *mesh, const bool do_tessellation, const bool is_d
   /* don't keep stale derivedMesh data around, see: [#38872] */
   BKE_editmesh_free_derivedmesh(em);
 
+  /* The changes aren't journaled, the next undo push needs a full copy. */
+  em->undo_state_id = 0;
+  MEM_SAFE_FREE(em->undo_journal);
+
 #ifdef DEBUG
   {
     BMEditSelection *ese;
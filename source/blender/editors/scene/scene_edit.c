@@ -45,6 +45,8 @@
 #include "ED_screen.h"
 #include "ED_util.h"
 
+#include "RE_pipeline.h"
+
 #include "RNA_access.h"
 #include "RNA_define.h"
 
@@ -182,6 +184,8 @@ bool ED_scene_view_layer_delete(Main *bmain, Scene *scene, ViewLayer *layer, Rep
     }
   }
 
+  RE_FreePersistentDataForScene(scene, layer);
+
   BKE_view_layer_free(layer);
 
   DEG_id_tag_update(&scene->id, 0);
@@ -36,6 +36,7 @@
 #include "DNA_mesh_types.h"
 #include "DNA_movieclip_types.h"
 #include "DNA_scene_types.h" /* PET modes */
+#include "DNA_windowmanager_types.h"
 #include "DNA_workspace_types.h"
 #include "DNA_gpencil_types.h"
 
@@ -2075,6 +2076,13 @@ bool initTransform(bContext *C, TransInfo *t, wmOperator *op, const wmEvent *eve
     }
   }
 
+  /* Only when called directly, not from a macro or a script,
+   * the undo push which follows then stores exactly the changes made here. */
+  if ((op->opm == NULL) && (op->type->flag & OPTYPE_UNDO) &&
+      (CTX_wm_manager(C)->op_undo_depth == 1)) {
+    options |= CTX_UNDO_JOURNAL;
+  }
+
   t->options = options;
 
   t->mode = mode;
@@ -424,6 +424,8 @@ typedef struct TransDataMirror {
   const float *loc_src;
   /** Location of the data to transform. */
   float *loc_dst;
+  /** Initial location of the data to transform. */
+  float iloc[3];
   void *extra;
   /* `sign` can be -2, -1, 0 or 1. */
   int sign_x : 2;
@@ -1777,8 +1777,71 @@ static void special_aftertrans_update__node(bContext *C, TransInfo *t)
   }
 }
 
+/**
+ * Store the initial vertex locations in the edit-mesh undo journal,
+ * so the undo push which follows only stores the vertices which were transformed.
+ */
+static void special_aftertrans_update__mesh_undo_journal(TransInfo *t)
+{
+  if ((t->options & CTX_UNDO_JOURNAL) == 0) {
+    return;
+  }
+
+  /* Only vertex locations are journaled, modes changing other data need a full undo step. */
+  if (!ELEM(t->mode,
+            TFM_TRANSLATION,
+            TFM_ROTATION,
+            TFM_RESIZE,
+            TFM_TOSPHERE,
+            TFM_SHEAR,
+            TFM_BEND,
+            TFM_SHRINKFATTEN,
+            TFM_TRACKBALL,
+            TFM_PUSHPULL,
+            TFM_MIRROR,
+            TFM_ALIGN,
+            TFM_EDGE_SLIDE,
+            TFM_VERT_SLIDE)) {
+    return;
+  }
+
+  /* Auto-merge changes topology and selection. */
+  if (t->scene->toolsettings->automerge || (t->flag & T_CLNOR_REBUILD)) {
+    return;
+  }
+
+  FOREACH_TRANS_DATA_CONTAINER (t, tc) {
+    /* Face attribute correction changes loop data too. */
+    if (tc->custom.type.data != NULL) {
+      continue;
+    }
+
+    BMEditMesh *em = BKE_editmesh_from_object(tc->obedit);
+    BMEditMeshJournal *journal = EDBM_undo_journal_begin(em, tc->data_len + tc->mirror.data_len);
+    if (journal == NULL) {
+      continue;
+    }
+
+    TransData *td = tc->data;
+    for (int i = 0; i < tc->data_len; i++, td++) {
+      BMEditMeshJournalVert *jv = &journal->verts[journal->verts_len++];
+      jv->index = BM_elem_index_get((BMVert *)td->extra);
+      copy_v3_v3(jv->co, td->iloc);
+    }
+
+    TransDataMirror *tdm = tc->mirror.data;
+    for (int i = 0; i < tc->mirror.data_len; i++, tdm++) {
+      BMEditMeshJournalVert *jv = &journal->verts[journal->verts_len++];
+      jv->index = BM_elem_index_get((BMVert *)tdm->extra);
+      copy_v3_v3(jv->co, tdm->iloc);
+    }
+  }
+}
+
 static void special_aftertrans_update__mesh(bContext *UNUSED(C), TransInfo *t)
 {
+  special_aftertrans_update__mesh_undo_journal(t);
+
   /* so automerge supports mirror */
   if ((t->scene->toolsettings->automerge) && ((t->flag & T_EDIT) && t->obedit_type == OB_MESH)) {
     FOREACH_TRANS_DATA_CONTAINER (t, tc) {
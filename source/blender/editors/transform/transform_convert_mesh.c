@@ -539,6 +539,7 @@ static TransDataMirror *editmesh_mirror_data_calc(BMEditMesh *em,
 
         mirror_data_iter->loc_src = v_src->co;
         mirror_data_iter->loc_dst = eve->co;
+        copy_v3_v3(mirror_data_iter->iloc, eve->co);
         mirror_data_iter->sign_x = index[0] && index[0][i] == -2 ? -1 : 1;
         mirror_data_iter->sign_y = index[1] && index[1][i] == -2 ? -1 : 1;
         mirror_data_iter->sign_z = index[2] && index[2][i] == -2 ? -1 : 1;
@@ -20,6 +20,8 @@
  * Wrapper between 'ED_undo.h' and 'BKE_undo_system.h' API's.
  */
 
+#include "CLG_log.h"
+
 #include "BLI_utildefines.h"
 #include "BLI_sys_types.h"
 
@@ -41,6 +43,8 @@
 
 #include "undo_intern.h"
 
+static CLG_LogRef LOG = {"ed.undo.memfile"};
+
 /* -------------------------------------------------------------------- */
 /** \name Implements ED Undo System
  * \{ */
@@ -85,6 +89,13 @@ static bool memfile_undosys_step_encode(struct bContext *UNUSED(C),
   us->data = BKE_memfile_undo_encode(bmain, us_prev ? us_prev->data : NULL);
   us->step.data_size = us->data->undo_size;
 
+  CLOG_INFO(&LOG,
+            1,
+            "name='%s', new data=%zu bytes, total data=%zu bytes",
+            us->step.name,
+            us->data->memfile.size,
+            us->data->memfile.size_total);
+
   return true;
 }
 
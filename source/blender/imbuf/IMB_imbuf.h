@@ -446,6 +446,24 @@ bool IMB_scaleImBuf(struct ImBuf *ibuf, unsigned int newx, unsigned int newy);
  */
 bool IMB_scalefastImBuf(struct ImBuf *ibuf, unsigned int newx, unsigned int newy);
 
+typedef enum eIMBScaleFilter {
+  /** Average of the covered pixels, nearest neighbor when enlarging. */
+  IMB_SCALE_FILTER_BOX = 0,
+  /** Linear interpolation, a tent filter when shrinking. */
+  IMB_SCALE_FILTER_BILINEAR = 1,
+  /** Sharpest, may cause ringing around high contrast edges. */
+  IMB_SCALE_FILTER_LANCZOS = 2,
+} eIMBScaleFilter;
+
+/**
+ *
+ * \attention Defined in scaling.c
+ */
+bool IMB_scaleImBuf_filter(struct ImBuf *ibuf,
+                           unsigned int newx,
+                           unsigned int newy,
+                           eIMBScaleFilter filter);
+
 /**
  *
  * \attention Defined in scaling.c
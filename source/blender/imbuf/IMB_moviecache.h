@@ -40,6 +40,16 @@ typedef void *(*MovieCacheGetPriorityDataFP)(void *userkey);
 typedef int (*MovieCacheGetItemPriorityFP)(void *last_userkey, void *priority_data);
 typedef void (*MovieCachePriorityDeleterFP)(void *priority_data);
 
+/* Counters since the cache was created, for tuning cache sizes and priorities. */
+typedef struct MovieCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  /* Items freed to stay below the memory limit. */
+  uint64_t evictions;
+  size_t mem_in_use;
+  int items_len;
+} MovieCacheStats;
+
 void IMB_moviecache_init(void);
 void IMB_moviecache_destruct(void);
 
@@ -70,6 +80,8 @@ void IMB_moviecache_cleanup(struct MovieCache *cache,
 void IMB_moviecache_get_cache_segments(
     struct MovieCache *cache, int proxy, int render_flags, int *totseg_r, int **points_r);
 
+void IMB_moviecache_get_stats(struct MovieCache *cache, MovieCacheStats *r_stats);
+
 struct MovieCacheIter;
 struct MovieCacheIter *IMB_moviecacheIter_new(struct MovieCache *cache);
 void IMB_moviecacheIter_free(struct MovieCacheIter *iter);
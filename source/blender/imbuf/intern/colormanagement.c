@@ -43,6 +43,7 @@
 #include "MEM_guardedalloc.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_hash_mm2a.h"
 #include "BLI_math.h"
 #include "BLI_math_color.h"
 #include "BLI_string.h"
@@ -60,6 +61,10 @@
 
 #include <ocio_capi.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /*********************** Global declarations *************************/
 
 #define DISPLAY_BUFFER_CHANNELS 4
@@ -101,6 +106,9 @@ typedef struct ColormanageProcessor {
   OCIO_ConstProcessorRcPtr *processor;
   CurveMapping *curve_mapping;
   bool is_data_result;
+  /* Baked display transform, used instead of the processor and curve mapping when set,
+   * see #display_lut_acquire. */
+  struct DisplayLUT *display_lut;
 } ColormanageProcessor;
 
 static struct global_glsl_state {
@@ -455,6 +463,74 @@ static void colormanage_cache_handle_release(void *cache_handle)
   IMB_freeImBuf(cache_ibuf);
 }
 
+/* Applying the OCIO processor and curve mapping for every pixel is slow for large images.
+ * Display buffers can use the transform baked into a 3D LUT instead, which is only accurate
+ * enough for 8 bit output. The input goes through a 1D shaper first:
+ *
+ * - Float buffers use a logarithmic shaper covering a high dynamic range, with a polynomial
+ *   approximation of the logarithm which is cheap to evaluate with SIMD.
+ * - Byte buffers are in [0, 1] already, the LUT is baked from their color space directly,
+ *   which avoids the conversion to scene linear.
+ *
+ * Baked LUTs are cached by their settings, so only changing the settings bakes a new one.
+ */
+
+#define DISPLAY_LUT_SIZE 65
+/* Range of the logarithmic shaper, values outside of it are clamped. */
+#define DISPLAY_LUT_LOG_MIN (1.0f / 16384.0f)
+#define DISPLAY_LUT_LOG_MAX 256.0f
+/* Baking uses as many processor evaluations as applying it to an image of this size. */
+#define DISPLAY_LUT_MIN_PIXELS (DISPLAY_LUT_SIZE * DISPLAY_LUT_SIZE * DISPLAY_LUT_SIZE)
+#define DISPLAY_LUT_CACHE_MAX 3
+
+typedef struct DisplayLUTKey {
+  char look[MAX_COLORSPACE_NAME];
+  char view[MAX_COLORSPACE_NAME];
+  char display[MAX_COLORSPACE_NAME];
+  char from_colorspace[MAX_COLORSPACE_NAME];
+  float exposure;
+  float gamma;
+  /* Same as display buffer cache, curve mapping is identified by its time stamp. */
+  const CurveMapping *curve_mapping;
+  int curve_mapping_timestamp;
+  bool use_log_shaper;
+} DisplayLUTKey;
+
+typedef struct DisplayLUT {
+  struct DisplayLUT *next, *prev;
+
+  DisplayLUTKey key;
+  unsigned int hash;
+  /* Number of processors using the LUT, it's freed when unused and not cached anymore. */
+  int users;
+  bool is_cached;
+
+  bool use_log_shaper;
+  /* RGB and padding for every entry, red changing fastest. */
+  float (*table)[4];
+} DisplayLUT;
+
+/* Cached LUTs, most recently used first. */
+static ListBase global_display_luts = {NULL, NULL};
+static ThreadMutex display_lut_lock = BLI_MUTEX_INITIALIZER;
+
+static void display_lut_free(DisplayLUT *lut)
+{
+  MEM_freeN(lut->table);
+  MEM_freeN(lut);
+}
+
+static void display_lut_free_all(void)
+{
+  DisplayLUT *lut, *lut_next;
+  for (lut = global_display_luts.first; lut; lut = lut_next) {
+    lut_next = lut->next;
+    BLI_assert(lut->users == 0);
+    display_lut_free(lut);
+  }
+  BLI_listbase_clear(&global_display_luts);
+}
+
 /*********************** Initialization / De-initialization *************************/
 
 static void colormanage_role_color_space_name_get(OCIO_ConstConfigRcPtr *config,
@@ -742,6 +818,8 @@ void colormanagement_exit(void)
   memset(&global_glsl_state, 0, sizeof(global_glsl_state));
   memset(&global_color_picking_state, 0, sizeof(global_color_picking_state));
 
+  display_lut_free_all();
+
   colormanage_free_config();
 }
 
@@ -1403,6 +1481,294 @@ bool IMB_colormanagement_space_name_is_data(const char *name)
   return (colorspace && colorspace->is_data);
 }
 
+/*********************** Baked display transforms *************************/
+
+/* Coefficients of the cubic used for the logarithm of the mantissa in [1, 2), with the
+ * derivative of log2 at 1 and half of that at 2, so the shaper is smooth across octaves. */
+#define LOG2_C1 1.442695f
+#define LOG2_C2 (3.0f - 2.5f * LOG2_C1)
+#define LOG2_C3 (1.5f * LOG2_C1 - 2.0f)
+
+BLI_INLINE float display_lut_log2_mantissa(float t)
+{
+  return t * (LOG2_C1 + t * (LOG2_C2 + t * LOG2_C3));
+}
+
+/* Approximation of log2 for positive normalized floats. */
+BLI_INLINE float display_lut_log2(float value)
+{
+  union {
+    float f;
+    int i;
+  } u;
+  u.f = value;
+  const int exponent = (u.i >> 23) - 127;
+  u.i = (u.i & 0x007FFFFF) | 0x3F800000;
+  return (float)exponent + display_lut_log2_mantissa(u.f - 1.0f);
+}
+
+/* Inverse of the shaper, the input value of an entry of the LUT. */
+static float display_lut_shaper_inverse(bool use_log_shaper, float t)
+{
+  if (use_log_shaper) {
+    const float log_min = log2f(DISPLAY_LUT_LOG_MIN), log_max = log2f(DISPLAY_LUT_LOG_MAX);
+    const float log_value = log_min + t * (log_max - log_min);
+    const float exponent = floorf(log_value);
+    const float frac = log_value - exponent;
+
+    /* The cubic is monotonic, bisect for the mantissa. */
+    float low = 0.0f, high = 1.0f;
+    for (int i = 0; i < 32; i++) {
+      const float mid = 0.5f * (low + high);
+      if (display_lut_log2_mantissa(mid) < frac) {
+        low = mid;
+      }
+      else {
+        high = mid;
+      }
+    }
+    return ldexpf(1.0f + 0.5f * (low + high), (int)exponent);
+  }
+  return t;
+}
+
+static void display_lut_bake(DisplayLUT *lut,
+                             const ColorManagedViewSettings *view_settings,
+                             const ColorManagedDisplaySettings *display_settings)
+{
+  const int size = DISPLAY_LUT_SIZE;
+  const int size_sq = size * size;
+  /* Aligned for SIMD loads. */
+  float(*table)[4] = MEM_mallocN_aligned(sizeof(*table) * size_sq * size, 16, "display LUT");
+  float shaper_inverse[DISPLAY_LUT_SIZE];
+
+  for (int i = 0; i < size; i++) {
+    shaper_inverse[i] = display_lut_shaper_inverse(lut->use_log_shaper,
+                                                   (float)i / (float)(size - 1));
+  }
+
+  for (int b = 0; b < size; b++) {
+    for (int g = 0; g < size; g++) {
+      for (int r = 0; r < size; r++) {
+        float *entry = table[b * size_sq + g * size + r];
+        entry[0] = shaper_inverse[r];
+        entry[1] = shaper_inverse[g];
+        entry[2] = shaper_inverse[b];
+        entry[3] = 1.0f;
+      }
+    }
+  }
+
+  if (!STREQ(lut->key.from_colorspace, global_role_scene_linear)) {
+    IMB_colormanagement_transform(&table[0][0],
+                                  size_sq,
+                                  size,
+                                  4,
+                                  lut->key.from_colorspace,
+                                  global_role_scene_linear,
+                                  false);
+  }
+
+  ColormanageProcessor *cm_processor = IMB_colormanagement_display_processor_new(
+      view_settings, display_settings);
+  IMB_colormanagement_processor_apply(cm_processor, &table[0][0], size_sq, size, 4, false);
+  IMB_colormanagement_processor_free(cm_processor);
+
+  lut->table = table;
+}
+
+/**
+ * Get the LUT for the display transform of \a view_settings, for input in \a from_colorspace.
+ * Returns NULL when it would be faster to apply the processor to \a pixels_num pixels.
+ */
+static DisplayLUT *display_lut_acquire(const ColorManagedViewSettings *view_settings,
+                                       const ColorManagedDisplaySettings *display_settings,
+                                       const char *from_colorspace,
+                                       bool use_log_shaper,
+                                       size_t pixels_num)
+{
+  DisplayLUTKey key;
+  memset(&key, 0, sizeof(key));
+  STRNCPY(key.look, view_settings->look);
+  STRNCPY(key.view, view_settings->view_transform);
+  STRNCPY(key.display, display_settings->display_device);
+  STRNCPY(key.from_colorspace, from_colorspace);
+  key.exposure = view_settings->exposure;
+  key.gamma = view_settings->gamma;
+  if (view_settings->flag & COLORMANAGE_VIEW_USE_CURVES) {
+    key.curve_mapping = view_settings->curve_mapping;
+    key.curve_mapping_timestamp = view_settings->curve_mapping->changed_timestamp;
+  }
+  key.use_log_shaper = use_log_shaper;
+
+  const unsigned int hash = BLI_hash_mm2((const unsigned char *)&key, sizeof(key), 0);
+
+  BLI_mutex_lock(&display_lut_lock);
+
+  DisplayLUT *lut;
+  for (lut = global_display_luts.first; lut; lut = lut->next) {
+    if (lut->hash == hash && memcmp(&lut->key, &key, sizeof(key)) == 0) {
+      break;
+    }
+  }
+
+  if (lut) {
+    BLI_remlink(&global_display_luts, lut);
+  }
+  else if (pixels_num >= DISPLAY_LUT_MIN_PIXELS) {
+    lut = MEM_callocN(sizeof(*lut), "DisplayLUT");
+    lut->key = key;
+    lut->hash = hash;
+    lut->use_log_shaper = use_log_shaper;
+    lut->is_cached = true;
+    display_lut_bake(lut, view_settings, display_settings);
+
+    if (BLI_listbase_count_at_most(&global_display_luts, DISPLAY_LUT_CACHE_MAX) ==
+        DISPLAY_LUT_CACHE_MAX) {
+      DisplayLUT *lut_last = global_display_luts.last;
+      BLI_remlink(&global_display_luts, lut_last);
+      lut_last->is_cached = false;
+      if (lut_last->users == 0) {
+        display_lut_free(lut_last);
+      }
+    }
+  }
+
+  if (lut) {
+    BLI_addhead(&global_display_luts, lut);
+    lut->users++;
+  }
+
+  BLI_mutex_unlock(&display_lut_lock);
+
+  return lut;
+}
+
+static void display_lut_release(DisplayLUT *lut)
+{
+  BLI_mutex_lock(&display_lut_lock);
+  lut->users--;
+  if (lut->users == 0 && !lut->is_cached) {
+    display_lut_free(lut);
+  }
+  BLI_mutex_unlock(&display_lut_lock);
+}
+
+/* Apply the LUT to straight alpha RGB. */
+BLI_INLINE void display_lut_apply_rgb(const DisplayLUT *lut, float rgb[3])
+{
+  const int size = DISPLAY_LUT_SIZE;
+  const float max_index = (float)(size - 1);
+
+#ifdef __SSE2__
+  __m128 shaped;
+  if (lut->use_log_shaper) {
+    /* Same as #display_lut_log2. */
+    const float log_min = log2f(DISPLAY_LUT_LOG_MIN), log_max = log2f(DISPLAY_LUT_LOG_MAX);
+    const __m128 value = _mm_max_ps(_mm_set_ps(1.0f, rgb[2], rgb[1], rgb[0]),
+                                    _mm_set1_ps(DISPLAY_LUT_LOG_MIN));
+    const __m128i bits = _mm_castps_si128(value);
+    const __m128 exponent = _mm_cvtepi32_ps(
+        _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    const __m128 t = _mm_sub_ps(
+        _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                                      _mm_set1_epi32(0x3F800000))),
+        _mm_set1_ps(1.0f));
+    __m128 log_value = _mm_add_ps(_mm_set1_ps(LOG2_C2), _mm_mul_ps(t, _mm_set1_ps(LOG2_C3)));
+    log_value = _mm_add_ps(_mm_set1_ps(LOG2_C1), _mm_mul_ps(t, log_value));
+    log_value = _mm_add_ps(exponent, _mm_mul_ps(t, log_value));
+    shaped = _mm_mul_ps(_mm_sub_ps(log_value, _mm_set1_ps(log_min)),
+                        _mm_set1_ps(max_index / (log_max - log_min)));
+  }
+  else {
+    shaped = _mm_mul_ps(_mm_set_ps(0.0f, rgb[2], rgb[1], rgb[0]), _mm_set1_ps(max_index));
+  }
+  shaped = _mm_min_ps(_mm_max_ps(shaped, _mm_setzero_ps()), _mm_set1_ps(max_index));
+
+  /* Clamp the cell so its upper corner is inside of the table. */
+  const __m128 index_f = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(shaped)),
+                                    _mm_set1_ps((float)(size - 2)));
+  const __m128i index_v = _mm_cvttps_epi32(index_f);
+  const __m128 fac = _mm_sub_ps(shaped, index_f);
+  int index[4];
+  _mm_storeu_si128((__m128i *)index, index_v);
+
+  const float(*cell)[4] = &lut->table[(index[2] * size + index[1]) * size + index[0]];
+  const int g_step = size, b_step = size * size;
+  const __m128 fac_r = _mm_shuffle_ps(fac, fac, _MM_SHUFFLE(0, 0, 0, 0));
+  const __m128 fac_g = _mm_shuffle_ps(fac, fac, _MM_SHUFFLE(1, 1, 1, 1));
+  const __m128 fac_b = _mm_shuffle_ps(fac, fac, _MM_SHUFFLE(2, 2, 2, 2));
+
+#  define LERP_PS(a, b, f) _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f))
+  const __m128 c00 = LERP_PS(_mm_load_ps(cell[0]), _mm_load_ps(cell[1]), fac_r);
+  const __m128 c10 = LERP_PS(_mm_load_ps(cell[g_step]), _mm_load_ps(cell[g_step + 1]), fac_r);
+  const __m128 c01 = LERP_PS(_mm_load_ps(cell[b_step]), _mm_load_ps(cell[b_step + 1]), fac_r);
+  const __m128 c11 = LERP_PS(
+      _mm_load_ps(cell[b_step + g_step]), _mm_load_ps(cell[b_step + g_step + 1]), fac_r);
+  const __m128 c0 = LERP_PS(c00, c10, fac_g);
+  const __m128 c1 = LERP_PS(c01, c11, fac_g);
+  float result[4];
+  _mm_storeu_ps(result, LERP_PS(c0, c1, fac_b));
+#  undef LERP_PS
+
+  copy_v3_v3(rgb, result);
+#else
+  float shaped[3];
+  int index[3];
+  float fac[3];
+
+  for (int i = 0; i < 3; i++) {
+    if (lut->use_log_shaper) {
+      const float log_min = log2f(DISPLAY_LUT_LOG_MIN), log_max = log2f(DISPLAY_LUT_LOG_MAX);
+      shaped[i] = (display_lut_log2(max_ff(rgb[i], DISPLAY_LUT_LOG_MIN)) - log_min) *
+                  (max_index / (log_max - log_min));
+    }
+    else {
+      shaped[i] = rgb[i] * max_index;
+    }
+    shaped[i] = clamp_f(shaped[i], 0.0f, max_index);
+    index[i] = min_ii((int)shaped[i], size - 2);
+    fac[i] = shaped[i] - (float)index[i];
+  }
+
+  const float(*cell)[4] = &lut->table[(index[2] * size + index[1]) * size + index[0]];
+  const int g_step = size, b_step = size * size;
+
+  for (int i = 0; i < 3; i++) {
+    const float c00 = interpf(cell[1][i], cell[0][i], fac[0]);
+    const float c10 = interpf(cell[g_step + 1][i], cell[g_step][i], fac[0]);
+    const float c01 = interpf(cell[b_step + 1][i], cell[b_step][i], fac[0]);
+    const float c11 = interpf(cell[b_step + g_step + 1][i], cell[b_step + g_step][i], fac[0]);
+    rgb[i] = interpf(interpf(c11, c01, fac[1]), interpf(c10, c00, fac[1]), fac[2]);
+  }
+#endif
+}
+
+BLI_INLINE void display_lut_apply_pixel(const DisplayLUT *lut,
+                                        float *pixel,
+                                        int channels,
+                                        bool predivide)
+{
+  if (channels == 4 && predivide && pixel[3] != 1.0f && pixel[3] != 0.0f) {
+    const float alpha = pixel[3];
+    mul_v3_fl(pixel, 1.0f / alpha);
+    display_lut_apply_rgb(lut, pixel);
+    mul_v3_fl(pixel, alpha);
+  }
+  else {
+    display_lut_apply_rgb(lut, pixel);
+  }
+}
+
+static void display_lut_apply(
+    const DisplayLUT *lut, float *buffer, size_t pixels_num, int channels, bool predivide)
+{
+  BLI_assert(ELEM(channels, 3, 4));
+  for (size_t i = 0; i < pixels_num; i++, buffer += channels) {
+    display_lut_apply_pixel(lut, buffer, channels, predivide);
+  }
+}
+
 /*********************** Threaded display buffer transform routines *************************/
 
 typedef struct DisplayBufferThread {
@@ -1505,6 +1871,8 @@ static void display_buffer_apply_get_linear_buffer(DisplayBufferThread *handle,
   bool is_data = handle->is_data;
   bool is_data_display = handle->cm_processor->is_data_result;
   bool predivide = handle->predivide;
+  /* The LUT is baked from the buffer's color space. */
+  bool use_display_lut = handle->cm_processor->display_lut != NULL;
 
   if (!handle->buffer) {
     unsigned char *byte_buffer = handle->byte_buffer;
@@ -1531,7 +1899,7 @@ static void display_buffer_apply_get_linear_buffer(DisplayBufferThread *handle,
       }
     }
 
-    if (!is_data && !is_data_display) {
+    if (!is_data && !is_data_display && !use_display_lut) {
       /* convert float buffer to scene linear space */
       IMB_colormanagement_transform(
           linear_buffer, width, height, channels, from_colorspace, to_colorspace, false);
@@ -1551,7 +1919,7 @@ static void display_buffer_apply_get_linear_buffer(DisplayBufferThread *handle,
 
     memcpy(linear_buffer, handle->buffer, buffer_size * sizeof(float));
 
-    if (!is_data && !is_data_display) {
+    if (!is_data && !is_data_display && !use_display_lut) {
       IMB_colormanagement_transform(
           linear_buffer, width, height, channels, from_colorspace, to_colorspace, predivide);
     }
@@ -1622,6 +1990,10 @@ static void *do_display_buffer_apply_thread(void *handle_v)
        * only generate byte buffers
        */
     }
+    else if (cm_processor->display_lut) {
+      display_lut_apply(
+          cm_processor->display_lut, linear_buffer, (size_t)width * height, channels, predivide);
+    }
     else {
       /* apply processor */
       IMB_colormanagement_processor_apply(
@@ -1748,6 +2120,26 @@ static void colormanage_display_buffer_process_ex(
 
   if (skip_transform == false) {
     cm_processor = IMB_colormanagement_display_processor_new(view_settings, display_settings);
+
+    /* The LUT is only accurate enough for byte display buffers. */
+    if (display_buffer == NULL && view_settings != NULL && ELEM(ibuf->channels, 3, 4) &&
+        (ibuf->colormanage_flag & IMB_COLORMANAGE_IS_DATA) == 0 &&
+        !cm_processor->is_data_result) {
+      const char *from_colorspace;
+      if (ibuf->rect_float == NULL) {
+        from_colorspace = ibuf->rect_colorspace ? ibuf->rect_colorspace->name :
+                                                  global_role_default_byte;
+      }
+      else {
+        from_colorspace = ibuf->float_colorspace ? ibuf->float_colorspace->name :
+                                                   global_role_scene_linear;
+      }
+      cm_processor->display_lut = display_lut_acquire(view_settings,
+                                                      display_settings,
+                                                      from_colorspace,
+                                                      ibuf->rect_float != NULL,
+                                                      (size_t)ibuf->x * ibuf->y);
+    }
   }
 
   display_buffer_apply_threaded(ibuf,
@@ -3398,7 +3790,13 @@ static void partial_buffer_update_rect(ImBuf *ibuf,
           straight_to_premul_v4(pixel);
         }
 
-        if (!is_data) {
+        if (is_data) {
+          /* pass */
+        }
+        else if (cm_processor->display_lut && channels != 1) {
+          display_lut_apply_pixel(cm_processor->display_lut, pixel, channels, true);
+        }
+        else {
           IMB_colormanagement_processor_apply_pixel(cm_processor, pixel, channels);
         }
 
@@ -3579,6 +3977,15 @@ static void imb_partial_display_buffer_update_ex(
 
     if (!skip_transform) {
       cm_processor = IMB_colormanagement_display_processor_new(view_settings, display_settings);
+
+      /* Pixels are converted to scene linear first, also from the byte buffer. */
+      if (view_settings != NULL && !cm_processor->is_data_result) {
+        cm_processor->display_lut = display_lut_acquire(view_settings,
+                                                        display_settings,
+                                                        global_role_scene_linear,
+                                                        true,
+                                                        (size_t)(xmax - xmin) * (ymax - ymin));
+      }
     }
 
     if (do_threads) {
@@ -3869,6 +4276,9 @@ void IMB_colormanagement_processor_apply_byte(
 
 void IMB_colormanagement_processor_free(ColormanageProcessor *cm_processor)
 {
+  if (cm_processor->display_lut) {
+    display_lut_release(cm_processor->display_lut);
+  }
   if (cm_processor->curve_mapping) {
     BKE_curvemapping_free(cm_processor->curve_mapping);
   }
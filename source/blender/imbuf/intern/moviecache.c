@@ -32,6 +32,8 @@
 #include "BLI_string.h"
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_hash.h"
+#include "BLI_listbase.h"
 #include "BLI_mempool.h"
 #include "BLI_threads.h"
 
@@ -40,6 +42,8 @@
 #include "IMB_imbuf_types.h"
 #include "IMB_imbuf.h"
 
+#include "atomic_ops.h"
+
 #ifdef DEBUG_MESSAGES
 #  if defined __GNUC__
 #    define PRINT(format, args...) printf(format, ##args)
@@ -50,13 +54,36 @@
 #  define PRINT(format, ...)
 #endif
 
-static MEM_CacheLimiterC *limitor = NULL;
-static pthread_mutex_t limitor_lock = BLI_MUTEX_INITIALIZER;
+/* Every cache is split in shards with their own lock, so threads reading or writing different
+ * frames don't wait for each other. */
+#define MOVIECACHE_SHARDS 16
+
+/* Candidates compared when evicting from a cache with item priorities, the lowest priority one
+ * is freed. */
+#define MOVIECACHE_PRIORITY_SAMPLES 8
+
+struct MovieCacheItem;
+
+typedef struct MovieCacheShard {
+  ThreadRWMutex lock;
+
+  GHash *hash;
+
+  struct BLI_mempool *keys_pool;
+  struct BLI_mempool *items_pool;
+  struct BLI_mempool *userkeys_pool;
+
+  /* Items in the order they were added, swept by the CLOCK hand when evicting. */
+  ListBase items;
+  struct MovieCacheItem *clock_hand;
+} MovieCacheShard;
 
 typedef struct MovieCache {
+  struct MovieCache *next, *prev;
+
   char name[64];
 
-  GHash *hash;
+  MovieCacheShard shards[MOVIECACHE_SHARDS];
   GHashHashFP hashfp;
   GHashCmpFP cmpfp;
   MovieCacheGetKeyDataFP getdatafp;
@@ -65,16 +92,21 @@ typedef struct MovieCache {
   MovieCacheGetItemPriorityFP getitempriorityfp;
   MovieCachePriorityDeleterFP prioritydeleterfp;
 
-  struct BLI_mempool *keys_pool;
-  struct BLI_mempool *items_pool;
-  struct BLI_mempool *userkeys_pool;
-
   int keysize;
 
+  SpinLock last_userkey_lock;
   void *last_userkey;
 
+  /* Shard to evict from next, only used with #limitor_lock held. */
+  int clock_shard;
+
+  size_t mem_in_use;
+  uint64_t hits, misses, evictions;
+
+  /* Set from any thread when cached frames change, the segments are only freed by
+   * #IMB_moviecache_get_cache_segments so they stay valid for drawing. */
+  int segments_dirty;
   int totseg, *points, proxy, render_flags; /* for visual statistics optimization */
-  int pad;
 } MovieCache;
 
 typedef struct MovieCacheKey {
@@ -83,12 +115,26 @@ typedef struct MovieCacheKey {
 } MovieCacheKey;
 
 typedef struct MovieCacheItem {
+  struct MovieCacheItem *next, *prev;
   MovieCache *cache_owner;
+  MovieCacheShard *shard;
+  MovieCacheKey *key;
   ImBuf *ibuf;
-  MEM_CacheLimiterHandleC *c_handle;
   void *priority_data;
+  size_t mem_size;
+  /* Set when the item is read, cleared by the CLOCK hand which skips it once. */
+  char referenced;
 } MovieCacheItem;
 
+/* All caches, swept in turns when memory use is above the limit. The lock protects the list
+ * and is held by the only thread evicting items at a time. */
+static ListBase caches = {NULL, NULL};
+static MovieCache *clock_cache = NULL;
+static pthread_mutex_t limitor_lock = BLI_MUTEX_INITIALIZER;
+
+/* Memory used by the items of all caches. */
+static size_t mem_in_use = 0;
+
 static unsigned int moviecache_hashhash(const void *keyv)
 {
   const MovieCacheKey *key = keyv;
@@ -104,160 +150,243 @@ static bool moviecache_hashcmp(const void *av, const void *bv)
   return a->cache_owner->cmpfp(a->userkey, b->userkey);
 }
 
+static MovieCacheShard *moviecache_shard_get(MovieCache *cache, const void *userkey)
+{
+  /* Frame numbers hash to themselves, mix the bits so consecutive frames spread over shards. */
+  const unsigned int hash = BLI_hash_int(cache->hashfp(userkey));
+
+  return &cache->shards[hash % MOVIECACHE_SHARDS];
+}
+
+static void moviecache_segments_invalidate(MovieCache *cache)
+{
+  atomic_fetch_and_or_int32(&cache->segments_dirty, 1);
+}
+
 static void moviecache_keyfree(void *val)
 {
   MovieCacheKey *key = val;
+  MovieCacheShard *shard = moviecache_shard_get(key->cache_owner, key->userkey);
 
-  BLI_mempool_free(key->cache_owner->userkeys_pool, key->userkey);
+  BLI_mempool_free(shard->userkeys_pool, key->userkey);
 
-  BLI_mempool_free(key->cache_owner->keys_pool, key);
+  BLI_mempool_free(shard->keys_pool, key);
 }
 
 static void moviecache_valfree(void *val)
 {
   MovieCacheItem *item = (MovieCacheItem *)val;
   MovieCache *cache = item->cache_owner;
+  MovieCacheShard *shard = item->shard;
 
   PRINT("%s: cache '%s' free item %p buffer %p\n", __func__, cache->name, item, item->ibuf);
 
-  if (item->ibuf) {
-    MEM_CacheLimiter_unmanage(item->c_handle);
-    IMB_freeImBuf(item->ibuf);
+  if (shard->clock_hand == item) {
+    shard->clock_hand = item->next;
   }
+  BLI_remlink(&shard->items, item);
+
+  atomic_sub_and_fetch_z(&cache->mem_in_use, item->mem_size);
+  atomic_sub_and_fetch_z(&mem_in_use, item->mem_size);
+
+  IMB_freeImBuf(item->ibuf);
 
   if (item->priority_data && cache->prioritydeleterfp) {
     cache->prioritydeleterfp(item->priority_data);
   }
 
-  BLI_mempool_free(item->cache_owner->items_pool, item);
+  BLI_mempool_free(shard->items_pool, item);
+
+  moviecache_segments_invalidate(cache);
 }
 
-static void check_unused_keys(MovieCache *cache)
+static int compare_int(const void *av, const void *bv)
 {
-  GHashIterator gh_iter;
+  const int *a = av;
+  const int *b = bv;
+  return *a - *b;
+}
 
-  BLI_ghashIterator_init(&gh_iter, cache->hash);
+static size_t get_size_in_memory(ImBuf *ibuf)
+{
+  /* Keep textures in the memory to avoid constant file reload on viewport update. */
+  if (ibuf->userflags & IB_PERSISTENT) {
+    return 0;
+  }
+  else {
+    return IMB_get_size_in_memory(ibuf);
+  }
+}
 
-  while (!BLI_ghashIterator_done(&gh_iter)) {
-    const MovieCacheKey *key = BLI_ghashIterator_getKey(&gh_iter);
-    const MovieCacheItem *item = BLI_ghashIterator_getValue(&gh_iter);
-    bool remove;
+static size_t get_item_size(ImBuf *ibuf)
+{
+  return sizeof(MovieCacheItem) + get_size_in_memory(ibuf);
+}
 
-    BLI_ghashIterator_step(&gh_iter);
+/* Buffers may grow after being put, when float buffers or mipmaps are added for example. Items
+ * can be updated by readers sharing the shard lock, so only one of them applies the change. */
+static void moviecache_item_size_update(MovieCacheItem *item)
+{
+  const size_t mem_size_prev = item->mem_size;
+  const size_t mem_size = get_item_size(item->ibuf);
 
-    remove = !item->ibuf;
+  if (mem_size == mem_size_prev ||
+      atomic_cas_z(&item->mem_size, mem_size_prev, mem_size) != mem_size_prev) {
+    return;
+  }
 
-    if (remove) {
-      PRINT("%s: cache '%s' remove item %p without buffer\n", __func__, cache->name, item);
-    }
+  if (mem_size > mem_size_prev) {
+    atomic_add_and_fetch_z(&item->cache_owner->mem_in_use, mem_size - mem_size_prev);
+    atomic_add_and_fetch_z(&mem_in_use, mem_size - mem_size_prev);
+  }
+  else {
+    atomic_sub_and_fetch_z(&item->cache_owner->mem_in_use, mem_size_prev - mem_size);
+    atomic_sub_and_fetch_z(&mem_in_use, mem_size_prev - mem_size);
+  }
+}
 
-    if (remove) {
-      BLI_ghash_remove(cache->hash, key, moviecache_keyfree, moviecache_valfree);
-    }
+static bool get_item_destroyable(MovieCacheItem *item)
+{
+  /* IB_BITMAPDIRTY means image was modified from inside blender and
+   * changes are not saved to disk.
+   *
+   * Such buffers are never to be freed.
+   */
+  if ((item->ibuf->userflags & IB_BITMAPDIRTY) || (item->ibuf->userflags & IB_PERSISTENT)) {
+    return false;
   }
+  return true;
 }
 
-static int compare_int(const void *av, const void *bv)
+static int get_item_priority(MovieCache *cache, MovieCacheItem *item)
 {
-  const int *a = av;
-  const int *b = bv;
-  return *a - *b;
+  int priority;
+
+  BLI_spin_lock(&cache->last_userkey_lock);
+  priority = cache->getitempriorityfp(cache->last_userkey, item->priority_data);
+  BLI_spin_unlock(&cache->last_userkey_lock);
+
+  PRINT("%s: cache '%s' item %p priority %d\n", __func__, cache->name, item, priority);
+
+  return priority;
 }
 
-static void IMB_moviecache_destructor(void *p)
+/* Sweep the CLOCK hand of the shard to find the item to evict. Recently read items get a
+ * second chance, with item priorities the lowest priority of a few candidates is used. */
+static MovieCacheItem *moviecache_shard_clock_victim(MovieCache *cache, MovieCacheShard *shard)
 {
-  MovieCacheItem *item = (MovieCacheItem *)p;
+  MovieCacheItem *victim = NULL;
+  int victim_priority = 0, totcandidate = 0;
+  /* Twice the items, so every item is visited again after its reference was cleared. */
+  const int totstep = 2 * (int)BLI_ghash_len(shard->hash);
 
-  if (item && item->ibuf) {
-    MovieCache *cache = item->cache_owner;
+  for (int step = 0; step < totstep; step++) {
+    MovieCacheItem *item = shard->clock_hand ? shard->clock_hand : shard->items.first;
 
-    PRINT("%s: cache '%s' destroy item %p buffer %p\n", __func__, cache->name, item, item->ibuf);
+    shard->clock_hand = item->next;
 
-    IMB_freeImBuf(item->ibuf);
+    moviecache_item_size_update(item);
 
-    item->ibuf = NULL;
-    item->c_handle = NULL;
+    if (!get_item_destroyable(item)) {
+      continue;
+    }
+    if (atomic_fetch_and_and_char(&item->referenced, 0)) {
+      continue;
+    }
+    if (cache->getitempriorityfp == NULL) {
+      return item;
+    }
 
-    /* force cached segments to be updated */
-    if (cache->points) {
-      MEM_freeN(cache->points);
-      cache->points = NULL;
+    const int priority = get_item_priority(cache, item);
+    if (victim == NULL || priority < victim_priority) {
+      victim = item;
+      victim_priority = priority;
+    }
+    if (++totcandidate == MOVIECACHE_PRIORITY_SAMPLES) {
+      break;
     }
   }
-}
 
-static size_t get_size_in_memory(ImBuf *ibuf)
-{
-  /* Keep textures in the memory to avoid constant file reload on viewport update. */
-  if (ibuf->userflags & IB_PERSISTENT) {
-    return 0;
-  }
-  else {
-    return IMB_get_size_in_memory(ibuf);
-  }
+  return victim;
 }
-static size_t get_item_size(void *p)
+
+static bool moviecache_evict_one(MovieCache *cache)
 {
-  size_t size = sizeof(MovieCacheItem);
-  MovieCacheItem *item = (MovieCacheItem *)p;
+  for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+    MovieCacheShard *shard = &cache->shards[cache->clock_shard];
+    MovieCacheItem *item;
+
+    cache->clock_shard = (cache->clock_shard + 1) % MOVIECACHE_SHARDS;
+
+    /* Skip shards in use, this also avoids a deadlock when putting to a cache while iterating
+     * over another one. */
+    if (!BLI_rw_mutex_trylock(&shard->lock, THREAD_LOCK_WRITE)) {
+      continue;
+    }
 
-  if (item->ibuf) {
-    size += get_size_in_memory(item->ibuf);
+    item = moviecache_shard_clock_victim(cache, shard);
+    if (item) {
+      PRINT("%s: cache '%s' evict item %p buffer %p\n", __func__, cache->name, item, item->ibuf);
+
+      BLI_ghash_remove(shard->hash, item->key, moviecache_keyfree, moviecache_valfree);
+      atomic_add_and_fetch_uint64(&cache->evictions, 1);
+    }
+
+    BLI_rw_mutex_unlock(&shard->lock);
+
+    if (item) {
+      return true;
+    }
   }
 
-  return size;
+  return false;
 }
 
-static int get_item_priority(void *item_v, int default_priority)
+static void moviecache_enforce_limits(void)
 {
-  MovieCacheItem *item = (MovieCacheItem *)item_v;
-  MovieCache *cache = item->cache_owner;
-  int priority;
+  const size_t mem_limit = MEM_CacheLimiter_get_maximum();
+  int totfailed = 0;
 
-  if (!cache->getitempriorityfp) {
-    PRINT("%s: cache '%s' item %p use default priority %d\n",
-          __func__,
-          cache->name,
-          item,
-          default_priority);
+  if (MEM_CacheLimiter_is_disabled() || mem_limit == 0 || mem_in_use <= mem_limit) {
+    return;
+  }
 
-    return default_priority;
+  /* Another thread is evicting already, it continues until memory use is below the limit. */
+  if (!BLI_mutex_trylock(&limitor_lock)) {
+    return;
   }
 
-  priority = cache->getitempriorityfp(cache->last_userkey, item->priority_data);
+  /* Evict one item of each cache in turn, until none of them has any item left to free. */
+  const int totcache = BLI_listbase_count(&caches);
 
-  PRINT("%s: cache '%s' item %p priority %d\n", __func__, cache->name, item, priority);
+  while (mem_in_use > mem_limit && totfailed < totcache) {
+    MovieCache *cache = clock_cache ? clock_cache : caches.first;
 
-  return priority;
-}
+    clock_cache = cache->next;
 
-static bool get_item_destroyable(void *item_v)
-{
-  MovieCacheItem *item = (MovieCacheItem *)item_v;
-  /* IB_BITMAPDIRTY means image was modified from inside blender and
-   * changes are not saved to disk.
-   *
-   * Such buffers are never to be freed.
-   */
-  if ((item->ibuf->userflags & IB_BITMAPDIRTY) || (item->ibuf->userflags & IB_PERSISTENT)) {
-    return false;
+    if (moviecache_evict_one(cache)) {
+      totfailed = 0;
+    }
+    else {
+      totfailed++;
+    }
   }
-  return true;
+
+  BLI_mutex_unlock(&limitor_lock);
 }
 
 void IMB_moviecache_init(void)
 {
-  limitor = new_MEM_CacheLimiter(IMB_moviecache_destructor, get_item_size);
-
-  MEM_CacheLimiter_ItemPriority_Func_set(limitor, get_item_priority);
-  MEM_CacheLimiter_ItemDestroyable_Func_set(limitor, get_item_destroyable);
+  /* Caches register themselves when created, there is no global state to set up. */
 }
 
 void IMB_moviecache_destruct(void)
 {
-  if (limitor) {
-    delete_MEM_CacheLimiter(limitor);
-  }
+  /* Caches are freed by their owners, forget the ones which are left. */
+  BLI_mutex_lock(&limitor_lock);
+  BLI_listbase_clear(&caches);
+  clock_cache = NULL;
+  BLI_mutex_unlock(&limitor_lock);
 }
 
 MovieCache *IMB_moviecache_create(const char *name,
@@ -273,17 +402,28 @@ MovieCache *IMB_moviecache_create(const char *name,
 
   BLI_strncpy(cache->name, name, sizeof(cache->name));
 
-  cache->keys_pool = BLI_mempool_create(sizeof(MovieCacheKey), 0, 64, BLI_MEMPOOL_NOP);
-  cache->items_pool = BLI_mempool_create(sizeof(MovieCacheItem), 0, 64, BLI_MEMPOOL_NOP);
-  cache->userkeys_pool = BLI_mempool_create(keysize, 0, 64, BLI_MEMPOOL_NOP);
-  cache->hash = BLI_ghash_new(
-      moviecache_hashhash, moviecache_hashcmp, "MovieClip ImBuf cache hash");
+  for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+    MovieCacheShard *shard = &cache->shards[i];
+
+    BLI_rw_mutex_init(&shard->lock);
+    shard->keys_pool = BLI_mempool_create(sizeof(MovieCacheKey), 0, 64, BLI_MEMPOOL_NOP);
+    shard->items_pool = BLI_mempool_create(sizeof(MovieCacheItem), 0, 64, BLI_MEMPOOL_NOP);
+    shard->userkeys_pool = BLI_mempool_create(keysize, 0, 64, BLI_MEMPOOL_NOP);
+    shard->hash = BLI_ghash_new(
+        moviecache_hashhash, moviecache_hashcmp, "MovieClip ImBuf cache hash");
+  }
+
+  BLI_spin_init(&cache->last_userkey_lock);
 
   cache->keysize = keysize;
   cache->hashfp = hashfp;
   cache->cmpfp = cmpfp;
   cache->proxy = -1;
 
+  BLI_mutex_lock(&limitor_lock);
+  BLI_addtail(&caches, cache);
+  BLI_mutex_unlock(&limitor_lock);
+
   return cache;
 }
 
@@ -304,130 +444,131 @@ void IMB_moviecache_set_priority_callback(struct MovieCache *cache,
   cache->prioritydeleterfp = prioritydeleterfp;
 }
 
-static void do_moviecache_put(MovieCache *cache, void *userkey, ImBuf *ibuf, bool need_lock)
+void IMB_moviecache_put(MovieCache *cache, void *userkey, ImBuf *ibuf)
 {
+  MovieCacheShard *shard = moviecache_shard_get(cache, userkey);
   MovieCacheKey *key;
   MovieCacheItem *item;
+  void *priority_data = NULL;
+
+  IMB_refImBuf(ibuf);
 
-  if (!limitor) {
-    IMB_moviecache_init();
+  if (cache->getprioritydatafp) {
+    priority_data = cache->getprioritydatafp(userkey);
   }
 
-  IMB_refImBuf(ibuf);
+  BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
 
-  key = BLI_mempool_alloc(cache->keys_pool);
+  key = BLI_mempool_alloc(shard->keys_pool);
   key->cache_owner = cache;
-  key->userkey = BLI_mempool_alloc(cache->userkeys_pool);
+  key->userkey = BLI_mempool_alloc(shard->userkeys_pool);
   memcpy(key->userkey, userkey, cache->keysize);
 
-  item = BLI_mempool_alloc(cache->items_pool);
+  item = BLI_mempool_alloc(shard->items_pool);
 
   PRINT("%s: cache '%s' put %p, item %p\n", __func__, cache->name, ibuf, item);
 
   item->ibuf = ibuf;
   item->cache_owner = cache;
-  item->c_handle = NULL;
-  item->priority_data = NULL;
+  item->shard = shard;
+  item->key = key;
+  item->priority_data = priority_data;
+  item->mem_size = get_item_size(ibuf);
+  item->referenced = 0;
 
-  if (cache->getprioritydatafp) {
-    item->priority_data = cache->getprioritydatafp(userkey);
-  }
+  /* Replaced items are unlinked, add the new one after that. */
+  BLI_ghash_reinsert(shard->hash, key, item, moviecache_keyfree, moviecache_valfree);
+  BLI_addtail(&shard->items, item);
 
-  BLI_ghash_reinsert(cache->hash, key, item, moviecache_keyfree, moviecache_valfree);
+  atomic_add_and_fetch_z(&cache->mem_in_use, item->mem_size);
+  atomic_add_and_fetch_z(&mem_in_use, item->mem_size);
+
+  BLI_rw_mutex_unlock(&shard->lock);
 
   if (cache->last_userkey) {
+    BLI_spin_lock(&cache->last_userkey_lock);
     memcpy(cache->last_userkey, userkey, cache->keysize);
+    BLI_spin_unlock(&cache->last_userkey_lock);
   }
 
-  if (need_lock) {
-    BLI_mutex_lock(&limitor_lock);
-  }
-
-  item->c_handle = MEM_CacheLimiter_insert(limitor, item);
+  moviecache_segments_invalidate(cache);
 
-  MEM_CacheLimiter_ref(item->c_handle);
-  MEM_CacheLimiter_enforce_limits(limitor);
-  MEM_CacheLimiter_unref(item->c_handle);
-
-  if (need_lock) {
-    BLI_mutex_unlock(&limitor_lock);
-  }
-
-  /* cache limiter can't remove unused keys which points to destroyed values */
-  check_unused_keys(cache);
-
-  if (cache->points) {
-    MEM_freeN(cache->points);
-    cache->points = NULL;
-  }
-}
-
-void IMB_moviecache_put(MovieCache *cache, void *userkey, ImBuf *ibuf)
-{
-  do_moviecache_put(cache, userkey, ibuf, true);
+  moviecache_enforce_limits();
 }
 
 bool IMB_moviecache_put_if_possible(MovieCache *cache, void *userkey, ImBuf *ibuf)
 {
-  size_t mem_in_use, mem_limit, elem_size;
-  bool result = false;
-
-  elem_size = get_size_in_memory(ibuf);
-  mem_limit = MEM_CacheLimiter_get_maximum();
-
-  BLI_mutex_lock(&limitor_lock);
-  mem_in_use = MEM_CacheLimiter_get_memory_in_use(limitor);
+  const size_t elem_size = get_size_in_memory(ibuf);
+  const size_t mem_limit = MEM_CacheLimiter_get_maximum();
 
+  /* Other threads may put items meanwhile, the limit is enforced after putting anyway. */
   if (mem_in_use + elem_size <= mem_limit) {
-    do_moviecache_put(cache, userkey, ibuf, false);
-    result = true;
+    IMB_moviecache_put(cache, userkey, ibuf);
+    return true;
   }
 
-  BLI_mutex_unlock(&limitor_lock);
-
-  return result;
+  return false;
 }
 
 void IMB_moviecache_remove(MovieCache *cache, void *userkey)
 {
+  MovieCacheShard *shard = moviecache_shard_get(cache, userkey);
   MovieCacheKey key;
   key.cache_owner = cache;
   key.userkey = userkey;
-  BLI_ghash_remove(cache->hash, &key, moviecache_keyfree, moviecache_valfree);
+
+  BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+  BLI_ghash_remove(shard->hash, &key, moviecache_keyfree, moviecache_valfree);
+  BLI_rw_mutex_unlock(&shard->lock);
 }
 
 ImBuf *IMB_moviecache_get(MovieCache *cache, void *userkey)
 {
+  MovieCacheShard *shard = moviecache_shard_get(cache, userkey);
   MovieCacheKey key;
   MovieCacheItem *item;
+  ImBuf *ibuf = NULL;
 
   key.cache_owner = cache;
   key.userkey = userkey;
-  item = (MovieCacheItem *)BLI_ghash_lookup(cache->hash, &key);
+
+  BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+
+  item = (MovieCacheItem *)BLI_ghash_lookup(shard->hash, &key);
 
   if (item) {
-    if (item->ibuf) {
-      BLI_mutex_lock(&limitor_lock);
-      MEM_CacheLimiter_touch(item->c_handle);
-      BLI_mutex_unlock(&limitor_lock);
+    /* Readers share the lock, only the reference flag is written. */
+    atomic_fetch_and_or_char(&item->referenced, 1);
+    moviecache_item_size_update(item);
 
-      IMB_refImBuf(item->ibuf);
+    IMB_refImBuf(item->ibuf);
+    ibuf = item->ibuf;
+  }
 
-      return item->ibuf;
-    }
+  BLI_rw_mutex_unlock(&shard->lock);
+
+  atomic_add_and_fetch_uint64(ibuf ? &cache->hits : &cache->misses, 1);
+
+  if (ibuf) {
+    /* The item may have grown above the limit. */
+    moviecache_enforce_limits();
   }
 
-  return NULL;
+  return ibuf;
 }
 
 bool IMB_moviecache_has_frame(MovieCache *cache, void *userkey)
 {
+  MovieCacheShard *shard = moviecache_shard_get(cache, userkey);
   MovieCacheKey key;
   MovieCacheItem *item;
 
   key.cache_owner = cache;
   key.userkey = userkey;
-  item = (MovieCacheItem *)BLI_ghash_lookup(cache->hash, &key);
+
+  BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+  item = (MovieCacheItem *)BLI_ghash_lookup(shard->hash, &key);
+  BLI_rw_mutex_unlock(&shard->lock);
 
   return item != NULL;
 }
@@ -436,11 +577,39 @@ void IMB_moviecache_free(MovieCache *cache)
 {
   PRINT("%s: cache '%s' free\n", __func__, cache->name);
 
-  BLI_ghash_free(cache->hash, moviecache_keyfree, moviecache_valfree);
+#ifdef DEBUG_MESSAGES
+  MovieCacheStats stats;
+  IMB_moviecache_get_stats(cache, &stats);
+  PRINT("%s: cache '%s' %d items, %zu bytes, %llu hits, %llu misses, %llu evictions\n",
+        __func__,
+        cache->name,
+        stats.items_len,
+        stats.mem_in_use,
+        (unsigned long long)stats.hits,
+        (unsigned long long)stats.misses,
+        (unsigned long long)stats.evictions);
+#endif
 
-  BLI_mempool_destroy(cache->keys_pool);
-  BLI_mempool_destroy(cache->items_pool);
-  BLI_mempool_destroy(cache->userkeys_pool);
+  BLI_mutex_lock(&limitor_lock);
+  if (clock_cache == cache) {
+    clock_cache = cache->next;
+  }
+  BLI_remlink(&caches, cache);
+  BLI_mutex_unlock(&limitor_lock);
+
+  for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+    MovieCacheShard *shard = &cache->shards[i];
+
+    BLI_ghash_free(shard->hash, moviecache_keyfree, moviecache_valfree);
+
+    BLI_mempool_destroy(shard->keys_pool);
+    BLI_mempool_destroy(shard->items_pool);
+    BLI_mempool_destroy(shard->userkeys_pool);
+
+    BLI_rw_mutex_end(&shard->lock);
+  }
+
+  BLI_spin_end(&cache->last_userkey_lock);
 
   if (cache->points) {
     MEM_freeN(cache->points);
@@ -457,23 +626,28 @@ void IMB_moviecache_cleanup(MovieCache *cache,
                             bool(cleanup_check_cb)(ImBuf *ibuf, void *userkey, void *userdata),
                             void *userdata)
 {
-  GHashIterator gh_iter;
+  for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+    MovieCacheShard *shard = &cache->shards[i];
+    GHashIterator gh_iter;
 
-  check_unused_keys(cache);
+    BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
 
-  BLI_ghashIterator_init(&gh_iter, cache->hash);
+    BLI_ghashIterator_init(&gh_iter, shard->hash);
 
-  while (!BLI_ghashIterator_done(&gh_iter)) {
-    MovieCacheKey *key = BLI_ghashIterator_getKey(&gh_iter);
-    MovieCacheItem *item = BLI_ghashIterator_getValue(&gh_iter);
+    while (!BLI_ghashIterator_done(&gh_iter)) {
+      MovieCacheKey *key = BLI_ghashIterator_getKey(&gh_iter);
+      MovieCacheItem *item = BLI_ghashIterator_getValue(&gh_iter);
 
-    BLI_ghashIterator_step(&gh_iter);
+      BLI_ghashIterator_step(&gh_iter);
 
-    if (cleanup_check_cb(item->ibuf, key->userkey, userdata)) {
-      PRINT("%s: cache '%s' remove item %p\n", __func__, cache->name, item);
+      if (cleanup_check_cb(item->ibuf, key->userkey, userdata)) {
+        PRINT("%s: cache '%s' remove item %p\n", __func__, cache->name, item);
 
-      BLI_ghash_remove(cache->hash, key, moviecache_keyfree, moviecache_valfree);
+        BLI_ghash_remove(shard->hash, key, moviecache_keyfree, moviecache_valfree);
+      }
     }
+
+    BLI_rw_mutex_unlock(&shard->lock);
   }
 }
 
@@ -488,7 +662,8 @@ void IMB_moviecache_get_cache_segments(
     return;
   }
 
-  if (cache->proxy != proxy || cache->render_flags != render_flags) {
+  if (atomic_fetch_and_and_int32(&cache->segments_dirty, 0) || cache->proxy != proxy ||
+      cache->render_flags != render_flags) {
     if (cache->points) {
       MEM_freeN(cache->points);
     }
@@ -501,24 +676,33 @@ void IMB_moviecache_get_cache_segments(
     *points_r = cache->points;
   }
   else {
-    int totframe = BLI_ghash_len(cache->hash);
-    int *frames = MEM_callocN(totframe * sizeof(int), "movieclip cache frames");
+    int totframe = 0, frames_len = 0;
+    int *frames = NULL;
     int a, totseg = 0;
-    GHashIterator gh_iter;
 
-    a = 0;
-    GHASH_ITER (gh_iter, cache->hash) {
-      MovieCacheKey *key = BLI_ghashIterator_getKey(&gh_iter);
-      MovieCacheItem *item = BLI_ghashIterator_getValue(&gh_iter);
-      int framenr, curproxy, curflags;
+    for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+      MovieCacheShard *shard = &cache->shards[i];
+      GHashIterator gh_iter;
+
+      BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+
+      if (BLI_ghash_len(shard->hash)) {
+        frames_len += BLI_ghash_len(shard->hash);
+        frames = MEM_reallocN_id(frames, frames_len * sizeof(int), "movieclip cache frames");
+      }
+
+      GHASH_ITER (gh_iter, shard->hash) {
+        MovieCacheKey *key = BLI_ghashIterator_getKey(&gh_iter);
+        int framenr, curproxy, curflags;
 
-      if (item->ibuf) {
         cache->getdatafp(key->userkey, &framenr, &curproxy, &curflags);
 
         if (curproxy == proxy && curflags == render_flags) {
-          frames[a++] = framenr;
+          frames[totframe++] = framenr;
         }
       }
+
+      BLI_rw_mutex_unlock(&shard->lock);
     }
 
     qsort(frames, totframe, sizeof(int), compare_int);
@@ -564,43 +748,86 @@ void IMB_moviecache_get_cache_segments(
       cache->render_flags = render_flags;
     }
 
-    MEM_freeN(frames);
+    MEM_SAFE_FREE(frames);
+  }
+}
+
+void IMB_moviecache_get_stats(MovieCache *cache, MovieCacheStats *r_stats)
+{
+  r_stats->hits = cache->hits;
+  r_stats->misses = cache->misses;
+  r_stats->evictions = cache->evictions;
+  r_stats->mem_in_use = cache->mem_in_use;
+  r_stats->items_len = 0;
+
+  for (int i = 0; i < MOVIECACHE_SHARDS; i++) {
+    r_stats->items_len += (int)BLI_ghash_len(cache->shards[i].hash);
+  }
+}
+
+/* Iterates over the shards one by one, keeping the current one locked for reading so items
+ * aren't evicted meanwhile. */
+typedef struct MovieCacheIter {
+  MovieCache *cache;
+  int shard_index;
+  GHashIterator gh_iter;
+} MovieCacheIter;
+
+static void moviecache_iter_skip_empty(MovieCacheIter *iter)
+{
+  while (iter->shard_index < MOVIECACHE_SHARDS && BLI_ghashIterator_done(&iter->gh_iter)) {
+    BLI_rw_mutex_unlock(&iter->cache->shards[iter->shard_index].lock);
+
+    if (++iter->shard_index < MOVIECACHE_SHARDS) {
+      MovieCacheShard *shard = &iter->cache->shards[iter->shard_index];
+
+      BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+      BLI_ghashIterator_init(&iter->gh_iter, shard->hash);
+    }
   }
 }
 
 struct MovieCacheIter *IMB_moviecacheIter_new(MovieCache *cache)
 {
-  GHashIterator *iter;
+  MovieCacheIter *iter = MEM_mallocN(sizeof(MovieCacheIter), "MovieCacheIter");
+
+  iter->cache = cache;
+  iter->shard_index = 0;
 
-  check_unused_keys(cache);
-  iter = BLI_ghashIterator_new(cache->hash);
+  BLI_rw_mutex_lock(&cache->shards[0].lock, THREAD_LOCK_READ);
+  BLI_ghashIterator_init(&iter->gh_iter, cache->shards[0].hash);
+  moviecache_iter_skip_empty(iter);
 
-  return (struct MovieCacheIter *)iter;
+  return iter;
 }
 
 void IMB_moviecacheIter_free(struct MovieCacheIter *iter)
 {
-  BLI_ghashIterator_free((GHashIterator *)iter);
+  if (iter->shard_index < MOVIECACHE_SHARDS) {
+    BLI_rw_mutex_unlock(&iter->cache->shards[iter->shard_index].lock);
+  }
+  MEM_freeN(iter);
 }
 
 bool IMB_moviecacheIter_done(struct MovieCacheIter *iter)
 {
-  return BLI_ghashIterator_done((GHashIterator *)iter);
+  return iter->shard_index == MOVIECACHE_SHARDS;
 }
 
 void IMB_moviecacheIter_step(struct MovieCacheIter *iter)
 {
-  BLI_ghashIterator_step((GHashIterator *)iter);
+  BLI_ghashIterator_step(&iter->gh_iter);
+  moviecache_iter_skip_empty(iter);
 }
 
 ImBuf *IMB_moviecacheIter_getImBuf(struct MovieCacheIter *iter)
 {
-  MovieCacheItem *item = BLI_ghashIterator_getValue((GHashIterator *)iter);
+  MovieCacheItem *item = BLI_ghashIterator_getValue(&iter->gh_iter);
   return item->ibuf;
 }
 
 void *IMB_moviecacheIter_getUserKey(struct MovieCacheIter *iter)
 {
-  MovieCacheKey *key = BLI_ghashIterator_getKey((GHashIterator *)iter);
+  MovieCacheKey *key = BLI_ghashIterator_getKey(&iter->gh_iter);
   return key->userkey;
 }
@@ -112,7 +112,11 @@ typedef struct Mesh_Runtime {
    * In the future we may leave the mesh-data empty
    * since its not needed if we can use edit-mesh data. */
   char is_original;
-  char _pad[6];
+  /** State of #eval_cache_input_hash, see #BKE_mesh_eval_cache_key_init. */
+  char eval_cache_input_state;
+  char _pad[5];
+  /** Hash of the data of this mesh as input of the modifier stack, see BKE_mesh_eval_cache.h. */
+  unsigned int eval_cache_input_hash[2];
 } Mesh_Runtime;
 
 typedef struct Mesh {
@@ -634,6 +634,8 @@ typedef struct UserDef {
   char sounddir[768];
   char i18ndir[768];
   /** 1024 = FILE_MAX. */
+  char sequencer_disk_cache_dir[1024];
+  /** 1024 = FILE_MAX. */
   char image_editor[1024];
   /** 1024 = FILE_MAX. */
   char anim_player[1024];
@@ -714,10 +716,13 @@ typedef struct UserDef {
   short gp_manhattendist, gp_euclideandist, gp_eraser;
   /** #eGP_UserdefSettings. */
   short gp_settings;
-  char _pad13[4];
+  /** #eUserpref_SeqDiskCacheCompression. */
+  short sequencer_disk_cache_compression;
+  char _pad13[2];
   struct SolidLight light_param[4];
   float light_ambient[3];
-  char _pad3[4];
+  /** Modifier stack results cache size limit (in megabytes). */
+  int mesh_eval_cache_limit;
   short gizmo_flag, gizmo_size;
   short edit_studio_light;
   short lookdev_sphere_size;
@@ -727,7 +732,8 @@ typedef struct UserDef {
   int prefetchframes;
   /** Control the rotation step of the view when PAD2, PAD4, PAD6&PAD8 is use. */
   float pad_rot_angle;
-  char _pad12[4];
+  /** Sequencer disk cache size limit (in gigabytes). */
+  int sequencer_disk_cache_size_limit;
   /** Rotating view icon size. */
   short rvisize;
   /** Rotating view icon brightness. */
@@ -1282,6 +1288,13 @@ typedef enum eUserpref_EmulateMMBMod {
   USER_EMU_MMB_MOD_OSKEY = 1,
 } eUserpref_EmulateMMBMod;
 
+/** #UserDef.sequencer_disk_cache_compression */
+typedef enum eUserpref_SeqDiskCacheCompression {
+  USER_SEQ_DISK_CACHE_COMPRESSION_NONE = 0,
+  USER_SEQ_DISK_CACHE_COMPRESSION_LOW = 1,
+  USER_SEQ_DISK_CACHE_COMPRESSION_HIGH = 2,
+} eUserpref_SeqDiskCacheCompression;
+
 #ifdef __cplusplus
 }
 #endif
@@ -806,6 +806,14 @@ static void rna_def_render_engine(BlenderRNA *brna)
   RNA_def_property_int_sdna(prop, NULL, "resolution_y");
   RNA_def_property_clear_flag(prop, PROP_EDITABLE);
 
+  prop = RNA_def_property(srna, "depsgraph_generation", PROP_INT, PROP_NONE);
+  RNA_def_property_int_sdna(prop, NULL, "depsgraph_generation");
+  RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+  RNA_def_property_ui_text(prop,
+                           "Depsgraph Generation",
+                           "Changes whenever a new dependency graph is created for rendering, "
+                           "it stays the same while persistent data keeps the dependency graph");
+
   /* Render Data */
   prop = RNA_def_property(srna, "render", PROP_POINTER, PROP_NONE);
   RNA_def_property_struct_type(prop, "RenderSettings");
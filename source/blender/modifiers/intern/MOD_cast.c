@@ -512,7 +512,7 @@ ModifierTypeInfo modifierType_Cast = {
     /* structSize */ sizeof(CastModifierData),
     /* type */ eModifierTypeType_OnlyDeform,
     /* flags */ eModifierTypeFlag_AcceptsCVs | eModifierTypeFlag_AcceptsLattice |
-        eModifierTypeFlag_SupportsEditmode,
+        eModifierTypeFlag_SupportsEditmode | eModifierTypeFlag_SupportsResultCache,
 
     /* copyData */ modifier_copyData_generic,
 
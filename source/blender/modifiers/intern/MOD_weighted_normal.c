@@ -705,7 +705,8 @@ ModifierTypeInfo modifierType_WeightedNormal = {
     /* structSize */ sizeof(WeightedNormalModifierData),
     /* type */ eModifierTypeType_Constructive,
     /* flags */ eModifierTypeFlag_AcceptsMesh | eModifierTypeFlag_SupportsMapping |
-        eModifierTypeFlag_SupportsEditmode | eModifierTypeFlag_EnableInEditmode,
+        eModifierTypeFlag_SupportsEditmode | eModifierTypeFlag_EnableInEditmode |
+        eModifierTypeFlag_SupportsResultCache,
 
     /* copyData */ modifier_copyData_generic,
 
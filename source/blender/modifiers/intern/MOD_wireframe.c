@@ -111,7 +111,8 @@ ModifierTypeInfo modifierType_Wireframe = {
     /* structName */ "WireframeModifierData",
     /* structSize */ sizeof(WireframeModifierData),
     /* type */ eModifierTypeType_Constructive,
-    /* flags */ eModifierTypeFlag_AcceptsMesh | eModifierTypeFlag_SupportsEditmode,
+    /* flags */ eModifierTypeFlag_AcceptsMesh | eModifierTypeFlag_SupportsEditmode |
+        eModifierTypeFlag_SupportsResultCache,
 
     /* copyData */ modifier_copyData_generic,
 
@@ -37,6 +37,10 @@ extern "C" {
 //#define IMPLICIT_SOLVER_EIGEN
 #define IMPLICIT_SOLVER_BLENDER
 
+/* Solve with the multi-threaded block-Jacobi preconditioned CG on a block sparse row copy of the
+ * system, instead of cg_filtered. Only used by IMPLICIT_SOLVER_BLENDER. */
+#define IMPLICIT_SOLVER_BLENDER_PCG
+
 #define CLOTH_ROOT_FRAME /* enable use of root frame coordinate transform */
 
 #define CLOTH_FORCE_GRAVITY
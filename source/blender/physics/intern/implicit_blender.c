@@ -34,6 +34,7 @@
 #  include "DNA_texture_types.h"
 
 #  include "BLI_math.h"
+#  include "BLI_task.h"
 #  include "BLI_utildefines.h"
 
 #  include "BKE_cloth.h"
@@ -838,6 +839,7 @@ static int cg_filtered(lfVector *ldV, fmatrix3x3 *lA, lfVector *lB, lfVector *z,
 }
 #  endif
 
+#  ifndef IMPLICIT_SOLVER_BLENDER_PCG
 static int cg_filtered(lfVector *ldV,
                        fmatrix3x3 *lA,
                        lfVector *lB,
@@ -932,6 +934,305 @@ static int cg_filtered(lfVector *ldV,
   return conjgrad_loopcount <
          conjgrad_looplimit;  // true means we reached desired accuracy in given time - ie stable
 }
+#  endif /* IMPLICIT_SOLVER_BLENDER_PCG */
+
+#  ifdef IMPLICIT_SOLVER_BLENDER_PCG
+
+/* ==== Multi-threaded preconditioned conjugate gradient ==== */
+
+/* Number of vertices handled by a single task. Dot products are summed per chunk and then in
+ * chunk order, so the result does not depend on the number of threads. */
+#    define PCG_CHUNK_SIZE 1024
+
+/* Block sparse row copy of the system matrix. Both triangles of the symmetric matrix are stored,
+ * so every row is multiplied independently. The diagonal block comes first in every row. */
+typedef struct BSRMatrix {
+  int num_rows;
+  int *row_offsets;
+  int *columns;
+  /* Block of the fmatrix3x3 array the value comes from, -index - 1 for transposed blocks. */
+  int *sources;
+  float (*blocks)[3][3];
+  /* Inverted diagonal blocks, used as block-Jacobi preconditioner. */
+  float (*diagonal_inv)[3][3];
+} BSRMatrix;
+
+static void bsr_matrix_init(BSRMatrix *bsr, const fmatrix3x3 *A, const int num_blocks)
+{
+  const int num_rows = A[0].vcount;
+  int *row_offsets = MEM_calloc_arrayN(num_rows + 1, sizeof(int), "bsr row offsets");
+
+  /* Count diagonal block plus both triangles of off-diagonal blocks. */
+  for (int i = 0; i < num_rows; i++) {
+    row_offsets[i + 1] = 1;
+  }
+  for (int i = num_rows; i < num_rows + num_blocks; i++) {
+    row_offsets[A[i].r + 1]++;
+    row_offsets[A[i].c + 1]++;
+  }
+  for (int i = 0; i < num_rows; i++) {
+    row_offsets[i + 1] += row_offsets[i];
+  }
+
+  const int num_bsr_blocks = row_offsets[num_rows];
+  int *columns = MEM_malloc_arrayN(num_bsr_blocks, sizeof(int), "bsr columns");
+  int *sources = MEM_malloc_arrayN(num_bsr_blocks, sizeof(int), "bsr sources");
+  int *row_fill = MEM_malloc_arrayN(num_rows, sizeof(int), "bsr row fill");
+
+  for (int i = 0; i < num_rows; i++) {
+    BLI_assert(A[i].r == i && A[i].c == i);
+    columns[row_offsets[i]] = i;
+    sources[row_offsets[i]] = i;
+    row_fill[i] = row_offsets[i] + 1;
+  }
+  for (int i = num_rows; i < num_rows + num_blocks; i++) {
+    const int r = A[i].r, c = A[i].c;
+    columns[row_fill[r]] = c;
+    sources[row_fill[r]++] = i;
+    columns[row_fill[c]] = r;
+    sources[row_fill[c]++] = -i - 1;
+  }
+  MEM_freeN(row_fill);
+
+  bsr->num_rows = num_rows;
+  bsr->row_offsets = row_offsets;
+  bsr->columns = columns;
+  bsr->sources = sources;
+  bsr->blocks = MEM_malloc_arrayN(num_bsr_blocks, sizeof(*bsr->blocks), "bsr blocks");
+  bsr->diagonal_inv = MEM_malloc_arrayN(num_rows, sizeof(*bsr->diagonal_inv), "bsr diagonal");
+}
+
+static void bsr_matrix_free(BSRMatrix *bsr)
+{
+  MEM_freeN(bsr->row_offsets);
+  MEM_freeN(bsr->columns);
+  MEM_freeN(bsr->sources);
+  MEM_freeN(bsr->blocks);
+  MEM_freeN(bsr->diagonal_inv);
+}
+
+BLI_INLINE void bsr_matrix_mul_row(const BSRMatrix *bsr, const int row, lfVector *x, float r[3])
+{
+  zero_v3(r);
+  for (int k = bsr->row_offsets[row]; k < bsr->row_offsets[row + 1]; k++) {
+    muladd_fmatrix_fvector(r, bsr->blocks[k], x[bsr->columns[k]]);
+  }
+}
+
+typedef struct PCGData {
+  BSRMatrix bsr;
+  const fmatrix3x3 *A;
+  fmatrix3x3 *S;
+  lfVector *B, *dV, *r, *c, *q, *s;
+  float alpha, beta;
+  /* Partial sums of dot products, two for every chunk. */
+  double *partials;
+  int num_chunks;
+} PCGData;
+
+BLI_INLINE void pcg_chunk_range(const PCGData *data, const int chunk, int *r_start, int *r_end)
+{
+  *r_start = chunk * PCG_CHUNK_SIZE;
+  *r_end = min_ii(*r_start + PCG_CHUNK_SIZE, data->bsr.num_rows);
+}
+
+BLI_INLINE void pcg_filter(fmatrix3x3 *S, const int i, float v[3])
+{
+  mul_m3_v3(S[i].m, v);
+}
+
+/* Gather values of the system matrix and invert its diagonal blocks. */
+static void pcg_matrix_update_task(void *__restrict userdata,
+                                   const int chunk,
+                                   const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PCGData *data = userdata;
+  BSRMatrix *bsr = &data->bsr;
+  int start, end;
+  pcg_chunk_range(data, chunk, &start, &end);
+  for (int i = start; i < end; i++) {
+    for (int k = bsr->row_offsets[i]; k < bsr->row_offsets[i + 1]; k++) {
+      const int source = bsr->sources[k];
+      if (source >= 0) {
+        copy_m3_m3(bsr->blocks[k], data->A[source].m);
+      }
+      else {
+        transpose_m3_m3(bsr->blocks[k], data->A[-source - 1].m);
+      }
+    }
+    if (!invert_m3_m3(bsr->diagonal_inv[i], bsr->blocks[bsr->row_offsets[i]])) {
+      unit_m3(bsr->diagonal_inv[i]);
+    }
+  }
+}
+
+/* r = filter(B - A * dV), c = filter(P^-1 * r), and the norm of the filtered B. */
+static void pcg_init_task(void *__restrict userdata,
+                          const int chunk,
+                          const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PCGData *data = userdata;
+  double delta = 0.0, bnorm2 = 0.0;
+  int start, end;
+  pcg_chunk_range(data, chunk, &start, &end);
+  for (int i = start; i < end; i++) {
+    float AdV[3], fB[3], PfB[3];
+    bsr_matrix_mul_row(&data->bsr, i, data->dV, AdV);
+    sub_v3_v3v3(data->r[i], data->B[i], AdV);
+    pcg_filter(data->S, i, data->r[i]);
+    mul_v3_m3v3(data->c[i], data->bsr.diagonal_inv[i], data->r[i]);
+    pcg_filter(data->S, i, data->c[i]);
+    delta += dot_v3v3(data->r[i], data->c[i]);
+
+    copy_v3_v3(fB, data->B[i]);
+    pcg_filter(data->S, i, fB);
+    mul_v3_m3v3(PfB, data->bsr.diagonal_inv[i], fB);
+    pcg_filter(data->S, i, PfB);
+    bnorm2 += dot_v3v3(fB, PfB);
+  }
+  data->partials[chunk * 2] = delta;
+  data->partials[chunk * 2 + 1] = bnorm2;
+}
+
+/* q = filter(A * c), and c^T * q. */
+static void pcg_spmv_task(void *__restrict userdata,
+                          const int chunk,
+                          const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PCGData *data = userdata;
+  double cq = 0.0;
+  int start, end;
+  pcg_chunk_range(data, chunk, &start, &end);
+  for (int i = start; i < end; i++) {
+    bsr_matrix_mul_row(&data->bsr, i, data->c, data->q[i]);
+    pcg_filter(data->S, i, data->q[i]);
+    cq += dot_v3v3(data->c[i], data->q[i]);
+  }
+  data->partials[chunk * 2] = cq;
+}
+
+/* dV += alpha * c, r -= alpha * q, s = P^-1 * r, and r^T * s. */
+static void pcg_update_task(void *__restrict userdata,
+                            const int chunk,
+                            const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PCGData *data = userdata;
+  const float alpha = data->alpha;
+  double delta = 0.0;
+  int start, end;
+  pcg_chunk_range(data, chunk, &start, &end);
+  for (int i = start; i < end; i++) {
+    madd_v3_v3fl(data->dV[i], data->c[i], alpha);
+    madd_v3_v3fl(data->r[i], data->q[i], -alpha);
+    mul_v3_m3v3(data->s[i], data->bsr.diagonal_inv[i], data->r[i]);
+    delta += dot_v3v3(data->r[i], data->s[i]);
+  }
+  data->partials[chunk * 2] = delta;
+}
+
+/* c = filter(s + beta * c). */
+static void pcg_direction_task(void *__restrict userdata,
+                               const int chunk,
+                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PCGData *data = userdata;
+  const float beta = data->beta;
+  int start, end;
+  pcg_chunk_range(data, chunk, &start, &end);
+  for (int i = start; i < end; i++) {
+    float c[3];
+    madd_v3_v3v3fl(c, data->s[i], data->c[i], beta);
+    pcg_filter(data->S, i, c);
+    copy_v3_v3(data->c[i], c);
+  }
+}
+
+static void pcg_run(PCGData *data, TaskParallelRangeFunc func)
+{
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (data->num_chunks > 1);
+  settings.min_iter_per_thread = 1;
+  BLI_task_parallel_range(0, data->num_chunks, data, func, &settings);
+}
+
+static float pcg_partials_sum(const PCGData *data, const int offset)
+{
+  double sum = 0.0;
+  for (int chunk = 0; chunk < data->num_chunks; chunk++) {
+    sum += data->partials[chunk * 2 + offset];
+  }
+  return (float)sum;
+}
+
+/* Same as cg_filtered, but with block-Jacobi preconditioner, and all the vector operations and
+ * matrix multiplication run from threads on a block sparse row copy of the system matrix. */
+static int pcg_filtered(lfVector *ldV,
+                        fmatrix3x3 *lA,
+                        const int num_blocks,
+                        lfVector *lB,
+                        lfVector *z,
+                        fmatrix3x3 *S,
+                        ImplicitSolverResult *result)
+{
+  unsigned int conjgrad_loopcount = 0, conjgrad_looplimit = 100;
+  float conjgrad_epsilon = 0.01f;
+
+  unsigned int numverts = lA[0].vcount;
+  float bnorm2, delta_new, delta_old, delta_target;
+
+  PCGData data = {{0}};
+  bsr_matrix_init(&data.bsr, lA, num_blocks);
+  data.A = lA;
+  data.S = S;
+  data.B = lB;
+  data.dV = ldV;
+  data.r = create_lfvector(numverts);
+  data.c = create_lfvector(numverts);
+  data.q = create_lfvector(numverts);
+  data.s = create_lfvector(numverts);
+  data.num_chunks = (numverts + PCG_CHUNK_SIZE - 1) / PCG_CHUNK_SIZE;
+  data.partials = MEM_calloc_arrayN(data.num_chunks * 2, sizeof(double), "pcg partials");
+
+  pcg_run(&data, pcg_matrix_update_task);
+
+  cp_lfvector(ldV, z, numverts);
+
+  pcg_run(&data, pcg_init_task);
+  delta_new = pcg_partials_sum(&data, 0);
+  bnorm2 = pcg_partials_sum(&data, 1);
+  delta_target = conjgrad_epsilon * conjgrad_epsilon * bnorm2;
+
+  while (delta_new > delta_target && conjgrad_loopcount < conjgrad_looplimit) {
+    pcg_run(&data, pcg_spmv_task);
+    data.alpha = delta_new / pcg_partials_sum(&data, 0);
+
+    pcg_run(&data, pcg_update_task);
+    delta_old = delta_new;
+    delta_new = pcg_partials_sum(&data, 0);
+
+    data.beta = delta_new / delta_old;
+    pcg_run(&data, pcg_direction_task);
+
+    conjgrad_loopcount++;
+  }
+
+  bsr_matrix_free(&data.bsr);
+  del_lfvector(data.r);
+  del_lfvector(data.c);
+  del_lfvector(data.q);
+  del_lfvector(data.s);
+  MEM_freeN(data.partials);
+
+  result->status = conjgrad_loopcount < conjgrad_looplimit ? BPH_SOLVER_SUCCESS :
+                                                             BPH_SOLVER_NO_CONVERGENCE;
+  result->iterations = conjgrad_loopcount;
+  result->error = bnorm2 > 0.0f ? sqrtf(delta_new / bnorm2) : 0.0f;
+
+  return conjgrad_loopcount < conjgrad_looplimit;
+}
+
+#  endif /* IMPLICIT_SOLVER_BLENDER_PCG */
 
 #  if 0
 // block diagonalizer
@@ -1159,7 +1460,11 @@ bool BPH_mass_spring_solve_velocities(Implicit_Data *data, float dt, ImplicitSol
 #  endif
 
   /* Conjugate gradient algorithm to solve Ax=b. */
+#  ifdef IMPLICIT_SOLVER_BLENDER_PCG
+  pcg_filtered(data->dV, data->A, data->num_blocks, data->B, data->z, data->S, result);
+#  else
   cg_filtered(data->dV, data->A, data->B, data->z, data->S, result);
+#  endif
 
   // cg_filtered_pre(id->dV, id->A, id->B, id->z, id->S, id->P, id->Pinv, id->bigI);
 
@@ -67,6 +67,7 @@ struct bNodeTree;
 #define RE_ENGINE_RENDERING 16
 #define RE_ENGINE_HIGHLIGHT_TILES 32
 #define RE_ENGINE_USED_FOR_VIEWPORT 64
+#define RE_ENGINE_FREE_DEPSGRAPH 128
 
 extern ListBase R_engines;
 
@@ -140,6 +141,8 @@ typedef struct RenderEngine {
 
   /* Depsgraph */
   struct Depsgraph *depsgraph;
+  /* Incremented for every new depsgraph, so engines can tell whether it was kept. */
+  int depsgraph_generation;
 
   /* callback for render pass query */
   ThreadMutex update_render_passes_mutex;
@@ -155,6 +158,7 @@ typedef struct RenderEngine {
 RenderEngine *RE_engine_create(RenderEngineType *type);
 RenderEngine *RE_engine_create_ex(RenderEngineType *type, bool use_for_viewport);
 void RE_engine_free(RenderEngine *engine);
+void RE_engine_free_depsgraph(RenderEngine *engine);
 
 void RE_layer_load_from_file(
     struct RenderLayer *layer, struct ReportList *reports, const char *filename, int x, int y);
@@ -191,6 +191,12 @@ void RE_FreeAllPersistentData(void);
 void RE_FreeAllRenderResults(void);
 /* for external render engines that can keep persistent data */
 void RE_FreePersistentData(void);
+/* Free persistent data of engines with a depsgraph kept for the scene, or only for the view layer
+ * when given. Called before they are freed. */
+void RE_FreePersistentDataForScene(const struct Scene *scene, const struct ViewLayer *view_layer);
+/* Free only the depsgraphs kept by engines for persistent data, when the main database they
+ * were built for is replaced. */
+void RE_FreePersistentDepsgraphs(void);
 
 /* get results and statistics */
 void RE_FreeRenderResult(struct RenderResult *rr);
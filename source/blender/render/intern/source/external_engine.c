@@ -152,6 +152,12 @@ RenderEngine *RE_engine_create_ex(RenderEngineType *type, bool use_for_viewport)
 
 void RE_engine_free(RenderEngine *engine)
 {
+  /* Dependency graph kept for persistent data. */
+  if (engine->depsgraph) {
+    DEG_graph_free(engine->depsgraph);
+    engine->depsgraph = NULL;
+  }
+
 #ifdef WITH_PYTHON
   if (engine->py_instance) {
     BPY_DECREF_RNA_INVALIDATE(engine->py_instance);
@@ -504,13 +510,44 @@ RenderData *RE_engine_get_render_data(Render *re)
 }
 
 /* Depsgraph */
+
+/* With persistent data the depsgraph is kept between frames, so that the render engine can
+ * query which data changed since the previous frame and only update that. */
+static bool engine_keep_depsgraph(RenderEngine *engine)
+{
+  return (engine->re->r.mode & R_PERSISTENT_DATA) != 0 &&
+         (engine->re->r.scemode & R_BUTS_PREVIEW) == 0;
+}
+
+static void engine_depsgraph_free(RenderEngine *engine)
+{
+  DEG_graph_free(engine->depsgraph);
+
+  engine->depsgraph = NULL;
+  engine->flag &= ~RE_ENGINE_FREE_DEPSGRAPH;
+}
+
 static void engine_depsgraph_init(RenderEngine *engine, ViewLayer *view_layer)
 {
   Main *bmain = engine->re->main;
   Scene *scene = engine->re->scene;
 
-  engine->depsgraph = DEG_graph_new(bmain, scene, view_layer, DAG_EVAL_RENDER);
-  DEG_debug_name_set(engine->depsgraph, "RENDER");
+  if (engine->depsgraph) {
+    if (engine_keep_depsgraph(engine) && DEG_get_bmain(engine->depsgraph) == bmain &&
+        DEG_get_input_scene(engine->depsgraph) == scene &&
+        DEG_get_input_view_layer(engine->depsgraph) == view_layer) {
+      /* Reuse depsgraph from the previous frame. */
+    }
+    else {
+      engine_depsgraph_free(engine);
+    }
+  }
+
+  if (!engine->depsgraph) {
+    engine->depsgraph = DEG_graph_new(bmain, scene, view_layer, DAG_EVAL_RENDER);
+    engine->depsgraph_generation++;
+    DEG_debug_name_set(engine->depsgraph, "RENDER");
+  }
 
   if (engine->re->r.scemode & R_BUTS_PREVIEW) {
     Depsgraph *depsgraph = engine->depsgraph;
@@ -520,15 +557,41 @@ static void engine_depsgraph_init(RenderEngine *engine, ViewLayer *view_layer)
     DEG_ids_clear_recalc(bmain, depsgraph);
   }
   else {
-    BKE_scene_graph_update_for_newframe(engine->depsgraph, bmain);
+    /* Keep recalc flags for the engine to query updates, cleared in engine_depsgraph_exit(). */
+    BKE_scene_graph_update_for_newframe_ex(
+        engine->depsgraph, bmain, !engine_keep_depsgraph(engine));
   }
 }
 
-static void engine_depsgraph_free(RenderEngine *engine)
+static void engine_depsgraph_exit(RenderEngine *engine)
 {
-  DEG_graph_free(engine->depsgraph);
+  if (engine->depsgraph == NULL) {
+    return;
+  }
 
-  engine->depsgraph = NULL;
+  if (engine_keep_depsgraph(engine) && !(engine->flag & RE_ENGINE_FREE_DEPSGRAPH)) {
+    /* The engine handled the updates of this frame. */
+    DEG_ids_clear_recalc(engine->re->main, engine->depsgraph);
+  }
+  else {
+    engine_depsgraph_free(engine);
+  }
+}
+
+/* Free the depsgraph kept for persistent data, when the data it was built for goes away. */
+void RE_engine_free_depsgraph(RenderEngine *engine)
+{
+  if (engine->depsgraph == NULL) {
+    return;
+  }
+
+  if (engine->flag & RE_ENGINE_RENDERING) {
+    /* Still in use, free it once the render is done. */
+    engine->flag |= RE_ENGINE_FREE_DEPSGRAPH;
+  }
+  else {
+    engine_depsgraph_free(engine);
+  }
 }
 
 void RE_engine_frame_set(RenderEngine *engine, int frame, float subframe)
@@ -610,6 +673,10 @@ bool RE_bake_engine(Render *re,
   engine->tile_y = re->r.tiley;
 
   if (type->bake) {
+    /* Baking uses the depsgraph of the caller. */
+    if (engine->depsgraph) {
+      engine_depsgraph_free(engine);
+    }
     engine->depsgraph = depsgraph;
 
     /* update is only called so we create the engine.session */
@@ -787,7 +854,7 @@ int RE_engine_render(Render *re, int do_all)
         DRW_render_gpencil(engine, engine->depsgraph);
       }
 
-      engine_depsgraph_free(engine);
+      engine_depsgraph_exit(engine);
 
       if (RE_engine_test_break(engine)) {
         break;
@@ -882,6 +949,10 @@ void RE_engine_free_blender_memory(RenderEngine *engine)
   if (DRW_render_check_grease_pencil(engine->depsgraph)) {
     return;
   }
+  /* Persistent data keeps the depsgraph for the next frame. */
+  if (engine_keep_depsgraph(engine)) {
+    return;
+  }
   DEG_graph_free(engine->depsgraph);
   engine->depsgraph = NULL;
 }
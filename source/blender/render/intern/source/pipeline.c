@@ -728,6 +728,39 @@ void RE_FreePersistentData(void)
   }
 }
 
+void RE_FreePersistentDataForScene(const Scene *scene, const ViewLayer *view_layer)
+{
+  Render *re;
+
+  for (re = RenderGlobal.renderlist.first; re; re = re->next) {
+    RenderEngine *engine = re->engine;
+    if (engine == NULL || engine->depsgraph == NULL) {
+      continue;
+    }
+    if (DEG_get_input_scene(engine->depsgraph) != scene ||
+        (view_layer && DEG_get_input_view_layer(engine->depsgraph) != view_layer)) {
+      continue;
+    }
+
+    /* The engine keeps pointers into the depsgraph, free it along. */
+    if (!(engine->flag & RE_ENGINE_RENDERING)) {
+      RE_engine_free(engine);
+    }
+    re->engine = NULL;
+  }
+}
+
+void RE_FreePersistentDepsgraphs(void)
+{
+  Render *re;
+
+  for (re = RenderGlobal.renderlist.first; re; re = re->next) {
+    if (re->engine) {
+      RE_engine_free_depsgraph(re->engine);
+    }
+  }
+}
+
 /* ********* initialize state ******** */
 
 /* clear full sample and tile flags if needed */
@@ -277,17 +277,25 @@ int main(int argc,
    *       guarded allocator before any allocation happened.
    */
   {
+    bool use_thread_cache = false;
     int i;
     for (i = 0; i < argc; i++) {
       if (STR_ELEM(argv[i], "-d", "--debug", "--debug-memory", "--debug-all")) {
         printf("Switching to fully guarded memory allocator.\n");
         MEM_use_guarded_allocator();
+        use_thread_cache = false;
         break;
       }
+      else if (STREQ(argv[i], "--enable-memory-thread-cache")) {
+        use_thread_cache = true;
+      }
       else if (STREQ(argv[i], "--")) {
         break;
       }
     }
+    if (use_thread_cache) {
+      MEM_use_cached_allocator();
+    }
   }
 
 #ifdef BUILD_DATE
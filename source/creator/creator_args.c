@@ -617,6 +617,7 @@ static int arg_handle_print_help(int UNUSED(argc), const char **UNUSED(argv), vo
   BLI_argsPrintArgDoc(ba, "--factory-startup");
   BLI_argsPrintArgDoc(ba, "--enable-library-override");
   BLI_argsPrintArgDoc(ba, "--enable-event-simulate");
+  BLI_argsPrintArgDoc(ba, "--enable-memory-thread-cache");
   printf("\n");
   BLI_argsPrintArgDoc(ba, "--env-system-datafiles");
   BLI_argsPrintArgDoc(ba, "--env-system-scripts");
@@ -738,6 +739,18 @@ static int arg_handle_crash_handler_disable(int UNUSED(argc),
   return 0;
 }
 
+static const char arg_handle_memory_thread_cache_enable_doc[] =
+    "\n\t"
+    "Use the memory allocator with per-thread caches, which scales better with many threads.\n"
+    "\tIgnored when memory debugging is enabled.";
+static int arg_handle_memory_thread_cache_enable(int UNUSED(argc),
+                                                 const char **UNUSED(argv),
+                                                 void *UNUSED(data))
+{
+  /* Allocator is switched in main(), before any allocation happens. */
+  return 0;
+}
+
 static const char arg_handle_abort_handler_disable_doc[] =
     "\n\t"
     "Disable the abort handler.";
@@ -2039,6 +2052,12 @@ void main_args_setup(bContext *C, bArgs *ba)
 
   BLI_argsAdd(ba, 1, NULL, "--disable-crash-handler", CB(arg_handle_crash_handler_disable), NULL);
   BLI_argsAdd(ba, 1, NULL, "--disable-abort-handler", CB(arg_handle_abort_handler_disable), NULL);
+  BLI_argsAdd(ba,
+              1,
+              NULL,
+              "--enable-memory-thread-cache",
+              CB(arg_handle_memory_thread_cache_enable),
+              NULL);
 
   BLI_argsAdd(ba, 1, "-b", "--background", CB(arg_handle_background_mode_set), NULL);
 
@@ -0,0 +1,260 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+
+#include "BLI_listbase.h"
+
+#include "BKE_global.h"
+#include "BKE_library.h"
+#include "BKE_mesh.h"
+#include "BKE_mesh_eval_cache.h"
+#include "BKE_modifier.h"
+
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_modifier_types.h"
+#include "DNA_object_types.h"
+#include "DNA_scene_types.h"
+#include "DNA_userdef_types.h"
+
+#include "PIL_time.h"
+}
+
+/* About 1 MB of vertices. */
+#define MESH_VERTS_NUM 50000
+#define EVALUATIONS_NUM 100
+
+class MeshEvalCacheTest : public testing::Test {
+ protected:
+  Mesh *mesh;
+  int limit_prev;
+
+  void SetUp() override
+  {
+    mesh = BKE_mesh_new_nomain(MESH_VERTS_NUM, 0, 0, 0, 0);
+    limit_prev = U.mesh_eval_cache_limit;
+    U.mesh_eval_cache_limit = 256;
+  }
+
+  void TearDown() override
+  {
+    BKE_mesh_eval_cache_exit();
+    BKE_id_free(NULL, mesh);
+    U.mesh_eval_cache_limit = limit_prev;
+  }
+
+  static MeshEvalCacheKey key(unsigned int id)
+  {
+    MeshEvalCacheKey key = {{id, ~id}};
+    return key;
+  }
+
+  bool is_cached(unsigned int id)
+  {
+    const MeshEvalCacheKey k = key(id);
+    MeshEvalCacheItem *item = BKE_mesh_eval_cache_lookup(&k);
+    if (item == NULL) {
+      return false;
+    }
+    Mesh *mesh_copy = BKE_mesh_eval_cache_item_mesh_copy(item, mesh);
+    EXPECT_EQ(mesh_copy->totvert, MESH_VERTS_NUM);
+    BKE_id_free(NULL, mesh_copy);
+    BKE_mesh_eval_cache_item_release(item);
+    return true;
+  }
+
+  void insert(unsigned int id)
+  {
+    const MeshEvalCacheKey k = key(id);
+    BKE_mesh_eval_cache_insert(&k, mesh);
+  }
+
+  /**
+   * Evaluate a stack of constructive modifiers, as #mesh_calc_modifiers does: results of the
+   * last modifier with a cached result are used, the ones after it are evaluated and inserted.
+   * \return the number of modifiers which didn't need to be evaluated.
+   */
+  int evaluate(const unsigned int *ids, int ids_len)
+  {
+    int i_cached = ids_len - 1;
+    while ((i_cached >= 0) && !is_cached(ids[i_cached])) {
+      i_cached--;
+    }
+    for (int i = i_cached + 1; i < ids_len; i++) {
+      insert(ids[i]);
+    }
+    return i_cached + 1;
+  }
+};
+
+TEST_F(MeshEvalCacheTest, insert_second_evaluation)
+{
+  insert(1);
+  EXPECT_FALSE(is_cached(1));
+  insert(1);
+  EXPECT_TRUE(is_cached(1));
+  EXPECT_FALSE(is_cached(2));
+}
+
+TEST_F(MeshEvalCacheTest, evict_least_recently_used)
+{
+  /* Room for two results. */
+  U.mesh_eval_cache_limit = 2;
+  for (unsigned int id = 1; id <= 3; id++) {
+    insert(id);
+    insert(id);
+    EXPECT_TRUE(is_cached(id));
+    if (id == 2) {
+      EXPECT_TRUE(is_cached(1));
+    }
+  }
+  EXPECT_FALSE(is_cached(2));
+  EXPECT_TRUE(is_cached(1));
+  EXPECT_TRUE(is_cached(3));
+
+  /* Lowering the limit removes results too. */
+  U.mesh_eval_cache_limit = 0;
+  BKE_mesh_eval_cache_limit_update();
+  EXPECT_FALSE(is_cached(1));
+  EXPECT_FALSE(is_cached(3));
+}
+
+/* Hit rate and memory use of a setting being dragged, and of an animated input. */
+TEST_F(MeshEvalCacheTest, hit_rate_memory)
+{
+  const size_t mem_start = MEM_get_memory_in_use();
+
+  /* A setting of the last of three modifiers changes on every evaluation. */
+  int cached_tweak = 0;
+  for (unsigned int i = 0; i < EVALUATIONS_NUM; i++) {
+    const unsigned int ids[3] = {1, 2, 100 + i};
+    cached_tweak += evaluate(ids, ARRAY_SIZE(ids));
+  }
+  const size_t mem_tweak = MEM_get_memory_in_use() - mem_start;
+  BKE_mesh_eval_cache_exit();
+
+  /* The input changes on every evaluation, nothing can be reused. */
+  int cached_anim = 0;
+  for (unsigned int i = 0; i < EVALUATIONS_NUM; i++) {
+    const unsigned int ids[3] = {1000 + i, 2000 + i, 3000 + i};
+    cached_anim += evaluate(ids, ARRAY_SIZE(ids));
+  }
+  const size_t mem_anim = MEM_get_memory_in_use() - mem_start;
+
+  printf("Setting changes: %d of %d modifiers cached, %.2f MB in cache\n",
+         cached_tweak,
+         EVALUATIONS_NUM * 3,
+         (double)mem_tweak / (1024 * 1024));
+  printf("Input changes:   %d of %d modifiers cached, %.2f MB in cache\n",
+         cached_anim,
+         EVALUATIONS_NUM * 3,
+         (double)mem_anim / (1024 * 1024));
+
+  /* The first two modifiers are evaluated twice, then their result is reused. */
+  EXPECT_EQ(cached_tweak, (EVALUATIONS_NUM - 2) * 2);
+  EXPECT_LT(mem_tweak, (size_t)3 * 1024 * 1024);
+  EXPECT_EQ(cached_anim, 0);
+  EXPECT_LT(mem_anim, (size_t)1024 * 1024);
+}
+
+/* Keys of the input of a subdivision surface modifier, which is only hashed when unchanged. */
+class MeshEvalCacheKeyTest : public MeshEvalCacheTest {
+ protected:
+  Scene scene;
+  Object ob;
+
+  static void SetUpTestCase()
+  {
+    BKE_modifier_init();
+  }
+
+  void SetUp() override
+  {
+    MeshEvalCacheTest::SetUp();
+    memset(&scene, 0, sizeof(scene));
+    memset(&ob, 0, sizeof(ob));
+    ob.type = OB_MESH;
+    ob.data = mesh;
+    BLI_addtail(&ob.modifiers, modifier_new(eModifierType_Subsurf));
+  }
+
+  void TearDown() override
+  {
+    LISTBASE_FOREACH_MUTABLE (ModifierData *, md, &ob.modifiers) {
+      modifier_free(md);
+    }
+    MeshEvalCacheTest::TearDown();
+  }
+
+  bool key_init(MeshEvalCacheKey *key)
+  {
+    return BKE_mesh_eval_cache_key_init(
+        key, &scene, &ob, (ModifierData *)ob.modifiers.first, mesh, 0);
+  }
+
+  /* The input is animated, as done by copy-on-write updates. */
+  void input_change(int i)
+  {
+    mesh->id.recalc |= ID_RECALC_GEOMETRY;
+    mesh->mvert[0].co[0] = (float)i;
+  }
+};
+
+TEST_F(MeshEvalCacheKeyTest, input_hashed_when_unchanged)
+{
+  MeshEvalCacheKey key_a, key_b;
+
+  /* A new mesh isn't hashed until it's evaluated again unchanged. */
+  EXPECT_FALSE(key_init(&key_a));
+  EXPECT_TRUE(key_init(&key_a));
+  EXPECT_TRUE(key_init(&key_b));
+  EXPECT_EQ(memcmp(&key_a, &key_b, sizeof(key_a)), 0);
+
+  input_change(1);
+  EXPECT_FALSE(key_init(&key_b));
+  mesh->id.recalc = 0;
+  EXPECT_TRUE(key_init(&key_b));
+  EXPECT_NE(memcmp(&key_a, &key_b, sizeof(key_a)), 0);
+
+  /* Nothing is hashed when the first modifier doesn't support caching. */
+  BLI_addhead(&ob.modifiers, modifier_new(eModifierType_Decimate));
+  const char input_state = mesh->runtime.eval_cache_input_state;
+  EXPECT_FALSE(key_init(&key_b));
+  EXPECT_FALSE(key_init(&key_b));
+  EXPECT_EQ(mesh->runtime.eval_cache_input_state, input_state);
+}
+
+/* Time spent on keys when the input changes on every evaluation, and when it doesn't. */
+TEST_F(MeshEvalCacheKeyTest, key_time)
+{
+  MeshEvalCacheKey key;
+
+  /* The cost of hashing the input, which every evaluation paid before. */
+  key_init(&key);
+  double time_start = PIL_check_seconds_timer();
+  key_init(&key);
+  const double time_hash = PIL_check_seconds_timer() - time_start;
+
+  time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < EVALUATIONS_NUM; i++) {
+    EXPECT_TRUE(key_init(&key));
+  }
+  const double time_unchanged = PIL_check_seconds_timer() - time_start;
+
+  time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < EVALUATIONS_NUM; i++) {
+    input_change(i);
+    EXPECT_FALSE(key_init(&key));
+    mesh->id.recalc = 0;
+  }
+  const double time_anim = PIL_check_seconds_timer() - time_start;
+
+  printf("Hashing the input: %.3f ms\n", time_hash * 1000.0);
+  printf("Unchanged input:   %.3f us per key\n", time_unchanged * 1e6 / EVALUATIONS_NUM);
+  printf("Animated input:    %.3f us per key\n", time_anim * 1e6 / EVALUATIONS_NUM);
+}
@@ -0,0 +1,170 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <cstring>
+#include <vector>
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+
+#include "BKE_library.h"
+#include "BKE_mesh.h"
+
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+}
+
+#define GRID_SIZE 200
+#define FAN_SIZE 64
+#define THREADS_NUM 8
+
+/**
+ * Vertex normals are added up from faces handled by multiple threads. Check they don't depend on
+ * the number of threads, on a jittered grid of quads and a fan of triangles around an n-gon, so
+ * the center of the fan has more corners than most vertices.
+ */
+class MeshNormalsTest : public testing::Test {
+ protected:
+  Mesh *mesh;
+
+  static void SetUpTestCase()
+  {
+    BLI_threadapi_init();
+    BLI_system_num_threads_override_set(THREADS_NUM);
+  }
+
+  static void TearDownTestCase()
+  {
+    BLI_system_num_threads_override_set(0);
+    BLI_threadapi_exit();
+  }
+
+  void SetUp() override
+  {
+    const int grid_verts_num = (GRID_SIZE + 1) * (GRID_SIZE + 1);
+    const int grid_polys_num = GRID_SIZE * GRID_SIZE;
+    mesh = BKE_mesh_new_nomain(grid_verts_num + FAN_SIZE + 1,
+                               0,
+                               0,
+                               grid_polys_num * 4 + FAN_SIZE * 4,
+                               grid_polys_num + FAN_SIZE + 1);
+
+    RNG *rng = BLI_rng_new(0);
+    MVert *mv = mesh->mvert;
+    for (int y = 0; y <= GRID_SIZE; y++) {
+      for (int x = 0; x <= GRID_SIZE; x++, mv++) {
+        mv->co[0] = (float)x;
+        mv->co[1] = (float)y;
+        mv->co[2] = BLI_rng_get_float(rng);
+      }
+    }
+    for (int i = 0; i < FAN_SIZE; i++, mv++) {
+      const float angle = (float)i * (float)(2.0 * M_PI) / FAN_SIZE;
+      mv->co[0] = cosf(angle) * 10.0f;
+      mv->co[1] = sinf(angle) * 10.0f;
+      mv->co[2] = -10.0f + BLI_rng_get_float(rng);
+    }
+    copy_v3_fl3(mv->co, 0.0f, 0.0f, -5.0f);
+    BLI_rng_free(rng);
+
+    MPoly *mp = mesh->mpoly;
+    MLoop *ml = mesh->mloop;
+    int loopstart = 0;
+    for (int y = 0; y < GRID_SIZE; y++) {
+      for (int x = 0; x < GRID_SIZE; x++, mp++) {
+        const unsigned int v = (unsigned int)(y * (GRID_SIZE + 1) + x);
+        mp->loopstart = loopstart;
+        mp->totloop = 4;
+        (ml++)->v = v;
+        (ml++)->v = v + 1;
+        (ml++)->v = v + GRID_SIZE + 2;
+        (ml++)->v = v + GRID_SIZE + 1;
+        loopstart += 4;
+      }
+    }
+    const unsigned int ring = (unsigned int)grid_verts_num;
+    const unsigned int center = ring + FAN_SIZE;
+    for (int i = 0; i < FAN_SIZE; i++, mp++) {
+      mp->loopstart = loopstart;
+      mp->totloop = 3;
+      (ml++)->v = ring + (unsigned int)i;
+      (ml++)->v = ring + (unsigned int)((i + 1) % FAN_SIZE);
+      (ml++)->v = center;
+      loopstart += 3;
+    }
+    mp->loopstart = loopstart;
+    mp->totloop = FAN_SIZE;
+    for (int i = FAN_SIZE - 1; i >= 0; i--) {
+      (ml++)->v = ring + (unsigned int)i;
+    }
+  }
+
+  void TearDown() override
+  {
+    BKE_id_free(NULL, mesh);
+  }
+
+  std::vector<float> calc_normals_poly(const int threads_num)
+  {
+    BLI_system_num_threads_override_set(threads_num);
+    std::vector<float> normals((size_t)(mesh->totvert + mesh->totpoly) * 3);
+    float(*vert_normals)[3] = (float(*)[3])normals.data();
+    BKE_mesh_calc_normals_poly(mesh->mvert,
+                               vert_normals,
+                               mesh->totvert,
+                               mesh->mloop,
+                               mesh->mpoly,
+                               mesh->totloop,
+                               mesh->totpoly,
+                               vert_normals + mesh->totvert,
+                               false);
+    BLI_system_num_threads_override_set(THREADS_NUM);
+    return normals;
+  }
+
+  std::vector<short> calc_normals_looptri(const int threads_num)
+  {
+    const int looptri_num = poly_to_tri_count(mesh->totpoly, mesh->totloop);
+    MLoopTri *looptri = (MLoopTri *)MEM_malloc_arrayN(
+        (size_t)looptri_num, sizeof(*looptri), __func__);
+    BKE_mesh_recalc_looptri(
+        mesh->mloop, mesh->mpoly, mesh->mvert, mesh->totloop, mesh->totpoly, looptri);
+
+    BLI_system_num_threads_override_set(threads_num);
+    BKE_mesh_calc_normals_looptri(
+        mesh->mvert, mesh->totvert, mesh->mloop, looptri, looptri_num, NULL);
+    BLI_system_num_threads_override_set(THREADS_NUM);
+    MEM_freeN(looptri);
+
+    std::vector<short> normals;
+    for (int i = 0; i < mesh->totvert; i++) {
+      normals.insert(normals.end(), mesh->mvert[i].no, mesh->mvert[i].no + 3);
+    }
+    return normals;
+  }
+};
+
+TEST_F(MeshNormalsTest, PolyThreadsMatchSingleThread)
+{
+  const std::vector<float> expected = calc_normals_poly(1);
+  for (int i = 0; i < 4; i++) {
+    const std::vector<float> normals = calc_normals_poly(THREADS_NUM);
+    /* Exact comparison, the same values must be added up in the same order. */
+    EXPECT_EQ(memcmp(normals.data(), expected.data(), normals.size() * sizeof(float)), 0);
+  }
+}
+
+TEST_F(MeshNormalsTest, LoopTriThreadsMatchSingleThread)
+{
+  const std::vector<short> expected = calc_normals_looptri(1);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(calc_normals_looptri(THREADS_NUM), expected);
+  }
+}
@@ -0,0 +1,188 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <thread>
+#include <vector>
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+
+#include "BLI_fileops.h"
+#include "BLI_listbase.h"
+#include "BLI_path_util.h"
+#include "BLI_string.h"
+#include "BLI_threads.h"
+
+#include "BKE_main.h"
+#include "BKE_scene.h"
+#include "BKE_sequencer.h"
+
+#include "DNA_scene_types.h"
+#include "DNA_sequence_types.h"
+
+#include "IMB_imbuf.h"
+#include "IMB_imbuf_types.h"
+}
+
+#define IMAGE_SIZE 64
+#define FRAMES_NUM 8
+#define THREADS_NUM SEQ_PREFETCH_WORKERS_MAX
+#define ITERATIONS_NUM 4
+
+/**
+ * Strips without shared state are rendered without the render lock, so frames are rendered by
+ * several threads at once when prefetching. Check this gives the same images as rendering them
+ * one at a time: images of an image strip, blended with a color strip by an effect, blurred.
+ */
+class SequencerRenderTest : public testing::Test {
+ protected:
+  Main *bmain;
+  Scene *scene;
+  std::vector<std::string> filepaths;
+
+  static void SetUpTestCase()
+  {
+    BLI_threadapi_init();
+    IMB_init();
+  }
+
+  static void TearDownTestCase()
+  {
+    IMB_exit();
+    BLI_threadapi_exit();
+  }
+
+  void SetUp() override
+  {
+    bmain = BKE_main_new();
+    scene = BKE_scene_add(bmain, "Scene");
+    scene->r.xsch = IMAGE_SIZE;
+    scene->r.ysch = IMAGE_SIZE;
+    Editing *ed = BKE_sequencer_editing_ensure(scene);
+
+    Sequence *seq_image = add_image_strip(ed);
+
+    Sequence *seq_color = BKE_sequence_alloc(ed->seqbasep, 1, 2, SEQ_TYPE_COLOR);
+    BKE_sequence_get_effect(seq_color).init(seq_color);
+    seq_color->len = 1;
+    BKE_sequence_tx_set_final_right(seq_color, 1 + FRAMES_NUM);
+    ((SolidColorVars *)seq_color->effectdata)->col[0] = 0.2f;
+    ((SolidColorVars *)seq_color->effectdata)->col[1] = 0.6f;
+    ((SolidColorVars *)seq_color->effectdata)->col[2] = 0.9f;
+    seq_color->blend_mode = SEQ_TYPE_CROSS;
+    BKE_sequence_calc(scene, seq_color);
+
+    Sequence *seq_cross = add_effect_strip(ed, SEQ_TYPE_GAMCROSS, 3, seq_image, seq_color);
+    add_effect_strip(ed, SEQ_TYPE_GAUSSIAN_BLUR, 4, seq_cross, NULL);
+  }
+
+  void TearDown() override
+  {
+    BKE_main_free(bmain);
+    for (const std::string &filepath : filepaths) {
+      BLI_delete(filepath.c_str(), false, false);
+    }
+  }
+
+  /* Image strip of files with a different gradient for every frame. */
+  Sequence *add_image_strip(Editing *ed)
+  {
+    Sequence *seq = BKE_sequence_alloc(ed->seqbasep, 1, 1, SEQ_TYPE_IMAGE);
+    seq->blend_mode = SEQ_TYPE_CROSS;
+    seq->len = FRAMES_NUM;
+    seq->strip->stripdata = (StripElem *)MEM_callocN(sizeof(StripElem) * FRAMES_NUM, __func__);
+    BLI_current_working_dir(seq->strip->dir, sizeof(seq->strip->dir));
+    BLI_add_slash(seq->strip->dir);
+
+    for (int frame = 0; frame < FRAMES_NUM; frame++) {
+      char filename[FILE_MAXFILE];
+      BLI_snprintf(filename, sizeof(filename), "sequencer_render_test_%d.png", frame);
+      BLI_strncpy(seq->strip->stripdata[frame].name, filename, sizeof(filename));
+      char filepath[FILE_MAX];
+      BLI_join_dirfile(filepath, sizeof(filepath), seq->strip->dir, filename);
+
+      ImBuf *ibuf = IMB_allocImBuf(IMAGE_SIZE, IMAGE_SIZE, 32, IB_rect);
+      unsigned char *rect = (unsigned char *)ibuf->rect;
+      for (int i = 0; i < IMAGE_SIZE * IMAGE_SIZE; i++) {
+        rect[i * 4 + 0] = (unsigned char)(i * (frame + 1));
+        rect[i * 4 + 1] = (unsigned char)(i / IMAGE_SIZE * 4);
+        rect[i * 4 + 2] = (unsigned char)(frame * 32);
+        rect[i * 4 + 3] = 255;
+      }
+      ibuf->ftype = IMB_FTYPE_PNG;
+      EXPECT_TRUE(IMB_saveiff(ibuf, filepath, IB_rect));
+      IMB_freeImBuf(ibuf);
+      filepaths.push_back(filepath);
+    }
+
+    BKE_sequence_calc(scene, seq);
+    return seq;
+  }
+
+  Sequence *add_effect_strip(Editing *ed, int type, int channel, Sequence *seq1, Sequence *seq2)
+  {
+    Sequence *seq = BKE_sequence_alloc(ed->seqbasep, 1, channel, type);
+    seq->seq1 = seq1;
+    seq->seq2 = seq2;
+    BKE_sequence_get_effect(seq).init(seq);
+    BKE_sequence_calc(scene, seq);
+    return seq;
+  }
+
+  /* Render without the cache, so every frame is rendered again. */
+  std::vector<unsigned int> render(int task_id, int frame)
+  {
+    SeqRenderData context;
+    BKE_sequencer_new_render_data(bmain, NULL, scene, IMAGE_SIZE, IMAGE_SIZE, 100, false, &context);
+    context.skip_cache = true;
+    context.task_id = (eSeqTaskId)task_id;
+
+    std::vector<unsigned int> pixels;
+    ImBuf *ibuf = BKE_sequencer_give_ibuf(&context, 1 + frame, 0);
+    EXPECT_NE(ibuf, nullptr);
+    if (ibuf == NULL) {
+      return pixels;
+    }
+    if (ibuf->rect == NULL) {
+      IMB_rect_from_float(ibuf);
+    }
+    pixels.assign(ibuf->rect, ibuf->rect + ibuf->x * ibuf->y);
+    IMB_freeImBuf(ibuf);
+    return pixels;
+  }
+};
+
+TEST_F(SequencerRenderTest, ThreadsMatchSingleThread)
+{
+  std::vector<unsigned int> expected[FRAMES_NUM];
+  for (int frame = 0; frame < FRAMES_NUM; frame++) {
+    expected[frame] = render(SEQ_TASK_MAIN_RENDER, frame);
+    ASSERT_EQ(expected[frame].size(), IMAGE_SIZE * IMAGE_SIZE);
+  }
+  /* Frames differ, so images rendered for the wrong frame are noticed. */
+  EXPECT_NE(expected[0], expected[1]);
+
+  int mismatches[THREADS_NUM] = {0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < THREADS_NUM; i++) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < ITERATIONS_NUM * FRAMES_NUM; j++) {
+        /* Different frames in every thread at the same time. */
+        const int frame = (j + i * 3) % FRAMES_NUM;
+        if (render(SEQ_TASK_PREFETCH_RENDER + i, frame) != expected[frame]) {
+          mismatches[i]++;
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (int i = 0; i < THREADS_NUM; i++) {
+    EXPECT_EQ(mismatches[i], 0);
+  }
+}
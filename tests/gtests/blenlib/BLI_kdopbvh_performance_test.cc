@@ -0,0 +1,179 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_compiler_attrs.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math_geom.h"
+#include "BLI_math_vector.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+
+#include "PIL_time.h"
+}
+
+#include "stubs/bf_intern_eigen_stubs.h"
+
+#define TRIS_NUM 200000
+#define QUERIES_NUM 1000000
+/* Nearest point queries are a lot slower than ray-casts. */
+#define NEAREST_QUERIES_NUM (QUERIES_NUM / 4)
+
+static void raycast_tris_callback(void *userdata,
+                                  int index,
+                                  const BVHTreeRay *ray,
+                                  BVHTreeRayHit *hit)
+{
+  const float(*tris)[3][3] = (const float(*)[3][3])userdata;
+  float dist;
+
+  if (isect_ray_tri_watertight_v3(
+          ray->origin, ray->isect_precalc, UNPACK3(tris[index]), &dist, NULL) &&
+      (dist < hit->dist)) {
+    hit->index = index;
+    hit->dist = dist;
+  }
+}
+
+/* Small triangles scattered in a unit cube. */
+static BVHTree *tris_tree_create(RNG *rng, float (**r_tris)[3][3])
+{
+  float(*tris)[3][3] = (float(*)[3][3])MEM_mallocN(sizeof(*tris) * TRIS_NUM, __func__);
+  BVHTree *tree = BLI_bvhtree_new(TRIS_NUM, 0.0f, 4, 6);
+
+  for (int i = 0; i < TRIS_NUM; i++) {
+    float center[3];
+    BLI_rng_get_float_unit_v3(rng, center);
+    mul_v3_fl(center, BLI_rng_get_float(rng));
+    for (int j = 0; j < 3; j++) {
+      BLI_rng_get_float_unit_v3(rng, tris[i][j]);
+      madd_v3_v3v3fl(tris[i][j], center, tris[i][j], 0.02f);
+    }
+    BLI_bvhtree_insert(tree, i, tris[i][0], 3);
+  }
+  BLI_bvhtree_balance(tree);
+
+  *r_tris = tris;
+  return tree;
+}
+
+static void raycast_benchmark(const char *id, bool coherent)
+{
+  RNG *rng = BLI_rng_new(0);
+  float(*tris)[3][3];
+  BVHTree *tree = tris_tree_create(rng, &tris);
+
+  float(*co)[3] = (float(*)[3])MEM_mallocN(sizeof(*co) * QUERIES_NUM, __func__);
+  float(*dir)[3] = (float(*)[3])MEM_mallocN(sizeof(*dir) * QUERIES_NUM, __func__);
+  BVHTreeRayHit *hits = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hits) * QUERIES_NUM, __func__);
+
+  for (int i = 0; i < QUERIES_NUM; i++) {
+    if (coherent) {
+      /* Rays of a camera looking at the cube, in scan-line order. */
+      const int size = 1000;
+      const float pixel[3] = {
+          (float)(i % size) / size - 0.5f, (float)(i / size) / size - 0.5f, -1.0f};
+      copy_v3_fl3(co[i], 0.0f, 0.0f, 3.0f);
+      normalize_v3_v3(dir[i], pixel);
+    }
+    else {
+      BLI_rng_get_float_unit_v3(rng, co[i]);
+      mul_v3_fl(co[i], 2.0f);
+      BLI_rng_get_float_unit_v3(rng, dir[i]);
+    }
+  }
+
+  double time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < QUERIES_NUM; i++) {
+    hits[i].index = -1;
+    hits[i].dist = BVH_RAYCAST_DIST_MAX;
+    BLI_bvhtree_ray_cast(tree, co[i], dir[i], 0.0f, &hits[i], raycast_tris_callback, tris);
+  }
+  const double time_scalar = PIL_check_seconds_timer() - time_start;
+
+  time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < QUERIES_NUM; i++) {
+    hits[i].index = -1;
+    hits[i].dist = BVH_RAYCAST_DIST_MAX;
+  }
+  BLI_bvhtree_ray_cast_batch(
+      tree, co, dir, 0.0f, hits, QUERIES_NUM, raycast_tris_callback, tris, BVH_RAYCAST_DEFAULT);
+  const double time_batch = PIL_check_seconds_timer() - time_start;
+
+  printf("%s: scalar %.3fs (%.2f Mrays/s), batch %.3fs (%.2f Mrays/s)\n",
+         id,
+         time_scalar,
+         QUERIES_NUM / time_scalar * 1e-6,
+         time_batch,
+         QUERIES_NUM / time_batch * 1e-6);
+
+  BLI_bvhtree_free(tree);
+  BLI_rng_free(rng);
+  MEM_freeN(tris);
+  MEM_freeN(co);
+  MEM_freeN(dir);
+  MEM_freeN(hits);
+}
+
+static void find_nearest_benchmark(const char *id)
+{
+  RNG *rng = BLI_rng_new(0);
+  float(*tris)[3][3];
+  BVHTree *tree = tris_tree_create(rng, &tris);
+
+  float(*co)[3] = (float(*)[3])MEM_mallocN(sizeof(*co) * NEAREST_QUERIES_NUM, __func__);
+  BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(
+      sizeof(*nearest) * NEAREST_QUERIES_NUM, __func__);
+  for (int i = 0; i < NEAREST_QUERIES_NUM; i++) {
+    BLI_rng_get_float_unit_v3(rng, co[i]);
+    mul_v3_fl(co[i], 1.5f * BLI_rng_get_float(rng));
+  }
+
+  double time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < NEAREST_QUERIES_NUM; i++) {
+    nearest[i].index = -1;
+    nearest[i].dist_sq = FLT_MAX;
+    BLI_bvhtree_find_nearest(tree, co[i], &nearest[i], NULL, NULL);
+  }
+  const double time_scalar = PIL_check_seconds_timer() - time_start;
+
+  time_start = PIL_check_seconds_timer();
+  for (int i = 0; i < NEAREST_QUERIES_NUM; i++) {
+    nearest[i].index = -1;
+    nearest[i].dist_sq = FLT_MAX;
+  }
+  BLI_bvhtree_find_nearest_batch(tree, co, nearest, NEAREST_QUERIES_NUM, NULL, NULL, 0);
+  const double time_batch = PIL_check_seconds_timer() - time_start;
+
+  printf("%s: scalar %.3fs, batch %.3fs\n", id, time_scalar, time_batch);
+
+  BLI_bvhtree_free(tree);
+  BLI_rng_free(rng);
+  MEM_freeN(tris);
+  MEM_freeN(co);
+  MEM_freeN(nearest);
+}
+
+TEST(kdopbvh, RayCastCoherent)
+{
+  BLI_threadapi_init();
+  raycast_benchmark("Ray-cast coherent", true);
+  BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, RayCastIncoherent)
+{
+  BLI_threadapi_init();
+  raycast_benchmark("Ray-cast incoherent", false);
+  BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, FindNearest)
+{
+  BLI_threadapi_init();
+  find_nearest_benchmark("Find nearest");
+  BLI_threadapi_exit();
+}
@@ -266,6 +266,25 @@ TEST(map, Clear)
   EXPECT_FALSE(map.contains(2));
 }
 
+TEST(map, ClearAndKeepCapacity)
+{
+  IntFloatMap map;
+  for (int i = 0; i < 100; i++) {
+    map.add(i, (float)i);
+  }
+  EXPECT_EQ(map.size(), 100);
+
+  map.clear_and_keep_capacity();
+
+  EXPECT_EQ(map.size(), 0);
+  EXPECT_FALSE(map.contains(1));
+  EXPECT_FALSE(map.contains(99));
+
+  map.add(5, 2.0f);
+  EXPECT_EQ(map.size(), 1);
+  EXPECT_EQ(map.lookup(5), 2.0f);
+}
+
 TEST(map, UniquePtrValue)
 {
   auto value1 = std::unique_ptr<int>(new int());
@@ -15,6 +15,7 @@ extern "C" {
 #include "BLI_listbase.h"
 #include "BLI_mempool.h"
 #include "BLI_task.h"
+#include "BLI_threads.h"
 
 #include "PIL_time.h"
 }
@@ -296,3 +297,112 @@ TEST(task, ListBaseIter100k)
 {
   task_listbase_test("ListBase parallel iteration - Threaded - 100000 items", 100000, true);
 }
+
+/* *** Task scheduler scaling over number of threads. *** */
+
+#define SCALING_TREE_DEPTH 14
+#define SCALING_FLAT_TASKS 20000
+
+static void task_scaling_work(const int index)
+{
+  const uint limit = gen_pseudo_random_number((uint)index);
+  for (uint i = (uint)index; i < limit;) {
+    i += gen_pseudo_random_number(i);
+  }
+}
+
+/* Flat workload: all tasks are pushed from the main thread, workers have to steal them. */
+static void task_scaling_flat_func(TaskPool *__restrict UNUSED(pool),
+                                   void *taskdata,
+                                   int UNUSED(thread_id))
+{
+  task_scaling_work(POINTER_AS_INT(taskdata));
+}
+
+/* Recursive workload: every task spawns two children until given depth is reached, so tasks are
+ * pushed from all worker threads. */
+static void task_scaling_tree_func(TaskPool *__restrict pool, void *taskdata, int thread_id)
+{
+  const int depth = POINTER_AS_INT(taskdata);
+  task_scaling_work(depth);
+  if (depth > 0) {
+    for (int i = 0; i < 2; i++) {
+      BLI_task_pool_push_from_thread(pool,
+                                     task_scaling_tree_func,
+                                     POINTER_FROM_INT(depth - 1),
+                                     false,
+                                     TASK_PRIORITY_HIGH,
+                                     thread_id);
+    }
+  }
+}
+
+static void task_scaling_test_do(const int num_threads, double *r_flat_time, double *r_tree_time)
+{
+  TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+
+  *r_flat_time = 0.0;
+  *r_tree_time = 0.0;
+  for (int i = 0; i < NUM_RUN_AVERAGED / 10; i++) {
+    double init_time = PIL_check_seconds_timer();
+    TaskPool *pool = BLI_task_pool_create(scheduler, NULL);
+    for (int j = 0; j < SCALING_FLAT_TASKS; j++) {
+      BLI_task_pool_push(
+          pool, task_scaling_flat_func, POINTER_FROM_INT(j), false, TASK_PRIORITY_LOW);
+    }
+    BLI_task_pool_work_and_wait(pool);
+    BLI_task_pool_free(pool);
+    *r_flat_time += PIL_check_seconds_timer() - init_time;
+
+    init_time = PIL_check_seconds_timer();
+    pool = BLI_task_pool_create(scheduler, NULL);
+    BLI_task_pool_push(pool,
+                       task_scaling_tree_func,
+                       POINTER_FROM_INT(SCALING_TREE_DEPTH),
+                       false,
+                       TASK_PRIORITY_HIGH);
+    BLI_task_pool_work_and_wait(pool);
+    BLI_task_pool_free(pool);
+    *r_tree_time += PIL_check_seconds_timer() - init_time;
+  }
+  *r_flat_time /= NUM_RUN_AVERAGED / 10;
+  *r_tree_time /= NUM_RUN_AVERAGED / 10;
+
+  BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, SchedulerScaling)
+{
+  const int max_threads = BLI_system_thread_count();
+  const int num_tree_tasks = (1 << (SCALING_TREE_DEPTH + 1)) - 1;
+
+  printf("\n========== STARTING Task scheduler scaling ==========\n");
+
+  BLI_threadapi_init();
+
+  double flat_time_single = 0.0, tree_time_single = 0.0;
+  for (int num_threads = 1;; num_threads *= 2) {
+    if (num_threads > max_threads) {
+      num_threads = max_threads;
+    }
+    double flat_time, tree_time;
+    task_scaling_test_do(num_threads, &flat_time, &tree_time);
+    if (num_threads == 1) {
+      flat_time_single = flat_time;
+      tree_time_single = tree_time;
+    }
+    printf("\t%3d threads: flat %.0f tasks/s (x%.2f), tree %.0f tasks/s (x%.2f)\n",
+           num_threads,
+           SCALING_FLAT_TASKS / flat_time,
+           flat_time_single / flat_time,
+           num_tree_tasks / tree_time,
+           tree_time_single / tree_time);
+    if (num_threads == max_threads) {
+      break;
+    }
+  }
+
+  BLI_threadapi_exit();
+
+  printf("========== ENDED Task scheduler scaling ==========\n\n");
+}
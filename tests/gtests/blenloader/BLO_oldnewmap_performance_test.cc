@@ -0,0 +1,375 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_rand.h"
+#include "PIL_time_utildefines.h"
+
+#include "readfile_oldnewmap.h"
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Environment variable with the path of a file to read the old pointers from the blocks of
+ * (uncompressed, 64 bit little endian). Otherwise pointers to allocations with sizes similar to
+ * file data are used. */
+#define BLEND_FILE_PATH_ENV "BLO_OLDNEWMAP_BLEND_FILE"
+
+/* Number of pointers used when not reading them from a file. */
+#define POINTERS_NUM 500000
+
+/* Number of blocks per ID, for the data map which is cleared for every ID. */
+#define ID_BLOCKS_NUM 16
+
+/* Number of times every pointer is looked up. */
+#define LOOKUPS_NUM 4
+
+/* -------------------------------------------------------------------- */
+/** \name Reference Implementation
+ *
+ * The map used before, indices stored with probing based on Python dicts.
+ * \{ */
+
+typedef struct RefOldNewMap {
+  OldNew *entries;
+  int nentries;
+  int32_t *map;
+  int capacity_exp;
+} RefOldNewMap;
+
+#define ENTRIES_CAPACITY(onm) (1ll << (onm)->capacity_exp)
+#define MAP_CAPACITY(onm) (1ll << ((onm)->capacity_exp + 1))
+#define SLOT_MASK(onm) (MAP_CAPACITY(onm) - 1)
+#define DEFAULT_SIZE_EXP 6
+#define PERTURB_SHIFT 5
+
+#define ITER_SLOTS(onm, KEY, SLOT_NAME, INDEX_NAME) \
+  uint32_t hash = BLI_ghashutil_ptrhash(KEY); \
+  uint32_t mask = SLOT_MASK(onm); \
+  uint perturb = hash; \
+  int SLOT_NAME = mask & hash; \
+  int INDEX_NAME = onm->map[SLOT_NAME]; \
+  for (;; SLOT_NAME = mask & ((5 * SLOT_NAME) + 1 + perturb), \
+          perturb >>= PERTURB_SHIFT, \
+          INDEX_NAME = onm->map[SLOT_NAME])
+
+static void ref_oldnewmap_insert_index_in_map(RefOldNewMap *onm, const void *ptr, int index)
+{
+  ITER_SLOTS (onm, ptr, slot, stored_index) {
+    if (stored_index == -1) {
+      onm->map[slot] = index;
+      break;
+    }
+  }
+}
+
+static void ref_oldnewmap_clear_map(RefOldNewMap *onm)
+{
+  memset(onm->map, 0xFF, MAP_CAPACITY(onm) * sizeof(*onm->map));
+}
+
+static RefOldNewMap *ref_oldnewmap_new(void)
+{
+  RefOldNewMap *onm = (RefOldNewMap *)MEM_callocN(sizeof(*onm), __func__);
+  onm->capacity_exp = DEFAULT_SIZE_EXP;
+  onm->entries = (OldNew *)MEM_malloc_arrayN(
+      ENTRIES_CAPACITY(onm), sizeof(*onm->entries), __func__);
+  onm->map = (int32_t *)MEM_malloc_arrayN(MAP_CAPACITY(onm), sizeof(*onm->map), __func__);
+  ref_oldnewmap_clear_map(onm);
+  return onm;
+}
+
+static void ref_oldnewmap_insert(RefOldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
+{
+  if (UNLIKELY(onm->nentries == ENTRIES_CAPACITY(onm))) {
+    onm->capacity_exp++;
+    onm->entries = (OldNew *)MEM_reallocN(onm->entries,
+                                          sizeof(*onm->entries) * ENTRIES_CAPACITY(onm));
+    onm->map = (int32_t *)MEM_reallocN(onm->map, sizeof(*onm->map) * MAP_CAPACITY(onm));
+    ref_oldnewmap_clear_map(onm);
+    for (int i = 0; i < onm->nentries; i++) {
+      ref_oldnewmap_insert_index_in_map(onm, onm->entries[i].oldp, i);
+    }
+  }
+
+  ITER_SLOTS (onm, oldaddr, slot, index) {
+    if (index == -1) {
+      OldNew *entry = &onm->entries[onm->nentries];
+      entry->oldp = oldaddr;
+      entry->newp = newaddr;
+      entry->nr = nr;
+      onm->map[slot] = onm->nentries;
+      onm->nentries++;
+      break;
+    }
+    else if (onm->entries[index].oldp == oldaddr) {
+      onm->entries[index].newp = newaddr;
+      onm->entries[index].nr = nr;
+      break;
+    }
+  }
+}
+
+static OldNew *ref_oldnewmap_lookup_entry(const RefOldNewMap *onm, const void *addr)
+{
+  ITER_SLOTS (onm, addr, slot, index) {
+    if (index >= 0) {
+      OldNew *entry = &onm->entries[index];
+      if (entry->oldp == addr) {
+        return entry;
+      }
+    }
+    else {
+      return NULL;
+    }
+  }
+}
+
+static void ref_oldnewmap_clear(RefOldNewMap *onm)
+{
+  onm->capacity_exp = DEFAULT_SIZE_EXP;
+  ref_oldnewmap_clear_map(onm);
+  onm->nentries = 0;
+}
+
+static void ref_oldnewmap_free(RefOldNewMap *onm)
+{
+  MEM_freeN(onm->entries);
+  MEM_freeN(onm->map);
+  MEM_freeN(onm);
+}
+
+#undef ENTRIES_CAPACITY
+#undef MAP_CAPACITY
+#undef SLOT_MASK
+#undef DEFAULT_SIZE_EXP
+#undef PERTURB_SHIFT
+#undef ITER_SLOTS
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Old Pointers
+ * \{ */
+
+typedef struct OldPointers {
+  const void **ptrs;
+  int ptrs_len;
+  /* Allocations the pointers come from, when not read from a file. */
+  void **allocs;
+} OldPointers;
+
+static bool old_pointers_from_file(OldPointers *op, const char *filepath)
+{
+  FILE *file = fopen(filepath, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char header[12];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      !STREQLEN(header, "BLENDER-v", 9)) {
+    fclose(file);
+    return false;
+  }
+
+  int ptrs_alloc = 1 << 16;
+  op->ptrs = (const void **)MEM_malloc_arrayN(ptrs_alloc, sizeof(*op->ptrs), __func__);
+  op->ptrs_len = 0;
+
+  /* Matches #BHead8. */
+  struct {
+    int code, len;
+    uint64_t old;
+    int SDNAnr, nr;
+  } bhead;
+  while (fread(&bhead, sizeof(bhead), 1, file) == 1 && bhead.len >= 0) {
+    if (op->ptrs_len == ptrs_alloc) {
+      ptrs_alloc *= 2;
+      op->ptrs = (const void **)MEM_reallocN(op->ptrs, sizeof(*op->ptrs) * ptrs_alloc);
+    }
+    op->ptrs[op->ptrs_len++] = (const void *)(uintptr_t)bhead.old;
+    fseek(file, bhead.len, SEEK_CUR);
+  }
+  fclose(file);
+  op->allocs = NULL;
+  return true;
+}
+
+/**
+ * Allocate blocks with sizes similar to the data in files:
+ * mostly small structs, some arrays and a few large arrays.
+ */
+static void old_pointers_from_allocs(OldPointers *op, const int ptrs_len)
+{
+  RNG *rng = BLI_rng_new(0);
+  op->ptrs = (const void **)MEM_malloc_arrayN(ptrs_len, sizeof(*op->ptrs), __func__);
+  op->allocs = (void **)MEM_malloc_arrayN(ptrs_len, sizeof(*op->allocs), __func__);
+  op->ptrs_len = ptrs_len;
+  for (int i = 0; i < ptrs_len; i++) {
+    const float r = BLI_rng_get_float(rng);
+    size_t size;
+    if (r < 0.75f) {
+      size = 16 + BLI_rng_get_uint(rng) % 240;
+    }
+    else if (r < 0.98f) {
+      size = 256 + BLI_rng_get_uint(rng) % 3840;
+    }
+    else {
+      size = 4096 + BLI_rng_get_uint(rng) % 61440;
+    }
+    op->allocs[i] = MEM_mallocN(size, __func__);
+    op->ptrs[i] = op->allocs[i];
+  }
+  BLI_rng_free(rng);
+}
+
+static void old_pointers_free(OldPointers *op)
+{
+  if (op->allocs) {
+    for (int i = 0; i < op->ptrs_len; i++) {
+      MEM_freeN(op->allocs[i]);
+    }
+    MEM_freeN(op->allocs);
+  }
+  MEM_freeN(op->ptrs);
+}
+
+static void old_pointers_ensure(OldPointers *op)
+{
+  const char *filepath = getenv(BLEND_FILE_PATH_ENV);
+  if (filepath != NULL && filepath[0] != '\0') {
+    if (old_pointers_from_file(op, filepath)) {
+      printf("Using %d pointers from '%s'\n", op->ptrs_len, filepath);
+      return;
+    }
+    printf("Failed to read '%s', skipping it\n", filepath);
+  }
+  old_pointers_from_allocs(op, POINTERS_NUM);
+  printf("Using %d pointers from allocations\n", op->ptrs_len);
+}
+
+/* Order of lookups, every pointer is looked up multiple times in random order. */
+static int *lookup_order_new(const OldPointers *op, const int chunk_len)
+{
+  const int lookups_len = op->ptrs_len * LOOKUPS_NUM;
+  int *order = (int *)MEM_malloc_arrayN(lookups_len, sizeof(*order), __func__);
+  for (int i = 0; i < lookups_len; i++) {
+    order[i] = i % op->ptrs_len;
+  }
+  /* Shuffle within chunks, since the data map is cleared for every ID. */
+  RNG *rng = BLI_rng_new(1);
+  for (int chunk_start = 0; chunk_start < op->ptrs_len; chunk_start += chunk_len) {
+    const int len = MIN2(chunk_len, op->ptrs_len - chunk_start);
+    for (int i = 0; i < LOOKUPS_NUM; i++) {
+      BLI_rng_shuffle_array(rng, &order[i * op->ptrs_len + chunk_start], sizeof(*order), len);
+    }
+  }
+  BLI_rng_free(rng);
+  return order;
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Benchmarks
+ * \{ */
+
+/**
+ * Insert all pointers, then look them up (like the library and global maps),
+ * or insert and look up chunks of pointers, clearing the map in between (like the data map).
+ *
+ * \param reserve_first: Reserve this many entries first, like for an ID with many data blocks.
+ */
+static void oldnewmap_benchmark(const OldPointers *op,
+                                const int chunk_len,
+                                const bool use_reserve,
+                                const int reserve_first = 0)
+{
+  int *order = lookup_order_new(op, chunk_len);
+  size_t found_ref = 0, found = 0;
+  /* Pointers found after the map was cleared. */
+  size_t found_cleared = 0;
+
+  printf("\n========== %s (%d per chunk, %d reserved first) ==========\n",
+         (chunk_len == op->ptrs_len) ? "Single map" : "Cleared map",
+         chunk_len,
+         reserve_first);
+
+  {
+    RefOldNewMap *onm = ref_oldnewmap_new();
+    TIMEIT_START(reference);
+    for (int chunk_start = 0; chunk_start < op->ptrs_len; chunk_start += chunk_len) {
+      const int chunk_end = MIN2(chunk_start + chunk_len, op->ptrs_len);
+      for (int i = chunk_start; i < chunk_end; i++) {
+        ref_oldnewmap_insert(onm, op->ptrs[i], (void *)op->ptrs[i], 0);
+      }
+      for (int j = 0; j < LOOKUPS_NUM; j++) {
+        for (int i = chunk_start; i < chunk_end; i++) {
+          OldNew *entry = ref_oldnewmap_lookup_entry(onm, op->ptrs[order[j * op->ptrs_len + i]]);
+          found_ref += (entry != NULL);
+        }
+      }
+      ref_oldnewmap_clear(onm);
+    }
+    TIMEIT_END(reference);
+    ref_oldnewmap_free(onm);
+  }
+
+  {
+    OldNewMap *onm = oldnewmap_new();
+    if (reserve_first != 0) {
+      oldnewmap_reserve(onm, reserve_first);
+    }
+    TIMEIT_START(map);
+    for (int chunk_start = 0; chunk_start < op->ptrs_len; chunk_start += chunk_len) {
+      const int chunk_end = MIN2(chunk_start + chunk_len, op->ptrs_len);
+      if (use_reserve) {
+        oldnewmap_reserve(onm, chunk_end - chunk_start);
+      }
+      for (int i = chunk_start; i < chunk_end; i++) {
+        oldnewmap_insert(onm, op->ptrs[i], (void *)op->ptrs[i], 0);
+      }
+      for (int j = 0; j < LOOKUPS_NUM; j++) {
+        for (int i = chunk_start; i < chunk_end; i++) {
+          OldNew *entry = oldnewmap_lookup_entry(onm, op->ptrs[order[j * op->ptrs_len + i]]);
+          found += (entry != NULL);
+        }
+      }
+      oldnewmap_clear(onm);
+      found_cleared += (oldnewmap_lookup_entry(onm, op->ptrs[chunk_start]) != NULL);
+    }
+    TIMEIT_END(map);
+    oldnewmap_free(onm);
+  }
+
+  EXPECT_EQ(found_ref, found);
+  EXPECT_EQ(found_cleared, 0);
+  MEM_freeN(order);
+}
+
+TEST(oldnewmap, SingleMap)
+{
+  OldPointers op;
+  old_pointers_ensure(&op);
+  oldnewmap_benchmark(&op, op.ptrs_len, false);
+  oldnewmap_benchmark(&op, op.ptrs_len, true);
+  old_pointers_free(&op);
+}
+
+TEST(oldnewmap, ClearedMap)
+{
+  OldPointers op;
+  old_pointers_ensure(&op);
+  oldnewmap_benchmark(&op, ID_BLOCKS_NUM, true);
+  oldnewmap_benchmark(&op, ID_BLOCKS_NUM, false);
+  oldnewmap_benchmark(&op, ID_BLOCKS_NUM, true, op.ptrs_len / 4);
+  old_pointers_free(&op);
+}
+
+/** \} */
@@ -0,0 +1,81 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <string.h>
+
+extern "C" {
+#include "DNA_listBase.h"
+
+#include "BLI_threads.h"
+#include "BLI_utildefines.h"
+
+#include "BLO_undofile.h"
+}
+
+/* Memfile chunk data is only to be accessed from the main thread. */
+class UndofileTest : public testing::Test {
+ protected:
+  static void SetUpTestCase()
+  {
+    BLI_threadapi_init();
+  }
+
+  static void TearDownTestCase()
+  {
+    BLI_threadapi_exit();
+  }
+};
+
+static void memfile_write(MemFile *memfile, MemFile *compare, const char **chunks, int chunks_num)
+{
+  MemFileChunk *compchunk = (compare != NULL) ? (MemFileChunk *)compare->chunks.first : NULL;
+  for (int i = 0; i < chunks_num; i++) {
+    memfile_chunk_add(memfile, chunks[i], (uint)strlen(chunks[i]), &compchunk);
+  }
+}
+
+static MemFileChunk *memfile_chunk(MemFile *memfile, int index)
+{
+  MemFileChunk *chunk = (MemFileChunk *)memfile->chunks.first;
+  while (index--) {
+    chunk = (MemFileChunk *)chunk->next;
+  }
+  return chunk;
+}
+
+TEST_F(UndofileTest, ShiftedChunksAreShared)
+{
+  MemFile first = {{NULL, NULL}, 0, 0};
+  const char *first_chunks[] = {"aaaa", "bbbb", "cccc"};
+  memfile_write(&first, NULL, first_chunks, ARRAY_SIZE(first_chunks));
+  EXPECT_EQ(first.size, 12);
+  EXPECT_EQ(first.size_total, 12);
+
+  /* Inserted chunk shifts all the following ones. */
+  MemFile second = {{NULL, NULL}, 0, 0};
+  const char *second_chunks[] = {"xx", "aaaa", "bbbb", "cccc"};
+  memfile_write(&second, &first, second_chunks, ARRAY_SIZE(second_chunks));
+  EXPECT_EQ(second.size, 2);
+  EXPECT_EQ(second.size_total, 14);
+  EXPECT_FALSE(memfile_chunk(&second, 0)->is_identical);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(memfile_chunk(&second, i + 1)->is_identical);
+    EXPECT_EQ(memfile_chunk(&second, i + 1)->buf, memfile_chunk(&first, i)->buf);
+  }
+
+  /* Data shared with later memfiles stays when freeing the first one. */
+  BLO_memfile_merge(&first, &second);
+  EXPECT_EQ(memcmp(memfile_chunk(&second, 1)->buf, "aaaa", 4), 0);
+
+  /* Identical chunks within the same memfile are shared as well. */
+  MemFile third = {{NULL, NULL}, 0, 0};
+  const char *third_chunks[] = {"cccc", "yy", "yy"};
+  memfile_write(&third, &second, third_chunks, ARRAY_SIZE(third_chunks));
+  EXPECT_EQ(third.size, 2);
+  EXPECT_EQ(third.size_total, 8);
+  EXPECT_EQ(memfile_chunk(&third, 1)->buf, memfile_chunk(&third, 2)->buf);
+
+  BLO_memfile_free(&second);
+  BLO_memfile_free(&third);
+}
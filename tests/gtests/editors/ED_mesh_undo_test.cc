@@ -0,0 +1,260 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+#include "CLG_log.h"
+
+extern "C" {
+#include "BLI_listbase.h"
+#include "BLI_math_vector.h"
+#include "BLI_threads.h"
+
+#include "BKE_blender.h"
+#include "BKE_context.h"
+#include "BKE_editmesh.h"
+#include "BKE_global.h"
+#include "BKE_image.h"
+#include "BKE_layer.h"
+#include "BKE_main.h"
+#include "BKE_object.h"
+#include "BKE_scene.h"
+#include "BKE_undo_system.h"
+
+#include "DNA_genfile.h"
+#include "DNA_mesh_types.h"
+#include "DNA_object_types.h"
+#include "DNA_screen_types.h"
+#include "DNA_windowmanager_types.h"
+
+#include "ED_mesh.h"
+#include "ED_object.h"
+
+#include "IMB_imbuf.h"
+
+#include "bmesh.h"
+}
+
+/* Vertices of the grid the tests move, few enough to be stored as changes. */
+#define GRID_SIZE 32
+#define MOVE_VERTS_NUM 10
+
+static Object *test_obedit = NULL;
+
+/* There is no 3D view to get the edit-mode object from. */
+static int test_screen_context(const bContext *UNUSED(C),
+                               const char *member,
+                               bContextDataResult *result)
+{
+  if (STREQ(member, "edit_object")) {
+    CTX_data_id_pointer_set(result, &test_obedit->id);
+    return 1;
+  }
+  return 0;
+}
+
+class MeshUndoTest : public testing::Test {
+ protected:
+  bContext *C;
+  Scene *scene;
+  Object *ob;
+  wmWindowManager *wm;
+  bScreen *screen;
+  UndoStack *ustack;
+  const UndoType *ut;
+
+  static void SetUpTestCase()
+  {
+    CLG_init();
+    BLI_threadapi_init();
+    DNA_sdna_current_init();
+    BKE_blender_globals_init();
+    IMB_init();
+    BKE_images_init();
+    G.background = true;
+  }
+
+  static void TearDownTestCase()
+  {
+    BKE_blender_free();
+    DNA_sdna_current_free();
+    BLI_threadapi_exit();
+    CLG_exit();
+  }
+
+  void SetUp() override
+  {
+    Main *bmain = G_MAIN;
+    scene = BKE_scene_add(bmain, "Scene");
+    ViewLayer *view_layer = BKE_view_layer_default_view(scene);
+    ob = BKE_object_add(bmain, scene, view_layer, OB_MESH, "Grid");
+    ED_object_editmode_enter_ex(bmain, scene, ob, EM_NO_CONTEXT);
+
+    BMesh *bm = BKE_editmesh_from_object(ob)->bm;
+    for (int y = 0; y < GRID_SIZE; y++) {
+      for (int x = 0; x < GRID_SIZE; x++) {
+        const float co[3] = {(float)x, (float)y, 0.0f};
+        BM_vert_create(bm, co, NULL, BM_CREATE_NOP);
+      }
+    }
+    BM_mesh_elem_table_ensure(bm, BM_VERT);
+
+    wm = (wmWindowManager *)MEM_callocN(sizeof(*wm), __func__);
+    screen = (bScreen *)MEM_callocN(sizeof(*screen), __func__);
+    screen->context = (void *)test_screen_context;
+    test_obedit = ob;
+
+    C = CTX_create();
+    CTX_data_main_set(C, bmain);
+    CTX_data_scene_set(C, scene);
+    CTX_wm_manager_set(C, wm);
+    CTX_wm_screen_set(C, screen);
+
+    /* Only edit-mesh steps, no global undo. */
+    bmain->is_memfile_undo_written = true;
+    ut = BKE_undosys_type_append(ED_mesh_undosys_type);
+    ustack = BKE_undosys_stack_create();
+  }
+
+  void TearDown() override
+  {
+    BKE_undosys_stack_destroy(ustack);
+    BKE_undosys_type_free_all();
+
+    ED_object_editmode_exit_ex(G_MAIN, scene, ob, EM_FREEDATA);
+    BLI_freelistN(&wm->queue);
+    MEM_freeN(wm);
+    MEM_freeN(screen);
+    CTX_free(C);
+    test_obedit = NULL;
+  }
+
+  BMesh *bm()
+  {
+    return BKE_editmesh_from_object(ob)->bm;
+  }
+
+  void push(const char *name)
+  {
+    EXPECT_TRUE(BKE_undosys_step_push_with_type(ustack, C, name, ut));
+  }
+
+  /* Move some vertices and record their initial location, as transform does. */
+  void transform(const float offset[3])
+  {
+    BMEditMesh *em = BKE_editmesh_from_object(ob);
+    BMEditMeshJournal *journal = EDBM_undo_journal_begin(em, MOVE_VERTS_NUM);
+    ASSERT_NE(journal, nullptr);
+
+    BM_mesh_elem_table_ensure(em->bm, BM_VERT);
+    for (int i = 0; i < MOVE_VERTS_NUM; i++) {
+      const int index = i * 7;
+      BMVert *v = BM_vert_at_index(em->bm, index);
+      BMEditMeshJournalVert *jv = &journal->verts[journal->verts_len++];
+      jv->index = index;
+      copy_v3_v3(jv->co, v->co);
+      add_v3_v3(v->co, offset);
+    }
+  }
+
+  void expect_offset(const float offset[3])
+  {
+    BMesh *bm = this->bm();
+    BM_mesh_elem_table_ensure(bm, BM_VERT);
+    ASSERT_EQ(bm->totvert, GRID_SIZE * GRID_SIZE);
+
+    for (int i = 0; i < bm->totvert; i++) {
+      const float *co = BM_vert_at_index(bm, i)->co;
+      float co_expect[3] = {(float)(i % GRID_SIZE), (float)(i / GRID_SIZE), 0.0f};
+      if ((i % 7 == 0) && (i / 7 < MOVE_VERTS_NUM)) {
+        add_v3_v3(co_expect, offset);
+      }
+      EXPECT_V3_NEAR(co, co_expect, 1e-6f);
+    }
+  }
+};
+
+TEST_F(MeshUndoTest, transform_undo_redo)
+{
+  const float zero[3] = {0.0f, 0.0f, 0.0f};
+  const float offset_a[3] = {1.0f, 0.0f, 0.5f};
+  const float offset_b[3] = {1.0f, -2.0f, 0.5f};
+
+  push("Original");
+  transform(offset_a);
+  push("Move A");
+  const float offset_delta[3] = {0.0f, -2.0f, 0.0f};
+  transform(offset_delta);
+  push("Move B");
+  expect_offset(offset_b);
+
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  expect_offset(offset_a);
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  expect_offset(zero);
+
+  EXPECT_TRUE(BKE_undosys_step_redo(ustack, C));
+  expect_offset(offset_a);
+  EXPECT_TRUE(BKE_undosys_step_redo(ustack, C));
+  expect_offset(offset_b);
+
+  /* Jump over a step, from a full copy to the last changes. */
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  expect_offset(zero);
+  EXPECT_TRUE(BKE_undosys_step_load_data(ustack, C, (UndoStep *)ustack->steps.last));
+  expect_offset(offset_b);
+}
+
+TEST_F(MeshUndoTest, transform_undo_size)
+{
+  const float offset[3] = {0.0f, 0.0f, 1.0f};
+
+  push("Original");
+  UndoStep *us_full = (UndoStep *)ustack->steps.last;
+  const size_t full_size = us_full->data_size;
+  EXPECT_GT(full_size, sizeof(float[3]) * GRID_SIZE * GRID_SIZE);
+
+  transform(offset);
+  push("Move");
+  UndoStep *us_move = (UndoStep *)ustack->steps.last;
+
+  /* The shared full copy is counted once, in the newest step using it. */
+  EXPECT_LT(us_full->data_size, full_size);
+  EXPECT_GE(us_move->data_size, full_size);
+  EXPECT_LT(us_full->data_size + us_move->data_size - full_size, full_size / 4);
+
+  /* Once the newest step is freed, the full copy is counted in the one before. */
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  transform(offset);
+  push("Move Again");
+  EXPECT_EQ(BLI_listbase_count(&ustack->steps), 2);
+  UndoStep *us_again = (UndoStep *)ustack->steps.last;
+  EXPECT_LT(us_full->data_size, full_size);
+  EXPECT_GE(us_again->data_size, full_size);
+}
+
+TEST_F(MeshUndoTest, full_copy_undo_size)
+{
+  /* Without changes journaled every step stores a full copy, the array store shares the
+   * memory of unchanged arrays between them. */
+  push("Original");
+  UndoStep *us_original = (UndoStep *)ustack->steps.last;
+  const size_t full_size = us_original->data_size;
+  push("Unchanged");
+  UndoStep *us_unchanged = (UndoStep *)ustack->steps.last;
+  EXPECT_EQ(us_unchanged->data_size, full_size);
+
+  /* Steps are counted for the memory de-duplication added once it's done,
+   * which is waited for before the next full copy. */
+  push("Unchanged Again");
+  EXPECT_LE(us_original->data_size, full_size);
+  EXPECT_GT(us_original->data_size, sizeof(float[3]) * GRID_SIZE * GRID_SIZE);
+  EXPECT_LT(us_unchanged->data_size, full_size / 8);
+
+  /* Undo waits for the newest step. */
+  UndoStep *us_again = (UndoStep *)ustack->steps.last;
+  EXPECT_TRUE(BKE_undosys_step_undo(ustack, C));
+  EXPECT_LT(us_again->data_size, full_size / 8);
+}
@@ -121,3 +121,51 @@ TEST(guardedalloc, GuardedAlignedAlloc512)
   MEM_use_guarded_allocator();
   DoBasicAlignmentChecks(512);
 }
+
+TEST(guardedalloc, CachedAlignedAlloc1)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(1);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc2)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(2);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc4)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(4);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc8)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(8);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc16)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(16);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc32)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(32);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc256)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(256);
+}
+
+TEST(guardedalloc, CachedAlignedAlloc512)
+{
+  MEM_use_cached_allocator();
+  DoBasicAlignmentChecks(512);
+}
@@ -0,0 +1,110 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <thread>
+#include <vector>
+
+#include "MEM_guardedalloc.h"
+
+namespace {
+
+class CachedAllocatorTest : public testing::Test {
+ protected:
+  static void SetUpTestCase()
+  {
+    MEM_use_cached_allocator();
+  }
+};
+
+}  // namespace
+
+TEST_F(CachedAllocatorTest, AllocSizes)
+{
+  const unsigned int totblock = MEM_get_memory_blocks_in_use();
+  const size_t mem_in_use = MEM_get_memory_in_use();
+
+  /* Cover all the size classes and the blocks bigger than the biggest one. */
+  std::vector<char *> blocks;
+  for (size_t len = 1; len < 20000; len = len * 5 / 4 + 1) {
+    char *block = (char *)MEM_mallocN(len, __func__);
+    memset(block, 7, len);
+    EXPECT_GE(MEM_allocN_len(block), len);
+    blocks.push_back(block);
+  }
+  EXPECT_EQ(MEM_get_memory_blocks_in_use(), totblock + blocks.size());
+
+  for (char *block : blocks) {
+    MEM_freeN(block);
+  }
+  EXPECT_EQ(MEM_get_memory_blocks_in_use(), totblock);
+  EXPECT_EQ(MEM_get_memory_in_use(), mem_in_use);
+}
+
+TEST_F(CachedAllocatorTest, Recalloc)
+{
+  char *block = (char *)MEM_callocN(10, __func__);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(block[i], 0);
+    block[i] = 1;
+  }
+
+  /* Grows within the same size class. */
+  block = (char *)MEM_recallocN(block, 20);
+  EXPECT_EQ(MEM_allocN_len(block), 20);
+  for (int i = 0; i < 20; i++) {
+    EXPECT_EQ(block[i], i < 10 ? 1 : 0);
+  }
+
+  /* Moves to a bigger size class. */
+  block = (char *)MEM_recallocN(block, 2000);
+  EXPECT_EQ(MEM_allocN_len(block), 2000);
+  for (int i = 0; i < 2000; i++) {
+    EXPECT_EQ(block[i], i < 10 ? 1 : 0);
+  }
+
+  block = (char *)MEM_reallocN(block, 5);
+  EXPECT_EQ(MEM_allocN_len(block), 8);
+  for (int i = 0; i < 5; i++) {
+    EXPECT_EQ(block[i], 1);
+  }
+
+  MEM_freeN(block);
+}
+
+TEST_F(CachedAllocatorTest, Threads)
+{
+  const unsigned int totblock = MEM_get_memory_blocks_in_use();
+  const size_t mem_in_use = MEM_get_memory_in_use();
+  const int threads_num = 8;
+  const int blocks_num = 10000;
+
+  /* Every thread allocates blocks, which are then freed by another thread. */
+  std::vector<std::vector<void *>> blocks(threads_num);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threads_num; i++) {
+    threads.emplace_back([&blocks, i]() {
+      for (int j = 0; j < blocks_num; j++) {
+        blocks[i].push_back(MEM_mallocN((size_t)(j % 500 + 1) * (i + 1), __func__));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(MEM_get_memory_blocks_in_use(), totblock + threads_num * blocks_num);
+
+  threads.clear();
+  for (int i = 0; i < threads_num; i++) {
+    threads.emplace_back([&blocks, i]() {
+      for (void *block : blocks[(i + 1) % threads_num]) {
+        MEM_freeN(block);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(MEM_get_memory_blocks_in_use(), totblock);
+  EXPECT_EQ(MEM_get_memory_in_use(), mem_in_use);
+}
@@ -0,0 +1,158 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_CacheLimiterC-Api.h"
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+
+#include "BLI_ghash.h"
+#include "BLI_threads.h"
+
+#include "IMB_imbuf.h"
+#include "IMB_imbuf_types.h"
+#include "IMB_moviecache.h"
+}
+
+/* 16 KB byte buffers, the limit has room for a few of them. */
+#define IMAGE_SIZE 64
+#define IMAGE_MEM_SIZE (IMAGE_SIZE * IMAGE_SIZE * 4)
+#define LIMIT_IMAGES_NUM 8
+
+static unsigned int moviecache_test_hash(const void *key)
+{
+  return (unsigned int)*(const int *)key;
+}
+
+static bool moviecache_test_cmp(const void *a, const void *b)
+{
+  /* Same convention as GHash, false means equal. */
+  return *(const int *)a != *(const int *)b;
+}
+
+/* Referencing and freeing image buffers needs the module to be initialized. */
+class MovieCacheTest : public testing::Test {
+ protected:
+  MovieCache *cache;
+  size_t limit_prev;
+
+  static void SetUpTestCase()
+  {
+    BLI_threadapi_init();
+    IMB_init();
+  }
+
+  static void TearDownTestCase()
+  {
+    IMB_exit();
+    BLI_threadapi_exit();
+  }
+
+  void SetUp() override
+  {
+    limit_prev = MEM_CacheLimiter_get_maximum();
+    MEM_CacheLimiter_set_maximum(LIMIT_IMAGES_NUM * (IMAGE_MEM_SIZE + 1024));
+    cache = IMB_moviecache_create(
+        "test cache", sizeof(int), moviecache_test_hash, moviecache_test_cmp);
+  }
+
+  void TearDown() override
+  {
+    IMB_moviecache_free(cache);
+    MEM_CacheLimiter_set_maximum(limit_prev);
+  }
+
+  void put(int frame)
+  {
+    ImBuf *ibuf = IMB_allocImBuf(IMAGE_SIZE, IMAGE_SIZE, 32, IB_rect);
+    IMB_moviecache_put(cache, &frame, ibuf);
+    IMB_freeImBuf(ibuf);
+  }
+
+  bool get(int frame)
+  {
+    ImBuf *ibuf = IMB_moviecache_get(cache, &frame);
+    if (ibuf == NULL) {
+      return false;
+    }
+    IMB_freeImBuf(ibuf);
+    return true;
+  }
+
+  MovieCacheStats stats()
+  {
+    MovieCacheStats stats;
+    IMB_moviecache_get_stats(cache, &stats);
+    return stats;
+  }
+};
+
+TEST_F(MovieCacheTest, put_get)
+{
+  for (int frame = 0; frame < 4; frame++) {
+    put(frame);
+  }
+  EXPECT_TRUE(get(0));
+  EXPECT_TRUE(get(3));
+  EXPECT_FALSE(get(4));
+  int frame = 1;
+  EXPECT_TRUE(IMB_moviecache_has_frame(cache, &frame));
+
+  /* Putting a frame again replaces it. */
+  put(3);
+  const MovieCacheStats s = stats();
+  EXPECT_EQ(s.items_len, 4);
+  EXPECT_EQ(s.hits, 2);
+  EXPECT_EQ(s.misses, 1);
+  EXPECT_EQ(s.evictions, 0);
+  EXPECT_GE(s.mem_in_use, (size_t)4 * IMAGE_MEM_SIZE);
+
+  frame = 2;
+  IMB_moviecache_remove(cache, &frame);
+  EXPECT_FALSE(get(2));
+  EXPECT_EQ(stats().items_len, 3);
+}
+
+TEST_F(MovieCacheTest, evict_under_limit)
+{
+  const int frames_num = 4 * LIMIT_IMAGES_NUM;
+  for (int frame = 0; frame < frames_num; frame++) {
+    put(frame);
+    get(0);
+  }
+
+  const MovieCacheStats s = stats();
+  EXPECT_LE(s.mem_in_use, MEM_CacheLimiter_get_maximum());
+  EXPECT_GT(s.items_len, 0);
+  EXPECT_LE(s.items_len, LIMIT_IMAGES_NUM);
+  EXPECT_EQ(s.evictions, (uint64_t)(frames_num - s.items_len));
+  EXPECT_TRUE(get(frames_num - 1));
+}
+
+TEST_F(MovieCacheTest, evict_grown_item)
+{
+  put(0);
+  put(1);
+  const size_t mem_in_use = stats().mem_in_use;
+
+  /* Float buffers added to cached images are noticed when they are read. */
+  for (int frame = 0; frame < 2; frame++) {
+    ImBuf *ibuf = IMB_moviecache_get(cache, &frame);
+    ASSERT_NE(ibuf, nullptr);
+    imb_addrectfloatImBuf(ibuf);
+    IMB_freeImBuf(ibuf);
+  }
+  EXPECT_EQ(stats().mem_in_use, mem_in_use);
+
+  EXPECT_TRUE(get(0));
+  EXPECT_EQ(stats().mem_in_use, mem_in_use + IMAGE_MEM_SIZE * 4);
+  EXPECT_EQ(stats().evictions, 0);
+
+  /* Both together are above the limit, one of them is evicted. */
+  EXPECT_TRUE(get(1));
+  EXPECT_LE(stats().mem_in_use, MEM_CacheLimiter_get_maximum());
+  EXPECT_EQ(stats().evictions, 1);
+  EXPECT_EQ(stats().items_len, 1);
+}
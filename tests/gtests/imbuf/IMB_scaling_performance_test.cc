@@ -0,0 +1,161 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+#include "PIL_time.h"
+
+#include "IMB_imbuf.h"
+#include "IMB_imbuf_types.h"
+}
+
+/* Times every method is run, the average time is printed. */
+#define RUNS_NUM 3
+
+/* Noise on top of a gradient, so there is detail at every scale. */
+static ImBuf *imbuf_test_image(int x, int y, bool use_float)
+{
+  ImBuf *ibuf = IMB_allocImBuf(x, y, 32, use_float ? IB_rectfloat : IB_rect);
+  RNG *rng = BLI_rng_new(0);
+
+  for (int j = 0; j < y; j++) {
+    for (int i = 0; i < x; i++) {
+      const size_t offset = 4 * ((size_t)j * x + i);
+      const float gradient = (float)(i + j) / (float)(x + y);
+      for (int c = 0; c < 4; c++) {
+        const float value = 0.75f * gradient + 0.25f * BLI_rng_get_float(rng);
+        if (use_float) {
+          ibuf->rect_float[offset + c] = value;
+        }
+        else {
+          ((unsigned char *)ibuf->rect)[offset + c] = (unsigned char)(value * 255.0f);
+        }
+      }
+    }
+  }
+
+  BLI_rng_free(rng);
+  return ibuf;
+}
+
+template<typename ScaleFn>
+static void scale_timeit(const char *name, const ImBuf *ibuf_src, const ScaleFn &scale)
+{
+  double time_total = 0.0;
+
+  for (int run = 0; run < RUNS_NUM; run++) {
+    ImBuf *ibuf = IMB_dupImBuf(ibuf_src);
+    const double time_start = PIL_check_seconds_timer();
+    scale(ibuf);
+    time_total += PIL_check_seconds_timer() - time_start;
+    IMB_freeImBuf(ibuf);
+  }
+
+  printf("  %-24s %8.2f ms\n", name, 1000.0 * time_total / RUNS_NUM);
+}
+
+static void scale_benchmark(int x, int y, int newx, int newy, bool use_float)
+{
+  ImBuf *ibuf_src = imbuf_test_image(x, y, use_float);
+
+  printf("%dx%d -> %dx%d (%s):\n", x, y, newx, newy, use_float ? "float" : "byte");
+
+  scale_timeit("IMB_scaleImBuf", ibuf_src, [&](ImBuf *ibuf) {
+    IMB_scaleImBuf(ibuf, newx, newy);
+  });
+  scale_timeit("IMB_scalefastImBuf", ibuf_src, [&](ImBuf *ibuf) {
+    IMB_scalefastImBuf(ibuf, newx, newy);
+  });
+  scale_timeit("filter box", ibuf_src, [&](ImBuf *ibuf) {
+    IMB_scaleImBuf_filter(ibuf, newx, newy, IMB_SCALE_FILTER_BOX);
+  });
+  scale_timeit("filter bilinear", ibuf_src, [&](ImBuf *ibuf) {
+    IMB_scaleImBuf_filter(ibuf, newx, newy, IMB_SCALE_FILTER_BILINEAR);
+  });
+  scale_timeit("filter lanczos", ibuf_src, [&](ImBuf *ibuf) {
+    IMB_scaleImBuf_filter(ibuf, newx, newy, IMB_SCALE_FILTER_LANCZOS);
+  });
+
+  IMB_freeImBuf(ibuf_src);
+}
+
+/* Scaling uses the task scheduler, freeing image buffers needs the module to be initialized. */
+class ImbufScalingTest : public testing::Test {
+ protected:
+  static void SetUpTestCase()
+  {
+    BLI_threadapi_init();
+    IMB_init();
+  }
+
+  static void TearDownTestCase()
+  {
+    IMB_exit();
+    BLI_threadapi_exit();
+  }
+};
+
+TEST_F(ImbufScalingTest, FilterConstantColor)
+{
+  const eIMBScaleFilter filters[] = {
+      IMB_SCALE_FILTER_BOX, IMB_SCALE_FILTER_BILINEAR, IMB_SCALE_FILTER_LANCZOS};
+
+  for (eIMBScaleFilter filter : filters) {
+    ImBuf *ibuf = IMB_allocImBuf(301, 157, 32, IB_rect | IB_rectfloat);
+    for (size_t i = 0; i < 4 * (size_t)ibuf->x * ibuf->y; i++) {
+      ((unsigned char *)ibuf->rect)[i] = 200;
+      ibuf->rect_float[i] = 0.5f;
+    }
+
+    EXPECT_TRUE(IMB_scaleImBuf_filter(ibuf, 97, 211, filter));
+    EXPECT_EQ(ibuf->x, 97);
+    EXPECT_EQ(ibuf->y, 211);
+    for (size_t i = 0; i < 4 * (size_t)ibuf->x * ibuf->y; i++) {
+      EXPECT_EQ(((unsigned char *)ibuf->rect)[i], 200);
+      EXPECT_NEAR(ibuf->rect_float[i], 0.5f, 1e-5f);
+    }
+
+    IMB_freeImBuf(ibuf);
+  }
+}
+
+TEST_F(ImbufScalingTest, Shrink4KByte)
+{
+  scale_benchmark(3840, 2160, 1920, 1080, false);
+}
+
+TEST_F(ImbufScalingTest, Shrink4KFloat)
+{
+  scale_benchmark(3840, 2160, 1920, 1080, true);
+}
+
+TEST_F(ImbufScalingTest, Shrink8KByte)
+{
+  scale_benchmark(7680, 4320, 3840, 2160, false);
+}
+
+TEST_F(ImbufScalingTest, Shrink8KFloat)
+{
+  scale_benchmark(7680, 4320, 3840, 2160, true);
+}
+
+TEST_F(ImbufScalingTest, Shrink8KToPreviewByte)
+{
+  /* Odd ratio, as for sequencer preview at 25% of a 8K frame in a smaller region. */
+  scale_benchmark(7680, 4320, 1366, 768, false);
+}
+
+TEST_F(ImbufScalingTest, Enlarge4KByte)
+{
+  scale_benchmark(1920, 1080, 3840, 2160, false);
+}
+
+TEST_F(ImbufScalingTest, Enlarge4KFloat)
+{
+  scale_benchmark(1920, 1080, 3840, 2160, true);
+}
@@ -0,0 +1,195 @@
+# ##### BEGIN GPL LICENSE BLOCK #####
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software Foundation,
+#  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+#
+# ##### END GPL LICENSE BLOCK #####
+
+# <pep8 compliant>
+
+"""
+Time the cloth solver on a generated scene, so runs on different builds are comparable.
+
+A subdivided plane, pinned along one edge, falls on a sphere collider.
+
+The solver uses as many threads as Blender's task scheduler, which is set once on startup with
+the ``--threads`` command line argument. So each thread count runs in its own Blender process,
+started by this script when it runs outside of Blender.
+
+Example Usage, timing 1, 2 and 4 threads, and comparing with another build:
+
+python3 tests/python/bl_cloth_solver_benchmark.py \
+    --blender=./blender.bin --blender-reference=../build_before/bin/blender \
+    --resolution=128 --frames=50 --threads=1,2,4
+
+Running a single thread count inside Blender:
+
+./blender.bin --background --factory-startup --threads=4 \
+    --python tests/python/bl_cloth_solver_benchmark.py -- \
+    --resolution=128 --frames=50
+"""
+
+import sys
+import time
+
+
+def create_scene(resolution):
+    import bpy
+    import bmesh
+
+    scene = bpy.context.scene
+    collection = scene.collection
+
+    # Cloth grid, with the last row pinned.
+    mesh = bpy.data.meshes.new("Cloth")
+    bm = bmesh.new()
+    bmesh.ops.create_grid(bm, x_segments=resolution, y_segments=resolution, size=1.0)
+    bm.to_mesh(mesh)
+    bm.free()
+
+    cloth = bpy.data.objects.new("Cloth", mesh)
+    cloth.location = (0.0, 0.0, 1.5)
+    collection.objects.link(cloth)
+
+    group = cloth.vertex_groups.new(name="Pin")
+    pinned = [v.index for v in mesh.vertices if v.co.y > 1.0 - 1e-4]
+    group.add(pinned, 1.0, 'REPLACE')
+
+    modifier = cloth.modifiers.new("Cloth", 'CLOTH')
+    modifier.settings.vertex_group_mass = "Pin"
+    modifier.settings.quality = 5
+    modifier.collision_settings.use_self_collision = False
+
+    # Collider.
+    mesh = bpy.data.meshes.new("Sphere")
+    bm = bmesh.new()
+    bmesh.ops.create_uvsphere(bm, u_segments=32, v_segments=16, diameter=0.75)
+    bm.to_mesh(mesh)
+    bm.free()
+
+    sphere = bpy.data.objects.new("Sphere", mesh)
+    collection.objects.link(sphere)
+    sphere.modifiers.new("Collision", 'COLLISION')
+
+    return cloth
+
+
+def run_benchmark(resolution, frames):
+    import bpy
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+
+    scene = bpy.context.scene
+    cloth = create_scene(resolution)
+    modifier = cloth.modifiers["Cloth"]
+    modifier.point_cache.frame_start = 1
+    modifier.point_cache.frame_end = frames + 1
+
+    scene.frame_start = 1
+    scene.frame_end = frames + 1
+    scene.frame_set(1)
+
+    print("Cloth: %d vertices, %d frames" % (len(cloth.data.vertices), frames))
+
+    frame_times = []
+    for frame in range(2, frames + 2):
+        time_start = time.perf_counter()
+        scene.frame_set(frame)
+        frame_times.append(time.perf_counter() - time_start)
+
+    # Bounding box of the result, to compare solvers with.
+    depsgraph = bpy.context.evaluated_depsgraph_get()
+    cloth_eval = cloth.evaluated_get(depsgraph)
+    z = [v.co.z for v in cloth_eval.to_mesh().vertices]
+    cloth_eval.to_mesh_clear()
+    print("Final height range: %.6f .. %.6f" % (min(z), max(z)))
+
+    total = sum(frame_times)
+    print("Total: %.3f s, average: %.2f ms/frame, slowest: %.2f ms" %
+          (total, 1000.0 * total / frames, 1000.0 * max(frame_times)))
+
+
+def run_blender(blender, threads, resolution, frames):
+    """
+    Run the benchmark in a new Blender process, returns the average frame time in milliseconds.
+    """
+    import re
+    import subprocess
+
+    command = [
+        blender,
+        "--background",
+        "--factory-startup",
+        "--threads", str(threads),
+        "--python", __file__,
+        "--",
+        "--resolution=%d" % resolution,
+        "--frames=%d" % frames,
+    ]
+    output = subprocess.run(command, stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+
+    match = re.search(r"average: ([0-9.]+) ms/frame", output)
+    if match is None:
+        print(output)
+        raise Exception("No timing in the output of " + blender)
+    return float(match.group(1))
+
+
+def run_blender_all(args):
+    blenders = [args.blender]
+    columns = ["ms/frame"]
+    if args.blender_reference:
+        blenders.insert(0, args.blender_reference)
+        columns = ["before", "after"]
+
+    print("Cloth: %dx%d grid, %d frames" % (args.resolution, args.resolution, args.frames))
+    print("%-8s" % "threads" + "".join("%12s" % column for column in columns))
+
+    for threads in (int(t) for t in args.threads.split(",")):
+        times = [run_blender(blender, threads, args.resolution, args.frames) for blender in blenders]
+        print("%-8s" % (threads if threads > 0 else "auto") + "".join("%12.2f" % t for t in times))
+
+
+def main():
+    import argparse
+
+    in_blender = "bpy" in sys.modules
+    argv = sys.argv
+    if in_blender:
+        argv = argv[argv.index("--") + 1:] if "--" in argv else []
+    else:
+        argv = argv[1:]
+
+    parser = argparse.ArgumentParser(
+        description="Run this script with Python to time several thread counts:"
+        "  python3 " + __file__ + " --blender=blender [options]")
+    parser.add_argument("--resolution", type=int, default=128, help="Subdivisions of the cloth grid")
+    parser.add_argument("--frames", type=int, default=50, help="Number of frames to simulate")
+    parser.add_argument("--threads", default="0",
+                        help="Comma separated thread counts to run Blender with, 0 for automatic")
+    parser.add_argument("--blender", help="Blender executable to time")
+    parser.add_argument("--blender-reference", help="Blender executable to compare with (before)")
+    args = parser.parse_args(argv)
+
+    if in_blender:
+        # Thread count is set with Blender's own "--threads" argument.
+        run_benchmark(args.resolution, args.frames)
+    else:
+        if not args.blender:
+            parser.error("--blender is required when running outside of Blender")
+        run_blender_all(args)
+
+
+if __name__ == "__main__":
+    main()